@@ -1,6 +1,7 @@
 #ifndef UWAVE_SERVER_DATA_CLIENT_GRPC_OPTIONS_HPP
 #define UWAVE_SERVER_DATA_CLIENT_GRPC_OPTIONS_HPP
 #include <string>
+#include <chrono>
 #include <memory>
 #include <filesystem>
 #include <optional>
@@ -53,6 +54,23 @@ public:
     /// @note The client certificate must also be set for gRPC to use this.
     [[nodiscard]] std::optional<std::string> getClientKey() const noexcept;
 
+    /// @brief Sets the maximum number of packets the subscriber accumulates
+    ///        before handing them to the callback.
+    /// @throws std::invalid_argument if this is not positive.
+    void setMaximumBatchSize(int batchSize);
+    /// @result The maximum number of packets in a batch.
+    /// @note By default this is 64.
+    [[nodiscard]] int getMaximumBatchSize() const noexcept;
+
+    /// @brief Sets the longest time a packet waits in a partial batch
+    ///        before the batch is handed to the callback.  This bounds the
+    ///        latency added by batching when the feed is slow.
+    /// @throws std::invalid_argument if this is not positive.
+    void setBatchFlushInterval(const std::chrono::milliseconds &interval);
+    /// @result The batch flush interval.
+    /// @note By default this is 10 milliseconds.
+    [[nodiscard]] std::chrono::milliseconds getBatchFlushInterval() const noexcept;
+
     /// @brief Destructor
     ~GRPCOptions();
     /// @brief Copy constructor.
@@ -4,8 +4,10 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <cstdint>
 #include <map>
 #include <set>
+#include <functional>
 #include <spdlog/spdlog.h>
 namespace UWaveServer
 {
@@ -25,6 +27,22 @@ public:
     /// @brief Constructs the client from the given postgres connection.
     explicit ReadOnlyClient(const Credentials &credentials,
                             std::shared_ptr<spdlog::logger> logger = nullptr);
+    /// @brief Constructs the client with a pool of connections so that
+    ///        concurrent queries, e.g., from different HTTP worker threads,
+    ///        run concurrently rather than serializing on one connection.
+    /// @param[in] credentials         The database credentials.
+    /// @param[in] connectionPoolSize  The number of connections to open.
+    ///                                This should match the number of
+    ///                                threads that will query the client.
+    /// @param[in] checkoutTimeOut     A query waits at most this long for a
+    ///                                connection before throwing.
+    /// @param[in] logger              The logger.
+    /// @throws std::invalid_argument if connectionPoolSize is not positive
+    ///         or checkoutTimeOut is negative.
+    ReadOnlyClient(const Credentials &credentials,
+                   int connectionPoolSize,
+                   const std::chrono::milliseconds &checkoutTimeOut,
+                   std::shared_ptr<spdlog::logger> logger = nullptr);
 
     /// @result True indicates the network, station, channel, and locationCode
     ///         packets are in the database.
@@ -47,6 +65,30 @@ public:
               const std::string &locationCode,
               const double startTime,
               const double endTime) const;
+    /// @brief Streams the packets for the given channel in increasing start
+    ///        time order.  Unlike query() the result is not materialized;
+    ///        rows are read from a server-side cursor in batches and each
+    ///        packet is decoded and handed to the callback as it arrives.
+    /// @param[in] callback  Receives each packet.  This runs on the calling
+    ///                      thread while a pooled connection is held so it
+    ///                      should not block for long.  Exceptions it throws
+    ///                      abort the query and are rethrown.
+    /// @result The number of packets given to the callback.
+    /// @throws std::invalid_argument if the stream does not exist.
+    int64_t streamQuery(const std::string &network,
+                        const std::string &station,
+                        const std::string &channel,
+                        const std::string &locationCode,
+                        const std::chrono::microseconds &startTime,
+                        const std::chrono::microseconds &endTime,
+                        const std::function<void (UWaveServer::Packet &&)> &callback) const;
+    int64_t streamQuery(const std::string &network,
+                        const std::string &station,
+                        const std::string &channel,
+                        const std::string &locationCode,
+                        const double startTime,
+                        const double endTime,
+                        const std::function<void (UWaveServer::Packet &&)> &callback) const;
     [[nodiscard]] std::map<std::string, std::vector<UWaveServer::Packet>>
         queryAllChannelsForStation(const std::string &network,
                                    const std::string &station,
@@ -60,6 +102,55 @@ public:
 
     /// @result Get most up-to-date list of streams in the database.
     [[nodiscard]] std::set<std::string> getStreams() const;
+
+    /// @result The number of queries that reused a statement already
+    ///         prepared on this connection.
+    [[nodiscard]] int64_t getPreparedStatementCacheHits() const noexcept;
+    /// @result The number of times a statement had to be prepared.  This
+    ///         grows with the number of data tables and with reconnects.
+    [[nodiscard]] int64_t getPreparedStatementCacheMisses() const noexcept;
+
+    /// @brief Enables a cache of decoded packets for query().  Overlapping
+    ///        windows, e.g., dashboards re-requesting the latest minutes,
+    ///        then reuse the decoded rows and only the parts of the window
+    ///        the cache does not cover are fetched from the database.
+    ///        Packets from the last two minutes are always re-fetched since
+    ///        rows may still be arriving.
+    /// @param[in] maximumBytes  The cache's memory budget in bytes.  The
+    ///                          least recently used packets are evicted
+    ///                          to stay within it.  0 disables the cache.
+    /// @throws std::invalid_argument if maximumBytes is negative.
+    /// @note Rows that arrive more than two minutes late, e.g., a spool
+    ///       replayed after a database outage or backfilled data, are not
+    ///       seen by cached queries until the window's coverage expires.
+    ///       See setPacketCacheCoverageLifetime().
+    /// @note This is not thread safe; call it before querying.
+    void setPacketCacheSize(int64_t maximumBytes);
+    /// @brief Sets how long the packet cache trusts that it holds every row
+    ///        of a window.  Once this elapses the window is re-fetched.  A
+    ///        shorter lifetime shows late rows sooner at the cost of more
+    ///        database queries.  The default is 10 minutes.
+    /// @param[in] lifetime  The coverage lifetime.
+    /// @throws std::invalid_argument if lifetime is not positive.
+    /// @note This is not thread safe; call it before querying.
+    void setPacketCacheCoverageLifetime(const std::chrono::seconds &lifetime);
+    /// @result The bytes held by the packet cache.
+    [[nodiscard]] int64_t getPacketCacheUsage() const noexcept;
+    /// @result The number of packets served from the packet cache.
+    [[nodiscard]] int64_t getPacketCacheHits() const noexcept;
+    /// @result The number of packets fetched into the packet cache.
+    [[nodiscard]] int64_t getPacketCacheMisses() const noexcept;
+
+    /// @result The number of connections in the pool.
+    [[nodiscard]] int getConnectionPoolSize() const noexcept;
+    /// @result The number of times a connection was checked out of the pool.
+    [[nodiscard]] int64_t getConnectionCheckouts() const noexcept;
+    /// @result The cumulative time spent waiting for a free connection.
+    ///         Dividing by getConnectionCheckouts() gives the mean wait.
+    [[nodiscard]] std::chrono::microseconds
+        getConnectionWaitTime() const noexcept;
+    /// @result The number of queries that gave up waiting for a connection.
+    [[nodiscard]] int64_t getConnectionCheckoutTimeOuts() const noexcept;
     
     /// @brief (Re)Establishes a connection.
     void connect();
@@ -4,11 +4,13 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <cstdint>
 #include <set>
 #include <spdlog/spdlog.h>
 namespace UWaveServer
 {
  class Packet;
+ struct PacketHeader;
 }
 namespace UWaveServer::Database
 {
@@ -21,6 +23,19 @@ namespace UWaveServer::Database
 /// @copyright Ben Baker (University of Utah) distributed under the MIT license.
 class WriteClient
 {
+public:
+    /// @brief Defines how Integer32 and Integer64 samples are stored.
+    enum class IntegerCodec
+    {
+        Zlib,        /*!< The samples are zlib compressed (when available).
+                          This is the default. */
+        DeltaBitPack /*!< The samples are first differenced, zigzag encoded,
+                          and bit-packed.  This is much faster to encode and
+                          decode than zlib and typically smaller for
+                          seismic data.  The data tables must have a codec
+                          column; see update_data_tables_add_codec in
+                          createProcedures.sql. */
+    };
 public:
     /// @brief Constructs the client from the given postgres connection.
     explicit WriteClient(const Credentials &credentials,
@@ -34,6 +49,43 @@ public:
     /// @throws std::runtime_error if there is another error while writing
     ///         the data.
     void write(const UWaveServer::Packet &packet);
+    /// @brief Writes a batch of packets to the database.  The packets are
+    ///        grouped by their data table and each group is copied into
+    ///        a staging table then merged into the data table in a single
+    ///        transaction.  Duplicate packets are silently ignored.
+    /// @param[in,out] packets  The data packets to write.  On exit, packets
+    ///                         will have been moved.
+    /// @result The number of packets that were not written because they
+    ///         were malformed or could not be packed.  These are logged and
+    ///         the rest of the batch is written.  Empty and expired packets
+    ///         are skipped but not counted.
+    /// @throws Database::ReconnectError if the connection could not be
+    ///         reestablished.  In this case the writable packets are left
+    ///         in packets.
+    /// @throws std::runtime_error if there is another error while writing
+    ///         the data.  In this case nothing was written and the writable
+    ///         packets are left in packets so they may be written
+    ///         individually.
+    [[nodiscard]] int write(std::vector<UWaveServer::Packet> &&packets);
+    /// @brief Writes the packets as prepared INSERTs pipelined on a
+    ///        dedicated connection.  This avoids waiting on the server's
+    ///        reply to each packet before sending the next.  Each INSERT
+    ///        commits on its own so a rejected packet does not affect the
+    ///        others.  Duplicate packets are silently ignored.
+    /// @param[in] packets         The data packets to write.
+    /// @param[in] maximumInFlight The maximum number of INSERTs whose replies
+    ///                            are outstanding.  Once this many are
+    ///                            pending the oldest reply is read before
+    ///                            the next INSERT is sent.
+    /// @result The i'th element is true if packets[i] could not be written,
+    ///         e.g., because it was malformed or the database rejected it.
+    ///         Empty and expired packets are skipped but not failed.
+    /// @throws std::invalid_argument if maximumInFlight is not positive.
+    /// @throws std::runtime_error if the connection was lost.  In this case
+    ///         some packets may have been written.
+    [[nodiscard]] std::vector<bool>
+        writePipelined(const std::vector<UWaveServer::Packet> &packets,
+                       int maximumInFlight = 64);
 
     /// @result True indicates the network, station, channel, and locationCode
     ///         packets are in the database.
@@ -43,6 +95,29 @@ public:
                                 const std::string &locationCode) const;
     /// @result Get most up-to-date list of streams in the database.
     //[[nodiscard]] std::set<std::string> getStreams() const;
+    /// @brief Fetches the headers of the packets in the database that start
+    ///        at or after the given time.  All the data tables are read
+    ///        in a single query.
+    /// @param[in] startTime  The UTC start time in microseconds since the
+    ///                       epoch.
+    /// @result The packet headers in order of increasing start time.
+    /// @throws std::runtime_error if the query fails.
+    [[nodiscard]] std::vector<UWaveServer::PacketHeader>
+        queryPacketHeaders(const std::chrono::microseconds &startTime) const;
+
+    /// @brief Sets the codec used to store integer samples.  Float, double,
+    ///        and text samples are unaffected.
+    /// @param[in] codec  The integer codec.
+    void setIntegerCodec(IntegerCodec codec) noexcept;
+    /// @result The codec used to store integer samples.
+    [[nodiscard]] IntegerCodec getIntegerCodec() const noexcept;
+
+    /// @result The number of inserts that reused a statement already
+    ///         prepared on this connection.
+    [[nodiscard]] int64_t getPreparedStatementCacheHits() const noexcept;
+    /// @result The number of times a statement had to be prepared.  This
+    ///         grows with the number of data tables and with reconnects.
+    [[nodiscard]] int64_t getPreparedStatementCacheMisses() const noexcept;
     
     /// @brief (Re)Establishes a connection.
     void connect();
@@ -1,6 +1,12 @@
 #ifndef UWAVE_SERVER_PACKET_HPP
 #define UWAVE_SERVER_PACKET_HPP
 #include <optional>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <chrono>
 #include <vector>
 #include <memory>
@@ -37,52 +43,76 @@ public:
 
     /// @brief Sets the network code.
     /// @param[in] network  The network code - e.g., UU.
+    /// @throws std::invalid_argument if the network code is empty or longer
+    ///         than 8 characters.
     void setNetwork(const std::string &network);
     /// @result The network code.
     [[nodiscard]] std::string getNetwork() const;
     /// @result The network code.
     /// @note This exists for optimization reasons - you should prefer
-    ///       \c getNetwork().
-    [[nodiscard]] const std::string &getNetworkReference() const;
+    ///       \c getNetwork().  The view is stored in the packet so it is
+    ///       invalidated when the packet is modified or destroyed.
+    [[nodiscard]] std::string_view getNetworkReference() const;
     /// @result True indicates the network code was set.
     [[nodiscard]] bool hasNetwork() const noexcept;
 
     /// @brief Sets the station name.
     /// @param[in] station  The station name - e.g., TCU.
+    /// @throws std::invalid_argument if the station name is empty or longer
+    ///         than 8 characters.
     void setStation(const std::string &station);
     /// @result The station name.
     [[nodiscard]] std::string getStation() const;
     /// @result The stationa name.
     /// @note This exists for optimization reasons - you should prefer
     ///       \c getStation().
-    [[nodiscard]] const std::string &getStationReference() const;
+    [[nodiscard]] std::string_view getStationReference() const;
     /// @result True indicates the station was set. 
     [[nodiscard]] bool hasStation() const noexcept;
 
     /// @brief Sets the channel code.
     /// @param[in] channel  The channel code - e.g., HHZ.
+    /// @throws std::invalid_argument if the channel code is empty or longer
+    ///         than 16 characters.
     void setChannel(const std::string &channel);
     /// @result The channel code.
     [[nodiscard]] std::string getChannel() const;
     /// @result The channel code.
     /// @note This exists for optimization reasons - you should prefer
     ///       \c getChannel().
-    [[nodiscard]] const std::string &getChannelReference() const;
+    [[nodiscard]] std::string_view getChannelReference() const;
     /// @result True indicates the channel code was set.
     [[nodiscard]] bool hasChannel() const noexcept;
 
     /// @brief Sets the location code.
     /// @param[in] location  The location code - e.g., 01.
+    /// @throws std::invalid_argument if the location code is longer than
+    ///         8 characters.
     void setLocationCode(const std::string &locationCode);
     /// @result The location code.
     [[nodiscard]] std::string getLocationCode() const;
     /// @result The location code.
     /// @note This exists for optimization reasons - you should prefer
     ///       \c getLocationCode().
-    [[nodiscard]] const std::string &getLocationCodeReference() const;
+    [[nodiscard]] std::string_view getLocationCodeReference() const;
     /// @result True indicates the location code was set.
     [[nodiscard]] bool hasLocationCode() const noexcept;
 
+    /// @brief Interns the network, station, channel, and location code in
+    ///        the \c StreamRegistry and remembers the resulting handle.
+    ///        This is intended to be called once when the packet enters the
+    ///        pipeline.  Subsequently changing the network, station, channel,
+    ///        or location code discards the handle.
+    /// @result The stream handle.
+    /// @throws std::runtime_error if the network, station, or channel
+    ///         was not set.
+    uint32_t assignStreamHandle();
+    /// @result The stream handle assigned by assignStreamHandle().
+    /// @throws std::runtime_error if a stream handle was not assigned.
+    [[nodiscard]] uint32_t getStreamHandle() const;
+    /// @result True indicates the stream handle was assigned.
+    [[nodiscard]] bool hasStreamHandle() const noexcept;
+
     /// @brief Sets the start time of the packet.
     /// @param[in] startTime  The start time (UTC) of the packet in seconds
     ///                       since the epoch.
@@ -113,17 +143,52 @@ public:
     [[nodiscard]] bool empty() const noexcept;
 
 
-    /// @brief Sets the data from a packet.
-    template<typename U> void setData(std::vector<U> &&data);
     /// @brief Sets the data from a packet.
     template<typename U> void setData(const int nSamples, const U *data);
     /// @brief Sets the data from a packet.
+    /// @note The samples are copied into the packet's storage.
     template<typename U> void setData(const std::vector<U> &data);
+    /// @brief Sizes the packet's storage for nSamples samples of type U so
+    ///        that they can be decoded in place rather than set from a copy.
+    /// @param[in] nSamples  The number of samples.
+    /// @result A writable view of the samples.  The values are unspecified
+    ///         until written.  The view is invalidated when the data is set,
+    ///         trimmed, or cleared or the packet is destroyed.
+    /// @throws std::invalid_argument if nSamples is not positive.
+    /// @note Any previous samples and data hash are discarded.
+    template<typename U>
+    [[nodiscard]] std::span<U> resizeData(int nSamples);
     /// @result A raw pointer to the underlying data.
     [[nodiscard]] const void *data() const noexcept;
     /// @result The data.
     template<typename U>
     [[nodiscard]] std::vector<U> getData() const;
+    /// @result A view of the samples without copying them.  This is empty
+    ///         if there are no samples.  The view is invalidated when the
+    ///         data is set, trimmed, or cleared or the packet is destroyed.
+    /// @throws std::invalid_argument if U does not match the data type,
+    ///         e.g., U is float but the samples are doubles.
+    template<typename U>
+    [[nodiscard]] std::span<const U> getDataView() const;
+    /// @brief Dispatches once on the data type then calls the visitor with
+    ///        a view of the samples, i.e., std::span<const int>,
+    ///        std::span<const int64_t>, std::span<const float>,
+    ///        std::span<const double>, or std::span<const char>.
+    /// @param[in] visitor  A callable accepting each of the views.  Every
+    ///                     call must return the same type.
+    /// @result The visitor's result.
+    /// @throws std::runtime_error if the data type is unknown, i.e., the
+    ///         packet has no samples.
+    template<typename F>
+    decltype(auto) visitData(F &&visitor) const;
+    /// @brief Sets a hash of the data samples that was computed upstream.
+    ///        This must be the 64-bit xxHash (seed 0) of the samples'
+    ///        little-endian bytes.  It lets the duplicate packet detector
+    ///        skip hashing the samples.
+    /// @note Setting or trimming the data discards the hash.
+    void setDataHash(uint64_t hash) noexcept;
+    /// @result The hash of the data samples if it was set.
+    [[nodiscard]] std::optional<uint64_t> getDataHash() const noexcept;
 
     /// @brief Trims the time series so that the samples are between
     ///        start time and end time.
@@ -134,8 +199,24 @@ public:
     /// @result The underlying data type.
     [[nodiscard]] DataType getDataType() const noexcept;
 
-    /// @brief Reset the class.
+    /// @brief Reset the class.  The storage, e.g., the sample buffer's
+    ///        capacity, is kept for reuse.
     void clear() noexcept;
+
+    /// @brief Counters for the pool from which packets draw their storage.
+    ///        A destroyed packet's storage, including its sample buffer, is
+    ///        returned to the pool and reused by the next packet that is
+    ///        constructed so packets flowing through the pipeline at a
+    ///        steady rate do not allocate.
+    struct PoolStatistics
+    {
+        int64_t hits{0};   /*!< Packets constructed from recycled storage. */
+        int64_t misses{0}; /*!< Packets that allocated their storage. */
+        int64_t size{0};   /*!< The storage waiting in the pool's shared
+                                list, i.e., not cached by a thread. */
+    };
+    /// @result The pool's counters.
+    [[nodiscard]] static PoolStatistics getPoolStatistics() noexcept;
     /// @brief Destructor
     ~Packet(); 
 
@@ -148,6 +229,27 @@ private:
     class PacketImpl;
     std::unique_ptr<PacketImpl> pImpl;
 };
+
+template<typename F>
+decltype(auto) Packet::visitData(F &&visitor) const
+{
+    switch (getDataType())
+    {
+        case DataType::Integer32:
+            return std::forward<F> (visitor)(getDataView<int> ());
+        case DataType::Integer64:
+            return std::forward<F> (visitor)(getDataView<int64_t> ());
+        case DataType::Float:
+            return std::forward<F> (visitor)(getDataView<float> ());
+        case DataType::Double:
+            return std::forward<F> (visitor)(getDataView<double> ());
+        case DataType::Text:
+            return std::forward<F> (visitor)(getDataView<char> ());
+        default:
+            throw std::runtime_error("Packet's data type is unknown");
+    }
+}
+
 /// @brief Swaps two time classes, lhs and rhs.
 /// @param[in,out] lhs  On exit this will contain the information in rhs.
 /// @param[in,out] rhs  On exit this will contain the information in lhs.
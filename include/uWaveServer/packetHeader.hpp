@@ -0,0 +1,46 @@
+#ifndef UWAVE_SERVER_PACKET_HEADER_HPP
+#define UWAVE_SERVER_PACKET_HEADER_HPP
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+namespace UWaveServer
+{
+/// @name PacketHeader "packetHeader.hpp" "uWaveServer/packetHeader.hpp"
+/// @brief Describes a previously processed packet without its samples.
+///        This is used to seed the packet testers, e.g., with the packets
+///        written to the database just before a restart.
+/// @copyright Ben Baker (University of Utah) distributed under the MIT license.
+struct PacketHeader
+{
+    std::string network;      /*!< The network code - e.g., UU. */
+    std::string station;      /*!< The station name - e.g., TCU. */
+    std::string channel;      /*!< The channel code - e.g., HHZ. */
+    std::string locationCode; /*!< The location code - e.g., 01. */
+    /// The UTC time of the first sample in microseconds since the epoch.
+    std::chrono::microseconds startTime{0};
+    /// The UTC time of the last sample in microseconds since the epoch.
+    std::chrono::microseconds endTime{0};
+    double samplingRate{0};   /*!< The sampling rate in Hz. */
+    int numberOfSamples{0};   /*!< The number of samples. */
+};
+/// @brief Writes the packet headers to a compact binary snapshot file.  The
+///        snapshot is first written to a memory mapped temporary file in
+///        the same directory which then atomically replaces the file, so
+///        a reader never sees a partially written snapshot.
+/// @param[in] headers   The packet headers to write.
+/// @param[in] fileName  The snapshot file.  Its directory will be created
+///                      if necessary.
+/// @throws std::invalid_argument if a header's network, station, channel,
+///         or location code is longer than 255 characters.
+/// @throws std::runtime_error if the file cannot be written.
+void writePacketHeaderSnapshot(const std::vector<PacketHeader> &headers,
+                               const std::filesystem::path &fileName);
+/// @brief Reads a snapshot written by writePacketHeaderSnapshot().
+/// @param[in] fileName  The snapshot file.
+/// @result The packet headers in the order in which they were written.
+/// @throws std::runtime_error if the file cannot be read or is corrupt.
+[[nodiscard]] std::vector<PacketHeader>
+    readPacketHeaderSnapshot(const std::filesystem::path &fileName);
+}
+#endif
@@ -1,9 +1,11 @@
 #ifndef UWAVE_SERVER_PACKET_SANITIZER_HPP
 #define UWAVE_SERVER_PACKET_SANITIZER_HPP
 #include <memory>
+#include <vector>
 namespace UWaveServer
 {
  class Packet;
+ struct PacketHeader;
  class PacketSanitizerOptions;
 }
 namespace UWaveServer
@@ -24,6 +26,15 @@ public:
     /// @result True indicates that this packet does not appear to be 
     //          a duplicate, extremely late, from the future, etc.
     bool allow(const Packet &packet);
+    /// @brief Seeds the sanitizer with a packet that was processed earlier,
+    ///        e.g., by this application before it was restarted.
+    /// @param[in] header  The header of the previously processed packet.
+    /// @throws std::invalid_argument if the header is malformed.
+    void seed(const PacketHeader &header);
+    /// @result The headers of the retained packets.  The headers of each
+    ///         stream are in order of increasing start time so they can be
+    ///         given to seed() to restore this sanitizer's state.
+    [[nodiscard]] std::vector<PacketHeader> getPacketHeaders() const;
     /// @brief Releases memory and resets the class.
     void clear() noexcept;
     /// @brief Destructor.
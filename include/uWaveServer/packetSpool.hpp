@@ -0,0 +1,86 @@
+#ifndef UWAVE_SERVER_PACKET_SPOOL_HPP
+#define UWAVE_SERVER_PACKET_SPOOL_HPP
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <spdlog/spdlog.h>
+namespace UWaveServer
+{
+  class Packet;
+}
+namespace UWaveServer
+{
+/// @brief A durable, append-only, first-in first-out spool of packets on
+///        local disk.  This is intended to hold packets while the database
+///        is unavailable so that they can be replayed once it returns.
+///
+///        The spool is a sequence of fixed-size segment files in a
+///        directory.  Each segment is memory mapped and packets are appended
+///        as checksummed records.  Since the mapping is shared with the page
+///        cache a packet survives the process crashing once push() returns.
+///        Consumed records are flagged in place and a segment is deleted
+///        once all of its records have been consumed.  On construction
+///        any segments already in the directory are recovered and a torn
+///        record at the end of a segment is discarded.
+/// @note The spool's directory should be owned by one instance at a time.
+/// @copyright Ben Baker (University of Utah) distributed under the MIT license.
+class PacketSpool
+{
+public:
+    /// @brief Opens (or creates) a spool in the given directory.
+    /// @param[in] directory           The directory holding the segments.
+    ///                                This will be created if necessary.
+    /// @param[in] segmentSizeInBytes  The size of each segment file.
+    /// @param[in] maximumSizeInBytes  The spool will not grow past this
+    ///                                size on disk.
+    /// @throws std::invalid_argument if the sizes are not positive or the
+    ///         segment size exceeds the maximum size.
+    /// @throws std::runtime_error if the directory or a segment cannot be
+    ///         opened.
+    PacketSpool(const std::filesystem::path &directory,
+                int64_t segmentSizeInBytes = 64*1024*1024,
+                int64_t maximumSizeInBytes = 4LL*1024*1024*1024,
+                std::shared_ptr<spdlog::logger> logger = nullptr);
+
+    /// @brief Appends a packet to the spool.
+    /// @param[in] packet  The packet to spool.  This must have a network,
+    ///                    station, channel, and sampling rate.
+    /// @result True indicates the packet was spooled.  False indicates the
+    ///         spool or the disk is full.
+    /// @throws std::invalid_argument if the packet is malformed.
+    /// @throws std::runtime_error if a new segment cannot be created.
+    [[nodiscard]] bool push(const Packet &packet);
+    /// @result Up to the oldest maximumNumberOfPackets packets in the
+    ///         spool.  The packets remain in the spool until consume() is
+    ///         called.
+    [[nodiscard]] std::vector<Packet> peek(int maximumNumberOfPackets) const;
+    /// @brief Removes the oldest nPackets packets from the spool.  Typically,
+    ///        this is called once the packets returned by peek() have been
+    ///        written.
+    void consume(int nPackets);
+    /// @brief Schedules the dirty pages to be written to disk.
+    void flush();
+
+    /// @result The number of packets in the spool.
+    [[nodiscard]] int64_t size() const noexcept;
+    /// @result True indicates the spool is empty.
+    [[nodiscard]] bool empty() const noexcept;
+    /// @result The size of the spool's segment files on disk in bytes.
+    [[nodiscard]] int64_t getSizeInBytes() const noexcept;
+    /// @result The spool's directory.
+    [[nodiscard]] std::filesystem::path getDirectory() const;
+
+    /// @brief Destructor.  This flushes and unmaps the segments.  Unconsumed
+    ///        packets remain on disk.
+    ~PacketSpool();
+
+    PacketSpool() = delete;
+    PacketSpool(const PacketSpool &) = delete;
+    PacketSpool& operator=(const PacketSpool &) = delete;
+private:
+    class PacketSpoolImpl;
+    std::unique_ptr<PacketSpoolImpl> pImpl;
+};
+}
+#endif
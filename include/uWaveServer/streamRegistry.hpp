@@ -0,0 +1,67 @@
+#ifndef UWAVE_SERVER_STREAM_REGISTRY_HPP
+#define UWAVE_SERVER_STREAM_REGISTRY_HPP
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+namespace UWaveServer
+{
+  class Packet;
+}
+namespace UWaveServer
+{
+/// @name StreamRegistry "streamRegistry.hpp" "uWaveServer/streamRegistry.hpp"
+/// @brief A process-wide intern table that maps a stream's network, station,
+///        channel, and location code to a compact handle.  Handles are
+///        assigned densely from 0 in the order streams are first seen and
+///        are never reused, so downstream stages can index flat arrays by
+///        handle rather than hashing the stream's name for every packet.
+/// @note This is thread safe.
+/// @copyright Ben Baker (University of Utah) distributed under the MIT license.
+class StreamRegistry
+{
+public:
+    /// @result The process's stream registry.
+    [[nodiscard]] static StreamRegistry &getInstance();
+
+    /// @brief Looks up the handle of the given stream and, if the stream
+    ///        has not been seen, assigns it the next handle.
+    /// @param[in] network       The network code - e.g., UU.
+    /// @param[in] station       The station name - e.g., TCU.
+    /// @param[in] channel       The channel code - e.g., HHZ.
+    /// @param[in] locationCode  The location code - e.g., 01.
+    /// @result The stream's handle.
+    /// @throws std::invalid_argument if the network, station, or channel
+    ///         is empty.
+    /// @throws std::runtime_error if the handles are exhausted.
+    [[nodiscard]] uint32_t intern(std::string_view network,
+                                  std::string_view station,
+                                  std::string_view channel,
+                                  std::string_view locationCode);
+    /// @brief Interns the packet's stream.
+    /// @throws std::runtime_error if the network, station, or channel is not
+    ///         set on the packet.
+    [[nodiscard]] uint32_t intern(const Packet &packet);
+    /// @result The NETWORK.STATION.CHANNEL[.LOCATION] name of the stream
+    ///         with the given handle.  The reference remains valid for the
+    ///         life of the process.
+    /// @throws std::out_of_range if the handle was never assigned.
+    [[nodiscard]] const std::string &getName(uint32_t handle) const;
+    /// @result The number of streams that have been interned.  Handles are
+    ///         in the range [0, size()).
+    [[nodiscard]] uint32_t size() const noexcept;
+
+    /// @brief Destructor.
+    ~StreamRegistry();
+
+    StreamRegistry(const StreamRegistry &) = delete;
+    StreamRegistry(StreamRegistry &&) noexcept = delete;
+    StreamRegistry& operator=(const StreamRegistry &) = delete;
+    StreamRegistry& operator=(StreamRegistry &&) noexcept = delete;
+private:
+    StreamRegistry();
+    class StreamRegistryImpl;
+    std::unique_ptr<StreamRegistryImpl> pImpl;
+};
+}
+#endif
@@ -3,10 +3,12 @@
 #include <chrono>
 #include <string>
 #include <memory>
+#include <vector>
 #include <spdlog/logger.h>
 namespace UWaveServer
 {
 class Packet;
+struct PacketHeader;
 }
 namespace UWaveServer
 {
@@ -22,6 +24,16 @@ namespace UWaveServer
 ///        packet will then be allowed.  In this instance, this is okay
 ///        because the database will detect a conflict on the start time
 ///        and default to an earlier packet.
+///
+///        Each stream's recent headers are indexed on start time so exact
+///        duplicates are found with a hash lookup and overlaps with a
+///        binary search.  Streams are spread over several locks so
+///        multiple threads may call allow() concurrently.
+///
+///        The retained headers do not keep the samples.  Hence, a packet's
+///        samples are only compared to those of a retained packet that
+///        carried an upstream hash (Packet::setDataHash()).  Otherwise, a
+///        packet matching a retained header is treated as a duplicate.
 /// @copyright Ben Baker (University of Utah) distributed under the MIT license.
 class TestDuplicatePacket
 {
@@ -57,7 +69,22 @@ public:
 
     /// @param[in] packet  The packet to test.
     /// @result True indicates the data does not appear to have been processed.
+    /// @note This is thread safe.
     [[nodiscard]] bool allow(const Packet &packet) const;
+    /// @brief Seeds the tester with a packet that was processed earlier,
+    ///        e.g., by this application before it was restarted.  Since its
+    ///        samples are unknown, packets matching this header are
+    ///        treated as duplicates.  Headers should be seeded in order
+    ///        of increasing start time.
+    /// @param[in] header  The header of the previously processed packet.
+    /// @throws std::invalid_argument if the header is malformed.
+    void seed(const PacketHeader &header);
+    /// @result The headers of the retained packets.  The headers of each
+    ///         stream are in order of increasing start time so they can be
+    ///         given to seed() to restore this tester's state, e.g., after
+    ///         a restart.
+    /// @note This is thread safe.
+    [[nodiscard]] std::vector<PacketHeader> getPacketHeaders() const;
 
     /// @brief Destructor.
     ~TestDuplicatePacket();
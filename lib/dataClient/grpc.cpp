@@ -1,3 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <grpc/grpc.h>
 #include <grpcpp/grpcpp.h>
 #include <spdlog/spdlog.h>
@@ -79,6 +86,9 @@ std::shared_ptr<grpc::Channel>
      return grpc::CreateChannel(address, grpc::InsecureChannelCredentials());
 }
 
+/// Reads packets from the stream and hands them to the callback in batches.
+/// A batch is delivered when it is full or, so that a slow feed does not
+/// add latency, when the flush interval elapses.
 class AsyncPacketSubscriber :
     public grpc::ClientReadReactor<UDataPacketServiceAPI::V1::Packet>
 {
@@ -87,15 +97,22 @@ public:
     (
         UDataPacketServiceAPI::V1::Broadcast::Stub *stub,
         const UDataPacketServiceAPI::V1::SubscriptionRequest &subscriptionRequest,
-        std::function<void (UWaveServer::Packet &&)> &addPacketCallback,
+        std::function<void (std::vector<UWaveServer::Packet> &&)> &addPacketsCallback,
         std::shared_ptr<spdlog::logger> logger,
-        std::atomic<bool> *keepRunning
+        std::atomic<bool> *keepRunning,
+        const int maximumBatchSize,
+        const std::chrono::milliseconds &batchFlushInterval
     ) :
         mSubscriptionRequest(subscriptionRequest),
-        mAddPacketCallback(addPacketCallback),
+        mAddPacketsCallback(addPacketsCallback),
         mLogger(logger),
+        mBatchFlushInterval(batchFlushInterval),
+        mMaximumBatchSize(static_cast<size_t> (std::max(1, maximumBatchSize))),
         mKeepRunning(keepRunning)
     {
+        mBatch.reserve(mMaximumBatchSize);
+        mFlushThread = std::thread(&AsyncPacketSubscriber::flushPeriodically,
+                                   this);
         mClientContext.set_wait_for_ready(false); // Fail immediately if server isn't there
         stub->async()->Subscribe(&mClientContext, &mSubscriptionRequest, this);
         StartRead(&mPacket);
@@ -110,13 +127,19 @@ public:
             try
             {
                 auto copy = UWaveServer::fromGRPC(mPacket);
-                mAddPacketCallback(std::move(copy));
+                bool isFull{false};
+                {
+                std::lock_guard<std::mutex> lock(mBatchMutex);
+                mBatch.push_back(std::move(copy));
+                isFull = (mBatch.size() >= mMaximumBatchSize);
+                }
+                if (isFull){flush();}
             }
             catch (const std::exception &e)
             {
                 SPDLOG_LOGGER_ERROR(
                     mLogger,
-                    "Failed to add packet to callback because {}",
+                    "Failed to add packet to batch because {}",
                     std::string {e.what()});
             }
             if (!mKeepRunning->load())
@@ -138,10 +161,12 @@ public:
 
     void OnDone(const grpc::Status &status) override
     {
+        // Deliver what's left before anyone waiting is released
+        flush();
         std::unique_lock<std::mutex> lock(mMutex);
         mStatus = status;
         mDone = true;
-        mConditionVariable.notify_one();
+        mConditionVariable.notify_all();
     }
 
     [[nodiscard]] std::pair<grpc::Status, bool> await()
@@ -151,27 +176,79 @@ public:
         return std::pair{std::move(mStatus), mHadSuccessfulRead};
     }
 
-#ifndef NDEBUG
     ~AsyncPacketSubscriber()
     {
+#ifndef NDEBUG
         SPDLOG_LOGGER_DEBUG(mLogger, "In destructor");
-    }
 #endif
+        {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDone = true;
+        }
+        mConditionVariable.notify_all();
+        if (mFlushThread.joinable()){mFlushThread.join();}
+    }
 
     AsyncPacketSubscriber() = delete;
 
 private:
+    /// Hands the accumulated packets to the callback.  Deliveries are
+    /// serialized so batches arrive in the order they were read.
+    void flush()
+    {
+        std::lock_guard<std::mutex> deliveryLock(mDeliveryMutex);
+        std::vector<UWaveServer::Packet> batch;
+        {
+        std::lock_guard<std::mutex> lock(mBatchMutex);
+        if (mBatch.empty()){return;}
+        batch.swap(mBatch);
+        mBatch.reserve(mMaximumBatchSize);
+        }
+        try
+        {
+            mAddPacketsCallback(std::move(batch));
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_LOGGER_ERROR(mLogger,
+                                "Failed to add packets to callback because {}",
+                                std::string {e.what()});
+        }
+    }
+    /// Delivers partial batches until the call is done.
+    void flushPeriodically()
+    {
+        while (true)
+        {
+            {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mConditionVariable.wait_for(lock, mBatchFlushInterval,
+                                            [this] {return mDone;}))
+            {
+                break;
+            }
+            }
+            flush();
+        }
+    }
+
     grpc::ClientContext mClientContext;
     UDataPacketServiceAPI::V1::SubscriptionRequest mSubscriptionRequest;
-    std::function<void (UWaveServer::Packet &&packet)> mAddPacketCallback;
+    std::function<void (std::vector<UWaveServer::Packet> &&packets)> mAddPacketsCallback;
     std::shared_ptr<spdlog::logger> mLogger{nullptr};
     std::mutex mMutex;
+    std::mutex mBatchMutex;
+    std::mutex mDeliveryMutex;
     std::condition_variable mConditionVariable;
+    std::vector<UWaveServer::Packet> mBatch;
     UDataPacketServiceAPI::V1::Packet mPacket;
     grpc::Status mStatus{grpc::Status::OK};
+    std::chrono::milliseconds mBatchFlushInterval{10};
+    size_t mMaximumBatchSize{64};
     bool mDone{false};
     std::atomic<bool> *mKeepRunning{nullptr};
     bool mHadSuccessfulRead{false};
+    std::thread mFlushThread;
 };
 
 }
@@ -243,7 +320,8 @@ public:
         mKeepRunning.store(false);
     }
 
-    std::function<void (UWaveServer::Packet &&packet)> mAddPacketFunction;
+    std::function<void (std::vector<UWaveServer::Packet> &&packets)>
+        mAddPacketsFunction;
     GRPCOptions mGRPCOptions; 
     std::shared_ptr<spdlog::logger> mLogger{nullptr};
     mutable std::mutex mShutdownMutex;
@@ -258,8 +336,8 @@ GRPC::GRPC(const std::function<void (std::vector<UWaveServer::Packet> &&)> &call
     IDataClient(callback),
     pImpl(std::make_unique<GRPCImpl> (options, logger))
 {
-    pImpl->mAddPacketFunction
-        = std::bind(&IDataClient::addPacket, this,
+    pImpl->mAddPacketsFunction
+        = std::bind(&IDataClient::addPackets, this,
                     std::placeholders::_1);
 
 }
@@ -1,4 +1,5 @@
 #include <string>
+#include <chrono>
 #include <algorithm>
 #include <filesystem>
 #include "uWaveServer/dataClient/grpcOptions.hpp"
@@ -13,6 +14,8 @@ public:
     std::string mServerCertificate;
     std::string mClientCertificate;
     std::string mClientKey;
+    std::chrono::milliseconds mBatchFlushInterval{10};
+    int mMaximumBatchSize{64};
     uint16_t mPort{50000};
     bool mHaveServerCertificate{false}; 
     bool mHaveClientCertificate{false};
@@ -164,3 +167,34 @@ std::optional<std::string> GRPCOptions::getAccessToken() const noexcept
            std::make_optional<std::string> (pImpl->mAccessToken) : std::nullopt;
 }
 
+
+/// Batch size
+void GRPCOptions::setMaximumBatchSize(const int batchSize)
+{
+    if (batchSize < 1)
+    {
+        throw std::invalid_argument("Batch size must be positive");
+    }
+    pImpl->mMaximumBatchSize = batchSize;
+}
+
+int GRPCOptions::getMaximumBatchSize() const noexcept
+{
+    return pImpl->mMaximumBatchSize;
+}
+
+/// Batch flush interval
+void GRPCOptions::setBatchFlushInterval(
+    const std::chrono::milliseconds &interval)
+{
+    if (interval.count() <= 0)
+    {
+        throw std::invalid_argument("Batch flush interval must be positive");
+    }
+    pImpl->mBatchFlushInterval = interval;
+}
+
+std::chrono::milliseconds GRPCOptions::getBatchFlushInterval() const noexcept
+{
+    return pImpl->mBatchFlushInterval;
+}
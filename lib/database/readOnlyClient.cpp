@@ -1,10 +1,16 @@
 #include <iostream>
 #include <iomanip>
 #include <bit>
+#include <cmath>
+#include <iterator>
 #include <limits>
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <optional>
+#include <set>
 #include <string>
 #include <vector>
 #ifndef NDEBUG
@@ -14,11 +20,16 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <pqxx/pqxx>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include "uWaveServer/database/readOnlyClient.hpp"
 #include "uWaveServer/database/credentials.hpp"
 #include "uWaveServer/database/exception.hpp"
 #include "uWaveServer/packet.hpp"
 #include "private/pack.hpp"
+#include "private/integerCodec.hpp"
+#include "private/preparedStatementCache.hpp"
+#include "private/decodedPacketCache.hpp"
 #include "private/toName.hpp"
 #ifdef WITH_ZLIB
 #include "private/compression.hpp"
@@ -33,6 +44,10 @@ using namespace UWaveServer::Database;
 namespace
 {
 
+// The compressed bytes a TBB task should inflate.  Rows are a few kB so
+// this amortizes the task overhead while leaving work to steal.
+constexpr size_t TARGET_BYTES_PER_TASK{65536};
+
 std::string toTableName(const std::string &schema,
                         const std::string &network, const std::string &station)
 {
@@ -50,6 +65,12 @@ std::string toTableName(const Credentials &credentials,
     return ::toTableName(credentials.getSchema(), network, station);
 }
 
+/// Tables created before the codec column only hold default codec data.
+std::string toCodecColumn(const bool hasCodec)
+{
+    return hasCodec ? "codec" : "0::SMALLINT AS codec";
+}
+
 struct StreamIdentifier
 {
     StreamIdentifier() = default;
@@ -100,8 +121,22 @@ UWaveServer::Packet unpackPacket(
     const bool packetIsLittleEndian,
     const bool amLittleEndian,
     const bool packetIsCompressed,
+    const int16_t packetCodec,
     const int packetSampleCount)
 {
+    constexpr auto deltaBitPack = static_cast<int16_t> (::Codec::DeltaBitPack);
+    if (packetCodec != static_cast<int16_t> (::Codec::Default) &&
+        packetCodec != deltaBitPack)
+    {
+        throw std::runtime_error("Unhandled codec "
+                               + std::to_string(packetCodec));
+    }
+    if (packetCodec == deltaBitPack &&
+        packetDataType != 'i' && packetDataType != 'l')
+    {
+        throw std::runtime_error("Codec " + std::to_string(packetCodec)
+                               + " only applies to integer data");
+    }
     UWaveServer::Packet packet;
     packet.setNetwork(network);
     packet.setStation(station);
@@ -111,53 +146,75 @@ UWaveServer::Packet unpackPacket(
     packet.setSamplingRate(packetSamplingRate);
     if (packetDataType == 'i')
     {
-        auto timeSeries
-            = ::decompressAndUnpack<int> (packetSampleCount,
-                                          packetByteArray,
-                                          packetIsLittleEndian,
-                                          amLittleEndian,
-                                          packetIsCompressed);
-        packet.setData(std::move(timeSeries));
-    }
-    else if (packetDataType == 'l') 
-    {
-        auto timeSeries
-            = ::decompressAndUnpack<int64_t> (packetSampleCount,
-                                              packetByteArray, 
-                                              packetIsLittleEndian,
-                                              amLittleEndian,
-                                              packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<int> (packetSampleCount);
+        if (packetCodec == deltaBitPack)
+        {
+            ::decodeDeltaBitPack<int> (samples.size(),
+                                       reinterpret_cast<const unsigned char *>
+                                       (packetByteArray.data()),
+                                       packetByteArray.size(),
+                                       samples.data());
+        }
+        else
+        {
+            ::decompressAndUnpack<int> (packetSampleCount,
+                                        packetByteArray,
+                                        packetIsLittleEndian,
+                                        amLittleEndian,
+                                        packetIsCompressed,
+                                        samples.data());
+        }
     }
-    else if (packetDataType == 'f')
+    else if (packetDataType == 'l')
     {
-        auto timeSeries
-            = ::decompressAndUnpack<float> (packetSampleCount,
+        auto samples = packet.resizeData<int64_t> (packetSampleCount);
+        if (packetCodec == deltaBitPack)
+        {
+            ::decodeDeltaBitPack<int64_t> (samples.size(),
+                                           reinterpret_cast<const unsigned char *>
+                                           (packetByteArray.data()),
+                                           packetByteArray.size(),
+                                           samples.data());
+        }
+        else
+        {
+            ::decompressAndUnpack<int64_t> (packetSampleCount,
                                             packetByteArray,
                                             packetIsLittleEndian,
                                             amLittleEndian,
-                                            packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+                                            packetIsCompressed,
+                                            samples.data());
+        }
+    }
+    else if (packetDataType == 'f')
+    {
+        auto samples = packet.resizeData<float> (packetSampleCount);
+        ::decompressAndUnpack<float> (packetSampleCount,
+                                      packetByteArray,
+                                      packetIsLittleEndian,
+                                      amLittleEndian,
+                                      packetIsCompressed,
+                                      samples.data());
     }
     else if (packetDataType == 'd')
     {
-        auto timeSeries
-             = ::decompressAndUnpack<double> (packetSampleCount,
-                                              packetByteArray,
-                                              packetIsLittleEndian,
-                                              amLittleEndian,
-                                              packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<double> (packetSampleCount);
+        ::decompressAndUnpack<double> (packetSampleCount,
+                                       packetByteArray,
+                                       packetIsLittleEndian,
+                                       amLittleEndian,
+                                       packetIsCompressed,
+                                       samples.data());
     }
     else if (packetDataType == 't')
     {
-        auto timeSeries
-            = ::decompressAndUnpack<char> (packetSampleCount,
-                                           packetByteArray,
-                                           packetIsLittleEndian,
-                                           amLittleEndian,
-                                           packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<char> (packetSampleCount);
+        ::decompressAndUnpack<char> (packetSampleCount,
+                                     packetByteArray,
+                                     packetIsLittleEndian,
+                                     amLittleEndian,
+                                     packetIsCompressed,
+                                     samples.data());
     }
     else
     {
@@ -179,6 +236,7 @@ std::vector<UWaveServer::Packet> unpackPackets(
     std::vector<std::basic_string<std::byte>> &packetByteArray,
     const std::vector<bool> packetIsLittleEndian,
     const std::vector<bool> packetIsCompressed,
+    const std::vector<int16_t> &packetCodec,
     const std::vector<int> packetSampleCount,
     spdlog::logger *logger)
 {
@@ -188,40 +246,63 @@ std::vector<UWaveServer::Packet> unpackPackets(
     assert(packetStartTime.size() == packetByteArray.size());
     assert(packetStartTime.size() == packetIsLittleEndian.size());
     assert(packetStartTime.size() == packetIsCompressed.size());
+    assert(packetStartTime.size() == packetCodec.size());
     assert(packetStartTime.size() == packetSampleCount.size());
 #endif
     std::vector<UWaveServer::Packet> result;
     if (packetStartTime.empty()){return result;}
-    result.reserve(packetStartTime.size());
-    for (int i = 0; i < static_cast<int> (packetStartTime.size()); ++i)
+    auto nPackets = static_cast<int> (packetStartTime.size());
+    // Inflating and unpacking the rows is independent so spread it across
+    // the TBB workers.  Each row in a task is the cost of inflating its
+    // bytes so size the tasks by bytes rather than rows.
+    size_t nBytes{0};
+    for (const auto &byteArray : packetByteArray)
     {
-        try
-        {
-            auto thisPacket = ::unpackPacket(network,
-                                             station,
-                                             channel,
-                                             locationCode,
-                                             packetStartTime[i],
-                                             packetSamplingRate[i],
-                                             packetDataType[i],
-                                             packetByteArray[i],
-                                             packetIsLittleEndian[i],
-                                             packetIsCompressed[i],
-                                             amLittleEndian,
-                                             packetSampleCount[i]);
-            result.push_back(std::move(thisPacket));
-        }
-        catch (const std::exception &e)
+        nBytes = nBytes + byteArray.size();
+    }
+    const size_t averageBytes = std::max<size_t> (1, nBytes/nPackets);
+    const auto grainSize
+        = static_cast<int> (std::max<size_t> (1, TARGET_BYTES_PER_TASK/averageBytes));
+    std::vector<std::optional<UWaveServer::Packet>> packets(nPackets);
+    tbb::parallel_for(tbb::blocked_range<int> (0, nPackets, grainSize),
+                      [&](const tbb::blocked_range<int> &range)
+    {
+        for (int i = range.begin(); i < range.end(); ++i)
         {
-            if (logger)
+            try
             {
-                auto packetName = ::toName(network, station, channel, locationCode);
-                SPDLOG_LOGGER_WARN(logger,
+                packets[i] = ::unpackPacket(network,
+                                            station,
+                                            channel,
+                                            locationCode,
+                                            packetStartTime[i],
+                                            packetSamplingRate[i],
+                                            packetDataType[i],
+                                            packetByteArray[i],
+                                            packetIsLittleEndian[i],
+                                            amLittleEndian,
+                                            packetIsCompressed[i],
+                                            packetCodec[i],
+                                            packetSampleCount[i]);
+            }
+            catch (const std::exception &e)
+            {
+                if (logger)
+                {
+                    auto packetName
+                        = ::toName(network, station, channel, locationCode);
+                    SPDLOG_LOGGER_WARN(logger,
                                "Failed to unpack packet for {}; failed with {}.",
                                packetName,
                                std::string {e.what()});
+                }
             }
         }
+    });
+    result.reserve(nPackets);
+    for (auto &packet : packets)
+    {
+        if (packet){result.push_back(std::move(*packet));}
     }
     std::sort(result.begin(), result.end(),
               [](const auto &lhs, const auto &rhs)
@@ -241,69 +322,85 @@ std::map<std::string, std::vector<UWaveServer::Packet>> unpackPackets(
     std::vector<std::basic_string<std::byte>> &packetByteArray,
     const std::vector<bool> packetIsLittleEndian,
     const std::vector<bool> packetIsCompressed,
+    const std::vector<int16_t> &packetCodec,
     const std::vector<int> packetSampleCount,
     spdlog::logger *logger)
 {
     std::map<std::string, std::vector<UWaveServer::Packet>> result;
+    // Bucket the rows by stream
+    std::map<int, std::vector<int>> identifierToRows;
+    for (int i = 0; i < static_cast<int> (streamIdentifiers.size()); ++i)
+    {
+        identifierToRows[streamIdentifiers[i]].push_back(i);
+    }
+    std::vector<std::pair<int, const ::StreamIdentifier *>> streams;
+    streams.reserve(identifierToStreamIdentifiers.size());
     for (const auto &streamIdentifierPair : identifierToStreamIdentifiers)
     {
-        auto targetIdentifier = streamIdentifierPair.first;
-        auto network = streamIdentifierPair.second.network;
-        auto station = streamIdentifierPair.second.station;
-        auto channel = streamIdentifierPair.second.channel;
-        auto locationCode = streamIdentifierPair.second.locationCode;
-        auto name = ::toName(network, station, channel, locationCode);
-        //std::vector<int> matchingStreamIdentifier;
+        if (identifierToRows.contains(streamIdentifierPair.first))
+        {
+            streams.push_back(std::pair {streamIdentifierPair.first,
+                                         &streamIdentifierPair.second});
+        }
+    }
+    // Unpack the streams in parallel.  Each stream's rows are then unpacked
+    // in parallel which TBB balances across the same workers.
+    std::vector<std::vector<UWaveServer::Packet>> streamPackets(streams.size());
+    tbb::parallel_for(size_t {0}, streams.size(), [&](const size_t iStream)
+    {
+        const auto targetIdentifier = streams[iStream].first;
+        const auto &network = streams[iStream].second->network;
+        const auto &station = streams[iStream].second->station;
+        const auto &channel = streams[iStream].second->channel;
+        const auto &locationCode = streams[iStream].second->locationCode;
+        const auto &rows = identifierToRows.at(targetIdentifier);
         std::vector<double> matchingPacketStartTime;
         std::vector<double> matchingPacketSamplingRate;
         std::vector<char> matchingPacketDataType;
         std::vector<std::basic_string<std::byte>> matchingPacketByteArray;
         std::vector<bool> matchingPacketIsLittleEndian;
         std::vector<bool> matchingPacketIsCompressed;
+        std::vector<int16_t> matchingPacketCodec;
         std::vector<int> matchingPacketSampleCount;
-        auto nPackets = static_cast<int> (streamIdentifiers.size());
+        auto nPackets = static_cast<int> (rows.size());
         matchingPacketStartTime.reserve(nPackets);
         matchingPacketSamplingRate.reserve(nPackets);
         matchingPacketDataType.reserve(nPackets);
         matchingPacketByteArray.reserve(nPackets);
         matchingPacketIsLittleEndian.reserve(nPackets);
         matchingPacketIsCompressed.reserve(nPackets);
+        matchingPacketCodec.reserve(nPackets);
         matchingPacketSampleCount.reserve(nPackets);
-        for (int i = 0; i < nPackets; ++i)
+        // Streams own disjoint rows so moving the bytes out is safe
+        for (const auto i : rows)
         {
-            if (streamIdentifiers[i] == targetIdentifier)
-            {
-                //matchingStreamIdentifier.push_back(streamIdentifiers[i]);
-                matchingPacketStartTime.push_back(packetStartTime[i]);
-                matchingPacketSamplingRate.push_back(packetSamplingRate[i]);
-                matchingPacketDataType.push_back(packetDataType[i]);
-                matchingPacketByteArray.push_back(
-                    std::move(packetByteArray.at(i)));
-                matchingPacketIsLittleEndian.push_back(packetIsLittleEndian[i]);
-                matchingPacketIsCompressed.push_back(packetIsCompressed[i]);
-                matchingPacketSampleCount.push_back(packetSampleCount[i]);
-            }
+            matchingPacketStartTime.push_back(packetStartTime[i]);
+            matchingPacketSamplingRate.push_back(packetSamplingRate[i]);
+            matchingPacketDataType.push_back(packetDataType[i]);
+            matchingPacketByteArray.push_back(
+                std::move(packetByteArray.at(i)));
+            matchingPacketIsLittleEndian.push_back(packetIsLittleEndian[i]);
+            matchingPacketIsCompressed.push_back(packetIsCompressed[i]);
+            matchingPacketCodec.push_back(packetCodec[i]);
+            matchingPacketSampleCount.push_back(packetSampleCount[i]);
         }
         try
         {
-            if (!matchingPacketStartTime.empty())
-            {
-                auto matchingPackets
-                    = ::unpackPackets(network,
-                                      station,
-                                      channel,
-                                      locationCode,
-                                      amLittleEndian, 
-                                      matchingPacketStartTime,
-                                      matchingPacketSamplingRate,
-                                      matchingPacketDataType,
-                                      matchingPacketByteArray,
-                                      matchingPacketIsLittleEndian,
-                                      matchingPacketIsCompressed,
-                                      matchingPacketSampleCount,
-                                      logger);
-                result.insert_or_assign(name, std::move(matchingPackets));
-            }
+            streamPackets[iStream]
+                = ::unpackPackets(network,
+                                  station,
+                                  channel,
+                                  locationCode,
+                                  amLittleEndian, 
+                                  matchingPacketStartTime,
+                                  matchingPacketSamplingRate,
+                                  matchingPacketDataType,
+                                  matchingPacketByteArray,
+                                  matchingPacketIsLittleEndian,
+                                  matchingPacketIsCompressed,
+                                  matchingPacketCodec,
+                                  matchingPacketSampleCount,
+                                  logger);
         }
         catch (const std::exception &e)
         {
@@ -311,10 +408,22 @@ std::map<std::string, std::vector<UWaveServer::Packet>> unpackPackets(
             {
                 SPDLOG_LOGGER_WARN(logger,
                                "Failed to unpack packets for {} because {}",
-                               name,
+                               ::toName(network, station,
+                                        channel, locationCode),
                                std::string {e.what()});
             }
         }
+    });
+    for (size_t iStream = 0; iStream < streams.size(); ++iStream)
+    {
+        if (streamPackets[iStream].empty()){continue;}
+        const auto &streamIdentifier = *streams[iStream].second;
+        auto name = ::toName(streamIdentifier.network,
+                             streamIdentifier.station,
+                             streamIdentifier.channel,
+                             streamIdentifier.locationCode);
+        result.insert_or_assign(std::move(name),
+                                std::move(streamPackets[iStream]));
     }
     return result;
 }
@@ -331,87 +440,179 @@ std::string convertString(const std::string &s)
     return temp;
 }
 
+/// A pooled connection.  Prepared statements belong to a connection so
+/// each connection has its own cache.
+struct PooledConnection
+{
+    std::unique_ptr<pqxx::connection> connection{nullptr};
+    PreparedStatementCache preparedStatements;
+    std::chrono::steady_clock::time_point lastUsed;
+    std::atomic<bool> connected{false};
+};
+
 }
 
 class ReadOnlyClient::ReadOnlyClientImpl
 {
 public:
+    /// Returns the connection to the pool when it goes out of scope.
+    class ConnectionLease
+    {
+    public:
+        ConnectionLease(const ReadOnlyClientImpl *owner,
+                        PooledConnection *pooled) :
+            mOwner(owner),
+            mPooled(pooled)
+        {
+        }
+        ConnectionLease(ConnectionLease &&lease) noexcept :
+            mOwner(lease.mOwner),
+            mPooled(lease.mPooled)
+        {
+            lease.mPooled = nullptr;
+        }
+        ConnectionLease(const ConnectionLease &) = delete;
+        ConnectionLease& operator=(const ConnectionLease &) = delete;
+        ConnectionLease& operator=(ConnectionLease &&) = delete;
+        ~ConnectionLease()
+        {
+            release();
+        }
+        /// Returns the connection to the pool early.
+        void release() noexcept
+        {
+            if (mPooled){mOwner->checkin(mPooled);}
+            mPooled = nullptr;
+        }
+        [[nodiscard]] pqxx::connection &connection() const
+        {
+            return *mPooled->connection;
+        }
+        [[nodiscard]] PreparedStatementCache &preparedStatements() const
+        {
+            return mPooled->preparedStatements;
+        }
+    private:
+        const ReadOnlyClientImpl *mOwner{nullptr};
+        PooledConnection *mPooled{nullptr};
+    };
+
     ReadOnlyClientImpl(const Credentials &credentials, 
+                       const int connectionPoolSize,
+                       const std::chrono::milliseconds &checkoutTimeOut,
                        std::shared_ptr<spdlog::logger> logger) :
         mCredentials(credentials),
-        mLogger(logger)
+        mLogger(logger),
+        mCheckoutTimeOut(checkoutTimeOut)
     {   
+        if (connectionPoolSize < 1)
+        {
+            throw std::invalid_argument(
+                "Connection pool size must be positive");
+        }
+        if (checkoutTimeOut.count() < 0)
+        {
+            throw std::invalid_argument(
+                "Checkout time out must be non-negative");
+        }
         if (mLogger == nullptr)
         {
             mLogger
                = spdlog::stdout_color_mt("db-reader-client-console");
         }
         mAmReadOnly = true;
+        mConnections.reserve(connectionPoolSize);
+        for (int i = 0; i < connectionPoolSize; ++i)
+        {
+            mConnections.push_back(std::make_unique<PooledConnection> ());
+        }
         connect();
         initializeStreams();
     }
     [[nodiscard]] bool isConnected() const noexcept
     {
-        std::scoped_lock lock(mDatabaseMutex);
-        if (mConnection)
-        {
-            return mConnection->is_open();
-            //return mConnection->dbname() != nullptr;
-        }
-        return false;
+        return std::any_of(mConnections.begin(), mConnections.end(),
+                           [](const auto &pooled)
+                           {
+                               return pooled->connected.load();
+                           });
     }
-    void connect()
+    // Opens a new connection for this pool entry.  The caller must own the
+    // entry, i.e., it is checked out or no one else can see the pool yet.
+    void connect(PooledConnection *pooled) const
     {
-        disconnect();
+        pooled->connected = false;
+        if (pooled->connection)
         {
-        std::scoped_lock lock(mDatabaseMutex);
-        mShutdownRequested = false;
-        mConnection
+            pooled->connection->close();
+            pooled->connection = nullptr;
+        }
+        pooled->connection
            = std::make_unique<pqxx::connection>
              (mCredentials.getConnectionString());
-        if (mConnection)
-        {
-            if (mConnection->dbname() == nullptr)
-            {
-                throw std::runtime_error("Failed to connect to "
-                                       + mCredentials.getDatabaseName()
-                                       + " at " + mCredentials.getHost());
-            }
-            // Schema
-            auto schema = mCredentials.getSchema();
-            if (!schema.empty())
-            {
-                SPDLOG_LOGGER_DEBUG(mLogger,
-                                    "Adding {} to search path", schema);
-                std::string query = "SET search_path TO " + schema + ", public";
-                pqxx::work transaction(*mConnection);
-                transaction.exec(query);
-                transaction.commit();
-            }
-        }
-        else
+        // Prepared statements do not survive the old connection
+        pooled->preparedStatements.clear();
+        if (pooled->connection == nullptr ||
+            pooled->connection->dbname() == nullptr)
         {
             throw std::runtime_error("Failed to connect to "
                                    + mCredentials.getDatabaseName()
                                    + " at " + mCredentials.getHost());
         }
+        // Schema
+        auto schema = mCredentials.getSchema();
+        if (!schema.empty())
+        {
+            SPDLOG_LOGGER_DEBUG(mLogger,
+                                "Adding {} to search path", schema);
+            std::string query = "SET search_path TO " + schema + ", public";
+            pqxx::work transaction(*pooled->connection);
+            transaction.exec(query);
+            transaction.commit();
+        }
+        pooled->lastUsed = std::chrono::steady_clock::now();
+        pooled->connected = true;
+    }
+    void connect()
+    {
+        {
+        std::scoped_lock lock(mShutdownMutex);
+        mShutdownRequested = false;
         }
-        SPDLOG_LOGGER_INFO(mLogger, "Connected to {} at {}",
+        std::scoped_lock lock(mPoolMutex);
+        mIdleConnections.clear();
+        for (auto &pooled : mConnections)
+        {
+            connect(pooled.get());
+            mIdleConnections.push_back(pooled.get());
+        }
+        mPoolCondition.notify_all();
+        SPDLOG_LOGGER_INFO(mLogger, "Opened {} connection(s) to {} at {}",
+                           mConnections.size(),
                            mCredentials.getDatabaseName(),
                            mCredentials.getHost());
     }
     void disconnect()
     {
-        mShutdownRequested = true;    
+        {
+        std::scoped_lock lock(mShutdownMutex);
+        mShutdownRequested = true;
+        }
         mShutdownCondition.notify_all();    
-        std::scoped_lock lock(mDatabaseMutex);
-        if (mConnection)
+        // Connections in use are left alone.  A closed connection is
+        // reopened when it is next checked out.
+        std::scoped_lock lock(mPoolMutex);
+        for (auto &pooled : mIdleConnections)
         {
-            mConnection->close();
-            mConnection = nullptr;
+            pooled->connected = false;
+            if (pooled->connection)
+            {
+                pooled->connection->close();
+                pooled->connection = nullptr;
+            }
         }
     }
-    void reconnect()
+    void reconnect(PooledConnection *pooled) const
     {
         const std::vector<std::chrono::seconds> reconnectSchedule
         {
@@ -424,8 +625,11 @@ public:
         {
             try
             {
-                connect();
-                if (isConnected()){return;}
+                connect(pooled);
+                SPDLOG_LOGGER_INFO(mLogger, "Reconnected to {} at {}",
+                                   mCredentials.getDatabaseName(),
+                                   mCredentials.getHost());
+                return;
             }
             catch (const std::exception &e)
             {
@@ -453,15 +657,100 @@ public:
                                      + " attempts");
         //throw std::runtime_error("Failed to reconnect to database");
     }
-    [[nodiscard]] std::map<std::string, std::pair<int, std::string>> getStreams()
+    // A connection that was idle for a while may have been dropped by the
+    // server or a firewall without us noticing so ping it before use.
+    [[nodiscard]] bool isHealthy(PooledConnection *pooled) const
+    {
+        if (pooled->connection == nullptr || !pooled->connection->is_open())
+        {
+            return false;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - pooled->lastUsed < mHealthCheckInterval){return true;}
+        try
+        {
+            pqxx::nontransaction transaction(*pooled->connection);
+            transaction.exec("SELECT 1");
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_LOGGER_WARN(mLogger, "Health check failed with {}",
+                               std::string {e.what()});
+            return false;
+        }
+        return true;
+    }
+    // Waits at most mCheckoutTimeOut for a free connection.  The connection
+    // is health checked and, if necessary, reconnected before it is handed
+    // out.
+    [[nodiscard]] ConnectionLease checkout() const
     {
-        // Ensure we're connected
-        if (!isConnected())
+        auto waitStartTime = std::chrono::steady_clock::now();
+        PooledConnection *pooled{nullptr};
+        {
+        std::unique_lock<std::mutex> lock(mPoolMutex);
+        if (!mPoolCondition.wait_for(lock, mCheckoutTimeOut,
+                                     [this]
+                                     {
+                                         return !mIdleConnections.empty();
+                                     }))
+        {
+            mCheckoutTimeOuts.fetch_add(1, std::memory_order_relaxed);
+            throw std::runtime_error(
+                "Timed out waiting for a database connection");
+        }
+        pooled = mIdleConnections.back();
+        mIdleConnections.pop_back();
+        }
+        auto waitTime
+            = std::chrono::duration_cast<std::chrono::microseconds>
+              (std::chrono::steady_clock::now() - waitStartTime);
+        mCheckouts.fetch_add(1, std::memory_order_relaxed);
+        mCheckoutWaitTime.fetch_add(waitTime.count(),
+                                    std::memory_order_relaxed);
+        ConnectionLease lease{this, pooled};
+        if (!isHealthy(pooled))
         {
+            pooled->connected = false;
             SPDLOG_LOGGER_INFO(mLogger,
-                         "Attempting to reconnect prior to getting streams...");
-            reconnect(); // Throws
+                               "Attempting to reconnect prior to query...");
+            reconnect(pooled); // Throws; the lease returns the connection
+        }
+        pooled->lastUsed = std::chrono::steady_clock::now();
+        return lease;
+    }
+    void checkin(PooledConnection *pooled) const noexcept
+    {
+        if (pooled->connection == nullptr || !pooled->connection->is_open())
+        {
+            pooled->connected = false;
+        }
+        {
+        std::scoped_lock lock(mPoolMutex);
+        mIdleConnections.push_back(pooled);
+        }
+        mPoolCondition.notify_one();
+    }
+    [[nodiscard]] int64_t getPreparedStatementCacheHits() const noexcept
+    {
+        int64_t hits{0};
+        for (const auto &pooled : mConnections)
+        {
+            hits = hits + pooled->preparedStatements.hits();
         }
+        return hits;
+    }
+    [[nodiscard]] int64_t getPreparedStatementCacheMisses() const noexcept
+    {
+        int64_t misses{0};
+        for (const auto &pooled : mConnections)
+        {
+            misses = misses + pooled->preparedStatements.misses();
+        }
+        return misses;
+    }
+    [[nodiscard]] std::map<std::string, std::pair<int, std::string>> getStreams()
+    {
         std::vector<std::pair<std::string, std::pair<int, std::string>>>
             streamTableMap;
         constexpr pqxx::zview query
@@ -470,8 +759,8 @@ public:
 };
         // Streaming for this little data is unnecessary and dangerous
         {
-        std::scoped_lock lock(mDatabaseMutex);
-        pqxx::work transaction(*mConnection);
+        auto lease = checkout(); // Throws
+        pqxx::work transaction(lease.connection());
         pqxx::result queryResult = transaction.exec(query);
         for (const auto &row : queryResult) //int i = 0; i < queryResult.size(); ++i)
         {
@@ -523,8 +812,8 @@ public:
         pqxx::params queryParameters{network, station};
         std::string tableName;
         {
-        std::scoped_lock databaseLock(mDatabaseMutex);
-        pqxx::work transaction(*mConnection);
+        auto lease = checkout(); // Throws
+        pqxx::work transaction(lease.connection());
         pqxx::result queryResult = transaction.exec(query, queryParameters);
         for (const auto &row : queryResult) //int i = 0; i < queryResult.size(); ++i)
         {
@@ -610,8 +899,8 @@ public:
         int identifier{-1};
         std::string tableName;
         {
-        std::scoped_lock databaseLock(mDatabaseMutex);
-        pqxx::work transaction(*mConnection);
+        auto lease = checkout(); // Throws
+        pqxx::work transaction(lease.connection());
         pqxx::result queryResult = transaction.exec(query, queryParameters);
         if (!queryResult.empty())
         {
@@ -648,10 +937,10 @@ public:
         getStreamIdentifierAndTableName(const Packet &packet,
                                         const bool checkCacheOnly) const
     {
-        const auto network = packet.getNetworkReference();
-        const auto station = packet.getStationReference();
-        const auto channel = packet.getChannelReference();
-        const auto locationCode = packet.getLocationCodeReference();
+        const std::string network{packet.getNetworkReference()};
+        const std::string station{packet.getStationReference()};
+        const std::string channel{packet.getChannelReference()};
+        const std::string locationCode{packet.getLocationCodeReference()};
         return getStreamIdentifierAndTableName(network, station,
                                                channel, locationCode,
                                                checkCacheOnly);
@@ -679,13 +968,6 @@ public:
                   const std::string &locationCode,
                   const bool checkCacheOnly)
     {
-        // Ensure we're connected
-        if (!isConnected())
-        {
-            SPDLOG_LOGGER_DEBUG(mLogger,
-                "Attempting to reconnect prior to checking if stream exists..");
-            reconnect(); // Throws
-        }   
         // Check the stream is there 
         auto streamIdentifierAndTableName
              = getStreamIdentifierAndTableName(network, station,
@@ -759,13 +1041,6 @@ public:
                                    const double startTime,
                                    const double endTime)
     {
-        // Ensure we're connected
-        if (!isConnected())
-        {
-            SPDLOG_LOGGER_INFO(mLogger,
-                               "Attempting to reconnect prior to query...");
-            reconnect(); // Throws
-        }
         std::map<std::string, std::vector<Packet>> result;
         // tableName, vector(stream_ids)
         auto tableToIdentifiersMap
@@ -810,51 +1085,49 @@ public:
         std::vector<int> packetSampleCount;
         std::vector<bool> packetIsLittleEndian;
         std::vector<bool> packetIsCompressed;
+        std::vector<int16_t> packetCodec;
         std::vector<char> packetDataType;
         std::vector<std::basic_string<std::byte>> packetByteArray;
+        // One connection serves all the tables
+        auto lease = checkout(); // Throws
+        auto &connection = lease.connection();
         for (const auto &tableIdentifiers : tableToIdentifiersMap)
         {
             const auto &tableName = tableIdentifiers.first;
             const auto &identifiers = tableIdentifiers.second;
             if (identifiers.empty()){continue;}
-            // Assemble query
-            constexpr std::string_view queryPrefix{
-"SELECT stream_identifier, EXTRACT(epoch FROM start_time), sampling_rate, number_of_samples, little_endian, compressed, data_type, data::bytea FROM "
-            };
-            std::string queryMultiStreamSuffix{
-" WHERE end_time > TO_TIMESTAMP($1) AND start_time < TO_TIMESTAMP($2) AND stream_identifier IN ("
-            };
-            auto nIdentifiers = static_cast<int> (identifiers.size());
-            for (int i = 0; i < nIdentifiers; ++i)
+            // Assemble query.  The identifiers are passed as an array so
+            // the statement only depends on the table and can be prepared.
+            const bool hasCodec{hasCodecColumn(connection, tableName)};
+            auto createQuery = [hasCodec](const std::string &table)
             {
-                queryMultiStreamSuffix = queryMultiStreamSuffix
-                                       + std::to_string(identifiers.at(i));
-                if (i < nIdentifiers - 1)
-                {
-                    queryMultiStreamSuffix = queryMultiStreamSuffix + ",";
-                }
-                else
-                {
-                    queryMultiStreamSuffix = queryMultiStreamSuffix + ")";
-                }
-            }
+                constexpr std::string_view queryPrefix{
+"SELECT stream_identifier, EXTRACT(epoch FROM start_time), sampling_rate, number_of_samples, little_endian, compressed, data_type, data::bytea, "
+                };
+                constexpr std::string_view queryMultiStreamSuffix{
+" WHERE end_time > TO_TIMESTAMP($1) AND start_time < TO_TIMESTAMP($2) AND stream_identifier = ANY($3::INTEGER[])"
+                };
+                return std::string {queryPrefix}
+                     + ::toCodecColumn(hasCodec)
+                     + " FROM "
+                     + table
+                     + std::string {queryMultiStreamSuffix};
+            };
             pqxx::params parameters{startTime,
-                                    endTime};
-            std::string query = std::string {queryPrefix}
-                              + tableName
-                              + queryMultiStreamSuffix;
-            std::vector<int> streamIdentifier;
-            std::vector<double> packetStartTime;
-            std::vector<double> packetSamplingRate;
-            std::vector<int> packetSampleCount;
-            std::vector<bool> packetIsLittleEndian;
-            std::vector<bool> packetIsCompressed;
-            std::vector<char> packetDataType;
-            std::vector<std::basic_string<std::byte>> packetByteArray;
+                                    endTime,
+                                    identifiers};
             {
-            std::scoped_lock lock(mDatabaseMutex);
-            pqxx::work transaction(*mConnection);
-            pqxx::result queryResult = transaction.exec(query, parameters);
+            auto query
+                = lease.preparedStatements().get(
+                     connection,
+                     hasCodec ?
+                     PreparedStatementCache::Kind::QueryAllChannels :
+                     PreparedStatementCache::Kind::QueryAllChannelsWithoutCodec,
+                     tableName,
+                     createQuery);
+            pqxx::work transaction(connection);
+            pqxx::result queryResult
+                = transaction.exec(pqxx::prepped{query}, parameters);
             auto queryResultSize = queryResult.size();
             streamIdentifier.reserve(streamIdentifier.size() + queryResultSize);
             packetStartTime.reserve(packetStartTime.size() + queryResultSize);
@@ -864,6 +1137,7 @@ public:
                 packetSampleCount.size() + queryResultSize);
             packetIsCompressed.reserve(
                 packetIsCompressed.size() + queryResultSize);
+            packetCodec.reserve(packetCodec.size() + queryResultSize);
             packetIsLittleEndian.reserve(
                 packetIsLittleEndian.size() + queryResultSize);
             packetDataType.reserve(packetDataType.size() + queryResultSize);
@@ -880,10 +1154,12 @@ public:
                 packetDataType.push_back(row[6].as<std::string_view> () [0]);
                 packetByteArray.push_back(
                     row[7].as<std::basic_string<std::byte>> ()); 
+                packetCodec.push_back(row[8].as<int16_t> ());
             }
             transaction.commit();
             }
         }
+        lease.release();
         // Now we unpack
         try
         {
@@ -896,6 +1172,7 @@ public:
                                     packetByteArray,
                                     packetIsLittleEndian,
                                     packetIsCompressed,
+                                    packetCodec,
                                     packetSampleCount,
                                     mLogger.get());
         }
@@ -914,14 +1191,6 @@ public:
                               const double startTime,
                               const double endTime)
     {
-        std::vector<Packet> result;
-        // Ensure we're connected
-        if (!isConnected())
-        {
-            SPDLOG_LOGGER_INFO(mLogger,
-                               "Attempting to reconnect prior to query...");
-            reconnect(); // Throws
-        }
         // Check the stream is there
         constexpr bool checkCacheOnly{false};
         auto [streamIdentifier, tableName]
@@ -934,42 +1203,127 @@ public:
                  "Could not obtain stream identifier in query for "
                 + ::toName(network, station, channel, locationCode));
         }
+        if (mPacketCache == nullptr)
+        {
+            return fetchPackets(network, station, channel, locationCode,
+                                streamIdentifier, tableName,
+                                startTime, endTime);
+        }
+        // Only fetch what the cache does not cover
+        auto t0 = static_cast<int64_t> (std::llround(startTime*1.e6));
+        auto t1 = static_cast<int64_t> (std::llround(endTime*1.e6));
+        auto settledTime
+            = std::chrono::duration_cast<std::chrono::microseconds>
+              ((std::chrono::system_clock::now() - mPacketCacheSettleTime)
+               .time_since_epoch()).count();
+        auto maximumCoverageAge
+            = std::chrono::duration_cast<std::chrono::microseconds>
+              (mPacketCacheCoverageLifetime).count();
+        auto lookup = mPacketCache->lookup(streamIdentifier,
+                                           t0, t1, settledTime,
+                                           maximumCoverageAge);
+        std::vector<Packet> fetchedPackets;
+        for (const auto &[missingStart, missingEnd] : lookup.missing)
+        {
+            auto packets = fetchPackets(network, station, channel,
+                                        locationCode,
+                                        streamIdentifier, tableName,
+                                        missingStart*1.e-6,
+                                        missingEnd*1.e-6);
+            fetchedPackets.insert(fetchedPackets.end(),
+                                  std::make_move_iterator(packets.begin()),
+                                  std::make_move_iterator(packets.end()));
+        }
+        mPacketCache->insert(streamIdentifier, fetchedPackets, lookup);
+        SPDLOG_LOGGER_DEBUG(mLogger,
+                            "{} packets from cache and {} from {} queries",
+                            lookup.packets.size(),
+                            fetchedPackets.size(),
+                            lookup.missing.size());
+        // Merge and drop the rows fetched on both sides of the coverage
+        auto result = std::move(lookup.packets);
+        result.insert(result.end(),
+                      std::make_move_iterator(fetchedPackets.begin()),
+                      std::make_move_iterator(fetchedPackets.end()));
+        std::stable_sort(result.begin(), result.end(),
+                         [](const auto &lhs, const auto &rhs)
+                         {
+                             return lhs.getStartTime() < rhs.getStartTime();
+                         });
+        result.erase(std::unique(result.begin(), result.end(),
+                                 [](const auto &lhs, const auto &rhs)
+                                 {
+                                     return lhs.getStartTime() ==
+                                            rhs.getStartTime();
+                                 }),
+                     result.end());
+        return result;
+    }
+    // Get the packets in this time range from the stream's data table
+    [[nodiscard]]
+    std::vector<Packet> fetchPackets(const std::string &network,
+                                     const std::string &station,
+                                     const std::string &channel,
+                                     const std::string &locationCode,
+                                     const int streamIdentifier,
+                                     const std::string &tableName,
+                                     const double startTime,
+                                     const double endTime) const
+    {
+        std::vector<Packet> result;
         // Time to work
 #ifndef NDEBUG  
         auto queryStartTime = std::chrono::high_resolution_clock::now();
 #endif              
         // Assemble query
-        constexpr std::string_view queryPrefix{
-"SELECT EXTRACT(epoch FROM start_time), sampling_rate, number_of_samples, little_endian, compressed, data_type, data::bytea FROM "
-        };
-        constexpr std::string_view queryStreamSpecificSuffix{
+        auto lease = checkout(); // Throws
+        auto &connection = lease.connection();
+        const bool hasCodec{hasCodecColumn(connection, tableName)};
+        auto createQuery = [hasCodec](const std::string &table)
+        {
+            constexpr std::string_view queryPrefix{
+"SELECT EXTRACT(epoch FROM start_time), sampling_rate, number_of_samples, little_endian, compressed, data_type, data::bytea, "
+            };
+            constexpr std::string_view queryStreamSpecificSuffix{
 " WHERE stream_identifier = $1 AND end_time > TO_TIMESTAMP($2) AND start_time < TO_TIMESTAMP($3)" 
-        }; 
+            }; 
+            return std::string {queryPrefix}
+                 + ::toCodecColumn(hasCodec)
+                 + " FROM "
+                 + table
+                 + std::string {queryStreamSpecificSuffix};
+        };
         pqxx::params parameters{streamIdentifier,
                                 startTime,
                                 endTime};
-        std::string query = std::string {queryPrefix}
-                          + tableName
-                          + std::string {queryStreamSpecificSuffix};
 
         std::vector<double> packetStartTime;
         std::vector<double> packetSamplingRate;
         std::vector<int> packetSampleCount;
         std::vector<bool> packetIsLittleEndian;
         std::vector<bool> packetIsCompressed;
+        std::vector<int16_t> packetCodec;
         std::vector<char> packetDataType;
         std::vector<std::basic_string<std::byte>> packetByteArray;
-        // TODO: Should switch to a stream despite it being dangerous.  Just
-        //       have to figure out how prepped statements work.
+        // TODO: Should switch to a stream despite it being dangerous.
         {
-        std::scoped_lock lock(mDatabaseMutex);
-        pqxx::work transaction(*mConnection);
-        pqxx::result queryResult = transaction.exec(query, parameters);
+        auto query
+            = lease.preparedStatements().get(
+                 connection,
+                 hasCodec ?
+                 PreparedStatementCache::Kind::Query :
+                 PreparedStatementCache::Kind::QueryWithoutCodec,
+                 tableName,
+                 createQuery);
+        pqxx::work transaction(connection);
+        pqxx::result queryResult
+            = transaction.exec(pqxx::prepped{query}, parameters);
         auto queryResultSize = queryResult.size();
         packetStartTime.reserve(queryResultSize);
         packetSamplingRate.reserve(queryResultSize);
         packetSampleCount.reserve(queryResultSize);
         packetIsCompressed.reserve(queryResultSize);
+        packetCodec.reserve(queryResultSize);
         packetIsLittleEndian.reserve(queryResultSize);
         packetDataType.reserve(queryResultSize);
         packetByteArray.reserve(queryResultSize);
@@ -984,9 +1338,11 @@ public:
             packetDataType.push_back(row[5].as<std::string_view> () [0]);
             packetByteArray.push_back(
                 row[6].as<std::basic_string<std::byte>> ()); 
+            packetCodec.push_back(row[7].as<int16_t> ());
         }
         transaction.commit();
         }
+        lease.release();
 #ifndef NDEBUG
         auto queryEndTime = std::chrono::high_resolution_clock::now();
         double queryDuration
@@ -1007,6 +1363,7 @@ public:
                                  packetByteArray,
                                  packetIsLittleEndian,
                                  packetIsCompressed,
+                                 packetCodec,
                                  packetSampleCount,
                                  mLogger.get());
 #ifndef NDEBUG
@@ -1020,15 +1377,154 @@ public:
 #endif                                
         return result;
     }
+    // Stream this SCNL's packets from the database.  Rather than
+    // materializing the whole result the rows are fetched from a
+    // server-side cursor in batches so only a batch is held in memory.
+    int64_t streamQuery(const std::string &network,
+                        const std::string &station,
+                        const std::string &channel,
+                        const std::string &locationCode,
+                        const double startTime,
+                        const double endTime,
+                        const std::function<void (Packet &&)> &callback)
+    {
+        // Check the stream is there
+        constexpr bool checkCacheOnly{false};
+        auto [streamIdentifier, tableName]
+             = getStreamIdentifierAndTableName(network, station,
+                                               channel, locationCode,
+                                               checkCacheOnly); // Throws
+        if (streamIdentifier < 0)
+        {
+            throw std::invalid_argument(
+                 "Could not obtain stream identifier in query for "
+                + ::toName(network, station, channel, locationCode));
+        }
+        auto lease = checkout(); // Throws
+        auto &connection = lease.connection();
+        // Cursors cannot be prepared but the plan is cheap compared to
+        // moving a day of data
+        constexpr std::string_view queryPrefix{
+"DECLARE uws_stream_cursor NO SCROLL CURSOR FOR SELECT EXTRACT(epoch FROM start_time), sampling_rate, number_of_samples, little_endian, compressed, data_type, data::bytea, "
+        };
+        constexpr std::string_view queryStreamSpecificSuffix{
+" WHERE stream_identifier = $1 AND end_time > TO_TIMESTAMP($2) AND start_time < TO_TIMESTAMP($3) ORDER BY start_time"
+        };
+        auto declareCursor = std::string {queryPrefix}
+                           + ::toCodecColumn(
+                                hasCodecColumn(connection, tableName))
+                           + " FROM "
+                           + tableName
+                           + std::string {queryStreamSpecificSuffix};
+        const std::string fetch{"FETCH FORWARD "
+                              + std::to_string(mCursorFetchSize)
+                              + " FROM uws_stream_cursor"};
+        pqxx::params parameters{streamIdentifier,
+                                startTime,
+                                endTime};
+        int64_t nPackets{0};
+        pqxx::work transaction(connection);
+        transaction.exec(declareCursor, parameters);
+        while (true)
+        {
+            pqxx::result queryResult = transaction.exec(fetch);
+            for (const auto &row : queryResult)
+            {
+                std::optional<Packet> packet;
+                try
+                {
+                    auto packetByteArray
+                        = row[6].as<std::basic_string<std::byte>> ();
+                    packet = ::unpackPacket(network,
+                                            station,
+                                            channel,
+                                            locationCode,
+                                            row[0].as<double> (),
+                                            row[1].as<double> (),
+                                            row[5].as<std::string_view> () [0],
+                                            packetByteArray,
+                                            row[3].as<bool> (),
+                                            mAmLittleEndian,
+                                            row[4].as<bool> (),
+                                            row[7].as<int16_t> (),
+                                            row[2].as<int> ());
+                }
+                catch (const std::exception &e)
+                {
+                    SPDLOG_LOGGER_WARN(mLogger,
+                                   "Failed to unpack packet for {}; failed with {}.",
+                                   ::toName(network, station,
+                                            channel, locationCode),
+                                   std::string {e.what()});
+                    continue;
+                }
+                // Let the caller's exceptions propagate
+                callback(std::move(*packet));
+                nPackets = nPackets + 1;
+            }
+            if (static_cast<int> (queryResult.size()) < mCursorFetchSize)
+            {
+                break;
+            }
+        }
+        transaction.exec("CLOSE uws_stream_cursor");
+        transaction.commit();
+        return nPackets;
+    }
+    // Tables created before the codec column was added only hold data
+    // with the default codec.  update_data_tables_add_codec() can add the
+    // column while we are running so a table is re-checked until it has
+    // the column, after which it will always have it.
+    // The caller must have checked out the connection.
+    [[nodiscard]] bool hasCodecColumn(pqxx::connection &connection,
+                                      const std::string &tableName) const
+    {
+        {
+        std::scoped_lock lock(mCodecMutex);
+        if (mTablesWithCodec.contains(tableName)){return true;}
+        }
+        constexpr pqxx::zview hasCodecQuery{
+"SELECT EXISTS (SELECT 1 FROM pg_attribute WHERE attrelid = TO_REGCLASS($1) AND attname = 'codec' AND NOT attisdropped)"
+        };
+        pqxx::work transaction(connection);
+        auto queryResult
+            = transaction.exec(hasCodecQuery, pqxx::params{tableName});
+        auto hasCodec = !queryResult.empty() && queryResult[0][0].as<bool> ();
+        transaction.commit();
+        if (!hasCodec)
+        {
+            SPDLOG_LOGGER_DEBUG(mLogger, "{} has no codec column", tableName);
+            return false;
+        }
+        std::scoped_lock lock(mCodecMutex);
+        mTablesWithCodec.insert(tableName);
+        return true;
+    }
     Credentials mCredentials;
     std::shared_ptr<spdlog::logger> mLogger{nullptr};    
-    mutable std::mutex mDatabaseMutex;
     mutable std::mutex mMutex;
+    mutable std::mutex mPoolMutex;
     mutable std::mutex mShutdownMutex;
+    mutable std::mutex mCodecMutex;
+    mutable std::set<std::string> mTablesWithCodec;
     mutable std::map<std::string, std::pair<int, std::string>>
          mStreamToIdentifierAndTableName;
-    mutable std::unique_ptr<pqxx::connection> mConnection{nullptr};
-    std::condition_variable mShutdownCondition;
+    std::vector<std::unique_ptr<PooledConnection>> mConnections;
+    mutable std::vector<PooledConnection *> mIdleConnections;
+    mutable std::condition_variable mPoolCondition;
+    mutable std::condition_variable mShutdownCondition;
+    mutable std::atomic<int64_t> mCheckouts{0};
+    mutable std::atomic<int64_t> mCheckoutWaitTime{0}; // Microseconds
+    mutable std::atomic<int64_t> mCheckoutTimeOuts{0};
+    std::chrono::milliseconds mCheckoutTimeOut{10000};
+    std::chrono::seconds mHealthCheckInterval{30};
+    // Rows fetched from a cursor at a time.  At 200 Hz a row is a few kB.
+    int mCursorFetchSize{256};
+    // Rows newer than this may still be arriving so the cache will not
+    // claim to cover them
+    std::chrono::seconds mPacketCacheSettleTime{120};
+    std::chrono::seconds mPacketCacheCoverageLifetime{600};
+    std::unique_ptr<::DecodedPacketCache> mPacketCache{nullptr};
     std::chrono::seconds mRetentionDuration{365*86400}; // Make it something large like a year
     //    std::chrono::days mRetentionDuration{5};
     bool mAmReadOnly{true};
@@ -1039,7 +1535,20 @@ public:
 /// Constructor
 ReadOnlyClient::ReadOnlyClient(const Credentials &credentials,
                                std::shared_ptr<spdlog::logger> logger) :
-    pImpl(std::make_unique<ReadOnlyClientImpl> (credentials, logger))
+    ReadOnlyClient(credentials, 1, std::chrono::seconds {10}, logger)
+{
+}
+
+/// Constructor with a connection pool
+ReadOnlyClient::ReadOnlyClient(
+    const Credentials &credentials,
+    const int connectionPoolSize,
+    const std::chrono::milliseconds &checkoutTimeOut,
+    std::shared_ptr<spdlog::logger> logger) :
+    pImpl(std::make_unique<ReadOnlyClientImpl> (credentials,
+                                                connectionPoolSize,
+                                                checkoutTimeOut,
+                                                logger))
 {
 }
 
@@ -1052,6 +1561,86 @@ bool ReadOnlyClient::isConnected() const noexcept
     return pImpl->isConnected();
 }
 
+/// Prepared statement cache hits
+int64_t ReadOnlyClient::getPreparedStatementCacheHits() const noexcept
+{
+    return pImpl->getPreparedStatementCacheHits();
+}
+
+/// Prepared statement cache misses
+int64_t ReadOnlyClient::getPreparedStatementCacheMisses() const noexcept
+{
+    return pImpl->getPreparedStatementCacheMisses();
+}
+
+/// Packet cache
+void ReadOnlyClient::setPacketCacheSize(const int64_t maximumBytes)
+{
+    if (maximumBytes < 0)
+    {
+        throw std::invalid_argument("Cache size must be non-negative");
+    }
+    if (maximumBytes == 0)
+    {
+        pImpl->mPacketCache = nullptr;
+        return;
+    }
+    pImpl->mPacketCache = std::make_unique<::DecodedPacketCache> (maximumBytes);
+}
+
+void ReadOnlyClient::setPacketCacheCoverageLifetime(
+    const std::chrono::seconds &lifetime)
+{
+    if (lifetime.count() <= 0)
+    {
+        throw std::invalid_argument("Coverage lifetime must be positive");
+    }
+    pImpl->mPacketCacheCoverageLifetime = lifetime;
+}
+
+int64_t ReadOnlyClient::getPacketCacheUsage() const noexcept
+{
+    if (pImpl->mPacketCache){return pImpl->mPacketCache->size();}
+    return 0;
+}
+
+int64_t ReadOnlyClient::getPacketCacheHits() const noexcept
+{
+    if (pImpl->mPacketCache){return pImpl->mPacketCache->hits();}
+    return 0;
+}
+
+int64_t ReadOnlyClient::getPacketCacheMisses() const noexcept
+{
+    if (pImpl->mPacketCache){return pImpl->mPacketCache->misses();}
+    return 0;
+}
+
+/// Pool size
+int ReadOnlyClient::getConnectionPoolSize() const noexcept
+{
+    return static_cast<int> (pImpl->mConnections.size());
+}
+
+/// Checkouts
+int64_t ReadOnlyClient::getConnectionCheckouts() const noexcept
+{
+    return pImpl->mCheckouts.load(std::memory_order_relaxed);
+}
+
+/// Time spent waiting for a connection
+std::chrono::microseconds ReadOnlyClient::getConnectionWaitTime() const noexcept
+{
+    return std::chrono::microseconds
+           {pImpl->mCheckoutWaitTime.load(std::memory_order_relaxed)};
+}
+
+/// Checkouts that timed out
+int64_t ReadOnlyClient::getConnectionCheckoutTimeOuts() const noexcept
+{
+    return pImpl->mCheckoutTimeOuts.load(std::memory_order_relaxed);
+}
+
 /*
 /// Connect
 void ReadOnlyClient::connect()
@@ -1111,6 +1700,56 @@ std::vector<UWaveServer::Packet> ReadOnlyClient::query(
                         startTime, endTime); 
 }
 
+// Stream data
+int64_t ReadOnlyClient::streamQuery(
+    const std::string &network,
+    const std::string &station,
+    const std::string &channel,
+    const std::string &locationCode,
+    const std::chrono::microseconds &t0MuS,
+    const std::chrono::microseconds &t1MuS,
+    const std::function<void (UWaveServer::Packet &&)> &callback) const
+{
+    const double t0{t0MuS.count()*1.e-6};
+    const double t1{t1MuS.count()*1.e-6};
+    return streamQuery(network, station, channel, locationCode,
+                       t0, t1, callback);
+}
+
+int64_t ReadOnlyClient::streamQuery(
+    const std::string &networkIn,
+    const std::string &stationIn,
+    const std::string &channelIn,
+    const std::string &locationCodeIn,
+    const double startTime,
+    const double endTime,
+    const std::function<void (UWaveServer::Packet &&)> &callback) const
+{
+    if (!callback){throw std::invalid_argument("Callback is empty");}
+    if (startTime >= endTime)
+    {
+        throw std::invalid_argument("Start time must be less han end time");
+    }
+    auto network = ::convertString(networkIn);
+    if (network.empty())
+    {
+        throw std::invalid_argument("Network is empty");
+    }
+    auto station = ::convertString(stationIn);
+    if (station.empty())
+    {
+        throw std::invalid_argument("Station is empty");
+    } 
+    auto channel = ::convertString(channelIn);
+    if (channel.empty())
+    {
+        throw std::invalid_argument("Channel is empty");
+    }
+    auto locationCode = ::convertString(locationCodeIn);
+    return pImpl->streamQuery(network, station, channel, locationCode,
+                              startTime, endTime, callback);
+}
+
 std::map<std::string, std::vector<UWaveServer::Packet>>
 ReadOnlyClient::queryAllChannelsForStation(
     const std::string &network,
@@ -72,53 +72,53 @@ UWaveServer::Packet unpackPacket(
     packet.setSamplingRate(packetSamplingRate);
     if (packetDataType == 'i')
     {
-        auto timeSeries
-            = ::decompressAndUnpack<int> (packetSampleCount,
-                                          packetByteArray,
-                                          packetIsLittleEndian,
-                                          amLittleEndian,
-                                          packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<int> (packetSampleCount);
+        ::decompressAndUnpack<int> (packetSampleCount,
+                                    packetByteArray,
+                                    packetIsLittleEndian,
+                                    amLittleEndian,
+                                    packetIsCompressed,
+                                    samples.data());
     }
-    else if (packetDataType == 'l') 
+    else if (packetDataType == 'l')
     {
-        auto timeSeries
-            = ::decompressAndUnpack<int64_t> (packetSampleCount,
-                                              packetByteArray, 
-                                              packetIsLittleEndian,
-                                              amLittleEndian,
-                                              packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<int64_t> (packetSampleCount);
+        ::decompressAndUnpack<int64_t> (packetSampleCount,
+                                        packetByteArray,
+                                        packetIsLittleEndian,
+                                        amLittleEndian,
+                                        packetIsCompressed,
+                                        samples.data());
     }
     else if (packetDataType == 'f')
     {
-        auto timeSeries
-            = ::decompressAndUnpack<float> (packetSampleCount,
-                                            packetByteArray,
-                                            packetIsLittleEndian,
-                                            amLittleEndian,
-                                            packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<float> (packetSampleCount);
+        ::decompressAndUnpack<float> (packetSampleCount,
+                                      packetByteArray,
+                                      packetIsLittleEndian,
+                                      amLittleEndian,
+                                      packetIsCompressed,
+                                      samples.data());
     }
     else if (packetDataType == 'd')
     {
-        auto timeSeries
-             = ::decompressAndUnpack<double> (packetSampleCount,
-                                              packetByteArray,
-                                              packetIsLittleEndian,
-                                              amLittleEndian,
-                                              packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<double> (packetSampleCount);
+        ::decompressAndUnpack<double> (packetSampleCount,
+                                       packetByteArray,
+                                       packetIsLittleEndian,
+                                       amLittleEndian,
+                                       packetIsCompressed,
+                                       samples.data());
     }
     else if (packetDataType == 't')
     {
-        auto timeSeries
-            = ::decompressAndUnpack<char> (packetSampleCount,
-                                           packetByteArray,
-                                           packetIsLittleEndian,
-                                           amLittleEndian,
-                                           packetIsCompressed);
-        packet.setData(std::move(timeSeries));
+        auto samples = packet.resizeData<char> (packetSampleCount);
+        ::decompressAndUnpack<char> (packetSampleCount,
+                                     packetByteArray,
+                                     packetIsLittleEndian,
+                                     amLittleEndian,
+                                     packetIsCompressed,
+                                     samples.data());
     }
     else
     {
@@ -598,10 +598,10 @@ R"""(
         getStreamIdentifierAndTableName(const Packet &packet,
                                         const bool addIfNotExists) const
     {
-        const auto network = packet.getNetworkReference();
-        const auto station = packet.getStationReference();
-        const auto channel = packet.getChannelReference();
-        const auto locationCode = packet.getLocationCodeReference();
+        const std::string network{packet.getNetworkReference()};
+        const std::string station{packet.getStationReference()};
+        const std::string channel{packet.getChannelReference()};
+        const std::string locationCode{packet.getLocationCodeReference()};
         return getStreamIdentifierAndTableName(network, station,
                                                channel, locationCode,
                                                addIfNotExists);
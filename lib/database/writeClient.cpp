@@ -3,8 +3,11 @@
 #include <bit>
 #include <limits>
 #include <algorithm>
+#include <array>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 #ifndef NDEBUG
@@ -14,11 +17,15 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <pqxx/pqxx>
+#include <libpq-fe.h>
 #include "uWaveServer/database/writeClient.hpp"
 #include "uWaveServer/database/credentials.hpp"
 #include "uWaveServer/database/exception.hpp"
 #include "uWaveServer/packet.hpp"
+#include "uWaveServer/packetHeader.hpp"
 #include "private/pack.hpp"
+#include "private/integerCodec.hpp"
+#include "private/preparedStatementCache.hpp"
 #include "private/toName.hpp"
 #ifdef WITH_ZLIB
 #include "private/compression.hpp"
@@ -63,6 +70,62 @@ std::string convertString(const std::string &s)
     return temp;
 }
 
+/// @brief Validates the packet prior to writing.
+/// @param[in] packet              The packet to check.
+/// @param[in] retentionDuration   Packets older than now minus this duration
+///                                are expired.
+/// @param[in] logger              The logger.
+/// @result True indicates the packet should be written.  False indicates
+///         the packet is empty or expired and should be skipped.
+/// @throws std::invalid_argument if the packet is malformed.
+/// @throws std::runtime_error if the data type is unknown.
+[[nodiscard]] bool isWritable(const UWaveServer::Packet &packet,
+                              const std::chrono::seconds &retentionDuration,
+                              const std::shared_ptr<spdlog::logger> &logger)
+{
+    if (!packet.hasNetwork())
+    {
+        throw std::invalid_argument("Network not set on packet");
+    }
+    if (!packet.hasStation())
+    {
+        throw std::invalid_argument("Station not set on packet");
+    }
+    if (!packet.hasChannel())
+    {
+        throw std::invalid_argument("Channel not set on packet");
+    }
+    if (!packet.hasSamplingRate())
+    {
+        throw std::invalid_argument("Sampling rate not set on packet");
+    }
+    if (packet.empty())
+    {
+        SPDLOG_LOGGER_WARN(logger, "Packet has no data - returning");
+        return false;
+    }
+    if (packet.getDataType() == UWaveServer::Packet::DataType::Unknown)
+    {
+        throw std::runtime_error("Packet's data type is unknown");
+    }
+    // Expired data?
+    auto now = std::chrono::high_resolution_clock::now();
+    auto endTime = packet.getEndTime();
+    std::chrono::microseconds oldestAllowableTime
+        = std::chrono::duration_cast<std::chrono::microseconds> 
+          (now.time_since_epoch()) 
+        - std::chrono::duration_cast<std::chrono::microseconds> 
+          (retentionDuration);
+    if (endTime < oldestAllowableTime)
+    {
+        SPDLOG_LOGGER_WARN(logger,
+                           "{}'s data has expired; skipping",
+                           ::toName(packet));
+        return false;
+    }
+    return true;
+}
+
 template<typename T, typename U>
 void fill(const int nFill,
           const int offset,
@@ -86,6 +149,53 @@ void fill(const int nFill,
     }
 }
 
+/// @result The SQL to insert a packet into the given data table.
+std::string createInsertStatement(const std::string &table)
+{
+    constexpr std::string_view queryPrefix{"INSERT INTO "};
+    constexpr std::string_view querySuffix{
+    "(stream_identifier, start_time, end_time, sampling_rate, number_of_samples, little_endian, compressed, data_type, data) VALUES($1, TO_TIMESTAMP($2), TO_TIMESTAMP($3), $4, $5, $6, $7, $8, $9) ON CONFLICT DO NOTHING"};
+    return std::string {queryPrefix}
+         + table
+         + std::string {querySuffix};
+}
+
+/// @result The SQL to insert a packet and its codec into the given data
+///         table.  Only touch the codec column when we're using it so that
+///         tables that haven't been migrated can still be written.
+std::string createInsertWithCodecStatement(const std::string &table)
+{
+    constexpr std::string_view queryPrefix{"INSERT INTO "};
+    constexpr std::string_view querySuffix{
+    "(stream_identifier, start_time, end_time, sampling_rate, number_of_samples, little_endian, compressed, data_type, data, codec) VALUES($1, TO_TIMESTAMP($2), TO_TIMESTAMP($3), $4, $5, $6, $7, $8, $9, $10) ON CONFLICT DO NOTHING"};
+    return std::string {queryPrefix}
+         + table
+         + std::string {querySuffix};
+}
+
+/// @brief Releases libpq objects.
+struct LibpqDeleter
+{
+    void operator()(PGconn *connection) const noexcept
+    {
+        PQfinish(connection);
+    }
+    void operator()(PGresult *result) const noexcept
+    {
+        PQclear(result);
+    }
+};
+using LibpqConnection = std::unique_ptr<PGconn, LibpqDeleter>;
+using LibpqResult = std::unique_ptr<PGresult, LibpqDeleter>;
+
+/// @result The libpq error message without the trailing newline.
+std::string toErrorMessage(const char *message)
+{
+    std::string result{message == nullptr ? "" : message};
+    while (!result.empty() && result.back() == '\n'){result.pop_back();}
+    return result;
+}
+
 }
 
 class WriteClient::WriteClientImpl
@@ -112,6 +222,12 @@ public:
     [[nodiscard]] bool isConnected() const noexcept
     {
         std::scoped_lock lock(mDatabaseMutex);
+        // The pipeline connection is only opened when pipelining
+        if (mPipelineConnection &&
+            PQstatus(mPipelineConnection.get()) != CONNECTION_OK)
+        {
+            return false;
+        }
         if (mConnection)
         {
             return mConnection->is_open();
@@ -128,6 +244,10 @@ public:
         mConnection
            = std::make_unique<pqxx::connection>
              (mCredentials.getConnectionString());
+        // Prepared statements do not survive the old connection
+        mPreparedStatements.clear();
+        mPipelineConnection = nullptr;
+        mPipelineStatements.clear();
         if (mConnection)
         {
             if (mConnection->dbname() == nullptr)
@@ -170,6 +290,7 @@ public:
             mConnection->close();
             mConnection = nullptr;
         }
+        mPipelineConnection = nullptr;
     }
     void reconnect()
     {
@@ -269,6 +390,75 @@ public:
         }
         return result;
     }
+    [[nodiscard]] std::vector<PacketHeader>
+        queryPacketHeaders(const std::chrono::microseconds &startTime)
+    {
+        // Ensure we're connected
+        if (!isConnected())
+        {
+            SPDLOG_LOGGER_INFO(mLogger,
+                "Attempting to reconnect prior to getting packet headers...");
+            reconnect(); // Throws
+        }
+        std::vector<PacketHeader> result;
+        pqxx::params queryParameters{startTime.count()*1.e-6};
+        std::scoped_lock lock(mDatabaseMutex);
+        pqxx::work transaction(*mConnection);
+        std::set<std::string> tableNames;
+        {
+        constexpr pqxx::zview tableQuery
+{
+"SELECT DISTINCT data_table_name FROM streams"
+};
+        pqxx::result queryResult = transaction.exec(tableQuery);
+        for (const auto &row : queryResult)
+        {
+            tableNames.insert(row[0].as<std::string> ());
+        }
+        }
+        if (tableNames.empty())
+        {
+            transaction.commit();
+            return result;
+        }
+        // Every data table is read in one round trip
+        std::string dataQuery;
+        for (const auto &tableName : tableNames)
+        {
+            if (!dataQuery.empty()){dataQuery = dataQuery + " UNION ALL ";}
+            dataQuery = dataQuery
+                      + "SELECT stream_identifier, "
+                      + "(EXTRACT(epoch FROM start_time)*1000000)::BIGINT AS start_time_mus, "
+                      + "(EXTRACT(epoch FROM end_time)*1000000)::BIGINT AS end_time_mus, "
+                      + "sampling_rate, number_of_samples FROM "
+                      + tableName
+                      + " WHERE start_time >= TO_TIMESTAMP($1)";
+        }
+        const std::string query
+            = "SELECT s.network, s.station, s.channel, s.location_code, "
+            + std::string {"d.start_time_mus, d.end_time_mus, "}
+            + "d.sampling_rate, d.number_of_samples FROM ("
+            + dataQuery
+            + ") AS d JOIN streams AS s ON s.identifier = d.stream_identifier"
+            + " ORDER BY d.start_time_mus";
+        pqxx::result queryResult = transaction.exec(query, queryParameters);
+        result.reserve(queryResult.size());
+        for (const auto &row : queryResult)
+        {
+            PacketHeader header;
+            header.network = row[0].as<std::string> ();
+            header.station = row[1].as<std::string> ();
+            header.channel = row[2].as<std::string> ();
+            header.locationCode = row[3].as<std::string> ();
+            header.startTime = std::chrono::microseconds {row[4].as<int64_t> ()};
+            header.endTime = std::chrono::microseconds {row[5].as<int64_t> ()};
+            header.samplingRate = row[6].as<double> ();
+            header.numberOfSamples = row[7].as<int> ();
+            result.push_back(std::move(header));
+        }
+        transaction.commit();
+        return result;
+    }
     // Search for a stream and, potentially, if it doesn't exist add it to my
     // cache
     [[nodiscard]] std::map<std::string, std::vector<int>>
@@ -539,13 +729,37 @@ R"""(
         getStreamIdentifierAndTableName(const Packet &packet,
                                         const bool addIfNotExists) const
     {
-        const auto network = packet.getNetworkReference();
-        const auto station = packet.getStationReference();
-        const auto channel = packet.getChannelReference();
-        const auto locationCode = packet.getLocationCodeReference();
-        return getStreamIdentifierAndTableName(network, station,
-                                               channel, locationCode,
-                                               addIfNotExists);
+        // Interned streams are cached by handle so this avoids building
+        // and comparing the stream's name
+        const bool haveHandle{packet.hasStreamHandle()};
+        const auto handle = haveHandle ? packet.getStreamHandle() : 0;
+        if (haveHandle)
+        {
+        std::scoped_lock lock(mMutex);
+        if (handle < mHandleToIdentifierAndTableName.size() &&
+            mHandleToIdentifierAndTableName[handle].first >= 0)
+        {
+            return mHandleToIdentifierAndTableName[handle];
+        }
+        }
+        const std::string network{packet.getNetworkReference()};
+        const std::string station{packet.getStationReference()};
+        const std::string channel{packet.getChannelReference()};
+        const std::string locationCode{packet.getLocationCodeReference()};
+        auto result = getStreamIdentifierAndTableName(network, station,
+                                                      channel, locationCode,
+                                                      addIfNotExists);
+        if (haveHandle && result.first >= 0)
+        {
+            std::scoped_lock lock(mMutex);
+            if (handle >= mHandleToIdentifierAndTableName.size())
+            {
+                mHandleToIdentifierAndTableName.resize(
+                    handle + 1, std::pair {-1, std::string {}});
+            }
+            mHandleToIdentifierAndTableName[handle] = result;
+        }
+        return result;
     }
     // Initialize my cache of streams
     void initializeStreams()
@@ -555,6 +769,7 @@ R"""(
         {
             std::scoped_lock lock(mMutex);
             mStreamToIdentifierAndTableName.clear();
+            mHandleToIdentifierAndTableName.clear();
             for (auto &stream : streams)
             {
                 mStreamToIdentifierAndTableName.insert_or_assign(
@@ -589,54 +804,61 @@ R"""(
         }
         return true;
     }
-    // Write the packet 
-    void insert(const Packet &packet)
+    // The packed samples and how to interpret them
+    struct PackedData
     {
-        if (packet.empty())
-        {
-            SPDLOG_LOGGER_WARN(mLogger, "Packet has no data - returning");
-            return;
-        }
-        // Ensure we're connected
-        if (!isConnected())
-        {
-            SPDLOG_LOGGER_INFO(mLogger,
-                               "Attempting to reconnect prior to insert...");
-            reconnect(); // Will throw
-        }
-        // Get the stream identifier
-        constexpr bool addIfNotExists{true};
-        auto [streamIdentifier, tableName]
-             = getStreamIdentifierAndTableName(packet, addIfNotExists); // Throws
-        if (streamIdentifier < 0 || tableName.empty()) 
-        {
-            throw std::runtime_error(
-               "Could not obtain stream identifier in insert");
-        }
-
-        auto nSamples = static_cast<int> (packet.size()); 
-        double startTime = packet.getStartTime().count()*1.e-6;
-        double endTime = packet.getEndTime().count()*1.e-6;
-        double samplingRate = packet.getSamplingRate();
-        auto dataType = packet.getDataType();
-
-        auto compressed = (mCompressionLevel != Z_NO_COMPRESSION) ? true : false;
         std::string binaryData;
-        std::string dataTypeSignifier{'i'};
+        std::string dataTypeSignifier{"i"};
+        int16_t codec{static_cast<int16_t> (::Codec::Default)};
+        bool compressed{false};
+    };
+    // Packs and, potentially, compresses the packet's samples.
+    [[nodiscard]] PackedData packData(const Packet &packet) const
+    {
+        auto nSamples = static_cast<int> (packet.size());
+        auto dataType = packet.getDataType();
+        PackedData result;
+        auto &binaryData = result.binaryData;
+        auto &dataTypeSignifier = result.dataTypeSignifier;
+        result.compressed
+            = (mCompressionLevel != Z_NO_COMPRESSION) ? true : false;
+        auto useDeltaBitPack
+            = (mIntegerCodec == WriteClient::IntegerCodec::DeltaBitPack);
         if (dataType == UWaveServer::Packet::DataType::Integer32)
         {
             auto dataPtr = static_cast<const int *> (packet.data());
-            binaryData
-                = ::packAndCompress<int>
-                  (nSamples, dataPtr, mCompressionLevel, mSwapBytes);
+            if (useDeltaBitPack)
+            {
+                binaryData = ::encodeDeltaBitPack<int> (nSamples, dataPtr);
+                result.codec
+                    = static_cast<int16_t> (::Codec::DeltaBitPack);
+                result.compressed = true;
+            }
+            else
+            {
+                binaryData
+                    = ::packAndCompress<int>
+                      (nSamples, dataPtr, mCompressionLevel, mSwapBytes);
+            }
             dataTypeSignifier = "i";
         }
         else if (dataType == UWaveServer::Packet::DataType::Integer64)
         {
             auto dataPtr = static_cast<const int64_t *> (packet.data());
-            binaryData
-                = ::packAndCompress<int64_t>
-                  (nSamples, dataPtr, mCompressionLevel, mSwapBytes);
+            if (useDeltaBitPack)
+            {
+                binaryData
+                    = ::encodeDeltaBitPack<int64_t> (nSamples, dataPtr);
+                result.codec
+                    = static_cast<int16_t> (::Codec::DeltaBitPack);
+                result.compressed = true;
+            }
+            else
+            {
+                binaryData
+                    = ::packAndCompress<int64_t>
+                      (nSamples, dataPtr, mCompressionLevel, mSwapBytes);
+            }
             dataTypeSignifier = "l";
         }
         else if (dataType == UWaveServer::Packet::DataType::Double)
@@ -669,15 +891,86 @@ R"""(
             assert(false);
         #endif
         }
+        return result;
+    }
+    // A packed packet ready to be written.  Start/end times are seconds
+    // since the epoch and are converted to timestamps by the database.
+    struct StagingRow
+    {
+        std::string binaryData;
+        std::string dataTypeSignifier;
+        double startTime{0};
+        double endTime{0};
+        double samplingRate{0};
+        int streamIdentifier{-1};
+        int nSamples{0};
+        int16_t codec{0};
+        bool compressed{false};
+    };
+    // Packs the packet and looks up (or creates) its stream.  The result
+    // is the data table name and the row to write to it.
+    [[nodiscard]] std::pair<std::string, StagingRow>
+        toStagingRow(const Packet &packet)
+    {
+        constexpr bool addIfNotExists{true};
+        auto [streamIdentifier, tableName]
+             = getStreamIdentifierAndTableName(packet,
+                                               addIfNotExists); // Throws
+        if (streamIdentifier < 0 || tableName.empty())
+        {
+            throw std::runtime_error(
+               "Could not obtain stream identifier in insert");
+        }
+        auto packedData = packData(packet);
+        StagingRow row;
+        row.binaryData = std::move(packedData.binaryData);
+        row.dataTypeSignifier = std::move(packedData.dataTypeSignifier);
+        row.codec = packedData.codec;
+        row.compressed = packedData.compressed;
+        row.startTime = packet.getStartTime().count()*1.e-6;
+        row.endTime = packet.getEndTime().count()*1.e-6;
+        row.samplingRate = packet.getSamplingRate();
+        row.streamIdentifier = streamIdentifier;
+        row.nSamples = static_cast<int> (packet.size());
+        return std::pair {std::move(tableName), std::move(row)};
+    }
+    // Write the packet 
+    void insert(const Packet &packet)
+    {
+        if (packet.empty())
+        {
+            SPDLOG_LOGGER_WARN(mLogger, "Packet has no data - returning");
+            return;
+        }
+        // Ensure we're connected
+        if (!isConnected())
+        {
+            SPDLOG_LOGGER_INFO(mLogger,
+                               "Attempting to reconnect prior to insert...");
+            reconnect(); // Will throw
+        }
+        // Get the stream identifier
+        constexpr bool addIfNotExists{true};
+        auto [streamIdentifier, tableName]
+             = getStreamIdentifierAndTableName(packet, addIfNotExists); // Throws
+        if (streamIdentifier < 0 || tableName.empty()) 
+        {
+            throw std::runtime_error(
+               "Could not obtain stream identifier in insert");
+        }
+
+        auto nSamples = static_cast<int> (packet.size()); 
+        double startTime = packet.getStartTime().count()*1.e-6;
+        double endTime = packet.getEndTime().count()*1.e-6;
+        double samplingRate = packet.getSamplingRate();
+
+        auto [binaryData, dataTypeSignifier, codec, compressed]
+            = packData(packet);
         constexpr bool littleEndian{true}; // Always write as little endian
         //auto castedBinaryData = pqxx::binary_cast(binaryData.data(), hexEncodedData.size());
         //std::cout << "send it again it" << castedBinaryData.size() << std::endl;
-        constexpr std::string_view queryPrefix{"INSERT INTO "};
-        constexpr std::string_view querySuffix{
-        "(stream_identifier, start_time, end_time, sampling_rate, number_of_samples, little_endian, compressed, data_type, data) VALUES($1, TO_TIMESTAMP($2), TO_TIMESTAMP($3), $4, $5, $6, $7, $8, $9) ON CONFLICT DO NOTHING"};
-        std::string insertStatement = std::string {queryPrefix}
-                                    + tableName
-                                    + std::string {querySuffix};
+        auto writeCodec
+            = (mIntegerCodec != WriteClient::IntegerCodec::Zlib);
 
         pqxx::params parameters{
             streamIdentifier,
@@ -690,12 +983,387 @@ R"""(
             compressed,
             std::string {dataTypeSignifier},
             pqxx::binary_cast(binaryData)}; //binaryData.data(), binaryData.size())};
+        if (writeCodec){parameters.append(codec);}
         {
+        std::scoped_lock lock(mDatabaseMutex);
+        auto insertStatement
+            = writeCodec ?
+              mPreparedStatements.get(
+                  *mConnection,
+                  PreparedStatementCache::Kind::InsertWithCodec,
+                  tableName,
+                  ::createInsertWithCodecStatement) :
+              mPreparedStatements.get(*mConnection,
+                                      PreparedStatementCache::Kind::Insert,
+                                      tableName,
+                                      ::createInsertStatement);
         pqxx::work transaction(*mConnection);
-        transaction.exec(insertStatement, parameters); 
+        transaction.exec(pqxx::prepped{insertStatement}, parameters); 
         transaction.commit();
         }
     }
+    // Write a batch of packets.  Packets are grouped by their data table,
+    // COPY'd into a temporary staging table, then merged into the
+    // corresponding data table.  This is one transaction for the batch.
+    // A packet that can't be packed is dropped and counted; the result is
+    // the number of such packets.
+    [[nodiscard]] int insert(std::vector<Packet> &&packets)
+    {
+        if (packets.empty()){return 0;}
+        // Ensure we're connected
+        if (!isConnected())
+        {
+            SPDLOG_LOGGER_INFO(mLogger,
+                               "Attempting to reconnect prior to insert...");
+            reconnect(); // Will throw
+        }
+        // Group by table
+        std::map<std::string, std::vector<StagingRow>> tableToRows;
+        int nFailed{0};
+        for (auto &packet : packets)
+        {
+            if (packet.empty()){continue;}
+            try
+            {
+                auto [tableName, row] = toStagingRow(packet); // Throws
+                tableToRows[tableName].push_back(std::move(row));
+            }
+            catch (const pqxx::broken_connection &)
+            {
+                throw;
+            }
+            catch (const std::exception &e)
+            {
+                SPDLOG_LOGGER_WARN(mLogger, "Failed to pack {} because {}",
+                                   ::toName(packet),
+                                   std::string {e.what()});
+                nFailed = nFailed + 1;
+            }
+        }
+        if (tableToRows.empty()){return nFailed;}
+
+        constexpr bool littleEndian{true}; // Always write as little endian
+        constexpr pqxx::zview createStagingTable
+{
+"CREATE TEMPORARY TABLE IF NOT EXISTS uwave_staging_packets (stream_identifier INTEGER NOT NULL, start_time DOUBLE PRECISION NOT NULL, end_time DOUBLE PRECISION NOT NULL, sampling_rate DOUBLE PRECISION NOT NULL, number_of_samples INTEGER NOT NULL, little_endian BOOLEAN NOT NULL, compressed BOOLEAN NOT NULL, data_type CHARACTER(1) NOT NULL, data BYTEA NOT NULL, codec SMALLINT NOT NULL) ON COMMIT DROP"
+};
+        constexpr pqxx::zview truncateStagingTable
+{
+"TRUNCATE uwave_staging_packets"
+};
+        constexpr std::string_view mergePrefix{"INSERT INTO "};
+        constexpr std::string_view mergeSuffix{
+        "(stream_identifier, start_time, end_time, sampling_rate, number_of_samples, little_endian, compressed, data_type, data) SELECT stream_identifier, TO_TIMESTAMP(start_time), TO_TIMESTAMP(end_time), sampling_rate, number_of_samples, little_endian, compressed, data_type, data FROM uwave_staging_packets ON CONFLICT DO NOTHING"};
+        // Only touch the codec column when we're using it so that tables
+        // that haven't been migrated can still be written
+        constexpr std::string_view mergeWithCodecSuffix{
+        "(stream_identifier, start_time, end_time, sampling_rate, number_of_samples, little_endian, compressed, data_type, data, codec) SELECT stream_identifier, TO_TIMESTAMP(start_time), TO_TIMESTAMP(end_time), sampling_rate, number_of_samples, little_endian, compressed, data_type, data, codec FROM uwave_staging_packets ON CONFLICT DO NOTHING"};
+        auto writeCodec
+            = (mIntegerCodec != WriteClient::IntegerCodec::Zlib);
+        {
+        std::scoped_lock lock(mDatabaseMutex);
+        pqxx::work transaction(*mConnection);
+        transaction.exec(createStagingTable);
+        for (const auto &[tableName, rows] : tableToRows)
+        {
+            {
+            auto stream
+                = pqxx::stream_to::table(transaction,
+                                         {"uwave_staging_packets"},
+                                         {"stream_identifier",
+                                          "start_time",
+                                          "end_time",
+                                          "sampling_rate",
+                                          "number_of_samples",
+                                          "little_endian",
+                                          "compressed",
+                                          "data_type",
+                                          "data",
+                                          "codec"});
+            for (const auto &row : rows)
+            {
+                stream.write_values(row.streamIdentifier,
+                                    row.startTime,
+                                    row.endTime,
+                                    row.samplingRate,
+                                    row.nSamples,
+                                    littleEndian,
+                                    row.compressed,
+                                    row.dataTypeSignifier,
+                                    pqxx::binary_cast(row.binaryData),
+                                    row.codec);
+            }
+            stream.complete();
+            }
+            std::string mergeStatement
+                = std::string {mergePrefix}
+                + tableName
+                + (writeCodec ? std::string {mergeWithCodecSuffix} :
+                                std::string {mergeSuffix});
+            transaction.exec(mergeStatement);
+            transaction.exec(truncateStagingTable);
+        }
+        transaction.commit();
+        }
+        return nFailed;
+    }
+    // Opens the pipeline connection if necessary.  This must be called
+    // while holding mDatabaseMutex.
+    [[nodiscard]] PGconn *getPipelineConnection()
+    {
+        if (mPipelineConnection &&
+            PQstatus(mPipelineConnection.get()) == CONNECTION_OK)
+        {
+            return mPipelineConnection.get();
+        }
+        mPipelineStatements.clear();
+        mPipelineConnection.reset(
+            PQconnectdb(mCredentials.getConnectionString()));
+        if (mPipelineConnection == nullptr ||
+            PQstatus(mPipelineConnection.get()) != CONNECTION_OK)
+        {
+            throw pqxx::broken_connection(
+                "Failed to open pipeline connection to "
+              + mCredentials.getDatabaseName()
+              + " at " + mCredentials.getHost() + ": "
+              + ::toErrorMessage(
+                    PQerrorMessage(mPipelineConnection.get())));
+        }
+        auto schema = mCredentials.getSchema();
+        if (!schema.empty())
+        {
+            std::string query = "SET search_path TO " + schema;
+            ::LibpqResult result{PQexec(mPipelineConnection.get(),
+                                        query.c_str())};
+            if (PQresultStatus(result.get()) != PGRES_COMMAND_OK)
+            {
+                throw std::runtime_error(
+                    "Failed to set search path on pipeline connection: "
+                  + ::toErrorMessage(PQresultErrorMessage(result.get())));
+            }
+        }
+        return mPipelineConnection.get();
+    }
+    // Write packets with up to maximumInFlight prepared INSERTs outstanding
+    // on the pipeline connection.  Each INSERT is followed by a sync so it
+    // commits, or fails, on its own.  Hence, a rejected packet never takes
+    // down the others and nothing has to be resent.  The result indicates,
+    // for each input packet, whether it failed.
+    [[nodiscard]] std::vector<bool>
+        insertPipelined(const std::vector<Packet> &packets,
+                        const std::vector<bool> &skip,
+                        const int maximumInFlight)
+    {
+#ifndef NDEBUG
+        assert(packets.size() == skip.size());
+#endif
+        std::vector<bool> failed(packets.size(), false);
+        if (packets.empty()){return failed;}
+#ifndef LIBPQ_HAS_PIPELINING
+        throw std::runtime_error("Pipelined writes require libpq 14 or newer");
+#else
+        // Ensure we're connected
+        if (!isConnected())
+        {
+            SPDLOG_LOGGER_INFO(mLogger,
+                               "Attempting to reconnect prior to insert...");
+            reconnect(); // Will throw
+        }
+        // Pack everything up front.  A packet we can't pack only fails
+        // itself.
+        std::vector<std::pair<std::string, StagingRow>> rows;
+        std::vector<size_t> rowToPacket;
+        rows.reserve(packets.size());
+        rowToPacket.reserve(packets.size());
+        for (size_t i = 0; i < packets.size(); ++i)
+        {
+            if (skip[i]){continue;}
+            try
+            {
+                rows.push_back(toStagingRow(packets[i]));
+                rowToPacket.push_back(i);
+            }
+            catch (const std::exception &e)
+            {
+                SPDLOG_LOGGER_WARN(mLogger, "Failed to pack {} because {}",
+                                   ::toName(packets[i]),
+                                   std::string {e.what()});
+                failed[i] = true;
+            }
+        }
+        if (rows.empty()){return failed;}
+        const std::string littleEndian{"true"}; // Always write little endian
+        auto writeCodec
+            = (mIntegerCodec != WriteClient::IntegerCodec::Zlib);
+        std::scoped_lock lock(mDatabaseMutex);
+        auto connection = getPipelineConnection(); // Throws
+        // Statements are prepared before entering pipeline mode.  A table
+        // we can't prepare for only fails its packets.
+        std::map<std::string, std::string> tableToStatement;
+        for (const auto &[tableName, row] : rows)
+        {
+            if (tableToStatement.contains(tableName)){continue;}
+            auto prepare = [&](const std::string &name, const std::string &sql)
+            {
+                ::LibpqResult result{PQprepare(connection,
+                                               name.c_str(),
+                                               sql.c_str(),
+                                               0, nullptr)};
+                if (PQresultStatus(result.get()) != PGRES_COMMAND_OK)
+                {
+                    throw std::runtime_error(
+                        ::toErrorMessage(PQresultErrorMessage(result.get())));
+                }
+            };
+            try
+            {
+                tableToStatement[tableName]
+                    = writeCodec ?
+                      mPipelineStatements.get(
+                          PreparedStatementCache::Kind::InsertWithCodec,
+                          tableName,
+                          ::createInsertWithCodecStatement,
+                          prepare) :
+                      mPipelineStatements.get(
+                          PreparedStatementCache::Kind::Insert,
+                          tableName,
+                          ::createInsertStatement,
+                          prepare);
+            }
+            catch (const std::exception &e)
+            {
+                if (PQstatus(connection) != CONNECTION_OK)
+                {
+                    throw pqxx::broken_connection(e.what());
+                }
+                SPDLOG_LOGGER_WARN(mLogger,
+                                   "Failed to prepare insert into {} because {}",
+                                   tableName, std::string {e.what()});
+                tableToStatement[tableName] = std::string {};
+            }
+        }
+        auto throwIfBroken = [&](const std::string &message)
+        {
+            if (PQstatus(connection) != CONNECTION_OK)
+            {
+                throw pqxx::broken_connection(
+                    message + ": "
+                  + ::toErrorMessage(PQerrorMessage(connection)));
+            }
+            throw std::runtime_error(
+                message + ": " + ::toErrorMessage(PQerrorMessage(connection)));
+        };
+        if (PQenterPipelineMode(connection) != 1)
+        {
+            throwIfBroken("Failed to enter pipeline mode");
+        }
+        // The rows whose replies are outstanding
+        std::deque<size_t> inFlight;
+        // Reads the reply to the oldest INSERT and its sync
+        auto readReply = [&]()
+        {
+            const auto iRow = inFlight.front();
+            inFlight.pop_front();
+            ::LibpqResult result{PQgetResult(connection)};
+            if (result == nullptr)
+            {
+                throwIfBroken("Pipelined insert got no reply");
+            }
+            if (PQresultStatus(result.get()) != PGRES_COMMAND_OK)
+            {
+                SPDLOG_LOGGER_WARN(mLogger,
+                    "Failed to insert {} because {}",
+                    ::toName(packets[rowToPacket[iRow]]),
+                    ::toErrorMessage(PQresultErrorMessage(result.get())));
+                failed[rowToPacket[iRow]] = true;
+            }
+            // The INSERT's results end with a null
+            while (::LibpqResult extra{PQgetResult(connection)}){}
+            ::LibpqResult sync{PQgetResult(connection)};
+            if (sync == nullptr ||
+                PQresultStatus(sync.get()) != PGRES_PIPELINE_SYNC)
+            {
+                throwIfBroken("Pipelined insert lost its sync");
+            }
+        };
+        try
+        {
+            for (size_t iRow = 0; iRow < rows.size(); ++iRow)
+            {
+                const auto &[tableName, row] = rows[iRow];
+                const auto &statement = tableToStatement[tableName];
+                if (statement.empty())
+                {
+                    failed[rowToPacket[iRow]] = true;
+                    continue;
+                }
+                // Only wait on the server once the window is full
+                if (static_cast<int> (inFlight.size()) >= maximumInFlight)
+                {
+                    readReply();
+                }
+                // The samples go as binary and the rest as text
+                const std::array<std::string, 8> text
+                {
+                    pqxx::to_string(row.streamIdentifier),
+                    pqxx::to_string(row.startTime),
+                    pqxx::to_string(row.endTime),
+                    pqxx::to_string(row.samplingRate),
+                    pqxx::to_string(row.nSamples),
+                    littleEndian,
+                    pqxx::to_string(row.compressed),
+                    pqxx::to_string(row.codec)
+                };
+                const std::array<const char *, 10> values
+                {
+                    text[0].c_str(), text[1].c_str(), text[2].c_str(),
+                    text[3].c_str(), text[4].c_str(), text[5].c_str(),
+                    text[6].c_str(), row.dataTypeSignifier.c_str(),
+                    row.binaryData.data(), text[7].c_str()
+                };
+                const std::array<int, 10> lengths
+                {
+                    0, 0, 0, 0, 0, 0, 0, 0,
+                    static_cast<int> (row.binaryData.size()), 0
+                };
+                const std::array<int, 10> formats
+                {
+                    0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+                };
+                if (PQsendQueryPrepared(connection,
+                                        statement.c_str(),
+                                        writeCodec ? 10 : 9,
+                                        values.data(),
+                                        lengths.data(),
+                                        formats.data(),
+                                        0) != 1)
+                {
+                    throwIfBroken("Failed to send pipelined insert");
+                }
+                if (PQpipelineSync(connection) != 1)
+                {
+                    throwIfBroken("Failed to sync pipelined insert");
+                }
+                inFlight.push_back(iRow);
+            }
+            while (!inFlight.empty()){readReply();}
+            if (PQexitPipelineMode(connection) != 1)
+            {
+                throwIfBroken("Failed to exit pipeline mode");
+            }
+        }
+        catch (...)
+        {
+            // We don't know where the replies stand so start over next time
+            if (PQstatus(connection) == CONNECTION_OK)
+            {
+                mPipelineConnection = nullptr;
+            }
+            throw;
+        }
+        return failed;
+#endif
+    }
     void getRetentionDuration()
     {
     }
@@ -706,7 +1374,15 @@ R"""(
     mutable std::mutex mShutdownMutex;
     mutable std::map<std::string, std::pair<int, std::string>>
         mStreamToIdentifierAndTableName;
+    // Indexed by stream handle.  An identifier of -1 indicates a miss.
+    mutable std::vector<std::pair<int, std::string>>
+        mHandleToIdentifierAndTableName;
     mutable std::unique_ptr<pqxx::connection> mConnection{nullptr};
+    PreparedStatementCache mPreparedStatements;
+    // pqxx can't send parameters in pipeline mode so pipelined writes go
+    // through their own libpq connection
+    ::LibpqConnection mPipelineConnection{nullptr};
+    PreparedStatementCache mPipelineStatements;
     std::chrono::seconds mRetentionDuration{365*86400}; // TODO look this up from settings
     std::condition_variable mShutdownCondition;
     //    std::chrono::days mRetentionDuration{5}; // TODO
@@ -717,6 +1393,7 @@ R"""(
     int mCompressionLevel{Z_NO_COMPRESSION};
     bool mWriteCompressedData{false};
 #endif
+    WriteClient::IntegerCodec mIntegerCodec{WriteClient::IntegerCodec::Zlib};
     bool mSwapBytes{std::endian::native == std::endian::little ? false : true};
     bool mAmLittleEndian{std::endian::native == std::endian::little ? true : false};
     bool mShutdownRequested{false};
@@ -732,76 +1409,132 @@ WriteClient::WriteClient(const Credentials &credentials,
 /// Destructor
 WriteClient::~WriteClient() = default;
 
-/*
 /// Connected?
 bool WriteClient::isConnected() const noexcept
 {
-     return pImpl->mConnection.isConnected();
+     return pImpl->isConnected();
 }
-*/
 
-/*
 /// Connect
 void WriteClient::connect()
 {
-     //pImpl->mConnection.connect();
+     pImpl->connect();
 }
-*/
 
-/*
 /// Disconnect
 void WriteClient::disconnect()
 {
-            //pImpl->mConnection.disconnect();
+     pImpl->disconnect();
 }
-*/
 
 /// Write the data packet
 void WriteClient::write(const UWaveServer::Packet &packet)
 {
-    if (!packet.hasNetwork())
+    if (!::isWritable(packet, pImpl->mRetentionDuration, pImpl->mLogger))
     {
-        throw std::invalid_argument("Network not set on packet");
-    }
-    if (!packet.hasStation())
-    {
-        throw std::invalid_argument("Station not set on packet");
-    }
-    if (!packet.hasChannel())
-    {
-        throw std::invalid_argument("Channel not set on packet");
+        return;
     }
-    if (!packet.hasSamplingRate())
+    // Try to write it 
+    pImpl->insert(packet);
+}
+
+/// Write the data packets
+int WriteClient::write(std::vector<UWaveServer::Packet> &&packetsIn)
+{
+    // Malformed packets only fail themselves.  This is done in place so
+    // that, should we fail to (re)connect, the caller still has the
+    // remaining packets.
+    int nFailed{0};
+    std::erase_if(packetsIn,
+                  [&](const UWaveServer::Packet &packet)
+                  {
+                      try
+                      {
+                          return !::isWritable(packet,
+                                               pImpl->mRetentionDuration,
+                                               pImpl->mLogger);
+                      }
+                      catch (const std::exception &e)
+                      {
+                          SPDLOG_LOGGER_WARN(pImpl->mLogger,
+                              "Will not write malformed packet because {}",
+                              std::string {e.what()});
+                          nFailed = nFailed + 1;
+                          return true;
+                      }
+                  });
+    // Try to write them
+    nFailed = nFailed + pImpl->insert(std::move(packetsIn));
+    packetsIn.clear();
+    return nFailed;
+}
+
+/// Prepared statement cache hits
+int64_t WriteClient::getPreparedStatementCacheHits() const noexcept
+{
+    return pImpl->mPreparedStatements.hits();
+}
+
+/// Prepared statement cache misses
+int64_t WriteClient::getPreparedStatementCacheMisses() const noexcept
+{
+    return pImpl->mPreparedStatements.misses();
+}
+
+/// Integer codec
+void WriteClient::setIntegerCodec(const IntegerCodec codec) noexcept
+{
+    pImpl->mIntegerCodec = codec;
+}
+
+WriteClient::IntegerCodec WriteClient::getIntegerCodec() const noexcept
+{
+    return pImpl->mIntegerCodec;
+}
+
+/// Pipeline the data packets
+std::vector<bool> WriteClient::writePipelined(
+    const std::vector<UWaveServer::Packet> &packets,
+    const int maximumInFlight)
+{
+    if (maximumInFlight < 1)
     {
-        throw std::invalid_argument("Sampling rate not set on packet");
+        throw std::invalid_argument("maximumInFlight must be positive");
     }
-    if (packet.empty())
+    // Malformed packets only fail themselves.  Empty and expired packets
+    // are skipped just like in write().
+    std::vector<bool> failed(packets.size(), false);
+    std::vector<bool> skip(packets.size(), false);
+    for (size_t i = 0; i < packets.size(); ++i)
     {
-        SPDLOG_LOGGER_WARN(pImpl->mLogger,
-                           "Packet has no data - returning");
-        return;
+        try
+        {
+            skip[i] = !::isWritable(packets[i],
+                                    pImpl->mRetentionDuration,
+                                    pImpl->mLogger);
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_LOGGER_WARN(pImpl->mLogger,
+                               "Will not write malformed packet because {}",
+                               std::string {e.what()});
+            skip[i] = true;
+            failed[i] = true;
+        }
     }
-    if (packet.getDataType() == UWaveServer::Packet::DataType::Unknown)
+    auto insertFailed = pImpl->insertPipelined(packets, skip, maximumInFlight);
+    for (size_t i = 0; i < failed.size(); ++i)
     {
-        throw std::runtime_error("Packet's data type is unknown");
+        failed[i] = failed[i] || insertFailed[i];
     }
-    // Expired data?
-    auto now = std::chrono::high_resolution_clock::now();
-    auto endTime = packet.getEndTime();
-    std::chrono::microseconds oldestAllowableTime
-        = std::chrono::duration_cast<std::chrono::microseconds> 
-          (now.time_since_epoch()) 
-        - std::chrono::duration_cast<std::chrono::microseconds> 
-          (pImpl->mRetentionDuration);
-    if (endTime < oldestAllowableTime)
-    {
-        SPDLOG_LOGGER_WARN(pImpl->mLogger,
-                           "{}'s data has expired; skipping",
-                           ::toName(packet));
-        return;
-    } 
-    // Try to write it 
-    pImpl->insert(packet);
+    return failed;
+}
+
+/// Packet headers
+std::vector<UWaveServer::PacketHeader>
+WriteClient::queryPacketHeaders(const std::chrono::microseconds &startTime) const
+{
+    return pImpl->queryPacketHeaders(startTime);
 }
 
 bool WriteClient::contains(const std::string &networkIn,
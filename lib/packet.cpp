@@ -1,16 +1,25 @@
 #include <iostream>
+#include <array>
 #include <bit>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
 #include <vector>
+#include <optional>
 #include <chrono>
 #include <cmath>
 #include <algorithm>
+#include <type_traits>
 #ifndef NDEBUG
 #include <cassert>
 #endif
 #include <google/protobuf/util/time_util.h>
 #include <libmseed.h>
 #include "uWaveServer/packet.hpp"
+#include "uWaveServer/streamRegistry.hpp"
 #include "uDataPacketServiceAPI/v1/packet.pb.h"
+#include "private/objectPool.hpp"
+#include "private/pack.hpp"
 
 using namespace UWaveServer;
 
@@ -162,60 +171,104 @@ std::string toMiniSEED(const std::vector<Packet> &packets,
     return outputBuffer; 
 }
 
+/// Unpacks the samples straight into the packet's recycled storage so that
+/// steady-state ingestion neither allocates nor copies.
 template<typename T>
-std::vector<T> unpack(const std::string &data, const int nSamples,
-                      const bool swapBytes)
+void unpack(const std::string &data, const int nSamples, Packet *packet)
 {
-    constexpr auto dataTypeSize = sizeof(T);
-    std::vector<T> result;
-    if (nSamples < 1){return result;}
-    if (static_cast<size_t> (nSamples)*dataTypeSize != data.size())
-    {   
-        throw std::invalid_argument("Unexpected data size");
-    }   
-    result.resize(nSamples);
-    // Pack it up
-    union CharacterValueUnion
+    const bool swapBytes
     {   
-        unsigned char cArray[dataTypeSize];
-        T value;
+        std::endian::native == std::endian::little ? false : true
     };  
-    CharacterValueUnion cvUnion;
-    if (!swapBytes)
-    {   
-        for (int i = 0; i < nSamples; ++i)
-        {
-            cvUnion.value = data[i];
-            auto i1 = i*dataTypeSize;
-            auto i2 = i1 + dataTypeSize;
-            std::copy(data.data() + i1, data.data() + i2, 
-                      cvUnion.cArray);
-            result[i] = cvUnion.value;
-        }
-    }   
+    auto samples = packet->resizeData<T> (nSamples);
+    ::unpack<T> (nSamples,
+                 reinterpret_cast<const unsigned char *> (data.data()),
+                 data.size(), swapBytes, samples.data());
+}
+
+/// The most memory the pool's shared list retains.  Typical packets retain
+/// a few kilobytes so this comfortably exceeds the packets in flight between
+/// acquisition and the writers.  Each thread also caches a few packets.
+constexpr size_t MAXIMUM_POOL_BYTES{64*1024*1024};
+/// A recycled sample buffer larger than this is released.  Typical packets
+/// are a few hundred samples.
+constexpr size_t MAXIMUM_RETAINED_SAMPLE_BYTES{64*1024};
+
+template<typename T>
+void recycle(std::vector<T> *samples) noexcept
+{
+    if (samples->capacity()*sizeof(T) > MAXIMUM_RETAINED_SAMPLE_BYTES)
+    {
+        std::vector<T> ().swap(*samples);
+    }
     else
-    {   
-        for (int i = 0; i < nSamples; ++i)
+    {
+        samples->clear();
+    }
+}
+
+/// The longest codes in the FDSN source identifier specification.  The
+/// channel's source and subsource may be several characters so it gets
+/// more room.
+constexpr size_t MAXIMUM_NETWORK_LENGTH{8};
+constexpr size_t MAXIMUM_STATION_LENGTH{8};
+constexpr size_t MAXIMUM_CHANNEL_LENGTH{16};
+constexpr size_t MAXIMUM_LOCATION_CODE_LENGTH{8};
+
+/// The sample buffer is viewed as any of the sample types.
+static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ >= alignof(int64_t) &&
+              __STDCPP_DEFAULT_NEW_ALIGNMENT__ >= alignof(double),
+              "Sample buffer is insufficiently aligned");
+
+/// @brief A string with inline, fixed capacity storage for the SEED codes.
+///        This keeps a packet's network, station, channel, and location code
+///        in the packet rather than behind four heap pointers.
+template<size_t N>
+class InlineString
+{
+public:
+    static_assert(N <= 255, "Length must fit in a byte");
+    /// @throws std::invalid_argument if the string exceeds the capacity.
+    void assign(const std::string_view value, const char *name)
+    {
+        if (value.size() > N)
         {
-            cvUnion.value = data[i];
-            auto i1 = i*dataTypeSize;
-            auto i2 = i1 + dataTypeSize;
-            std::reverse_copy(data.data() + i1, data.data() + i2, 
-                              cvUnion.cArray);
-            result[i] = cvUnion.value;
+            throw std::invalid_argument(std::string {name} + " "
+                                      + std::string {value}
+                                      + " exceeds "
+                                      + std::to_string(N) + " characters");
         }
-    }   
-    return result;
-}
+        std::copy(value.begin(), value.end(), mData.begin());
+        mSize = static_cast<uint8_t> (value.size());
+    }
+    [[nodiscard]] std::string_view view() const noexcept
+    {
+        return std::string_view {mData.data(), mSize};
+    }
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return mSize == 0;
+    }
+    void clear() noexcept
+    {
+        mSize = 0;
+    }
+private:
+    std::array<char, N> mData;
+    uint8_t mSize{0};
+};
 
+/// The pool is intentionally leaked so that packets with static storage
+/// duration can be safely destroyed at exit.
 template<typename T>
-std::vector<T> unpack(const std::string &data, const int nSamples)
+[[nodiscard]] ObjectPool<T> &getPool()
 {
-    const bool swapBytes
-    {   
-        std::endian::native == std::endian::little ? false : true
-    };  
-    return unpack<T>(data, nSamples, swapBytes);
+    static auto pool = new ObjectPool<T> (MAXIMUM_POOL_BYTES,
+                                          [](const T &object)
+                                          {
+                                              return object.getRetainedBytes();
+                                          });
+    return *pool;
 }
 
 }
@@ -223,119 +276,102 @@ std::vector<T> unpack(const std::string &data, const int nSamples)
 class Packet::PacketImpl
 {
 public:
-    [[nodiscard]] int size() const
+    [[nodiscard]] int size() const noexcept
     {
-        if (mDataType == Packet::DataType::Unknown)
-        {
-            return 0;
-        }
-        else if (mDataType == Packet::DataType::Integer32)
-        {
-            return static_cast<int> (mInteger32Data.size());
-        }
-        else if (mDataType == Packet::DataType::Float)
-        {
-            return static_cast<int> (mFloatData.size());
-        }
-        else if (mDataType == Packet::DataType::Double)
-        {
-            return static_cast<int> (mDoubleData.size());
-        }
-        else if (mDataType == Packet::DataType::Integer64)
-        {
-            return static_cast<int> (mInteger64Data.size());
-        }
-        else if (mDataType == Packet::DataType::Text)
-        {
-            return static_cast<int> (mTextData.size());
-        }
-#ifndef NDEBUG
-        assert(false);
-#else
-        throw std::runtime_error("Unhandled data type in packet impl size");
-#endif
+        return mNumberOfSamples;
     }
-    [[nodiscard]] bool isEmpty() const
+    [[nodiscard]] bool isEmpty() const noexcept
     {
-        if (mDataType == Packet::DataType::Unknown)
-        {
-            return true;
-        }
-        else if (mDataType == Packet::DataType::Integer32)
-        {
-            return mInteger32Data.empty();
-        }
-        else if (mDataType == Packet::DataType::Float)
-        {
-            return mFloatData.empty();
-        }
-        else if (mDataType == Packet::DataType::Double)
-        {
-            return mDoubleData.empty();
-        }
-        else if (mDataType == Packet::DataType::Integer64)
-        {
-            return mInteger64Data.empty();
-        }
-        else if (mDataType == Packet::DataType::Text)
-        {
-            return mTextData.empty();
-        }
-#ifndef NDEBUG
-        assert(false);
-#else
-        throw std::runtime_error("Unhandled data type in packet impl isEmpty");
-#endif
+        return mNumberOfSamples == 0;
+    }
+    /// @result The memory this holds, i.e., what pooling it retains.
+    [[nodiscard]] size_t getRetainedBytes() const noexcept
+    {
+        return sizeof(PacketImpl) + mSamples.capacity();
     }
-    void clearData()
+    /// Resets the packet while keeping its sample buffer's capacity.
+    void recycle() noexcept
     {
-        mInteger32Data.clear();
-        mInteger64Data.clear();
-        mFloatData.clear();
-        mDoubleData.clear();
-        mTextData.clear();
+        mNetwork.clear();
+        mStation.clear();
+        mChannel.clear();
+        mLocationCode.clear();
+        ::recycle(&mSamples);
+        mStartTimeMicroSeconds = std::chrono::microseconds {0};
+        mEndTimeMicroSeconds = std::chrono::microseconds {0};
+        mDataHash.reset();
+        mSamplingRate = 0;
+        mStreamHandle = 0;
+        mNumberOfSamples = 0;
         mDataType = Packet::DataType::Unknown;
+        mHaveLocationCode = false;
+        mHaveStreamHandle = false;
     }
-    void setData(std::vector<int> &&data)
+    /// The samples are only meaningful when U matches the data type.
+    template<typename U>
+    [[nodiscard]] const U *getSamples() const noexcept
     {
-        if (data.empty()){return;}
-        clearData();
-        mInteger32Data = std::move(data); 
-        mDataType = Packet::DataType::Integer32;
-        updateEndTime();
+        return reinterpret_cast<const U *> (mSamples.data());
     }
-    void setData(std::vector<float> &&data)
-    {   
-        if (data.empty()){return;}
-        clearData();
-        mFloatData = std::move(data); 
-        mDataType = Packet::DataType::Float;
-        updateEndTime();
+    template<typename U>
+    [[nodiscard]] static constexpr Packet::DataType toDataType() noexcept
+    {
+        if constexpr (std::is_same_v<U, int>){return Packet::DataType::Integer32;}
+        else if constexpr (std::is_same_v<U, int64_t>){return Packet::DataType::Integer64;}
+        else if constexpr (std::is_same_v<U, float>){return Packet::DataType::Float;}
+        else if constexpr (std::is_same_v<U, double>){return Packet::DataType::Double;}
+        else
+        {
+            static_assert(std::is_same_v<U, char>, "Unhandled sample type");
+            return Packet::DataType::Text;
+        }
     }
-    void setData(std::vector<double> &&data)
-    {   
-        if (data.empty()){return;}
+    /// Copies the samples into the (possibly recycled) sample buffer.
+    template<typename U>
+    void assignData(const int nSamples, const U *data)
+    {
         clearData();
-        mDoubleData = std::move(data); 
-        mDataType = Packet::DataType::Double;
+        if (nSamples < 1){return;}
+        auto bytes = reinterpret_cast<const std::byte *> (data);
+        mSamples.assign(bytes, bytes + static_cast<size_t> (nSamples)*sizeof(U));
+        mNumberOfSamples = nSamples;
+        mDataType = toDataType<U> ();
         updateEndTime();
     }
-    void setData(std::vector<int64_t> &&data)
-    {   
-        if (data.empty()){return;}
+    /// Sizes the (possibly recycled) sample buffer for nSamples samples.
+    template<typename U>
+    [[nodiscard]] U *resizeData(const int nSamples)
+    {
         clearData();
-        mInteger64Data = std::move(data); 
-        mDataType = Packet::DataType::Integer64;
+        mSamples.resize(static_cast<size_t> (nSamples)*sizeof(U));
+        mNumberOfSamples = nSamples;
+        mDataType = toDataType<U> ();
         updateEndTime();
-    }   
-    void setData(std::vector<char> &&data)
-    {   
-        if (data.empty()){return;}
-        clearData();
-        mTextData = std::move(data); 
-        mDataType = Packet::DataType::Text;
+        return reinterpret_cast<U *> (mSamples.data());
+    }
+    /// Keeps the samples in [iStart, iEnd) without reallocating.
+    void trimData(const int iStart, const int iEnd)
+    {
+        auto bytesPerSample = mSamples.size()/static_cast<size_t> (mNumberOfSamples);
+        auto nBytes = static_cast<size_t> (iEnd - iStart)*bytesPerSample;
+        if (iStart > 0)
+        {
+            std::memmove(mSamples.data(),
+                         mSamples.data() + static_cast<size_t> (iStart)*bytesPerSample,
+                         nBytes);
+        }
+        mSamples.resize(nBytes);
+        mNumberOfSamples = iEnd - iStart;
+        mDataHash.reset();
         updateEndTime();
-    }   
+    }
+    void clearData() noexcept
+    {
+        mSamples.clear();
+        mDataHash.reset();
+        mNumberOfSamples = 0;
+        mDataType = Packet::DataType::Unknown;
+    }
     void updateEndTime()
     {
         mEndTimeMicroSeconds = mStartTimeMicroSeconds;
@@ -349,25 +385,27 @@ public:
             mEndTimeMicroSeconds = mStartTimeMicroSeconds + traceDurationMuS;
         }
     }
-    std::string mNetwork;
-    std::string mStation;
-    std::string mChannel;
-    std::string mLocationCode;
-    std::vector<int> mInteger32Data;
-    std::vector<int64_t> mInteger64Data;
-    std::vector<float> mFloatData;
-    std::vector<double> mDoubleData;
-    std::vector<char> mTextData;
+    // The samples of any data type share one buffer so a recycled packet
+    // keeps its capacity regardless of the next packet's data type.
+    std::vector<std::byte> mSamples;
     std::chrono::microseconds mStartTimeMicroSeconds{0};
     std::chrono::microseconds mEndTimeMicroSeconds{0};
+    std::optional<uint64_t> mDataHash;
     double mSamplingRate{0};
+    uint32_t mStreamHandle{0};
+    int mNumberOfSamples{0};
+    ::InlineString<MAXIMUM_NETWORK_LENGTH> mNetwork;
+    ::InlineString<MAXIMUM_STATION_LENGTH> mStation;
+    ::InlineString<MAXIMUM_CHANNEL_LENGTH> mChannel;
+    ::InlineString<MAXIMUM_LOCATION_CODE_LENGTH> mLocationCode;
     Packet::DataType mDataType{Packet::DataType::Unknown};
     bool mHaveLocationCode{false};
+    bool mHaveStreamHandle{false};
 };
 
 /// Constructor
 Packet::Packet() :
-    pImpl(std::make_unique<PacketImpl> ())
+    pImpl(::getPool<PacketImpl> ().acquire())
 {
 }
 
@@ -387,30 +425,54 @@ Packet::Packet(Packet &&packet) noexcept
 Packet& Packet::operator=(const Packet &packet)
 {
     if (&packet == this){return *this;}
-    pImpl = std::make_unique<PacketImpl> (*packet.pImpl);
+    // Copying into existing storage reuses its capacity
+    if (pImpl == nullptr){pImpl = ::getPool<PacketImpl> ().acquire();}
+    *pImpl = *packet.pImpl;
     return *this;
 }
 
 /// Reset class
 void Packet::clear() noexcept
 {
-    pImpl = std::make_unique<PacketImpl> ();
+    if (pImpl == nullptr)
+    {
+        pImpl = ::getPool<PacketImpl> ().acquire();
+        return;
+    }
+    pImpl->recycle();
 }
 
 /// Move assignment
 Packet& Packet::operator=(Packet &&packet) noexcept
 {
     if (&packet == this){return *this;}
+    if (pImpl != nullptr)
+    {
+        pImpl->recycle();
+        ::getPool<PacketImpl> ().release(std::move(pImpl));
+    }
     pImpl = std::move(packet.pImpl);
     return *this;
 }
 
+/// Pool statistics
+Packet::PoolStatistics Packet::getPoolStatistics() noexcept
+{
+    const auto &pool = ::getPool<PacketImpl> ();
+    PoolStatistics statistics;
+    statistics.hits = pool.getHits();
+    statistics.misses = pool.getMisses();
+    statistics.size = pool.size();
+    return statistics;
+}
+
 /// Network
 void Packet::setNetwork(const std::string &stringIn)
 {
-    auto s = ::convertString(stringIn); 
+    auto s = ::convertString(stringIn);
     if (s.empty()){throw std::invalid_argument("Network is empty");}
-    pImpl->mNetwork = s;
+    pImpl->mNetwork.assign(s, "Network");
+    pImpl->mHaveStreamHandle = false;
 }
 
 std::string Packet::getNetwork() const
@@ -418,13 +480,13 @@ std::string Packet::getNetwork() const
     return std::string {getNetworkReference()};
 }
 
-const std::string &Packet::getNetworkReference() const
+std::string_view Packet::getNetworkReference() const
 {
     if (!hasNetwork())
     {
         throw std::runtime_error("Network code not set");
     }
-    return *&pImpl->mNetwork;
+    return pImpl->mNetwork.view();
 }
 
 
@@ -438,7 +500,8 @@ void Packet::setStation(const std::string &stringIn)
 {
     auto s = ::convertString(stringIn);
     if (s.empty()){throw std::invalid_argument("Station is empty");}
-    pImpl->mStation = s;
+    pImpl->mStation.assign(s, "Station");
+    pImpl->mHaveStreamHandle = false;
 }
 
 std::string Packet::getStation() const
@@ -446,13 +509,13 @@ std::string Packet::getStation() const
     return std::string {getStationReference()};
 }
 
-const std::string &Packet::getStationReference() const
+std::string_view Packet::getStationReference() const
 {
     if (!hasStation())
     {   
         throw std::runtime_error("Station name not set");
     }
-    return *&pImpl->mStation;
+    return pImpl->mStation.view();
 }
 
 bool Packet::hasStation() const noexcept
@@ -463,9 +526,10 @@ bool Packet::hasStation() const noexcept
 /// Channel
 void Packet::setChannel(const std::string &stringIn)
 {
-    auto s = ::convertString(stringIn); 
+    auto s = ::convertString(stringIn);
     if (s.empty()){throw std::invalid_argument("Channel is empty");}
-    pImpl->mChannel = s;
+    pImpl->mChannel.assign(s, "Channel");
+    pImpl->mHaveStreamHandle = false;
 }
 
 std::string Packet::getChannel() const
@@ -473,13 +537,13 @@ std::string Packet::getChannel() const
     return std::string {getChannelReference()};
 } 
 
-const std::string &Packet::getChannelReference() const
+std::string_view Packet::getChannelReference() const
 {
     if (!hasChannel())
     {
         throw std::runtime_error("Channel code not set");
     }
-    return *&pImpl->mChannel;
+    return pImpl->mChannel.view();
 }
 
 bool Packet::hasChannel() const noexcept
@@ -490,8 +554,9 @@ bool Packet::hasChannel() const noexcept
 /// Location code
 void Packet::setLocationCode(const std::string &stringIn)
 {
-    pImpl->mLocationCode = ::convertString(stringIn); 
+    pImpl->mLocationCode.assign(::convertString(stringIn), "Location code");
     pImpl->mHaveLocationCode = true;
+    pImpl->mHaveStreamHandle = false;
 }
 
 std::string Packet::getLocationCode() const
@@ -499,13 +564,13 @@ std::string Packet::getLocationCode() const
     return std::string {getLocationCodeReference()};
 }
 
-const std::string &Packet::getLocationCodeReference() const
+std::string_view Packet::getLocationCodeReference() const
 {
     if (!hasLocationCode())
     {
         throw std::runtime_error("Location code not set");
     }
-    return *&pImpl->mLocationCode;
+    return pImpl->mLocationCode.view();
 }
 
 bool Packet::hasLocationCode() const noexcept
@@ -513,6 +578,28 @@ bool Packet::hasLocationCode() const noexcept
     return pImpl->mHaveLocationCode;
 }
 
+/// Stream handle
+uint32_t Packet::assignStreamHandle()
+{
+    pImpl->mStreamHandle = StreamRegistry::getInstance().intern(*this);
+    pImpl->mHaveStreamHandle = true;
+    return pImpl->mStreamHandle;
+}
+
+uint32_t Packet::getStreamHandle() const
+{
+    if (!hasStreamHandle())
+    {
+        throw std::runtime_error("Stream handle not assigned");
+    }
+    return pImpl->mStreamHandle;
+}
+
+bool Packet::hasStreamHandle() const noexcept
+{
+    return pImpl->mHaveStreamHandle;
+}
+
 /// Sampling rate
 void Packet::setSamplingRate(const double samplingRate) 
 {
@@ -579,80 +666,42 @@ std::vector<U> Packet::getData() const
 {
     std::vector<U> result;
     if (empty()){return result;}
-    result.resize(size());
-    auto dataType = getDataType();
-    if (dataType == Packet::DataType::Integer32)
-    {
-        std::copy(pImpl->mInteger32Data.begin(),
-                  pImpl->mInteger32Data.end(),
-                  result.begin());
-    }
-    else if (dataType == Packet::DataType::Float)
-    {
-        std::copy(pImpl->mFloatData.begin(),
-                  pImpl->mFloatData.end(),
-                  result.begin());
-    }
-    else if (dataType == Packet::DataType::Double)
-    {
-        std::copy(pImpl->mDoubleData.begin(),
-                  pImpl->mDoubleData.end(),
-                  result.begin());
-    }
-    else if (dataType == Packet::DataType::Integer64)
-    {
-        std::copy(pImpl->mInteger64Data.begin(),
-                  pImpl->mInteger64Data.end(),
-                  result.begin());
-    }
-    else if (dataType == Packet::DataType::Text)
-    {
-        std::copy(pImpl->mTextData.begin(),
-                  pImpl->mTextData.end(),
-                  result.begin());
-    }
-    else
+    visitData([&result](const auto samples)
+              {
+                  result.assign(samples.begin(), samples.end());
+              });
+    return result;
+}
+
+/// Data view
+template<typename U>
+std::span<const U> Packet::getDataView() const
+{
+    if (empty()){return std::span<const U> {};}
+    if (getDataType() != PacketImpl::toDataType<U> ())
     {
-#ifndef NDEBUG
-        assert(false);
-#endif
-        constexpr U zero{0};
-        std::fill(result.begin(), result.end(), zero); 
+        throw std::invalid_argument(
+            "Requested sample type does not match packet's data type");
     }
-    return result;
+    return std::span<const U> {pImpl->getSamples<U> (),
+                               static_cast<size_t> (size())};
 }
 
 const void* Packet::data() const noexcept 
 {
     if (empty()){return nullptr;}
-    auto dataType = getDataType();
-    if (dataType == Packet::DataType::Integer32)
-    {
-        return pImpl->mInteger32Data.data();
-    }
-    else if (dataType == Packet::DataType::Float)
-    {
-        return pImpl->mFloatData.data();
-    }
-    else if (dataType == Packet::DataType::Double)
-    {
-        return pImpl->mDoubleData.data();
-    }
-    else if (dataType == Packet::DataType::Integer64)
-    {
-        return pImpl->mInteger64Data.data();
-    }
-    else if (dataType  == Packet::DataType::Unknown)
-    {
-        return nullptr;
-    }
-#ifndef NDEBUG
-    else 
-    {
-        assert(false);
-    }
-#endif
-    return nullptr;
+    return pImpl->mSamples.data();
+}
+
+/// Data hash
+void Packet::setDataHash(const uint64_t hash) noexcept
+{
+    pImpl->mDataHash = hash;
+}
+
+std::optional<uint64_t> Packet::getDataHash() const noexcept
+{
+    return pImpl->mDataHash;
 }
 
 /// Data type
@@ -676,27 +725,36 @@ void Packet::setData(const int nSamples, const U *data)
         throw std::invalid_argument("No data samples");
     }
     if (data == nullptr){throw std::invalid_argument("data is null");}
-    std::vector<U> dataVector{data, data + nSamples};
-    pImpl->setData(std::move(dataVector));
+    pImpl->assignData(nSamples, data);
 }
 
 template<typename U>
-void Packet::setData(std::vector<U> &&data)
+void Packet::setData(const std::vector<U> &data)
 {
     if (data.empty()){throw std::invalid_argument("No data samples");}
-    pImpl->setData(std::move(data));
+    pImpl->assignData(static_cast<int> (data.size()), data.data());
 }
 
 template<typename U>
-void Packet::setData(const std::vector<U> &data)
+std::span<U> Packet::resizeData(const int nSamples)
 {
-    if (data.empty()){throw std::invalid_argument("No data samples");}
-    auto dataCopy = data;
-    setData(std::move(dataCopy));
+    if (nSamples < 1)
+    {
+        throw std::invalid_argument("No data samples");
+    }
+    return std::span<U> {pImpl->resizeData<U> (nSamples),
+                         static_cast<size_t> (nSamples)};
 }
 
 /// Destructor
-Packet::~Packet() = default;
+Packet::~Packet()
+{
+    if (pImpl != nullptr)
+    {
+        pImpl->recycle();
+        ::getPool<PacketImpl> ().release(std::move(pImpl));
+    }
+}
 
 /// Trim
 void Packet::trim(const double startTime, const double endTime)
@@ -755,44 +813,7 @@ void Packet::trim(const std::chrono::microseconds &startTime,
     {
         if (iStart < iEnd)
         {
-            auto dataType = getDataType();
-            if (dataType == Packet::DataType::Integer32)
-            {
-                std::vector<int> work(pImpl->mInteger32Data.data() + iStart, 
-                                      pImpl->mInteger32Data.data() + iEnd);
-                setData(std::move(work));
-            }
-            else if (dataType == Packet::DataType::Integer64)
-            {
-                std::vector<int64_t> work(pImpl->mInteger64Data.data() + iStart,
-                                          pImpl->mInteger64Data.data() + iEnd);
-                setData(std::move(work));
-            }
-            else if (dataType == Packet::DataType::Double)
-            {
-                std::vector<double> work(pImpl->mDoubleData.data() + iStart,
-                                         pImpl->mDoubleData.data() + iEnd);
-                setData(std::move(work));
-            }
-            else if (dataType == Packet::DataType::Float)
-            {
-                std::vector<float> work(pImpl->mFloatData.data() + iStart,
-                                        pImpl->mFloatData.data() + iEnd);
-                setData(std::move(work));
-            }
-            else if (dataType == Packet::DataType::Text)
-            {
-                std::vector<char> work(pImpl->mTextData.data() + iStart,
-                                       pImpl->mTextData.data() + iEnd);
-            }
-            else
-            {
-#ifndef NDEBUG
-                assert(false);
-#else
-                throw std::runtime_error("Unhandled precision in trim");
-#endif
-            }
+            pImpl->trimData(iStart, iEnd);
         }
         else
         {
@@ -853,29 +874,27 @@ UWaveServer::Packet UWaveServer::fromGRPC(
     auto dataType = packet.data_type();
     if (dataType == UDataPacketServiceAPI::V1::DATA_TYPE_INTEGER_32)
     {
-        auto samples = ::unpack<int32_t> (packet.data(), nSamples);
-        result.setData(std::move(samples));
+        ::unpack<int32_t> (packet.data(), nSamples, &result);
     }
     else if (dataType == UDataPacketServiceAPI::V1::DATA_TYPE_INTEGER_64)
     {
-        auto samples = ::unpack<int64_t> (packet.data(), nSamples);
-        result.setData(std::move(samples));
+        ::unpack<int64_t> (packet.data(), nSamples, &result);
     }
     else if (dataType == UDataPacketServiceAPI::V1::DATA_TYPE_DOUBLE)
     {
-        auto samples = ::unpack<double> (packet.data(), nSamples);
-        result.setData(std::move(samples));
+        ::unpack<double> (packet.data(), nSamples, &result);
     }
     else if (dataType == UDataPacketServiceAPI::V1::DATA_TYPE_FLOAT)
     {
-        auto samples = ::unpack<float> (packet.data(), nSamples);
-        result.setData(std::move(samples));
+        ::unpack<float> (packet.data(), nSamples, &result);
     }
     else if (dataType == UDataPacketServiceAPI::V1::DATA_TYPE_TEXT)
     {
-        std::vector<char> data(nSamples);
-        std::copy(packet.data().begin(), packet.data().end(), data.begin());
-        result.setData(std::move(data));
+        if (static_cast<size_t> (nSamples) != packet.data().size())
+        {
+            throw std::invalid_argument("Unexpected data size");
+        }
+        result.setData(nSamples, packet.data().data());
     }
     else
     {
@@ -885,6 +904,12 @@ UWaveServer::Packet UWaveServer::fromGRPC(
         }
         throw std::invalid_argument("Unhandled data type");
     }
+    // The hash is of the little-endian bytes which are only our samples'
+    // bytes on a little-endian machine
+    if (packet.has_data_hash() && std::endian::native == std::endian::little)
+    {
+        result.setDataHash(packet.data_hash());
+    }
     return result;
 }
 
@@ -897,18 +922,23 @@ template void Packet::setData(const int nSamples, const float *data);
 template void Packet::setData(const int nSamples, const double *data);
 template void Packet::setData(const int nSamples, const int64_t *data);
 template void Packet::setData(const int nSamples, const char *data);
-template void Packet::setData(std::vector<int> &&data);
-template void Packet::setData(std::vector<float> &&data);
-template void Packet::setData(std::vector<double> &&data);
-template void Packet::setData(std::vector<int64_t> &&data);
-template void Packet::setData(std::vector<char> &&data);
 template void Packet::setData(const std::vector<int> &data);
 template void Packet::setData(const std::vector<float> &data);
 template void Packet::setData(const std::vector<double> &data);
 template void Packet::setData(const std::vector<int64_t> &data);
 template void Packet::setData(const std::vector<char> &data);
+template std::span<int> Packet::resizeData(int nSamples);
+template std::span<float> Packet::resizeData(int nSamples);
+template std::span<double> Packet::resizeData(int nSamples);
+template std::span<int64_t> Packet::resizeData(int nSamples);
+template std::span<char> Packet::resizeData(int nSamples);
 template std::vector<int> Packet::getData() const;
 template std::vector<float> Packet::getData() const;
 template std::vector<double> Packet::getData() const;
 template std::vector<int64_t> Packet::getData() const;
 template std::vector<char> Packet::getData() const;
+template std::span<const int> Packet::getDataView() const;
+template std::span<const float> Packet::getDataView() const;
+template std::span<const double> Packet::getDataView() const;
+template std::span<const int64_t> Packet::getDataView() const;
+template std::span<const char> Packet::getDataView() const;
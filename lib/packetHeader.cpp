@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "uWaveServer/packetHeader.hpp"
+#include "private/checksum.hpp"
+
+using namespace UWaveServer;
+
+namespace
+{
+
+// Snapshot layout:
+//   [magic (8 bytes)][version (4 bytes)][checksum (4 bytes)]
+//   [number of headers (8 bytes)][payload length (8 bytes)][payload]
+// Header layout in the payload:
+//   [network][station][channel][location code]
+//   [start time (8 bytes)][end time (8 bytes)][sampling rate (8 bytes)]
+//   [number of samples (4 bytes)]
+// where strings are a 1 byte length followed by the characters.  Values
+// are in native byte order since the snapshot never leaves this machine.
+constexpr std::string_view MAGIC{"UWSSNAPS"};
+constexpr uint32_t VERSION{1};
+constexpr size_t SNAPSHOT_HEADER_SIZE{32};
+
+template<typename T>
+void append(std::vector<char> *buffer, const T &value)
+{
+    auto offset = buffer->size();
+    buffer->resize(offset + sizeof(T));
+    std::memcpy(buffer->data() + offset, &value, sizeof(T));
+}
+
+void append(std::vector<char> *buffer, const std::string &value)
+{
+    if (value.size() > 255)
+    {
+        throw std::invalid_argument("String " + value + " is too long");
+    }
+    append(buffer, static_cast<uint8_t> (value.size()));
+    buffer->insert(buffer->end(), value.begin(), value.end());
+}
+
+template<typename T>
+[[nodiscard]] T readValue(const char *data, const size_t length, size_t *offset)
+{
+    if (*offset + sizeof(T) > length)
+    {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    T value;
+    std::memcpy(&value, data + *offset, sizeof(T));
+    *offset = *offset + sizeof(T);
+    return value;
+}
+
+[[nodiscard]] std::string readString(const char *data, const size_t length,
+                                     size_t *offset)
+{
+    auto stringLength = ::readValue<uint8_t> (data, length, offset);
+    if (*offset + stringLength > length)
+    {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    std::string result(data + *offset, stringLength);
+    *offset = *offset + stringLength;
+    return result;
+}
+
+[[nodiscard]] std::string toErrorMessage(const std::string &message,
+                                         const std::filesystem::path &path)
+{
+    return message + " " + path.string() + " because "
+         + std::string {std::strerror(errno)};
+}
+
+/// Unmaps and closes the file when it goes out of scope.
+struct MappedFile
+{
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile& operator=(const MappedFile &) = delete;
+    ~MappedFile()
+    {
+        if (map != nullptr){::munmap(map, size);}
+        if (fd >= 0){::close(fd);}
+    }
+    char *map{nullptr};
+    size_t size{0};
+    int fd{-1};
+};
+
+}
+
+/// Write the snapshot
+void UWaveServer::writePacketHeaderSnapshot(
+    const std::vector<PacketHeader> &headers,
+    const std::filesystem::path &fileName)
+{
+    std::vector<char> payload;
+    payload.reserve(64*headers.size());
+    for (const auto &header : headers)
+    {
+        ::append(&payload, header.network);
+        ::append(&payload, header.station);
+        ::append(&payload, header.channel);
+        ::append(&payload, header.locationCode);
+        ::append(&payload, static_cast<int64_t> (header.startTime.count()));
+        ::append(&payload, static_cast<int64_t> (header.endTime.count()));
+        ::append(&payload, header.samplingRate);
+        ::append(&payload, static_cast<int32_t> (header.numberOfSamples));
+    }
+    if (fileName.has_parent_path() &&
+        !std::filesystem::exists(fileName.parent_path()))
+    {
+        std::filesystem::create_directories(fileName.parent_path());
+    }
+    auto temporaryFileName = fileName;
+    temporaryFileName += ".tmp";
+    {
+    ::MappedFile file;
+    file.size = SNAPSHOT_HEADER_SIZE + payload.size();
+    file.fd = ::open(temporaryFileName.c_str(),
+                     O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     S_IRUSR | S_IWUSR);
+    if (file.fd < 0)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to open",
+                                                  temporaryFileName));
+    }
+    if (::ftruncate(file.fd, static_cast<off_t> (file.size)) != 0)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to size",
+                                                  temporaryFileName));
+    }
+    auto map = ::mmap(nullptr, file.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      file.fd, 0);
+    if (map == MAP_FAILED)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to map",
+                                                  temporaryFileName));
+    }
+    file.map = static_cast<char *> (map);
+    auto nHeaders = static_cast<uint64_t> (headers.size());
+    auto payloadLength = static_cast<uint64_t> (payload.size());
+    auto checksum = ::checksum(payload.data(), payload.size());
+    std::memcpy(file.map, MAGIC.data(), MAGIC.size());
+    std::memcpy(file.map + 8, &VERSION, sizeof(uint32_t));
+    std::memcpy(file.map + 12, &checksum, sizeof(uint32_t));
+    std::memcpy(file.map + 16, &nHeaders, sizeof(uint64_t));
+    std::memcpy(file.map + 24, &payloadLength, sizeof(uint64_t));
+    if (!payload.empty())
+    {
+        std::memcpy(file.map + SNAPSHOT_HEADER_SIZE,
+                    payload.data(), payload.size());
+    }
+    // The snapshot must be on disk before it replaces the old one
+    if (::msync(file.map, file.size, MS_SYNC) != 0)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to sync",
+                                                  temporaryFileName));
+    }
+    }
+    std::filesystem::rename(temporaryFileName, fileName);
+}
+
+/// Read the snapshot
+std::vector<PacketHeader>
+UWaveServer::readPacketHeaderSnapshot(const std::filesystem::path &fileName)
+{
+    ::MappedFile file;
+    file.fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to open", fileName));
+    }
+    struct stat status;
+    if (::fstat(file.fd, &status) != 0)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to stat", fileName));
+    }
+    file.size = static_cast<size_t> (status.st_size);
+    if (file.size < SNAPSHOT_HEADER_SIZE)
+    {
+        throw std::runtime_error(fileName.string() + " is too small");
+    }
+    auto map = ::mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+    if (map == MAP_FAILED)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to map", fileName));
+    }
+    file.map = static_cast<char *> (map);
+    if (std::string_view {file.map, MAGIC.size()} != MAGIC)
+    {
+        throw std::runtime_error(fileName.string() + " is not a snapshot");
+    }
+    size_t offset{MAGIC.size()};
+    auto version = ::readValue<uint32_t> (file.map, file.size, &offset);
+    if (version != VERSION)
+    {
+        throw std::runtime_error("Unsupported snapshot version "
+                               + std::to_string(version));
+    }
+    auto checksum = ::readValue<uint32_t> (file.map, file.size, &offset);
+    auto nHeaders = ::readValue<uint64_t> (file.map, file.size, &offset);
+    auto payloadLength = ::readValue<uint64_t> (file.map, file.size, &offset);
+    if (payloadLength != file.size - SNAPSHOT_HEADER_SIZE)
+    {
+        throw std::runtime_error(fileName.string() + " is truncated");
+    }
+    const char *payload = file.map + SNAPSHOT_HEADER_SIZE;
+    if (::checksum(payload, payloadLength) != checksum)
+    {
+        throw std::runtime_error(fileName.string() + " is corrupt");
+    }
+    std::vector<PacketHeader> headers;
+    // Every header takes at least 32 bytes so don't trust a large count
+    headers.reserve(std::min<uint64_t> (nHeaders, payloadLength/32));
+    offset = 0;
+    for (uint64_t i = 0; i < nHeaders; ++i)
+    {
+        PacketHeader header;
+        header.network = ::readString(payload, payloadLength, &offset);
+        header.station = ::readString(payload, payloadLength, &offset);
+        header.channel = ::readString(payload, payloadLength, &offset);
+        header.locationCode = ::readString(payload, payloadLength, &offset);
+        header.startTime = std::chrono::microseconds
+            {::readValue<int64_t> (payload, payloadLength, &offset)};
+        header.endTime = std::chrono::microseconds
+            {::readValue<int64_t> (payload, payloadLength, &offset)};
+        header.samplingRate
+            = ::readValue<double> (payload, payloadLength, &offset);
+        header.numberOfSamples
+            = ::readValue<int32_t> (payload, payloadLength, &offset);
+        headers.push_back(std::move(header));
+    }
+    return headers;
+}
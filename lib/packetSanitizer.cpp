@@ -12,6 +12,9 @@
 #include "uWaveServer/packetSanitizer.hpp"
 #include "uWaveServer/packetSanitizerOptions.hpp"
 #include "uWaveServer/packet.hpp"
+#include "uWaveServer/packetHeader.hpp"
+#include "uWaveServer/streamRegistry.hpp"
+#include "private/toName.hpp"
 
 using namespace UWaveServer;
 
@@ -24,23 +27,11 @@ public:
     DataPacketHeader() = default;
     explicit DataPacketHeader(const UWaveServer::Packet &packet)
     {
-        auto network = packet.getNetwork();
-        auto station = packet.getStation(); 
-        auto channel = packet.getChannel();
-        std::string locationCode;
-        try
-        {
-            locationCode = packet.getLocationCode();
-        }
-        catch (...)
-        {
-        }
         // Trace name
-        name = network + "."  + station + "." + channel;
-        if (!locationCode.empty())
-        {
-            name = name + "." + locationCode;
-        }
+        auto &registry = StreamRegistry::getInstance();
+        name = registry.getName(packet.hasStreamHandle() ?
+                                packet.getStreamHandle() :
+                                registry.intern(packet));
         // Start and end time
         startTime = packet.getStartTime();
         endTime = packet.getEndTime();
@@ -50,6 +41,42 @@ public:
         // Number of samples
         nSamples = packet.size();
     } 
+    explicit DataPacketHeader(const UWaveServer::PacketHeader &header)
+    {
+        if (header.network.empty() || header.station.empty() ||
+            header.channel.empty())
+        {
+            throw std::invalid_argument("Stream is not fully specified");
+        }
+        name = ::toName(header.network, header.station,
+                        header.channel, header.locationCode);
+        startTime = header.startTime;
+        endTime = header.endTime;
+        if (endTime < startTime)
+        {
+            throw std::invalid_argument("End time is before start time");
+        }
+        if (header.samplingRate <= 0)
+        {
+            throw std::invalid_argument("Sampling rate must be positive");
+        }
+        samplingRate = static_cast<int> (std::round(header.samplingRate));
+        nSamples = header.numberOfSamples;
+        if (nSamples <= 0)
+        {
+            throw std::invalid_argument("No samples in packet");
+        }
+    }
+    [[nodiscard]] UWaveServer::PacketHeader toPacketHeader() const
+    {
+        UWaveServer::PacketHeader header;
+        ::fromName(name, &header);
+        header.startTime = startTime;
+        header.endTime = endTime;
+        header.samplingRate = samplingRate;
+        header.numberOfSamples = nSamples;
+        return header;
+    }
     bool operator<(const ::DataPacketHeader &rhs) const
     {
         return startTime < rhs.startTime;
@@ -463,3 +490,26 @@ bool PacketSanitizer::allow(const UWaveServer::Packet &packet)
     }
     return pImpl->allow(header);
 }
+
+/// Seed with a previously processed packet
+void PacketSanitizer::seed(const PacketHeader &packetHeader)
+{
+    ::DataPacketHeader header{packetHeader}; // Throws
+    // A rejection just means the earlier packet is already retained or
+    // has since expired
+    [[maybe_unused]] auto allow = pImpl->allow(header);
+}
+
+/// Retained headers
+std::vector<PacketHeader> PacketSanitizer::getPacketHeaders() const
+{
+    std::vector<PacketHeader> headers;
+    for (const auto &circularBuffer : pImpl->mCircularBuffers)
+    {
+        for (const auto &header : circularBuffer.second)
+        {
+            headers.push_back(header.toPacketHeader());
+        }
+    }
+    return headers;
+}
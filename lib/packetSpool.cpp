@@ -0,0 +1,679 @@
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <charconv>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include "uWaveServer/packetSpool.hpp"
+#include "uWaveServer/packet.hpp"
+#include "private/checksum.hpp"
+
+using namespace UWaveServer;
+
+namespace
+{
+
+// Segment layout:
+//   [magic (8 bytes)][version (4 bytes)][reserved (4 bytes)]
+//   [record][record]...[zeros]
+// Record layout:
+//   [payload length (4 bytes)][checksum (4 bytes)][state (4 bytes)][payload]
+// A zero payload length marks the end of the records in a segment.
+constexpr std::string_view MAGIC{"UWSSPOOL"};
+constexpr uint32_t VERSION{1};
+constexpr int64_t SEGMENT_HEADER_SIZE{16};
+constexpr int64_t RECORD_HEADER_SIZE{12};
+constexpr uint32_t RECORD_AVAILABLE{0};
+constexpr uint32_t RECORD_CONSUMED{1};
+constexpr std::string_view SEGMENT_PREFIX{"segment-"};
+constexpr std::string_view SEGMENT_SUFFIX{".spool"};
+
+template<typename T>
+void append(std::vector<char> *buffer, const T &value)
+{
+    auto offset = buffer->size();
+    buffer->resize(offset + sizeof(T));
+    std::memcpy(buffer->data() + offset, &value, sizeof(T));
+}
+
+void append(std::vector<char> *buffer, const std::string_view value)
+{
+    if (value.size() > 255)
+    {
+        throw std::invalid_argument("String " + std::string {value}
+                                  + " is too long");
+    }
+    append(buffer, static_cast<uint8_t> (value.size()));
+    buffer->insert(buffer->end(), value.begin(), value.end());
+}
+
+template<typename T>
+[[nodiscard]] T readValue(const char *data, const size_t length, size_t *offset)
+{
+    if (*offset + sizeof(T) > length)
+    {
+        throw std::runtime_error("Spooled record is truncated");
+    }
+    T value;
+    std::memcpy(&value, data + *offset, sizeof(T));
+    *offset = *offset + sizeof(T);
+    return value;
+}
+
+[[nodiscard]] std::string readString(const char *data, const size_t length,
+                                     size_t *offset)
+{
+    auto stringLength = ::readValue<uint8_t> (data, length, offset);
+    if (*offset + stringLength > length)
+    {
+        throw std::runtime_error("Spooled record is truncated");
+    }
+    std::string result(data + *offset, stringLength);
+    *offset = *offset + stringLength;
+    return result;
+}
+
+template<typename T>
+void appendSamples(std::vector<char> *buffer, const UWaveServer::Packet &packet)
+{
+    auto nBytes = static_cast<size_t> (packet.size())*sizeof(T);
+    auto offset = buffer->size();
+    buffer->resize(offset + nBytes);
+    if (nBytes > 0)
+    {
+        std::memcpy(buffer->data() + offset, packet.data(), nBytes);
+    }
+}
+
+template<typename T>
+void readSamples(const char *data, const size_t length, size_t *offset,
+                 const uint32_t nSamples, UWaveServer::Packet *packet)
+{
+    auto nBytes = static_cast<size_t> (nSamples)*sizeof(T);
+    if (*offset + nBytes > length)
+    {
+        throw std::runtime_error("Spooled samples are truncated");
+    }
+    // The mapping gives no alignment guarantees so copy
+    std::vector<T> samples(nSamples);
+    if (nBytes > 0)
+    {
+        std::memcpy(samples.data(), data + *offset, nBytes);
+    }
+    *offset = *offset + nBytes;
+    packet->setData(samples);
+}
+
+/// Serializes the packet.  Samples are in native byte order since the
+/// spool never leaves this machine.
+void serialize(const UWaveServer::Packet &packet, std::vector<char> *buffer)
+{
+    if (!packet.hasNetwork()){throw std::invalid_argument("Network not set");}
+    if (!packet.hasStation()){throw std::invalid_argument("Station not set");}
+    if (!packet.hasChannel()){throw std::invalid_argument("Channel not set");}
+    if (!packet.hasSamplingRate())
+    {
+        throw std::invalid_argument("Sampling rate not set");
+    }
+    buffer->clear();
+    ::append(buffer, packet.getNetworkReference());
+    ::append(buffer, packet.getStationReference());
+    ::append(buffer, packet.getChannelReference());
+    ::append(buffer, static_cast<uint8_t> (packet.hasLocationCode() ? 1 : 0));
+    if (packet.hasLocationCode())
+    {
+        ::append(buffer, packet.getLocationCodeReference());
+    }
+    ::append(buffer, static_cast<int64_t> (packet.getStartTime().count()));
+    ::append(buffer, packet.getSamplingRate());
+    auto dataType = packet.getDataType();
+    ::append(buffer, static_cast<uint8_t> (dataType));
+    ::append(buffer, static_cast<uint32_t> (packet.size()));
+    if (dataType == UWaveServer::Packet::DataType::Integer32)
+    {
+        ::appendSamples<int> (buffer, packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Integer64)
+    {
+        ::appendSamples<int64_t> (buffer, packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Float)
+    {
+        ::appendSamples<float> (buffer, packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Double)
+    {
+        ::appendSamples<double> (buffer, packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Text)
+    {
+        ::appendSamples<char> (buffer, packet);
+    }
+    else if (!packet.empty())
+    {
+        throw std::invalid_argument("Packet's data type is unknown");
+    }
+}
+
+[[nodiscard]] UWaveServer::Packet deserialize(const char *data,
+                                              const size_t length)
+{
+    UWaveServer::Packet packet;
+    size_t offset{0};
+    packet.setNetwork(::readString(data, length, &offset));
+    packet.setStation(::readString(data, length, &offset));
+    packet.setChannel(::readString(data, length, &offset));
+    if (::readValue<uint8_t> (data, length, &offset) == 1)
+    {
+        packet.setLocationCode(::readString(data, length, &offset));
+    }
+    packet.setStartTime(std::chrono::microseconds
+                        {::readValue<int64_t> (data, length, &offset)});
+    packet.setSamplingRate(::readValue<double> (data, length, &offset));
+    auto dataType = static_cast<UWaveServer::Packet::DataType>
+                    (::readValue<uint8_t> (data, length, &offset));
+    auto nSamples = ::readValue<uint32_t> (data, length, &offset);
+    if (dataType == UWaveServer::Packet::DataType::Integer32)
+    {
+        ::readSamples<int> (data, length, &offset, nSamples, &packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Integer64)
+    {
+        ::readSamples<int64_t> (data, length, &offset, nSamples, &packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Float)
+    {
+        ::readSamples<float> (data, length, &offset, nSamples, &packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Double)
+    {
+        ::readSamples<double> (data, length, &offset, nSamples, &packet);
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Text)
+    {
+        ::readSamples<char> (data, length, &offset, nSamples, &packet);
+    }
+    return packet;
+}
+
+[[nodiscard]] std::string toSegmentName(const uint64_t sequence)
+{
+    auto number = std::to_string(sequence);
+    if (number.size() < 20){number.insert(0, 20 - number.size(), '0');}
+    return std::string {SEGMENT_PREFIX} + number + std::string {SEGMENT_SUFFIX};
+}
+
+/// @result The segment's sequence number or -1 if this is not a segment.
+[[nodiscard]] int64_t toSequence(const std::filesystem::path &path)
+{
+    auto name = path.filename().string();
+    if (!name.starts_with(SEGMENT_PREFIX) || !name.ends_with(SEGMENT_SUFFIX))
+    {
+        return -1;
+    }
+    std::string_view number{name};
+    number.remove_prefix(SEGMENT_PREFIX.size());
+    number.remove_suffix(SEGMENT_SUFFIX.size());
+    int64_t sequence{-1};
+    auto [pointer, errorCode]
+        = std::from_chars(number.data(), number.data() + number.size(),
+                          sequence);
+    if (errorCode != std::errc {} || pointer != number.data() + number.size())
+    {
+        return -1;
+    }
+    return sequence;
+}
+
+[[nodiscard]] std::string toErrorMessage(const std::string &message,
+                                         const std::filesystem::path &path)
+{
+    return message + " " + path.string() + " because "
+         + std::string {std::strerror(errno)};
+}
+
+/// A memory mapped segment file.
+struct Segment
+{
+    Segment() = default;
+    Segment(const Segment &) = delete;
+    Segment& operator=(const Segment &) = delete;
+    ~Segment()
+    {
+        close();
+    }
+    void close() noexcept
+    {
+        if (map != nullptr)
+        {
+            ::msync(map, static_cast<size_t> (capacity), MS_ASYNC);
+            ::munmap(map, static_cast<size_t> (capacity));
+            map = nullptr;
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    [[nodiscard]] uint32_t readUInt32(const int64_t offset) const
+    {
+        uint32_t value;
+        std::memcpy(&value, map + offset, sizeof(uint32_t));
+        return value;
+    }
+    void writeUInt32(const int64_t offset, const uint32_t value)
+    {
+        std::memcpy(map + offset, &value, sizeof(uint32_t));
+    }
+    std::filesystem::path path;
+    char *map{nullptr};
+    uint64_t sequence{0};
+    int64_t capacity{0};
+    int64_t readOffset{SEGMENT_HEADER_SIZE};  // First unconsumed record
+    int64_t writeOffset{SEGMENT_HEADER_SIZE}; // One past the last record
+    int64_t nPackets{0}; // Unconsumed packets
+    int fd{-1};
+};
+
+/// Maps the segment.  If create is true then the file is created with the
+/// given capacity.  The result is null if there is no disk space to create
+/// the file.
+[[nodiscard]] std::unique_ptr<Segment>
+    mapSegment(const std::filesystem::path &path,
+               const uint64_t sequence,
+               const int64_t capacity,
+               const bool create)
+{
+    auto segment = std::make_unique<Segment> ();
+    segment->path = path;
+    segment->sequence = sequence;
+    int flags = O_RDWR | O_CLOEXEC;
+    if (create){flags = flags | O_CREAT | O_EXCL;}
+    segment->fd = ::open(path.c_str(), flags, S_IRUSR | S_IWUSR);
+    if (segment->fd < 0)
+    {
+        if (create && (errno == ENOSPC || errno == EDQUOT)){return nullptr;}
+        throw std::runtime_error(::toErrorMessage("Failed to open", path));
+    }
+    if (create)
+    {
+        // Reserve the blocks now.  Writing through the map into a sparse
+        // file raises SIGBUS when the disk fills.
+        auto error = ::posix_fallocate(segment->fd, 0,
+                                       static_cast<off_t> (capacity));
+        if (error != 0)
+        {
+            segment.reset();
+            std::error_code errorCode;
+            std::filesystem::remove(path, errorCode);
+            if (error == ENOSPC || error == EDQUOT){return nullptr;}
+            throw std::runtime_error("Failed to reserve " + path.string()
+                                   + " because "
+                                   + std::string {std::strerror(error)});
+        }
+        segment->capacity = capacity;
+    }
+    else
+    {
+        struct stat status;
+        if (::fstat(segment->fd, &status) != 0)
+        {
+            throw std::runtime_error(::toErrorMessage("Failed to stat", path));
+        }
+        segment->capacity = static_cast<int64_t> (status.st_size);
+        if (segment->capacity < SEGMENT_HEADER_SIZE)
+        {
+            throw std::runtime_error(path.string() + " is too small");
+        }
+    }
+    auto map = ::mmap(nullptr, static_cast<size_t> (segment->capacity),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        throw std::runtime_error(::toErrorMessage("Failed to map", path));
+    }
+    segment->map = static_cast<char *> (map);
+    if (create)
+    {
+        std::memcpy(segment->map, MAGIC.data(), MAGIC.size());
+        segment->writeUInt32(MAGIC.size(), VERSION);
+    }
+    else if (std::string_view {segment->map, MAGIC.size()} != MAGIC ||
+             segment->readUInt32(MAGIC.size()) != VERSION)
+    {
+        throw std::runtime_error(path.string() + " is not a spool segment");
+    }
+    return segment;
+}
+
+}
+
+class PacketSpool::PacketSpoolImpl
+{
+public:
+    PacketSpoolImpl(const std::filesystem::path &directory,
+                    const int64_t segmentSize,
+                    const int64_t maximumSize,
+                    std::shared_ptr<spdlog::logger> logger) :
+        mDirectory(directory),
+        mLogger(logger),
+        mSegmentSize(segmentSize),
+        mMaximumSize(maximumSize)
+    {
+        if (mLogger == nullptr)
+        {
+            mLogger = spdlog::get("packet-spool-console");
+            if (mLogger == nullptr)
+            {
+                mLogger = spdlog::stdout_color_mt("packet-spool-console");
+            }
+        }
+        if (!std::filesystem::exists(mDirectory))
+        {
+            if (!std::filesystem::create_directories(mDirectory))
+            {
+                throw std::runtime_error("Failed to create spool directory "
+                                       + mDirectory.string());
+            }
+        }
+        recover();
+    }
+    // Open the existing segments in order and figure out where the
+    // unconsumed records begin and end
+    void recover()
+    {
+        std::vector<std::pair<int64_t, std::filesystem::path>> paths;
+        for (const auto &entry :
+             std::filesystem::directory_iterator(mDirectory))
+        {
+            if (!entry.is_regular_file()){continue;}
+            auto sequence = ::toSequence(entry.path());
+            if (sequence >= 0){paths.emplace_back(sequence, entry.path());}
+        }
+        std::sort(paths.begin(), paths.end());
+        for (const auto &[sequence, path] : paths)
+        {
+            std::unique_ptr<Segment> segment;
+            try
+            {
+                constexpr bool create{false};
+                segment = ::mapSegment(path, static_cast<uint64_t> (sequence),
+                                       0, create);
+            }
+            catch (const std::exception &e)
+            {
+                SPDLOG_LOGGER_WARN(mLogger, "Skipping {} because {}",
+                                   path.string(), std::string {e.what()});
+                continue;
+            }
+            scan(*segment);
+            mNextSequence = static_cast<uint64_t> (sequence) + 1;
+            mSizeInBytes = mSizeInBytes + segment->capacity;
+            if (segment->nPackets == 0)
+            {
+                remove(std::move(segment));
+                continue;
+            }
+            mPackets = mPackets + segment->nPackets;
+            mSegments.push_back(std::move(segment));
+        }
+        if (mPackets > 0)
+        {
+            SPDLOG_LOGGER_INFO(mLogger,
+                               "Recovered {} packets in {} segments from {}",
+                               mPackets, mSegments.size(),
+                               mDirectory.string());
+        }
+    }
+    // Find the valid records in a segment.  Anything after a torn or corrupt
+    // record is zeroed so that it is not mistaken for a record later.
+    void scan(Segment &segment)
+    {
+        int64_t offset{SEGMENT_HEADER_SIZE};
+        bool foundUnconsumed{false};
+        while (offset + RECORD_HEADER_SIZE <= segment.capacity)
+        {
+            auto length = static_cast<int64_t> (segment.readUInt32(offset));
+            if (length == 0){break;}
+            auto payloadOffset = offset + RECORD_HEADER_SIZE;
+            if (payloadOffset + length > segment.capacity ||
+                ::checksum(segment.map + payloadOffset,
+                           static_cast<size_t> (length))
+                != segment.readUInt32(offset + 4))
+            {
+                SPDLOG_LOGGER_WARN(mLogger,
+                                   "Discarding torn record in {} at {}",
+                                   segment.path.string(), offset);
+                std::memset(segment.map + offset, 0,
+                            static_cast<size_t> (segment.capacity - offset));
+                break;
+            }
+            if (segment.readUInt32(offset + 8) == RECORD_AVAILABLE)
+            {
+                if (!foundUnconsumed)
+                {
+                    segment.readOffset = offset;
+                    foundUnconsumed = true;
+                }
+                segment.nPackets = segment.nPackets + 1;
+            }
+            offset = payloadOffset + length;
+        }
+        segment.writeOffset = offset;
+        if (!foundUnconsumed){segment.readOffset = offset;}
+    }
+    // Unmap and delete a segment
+    void remove(std::unique_ptr<Segment> &&segment)
+    {
+        auto path = segment->path;
+        mSizeInBytes = mSizeInBytes - segment->capacity;
+        segment->close();
+        std::error_code errorCode;
+        std::filesystem::remove(path, errorCode);
+        if (errorCode)
+        {
+            SPDLOG_LOGGER_WARN(mLogger, "Failed to remove {} because {}",
+                               path.string(), errorCode.message());
+        }
+    }
+    [[nodiscard]] bool push(const Packet &packet)
+    {
+        std::scoped_lock lock(mMutex);
+        ::serialize(packet, &mBuffer); // Throws
+        auto recordSize = RECORD_HEADER_SIZE
+                        + static_cast<int64_t> (mBuffer.size());
+        // Only the newest segment is appended to
+        if (mSegments.empty() ||
+            mSegments.back()->writeOffset + recordSize
+          > mSegments.back()->capacity)
+        {
+            auto capacity = std::max(mSegmentSize,
+                                     SEGMENT_HEADER_SIZE + recordSize);
+            if (mSizeInBytes + capacity > mMaximumSize){return false;}
+            if (!mSegments.empty())
+            {
+                ::msync(mSegments.back()->map,
+                        static_cast<size_t> (mSegments.back()->capacity),
+                        MS_ASYNC);
+            }
+            auto path = mDirectory/::toSegmentName(mNextSequence);
+            constexpr bool create{true};
+            auto segment = ::mapSegment(path, mNextSequence, capacity, create);
+            if (segment == nullptr){return false;} // Disk is full
+            mNextSequence = mNextSequence + 1;
+            mSizeInBytes = mSizeInBytes + capacity;
+            mSegments.push_back(std::move(segment));
+        }
+        auto &segment = *mSegments.back();
+        auto offset = segment.writeOffset;
+        std::memcpy(segment.map + offset + RECORD_HEADER_SIZE,
+                    mBuffer.data(), mBuffer.size());
+        segment.writeUInt32(offset + 4,
+                            ::checksum(mBuffer.data(), mBuffer.size()));
+        segment.writeUInt32(offset + 8, RECORD_AVAILABLE);
+        // The length goes last since a non-zero length marks a record
+        segment.writeUInt32(offset, static_cast<uint32_t> (mBuffer.size()));
+        segment.writeOffset = offset + recordSize;
+        segment.nPackets = segment.nPackets + 1;
+        mPackets = mPackets + 1;
+        return true;
+    }
+    [[nodiscard]] std::vector<Packet> peek(const int maximumNumberOfPackets)
+    {
+        std::vector<Packet> result;
+        if (maximumNumberOfPackets <= 0){return result;}
+        std::scoped_lock lock(mMutex);
+        result.reserve(std::min(static_cast<int64_t> (maximumNumberOfPackets),
+                                mPackets));
+        for (const auto &segment : mSegments)
+        {
+            auto offset = segment->readOffset;
+            while (offset < segment->writeOffset)
+            {
+                auto length
+                    = static_cast<int64_t> (segment->readUInt32(offset));
+                if (segment->readUInt32(offset + 8) == RECORD_AVAILABLE)
+                {
+                    result.push_back(
+                        ::deserialize(segment->map + offset
+                                    + RECORD_HEADER_SIZE,
+                                      static_cast<size_t> (length)));
+                    if (static_cast<int> (result.size())
+                        >= maximumNumberOfPackets)
+                    {
+                        return result;
+                    }
+                }
+                offset = offset + RECORD_HEADER_SIZE + length;
+            }
+        }
+        return result;
+    }
+    void consume(int nPackets)
+    {
+        std::scoped_lock lock(mMutex);
+        while (nPackets > 0 && !mSegments.empty())
+        {
+            auto &segment = *mSegments.front();
+            while (nPackets > 0 && segment.readOffset < segment.writeOffset)
+            {
+                auto offset = segment.readOffset;
+                auto length
+                    = static_cast<int64_t> (segment.readUInt32(offset));
+                if (segment.readUInt32(offset + 8) == RECORD_AVAILABLE)
+                {
+                    segment.writeUInt32(offset + 8, RECORD_CONSUMED);
+                    segment.nPackets = segment.nPackets - 1;
+                    mPackets = mPackets - 1;
+                    nPackets = nPackets - 1;
+                }
+                segment.readOffset = offset + RECORD_HEADER_SIZE + length;
+            }
+            if (segment.nPackets > 0){break;}
+            // Everything in this segment was consumed
+            remove(std::move(mSegments.front()));
+            mSegments.erase(mSegments.begin());
+        }
+    }
+    void flush()
+    {
+        std::scoped_lock lock(mMutex);
+        for (const auto &segment : mSegments)
+        {
+            ::msync(segment->map, static_cast<size_t> (segment->capacity),
+                    MS_ASYNC);
+        }
+    }
+    mutable std::mutex mMutex;
+    std::filesystem::path mDirectory;
+    std::shared_ptr<spdlog::logger> mLogger{nullptr};
+    std::vector<std::unique_ptr<Segment>> mSegments;
+    std::vector<char> mBuffer;
+    int64_t mSegmentSize{64*1024*1024};
+    int64_t mMaximumSize{4LL*1024*1024*1024};
+    int64_t mSizeInBytes{0};
+    int64_t mPackets{0};
+    uint64_t mNextSequence{0};
+};
+
+/// Constructor
+PacketSpool::PacketSpool(const std::filesystem::path &directory,
+                         const int64_t segmentSize,
+                         const int64_t maximumSize,
+                         std::shared_ptr<spdlog::logger> logger)
+{
+    if (segmentSize <= SEGMENT_HEADER_SIZE + RECORD_HEADER_SIZE)
+    {
+        throw std::invalid_argument("Segment size is too small");
+    }
+    if (maximumSize < segmentSize)
+    {
+        throw std::invalid_argument(
+            "Maximum size must be at least the segment size");
+    }
+    pImpl = std::make_unique<PacketSpoolImpl> (directory, segmentSize,
+                                               maximumSize, logger);
+}
+
+/// Destructor
+PacketSpool::~PacketSpool() = default;
+
+/// Push
+bool PacketSpool::push(const Packet &packet)
+{
+    return pImpl->push(packet);
+}
+
+/// Peek
+std::vector<Packet> PacketSpool::peek(const int maximumNumberOfPackets) const
+{
+    return pImpl->peek(maximumNumberOfPackets);
+}
+
+/// Consume
+void PacketSpool::consume(const int nPackets)
+{
+    pImpl->consume(nPackets);
+}
+
+/// Flush
+void PacketSpool::flush()
+{
+    pImpl->flush();
+}
+
+/// Number of packets
+int64_t PacketSpool::size() const noexcept
+{
+    std::scoped_lock lock(pImpl->mMutex);
+    return pImpl->mPackets;
+}
+
+/// Empty?
+bool PacketSpool::empty() const noexcept
+{
+    return size() == 0;
+}
+
+/// Size on disk
+int64_t PacketSpool::getSizeInBytes() const noexcept
+{
+    std::scoped_lock lock(pImpl->mMutex);
+    return pImpl->mSizeInBytes;
+}
+
+/// Directory
+std::filesystem::path PacketSpool::getDirectory() const
+{
+    return pImpl->mDirectory;
+}
@@ -0,0 +1,190 @@
+#ifndef UWAVE_SERVER_PRIVATE_BYTE_SWAP_HPP
+#define UWAVE_SERVER_PRIVATE_BYTE_SWAP_HPP
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UWAVE_SERVER_X86_BYTE_SWAP
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define UWAVE_SERVER_NEON_BYTE_SWAP
+#endif
+namespace
+{
+/// @brief The byte reversal kernels.
+enum class ByteSwapKernel
+{
+    Scalar, /*!< One element at a time with the compiler's bswap builtins. */
+    SSSE3,  /*!< 16 bytes at a time with pshufb. */
+    AVX2,   /*!< 32 bytes at a time with vpshufb. */
+    NEON    /*!< 16 bytes at a time with vrev. */
+};
+
+/// @result The fastest kernel this CPU supports.  This is determined once.
+[[nodiscard]] ByteSwapKernel getByteSwapKernel() noexcept
+{
+    static const ByteSwapKernel kernel = []()
+    {
+#if defined(UWAVE_SERVER_X86_BYTE_SWAP) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")){return ByteSwapKernel::AVX2;}
+        if (__builtin_cpu_supports("ssse3")){return ByteSwapKernel::SSSE3;}
+        return ByteSwapKernel::Scalar;
+#elif defined(UWAVE_SERVER_NEON_BYTE_SWAP)
+        return ByteSwapKernel::NEON;
+#else
+        return ByteSwapKernel::Scalar;
+#endif
+    }();
+    return kernel;
+}
+
+/// Reverses the bytes of each of the n N-byte elements in input and writes
+/// them to output.  input and output may be the same but may not otherwise
+/// overlap.
+template<size_t N>
+void reverseBytesScalar(const unsigned char *input, const size_t n,
+                        unsigned char *output) noexcept
+{
+    static_assert(N == 2 || N == 4 || N == 8, "N must be 2, 4, or 8");
+    for (size_t i = 0; i < n; ++i)
+    {
+        if constexpr (N == 2)
+        {
+            uint16_t value;
+            std::memcpy(&value, input + 2*i, 2);
+            value = __builtin_bswap16(value);
+            std::memcpy(output + 2*i, &value, 2);
+        }
+        else if constexpr (N == 4)
+        {
+            uint32_t value;
+            std::memcpy(&value, input + 4*i, 4);
+            value = __builtin_bswap32(value);
+            std::memcpy(output + 4*i, &value, 4);
+        }
+        else
+        {
+            uint64_t value;
+            std::memcpy(&value, input + 8*i, 8);
+            value = __builtin_bswap64(value);
+            std::memcpy(output + 8*i, &value, 8);
+        }
+    }
+}
+
+/// The shuffle that reverses each N-byte element in a 16 byte lane.
+template<size_t N>
+[[nodiscard]] constexpr std::array<unsigned char, 16> createShuffleMask()
+{
+    std::array<unsigned char, 16> mask{};
+    for (size_t j = 0; j < mask.size(); ++j)
+    {
+        mask[j] = static_cast<unsigned char> ((j/N)*N + (N - 1 - j%N));
+    }
+    return mask;
+}
+
+#ifdef UWAVE_SERVER_X86_BYTE_SWAP
+template<size_t N>
+__attribute__((target("ssse3")))
+void reverseBytesSSSE3(const unsigned char *input, const size_t n,
+                       unsigned char *output) noexcept
+{
+    static constexpr auto maskBytes = ::createShuffleMask<N> ();
+    const __m128i mask
+        = _mm_loadu_si128(reinterpret_cast<const __m128i *> (maskBytes.data()));
+    const size_t nBytes = n*N;
+    size_t i = 0;
+    for (; i + 16 <= nBytes; i = i + 16)
+    {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *> (input + i));
+        v = _mm_shuffle_epi8(v, mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i *> (output + i), v);
+    }
+    ::reverseBytesScalar<N> (input + i, (nBytes - i)/N, output + i);
+}
+
+template<size_t N>
+__attribute__((target("avx2")))
+void reverseBytesAVX2(const unsigned char *input, const size_t n,
+                      unsigned char *output) noexcept
+{
+    static constexpr auto maskBytes = ::createShuffleMask<N> ();
+    // vpshufb works on each 128 bit lane independently
+    const __m128i halfMask
+        = _mm_loadu_si128(reinterpret_cast<const __m128i *> (maskBytes.data()));
+    const __m256i mask = _mm256_broadcastsi128_si256(halfMask);
+    const size_t nBytes = n*N;
+    size_t i = 0;
+    for (; i + 32 <= nBytes; i = i + 32)
+    {
+        auto v = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *> (input + i));
+        v = _mm256_shuffle_epi8(v, mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *> (output + i), v);
+    }
+    ::reverseBytesScalar<N> (input + i, (nBytes - i)/N, output + i);
+}
+#endif
+
+#ifdef UWAVE_SERVER_NEON_BYTE_SWAP
+template<size_t N>
+void reverseBytesNEON(const unsigned char *input, const size_t n,
+                      unsigned char *output) noexcept
+{
+    const size_t nBytes = n*N;
+    size_t i = 0;
+    for (; i + 16 <= nBytes; i = i + 16)
+    {
+        auto v = vld1q_u8(input + i);
+        if constexpr (N == 2){v = vrev16q_u8(v);}
+        else if constexpr (N == 4){v = vrev32q_u8(v);}
+        else {v = vrev64q_u8(v);}
+        vst1q_u8(output + i, v);
+    }
+    ::reverseBytesScalar<N> (input + i, (nBytes - i)/N, output + i);
+}
+#endif
+
+/// @brief Reverses the byte order of each of the n N-byte elements in input
+///        and writes the result to output with the fastest available
+///        kernel.  input and output may be the same but may not otherwise
+///        overlap.  When N is 1 this is a copy.
+template<size_t N>
+void reverseBytes(const void *input, const size_t n, void *output) noexcept
+{
+    auto in = static_cast<const unsigned char *> (input);
+    auto out = static_cast<unsigned char *> (output);
+    if constexpr (N == 1)
+    {
+        if (n > 0 && in != out){std::memmove(out, in, n);}
+    }
+    else
+    {
+        switch (::getByteSwapKernel())
+        {
+#ifdef UWAVE_SERVER_X86_BYTE_SWAP
+            case ByteSwapKernel::AVX2:
+                ::reverseBytesAVX2<N> (in, n, out);
+                return;
+            case ByteSwapKernel::SSSE3:
+                ::reverseBytesSSSE3<N> (in, n, out);
+                return;
+#endif
+#ifdef UWAVE_SERVER_NEON_BYTE_SWAP
+            case ByteSwapKernel::NEON:
+                ::reverseBytesNEON<N> (in, n, out);
+                return;
+#endif
+            default:
+                ::reverseBytesScalar<N> (in, n, out);
+                return;
+        }
+    }
+}
+
+}
+#endif
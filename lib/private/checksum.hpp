@@ -0,0 +1,21 @@
+#ifndef PRIVATE_CHECKSUM_HPP
+#define PRIVATE_CHECKSUM_HPP
+#include <cstddef>
+#include <cstdint>
+namespace
+{
+
+/// 32-bit FNV-1a hash used to detect torn or corrupt records on disk.
+[[nodiscard]] uint32_t checksum(const char *data, const size_t length)
+{
+    uint32_t hash{2166136261U};
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash = hash ^ static_cast<uint8_t> (data[i]);
+        hash = hash*16777619U;
+    }
+    return hash;
+}
+
+}
+#endif
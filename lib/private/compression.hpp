@@ -3,6 +3,8 @@
 #ifndef WITH_ZLIB
 #include <string>
 #include <sstream>
+#include <cstring>
+#include <stdexcept>
 #define Z_NO_COMPRESSION         0
 #define Z_BEST_SPEED             1
 #define Z_BEST_COMPRESSION       9
@@ -21,108 +23,203 @@ std::string decompressStringStream(const std::string &inputData)
     return inputData; 
 }
 
+/// Without zlib there is nothing to do but copy.
+inline void compressBytes(const void *input, const size_t inputSize,
+                          const int , std::string *output)
+{
+    output->assign(static_cast<const char *> (input), inputSize);
+}
+
+inline void decompressBytes(const void *input, const size_t inputSize,
+                            void *output, const size_t outputSize)
+{
+    if (inputSize != outputSize)
+    {
+        throw std::runtime_error("Input size does not match output size");
+    }
+    if (inputSize > 0){std::memcpy(output, input, inputSize);}
+}
+
 }
 #else
 #include <string>
 #include <sstream>
 #include <cstring>
 #include <array>
+#include <memory>
+#include <stdexcept>
 #include <zlib.h>
 namespace
 {
-std::string compressString(std::string &inputString,
-                           int compressionLevel)
+/// @brief A deflate stream that is initialized once and then reset between
+///        uses.  This avoids allocating and setting up the (roughly 256 kB)
+///        zlib state for every packet.
+class DeflateContext
 {
-    z_stream zs;
-    std::memset(&zs, 0, sizeof(zs));
-
-    if (deflateInit(&zs, compressionLevel) != Z_OK)
+public:
+    explicit DeflateContext(const int compressionLevel) :
+        mCompressionLevel(compressionLevel)
     {
-        throw std::runtime_error("deflateInit failed");
+        std::memset(&mStream, 0, sizeof(mStream));
+        if (deflateInit(&mStream, mCompressionLevel) != Z_OK)
+        {
+            throw std::runtime_error("deflateInit failed");
+        }
     }
-
-    zs.next_in = reinterpret_cast<Bytef *> (inputString.data());
-    zs.avail_in = inputString.size();
-
-    int returnCode{Z_OK};
-    std::array<char, 16384> outBuffer;
-    std::string outString;
-
-    // Retrieve the compressed bytes blockwise
-    do 
+    ~DeflateContext()
     {
-        zs.next_out = reinterpret_cast<Bytef *> (outBuffer.data());
-        zs.avail_out = outBuffer.size();
-
-        returnCode = deflate(&zs, Z_FINISH);
-
-        if (outString.size() < zs.total_out) 
+        deflateEnd(&mStream);
+    }
+    DeflateContext(const DeflateContext &) = delete;
+    DeflateContext& operator=(const DeflateContext &) = delete;
+    [[nodiscard]] int getCompressionLevel() const noexcept
+    {
+        return mCompressionLevel;
+    }
+    /// Compresses the input in one pass into output which is sized to
+    /// zlib's bound on the compressed size then shrunk to fit.
+    void compress(const void *input, const size_t inputSize,
+                  std::string *output)
+    {
+        if (deflateReset(&mStream) != Z_OK)
         {
-            // append the block to the output string
-            outString.append(outBuffer.data(),
-                             zs.total_out - outString.size());
+            throw std::runtime_error("deflateReset failed");
         }
-    } while (returnCode == Z_OK);
-
-    deflateEnd(&zs);
-
-    // Deal with an error
-    if (returnCode != Z_STREAM_END) 
-    {          
-        throw std::runtime_error("Exception during zlib compression: ("
-                               + std::to_string(returnCode) 
-                               + ") " + std::string {zs.msg});
+        output->resize(deflateBound(&mStream, inputSize));
+        // zlib doesn't modify the input despite the signature
+        mStream.next_in
+            = reinterpret_cast<Bytef *> (const_cast<void *> (input));
+        mStream.avail_in = static_cast<uInt> (inputSize);
+        mStream.next_out = reinterpret_cast<Bytef *> (output->data());
+        mStream.avail_out = static_cast<uInt> (output->size());
+        auto returnCode = deflate(&mStream, Z_FINISH);
+        if (returnCode != Z_STREAM_END) 
+        {          
+            throw std::runtime_error("Exception during zlib compression: ("
+                                   + std::to_string(returnCode) + ") "
+                                   + std::string {mStream.msg ?
+                                                  mStream.msg : ""});
+        }
+        output->resize(mStream.total_out);
     }
-    return outString;
-}
-
-std::string decompressByteString(std::byte *data, const size_t dataSize) 
+private:
+    z_stream mStream;
+    int mCompressionLevel{Z_BEST_COMPRESSION};
+};
+
+/// @brief An inflate stream that is initialized once and then reset between
+///        uses.
+class InflateContext
 {
-    z_stream zs;
-    std::memset(&zs, 0, sizeof(zs));
-
-    if (inflateInit(&zs) != Z_OK)
+public:
+    InflateContext()
     {
-        throw std::runtime_error("inflateInit failed");
+        std::memset(&mStream, 0, sizeof(mStream));
+        if (inflateInit(&mStream) != Z_OK)
+        {
+            throw std::runtime_error("inflateInit failed");
+        }
     }
-    //auto copy = compressedString;
-    zs.next_in = reinterpret_cast<Bytef *> (data); //copy.data());
-    zs.avail_in = dataSize; //copy.size();
-
-    int returnCode{Z_OK};
-    std::array<char, 16384> outBuffer;
-    std::string outString;
-
-    // get the decompressed bytes blockwise using repeated calls to inflate
-    do 
+    ~InflateContext()
     {
-        zs.next_out = reinterpret_cast<Bytef*> (outBuffer.data());
-        zs.avail_out = outBuffer.size();
-
-        returnCode = inflate(&zs, 0);
-
-        if (outString.size() < zs.total_out) 
+        inflateEnd(&mStream);
+    }
+    InflateContext(const InflateContext &) = delete;
+    InflateContext& operator=(const InflateContext &) = delete;
+    /// Decompresses the input directly into output.  The decompressed size
+    /// must be exactly outputSize.
+    void decompress(const void *input, const size_t inputSize,
+                    void *output, const size_t outputSize)
+    {
+        reset(input, inputSize);
+        mStream.next_out = static_cast<Bytef *> (output);
+        mStream.avail_out = static_cast<uInt> (outputSize);
+        auto returnCode = inflate(&mStream, Z_FINISH);
+        if (returnCode != Z_STREAM_END)
         {
-            outString.append(outBuffer.data(),
-                             zs.total_out - outString.size());
+            throw std::runtime_error("Exception during zlib decompression: ("
+                                   + std::to_string(returnCode) + ") "
+                                   + std::string {mStream.msg ?
+                                                  mStream.msg : ""});
         }
-    } while (returnCode == Z_OK);
-
-    inflateEnd(&zs);
+        if (mStream.total_out != outputSize)
+        {
+            throw std::runtime_error(
+                "Decompressed size does not match expected size");
+        }
+    }
+    /// Decompresses the input when the decompressed size is not known.
+    [[nodiscard]] std::string decompress(const void *input,
+                                         const size_t inputSize)
+    {
+        reset(input, inputSize);
+        int returnCode{Z_OK};
+        std::array<char, 16384> outBuffer;
+        std::string outString;
+        // Get the decompressed bytes blockwise
+        do 
+        {
+            mStream.next_out = reinterpret_cast<Bytef*> (outBuffer.data());
+            mStream.avail_out = outBuffer.size();
+            returnCode = inflate(&mStream, 0);
+            if (outString.size() < mStream.total_out) 
+            {
+                outString.append(outBuffer.data(),
+                                 mStream.total_out - outString.size());
+            }
+        } while (returnCode == Z_OK);
+        if (returnCode != Z_STREAM_END)
+        {
+            throw std::runtime_error("Exception during zlib decompression: ("
+                                   + std::to_string(returnCode) + ") "
+                                   + std::string {mStream.msg ?
+                                                  mStream.msg : ""});
+        }
+        return outString;
+    }
+private:
+    void reset(const void *input, const size_t inputSize)
+    {
+        if (inflateReset(&mStream) != Z_OK)
+        {
+            throw std::runtime_error("inflateReset failed");
+        }
+        mStream.next_in
+            = reinterpret_cast<Bytef *> (const_cast<void *> (input));
+        mStream.avail_in = static_cast<uInt> (inputSize);
+    }
+    z_stream mStream;
+};
 
-    // Deal with an error
-    if (returnCode != Z_STREAM_END)
+/// @result This thread's deflate context for the given compression level.
+[[nodiscard]] DeflateContext &getDeflateContext(const int compressionLevel)
+{
+    thread_local std::unique_ptr<DeflateContext> context{nullptr};
+    if (context == nullptr ||
+        context->getCompressionLevel() != compressionLevel)
     {
-        throw std::runtime_error("Exception during zlib decompression: ("
-                               + std::to_string(returnCode)
-                               + ") " + std::string {zs.msg});
+        context = std::make_unique<DeflateContext> (compressionLevel);
     }
-    return outString;
+    return *context;
+}
+
+/// @result This thread's inflate context.
+[[nodiscard]] InflateContext &getInflateContext()
+{
+    thread_local InflateContext context;
+    return context;
+}
+
+inline void compressBytes(const void *input, const size_t inputSize,
+                          const int compressionLevel, std::string *output)
+{
+    ::getDeflateContext(compressionLevel).compress(input, inputSize, output);
 }
 
-std::string decompressByteString(std::basic_string<std::byte> &data)
+inline void decompressBytes(const void *input, const size_t inputSize,
+                            void *output, const size_t outputSize)
 {
-    return ::decompressByteString(data.data(), data.size());
+    ::getInflateContext().decompress(input, inputSize, output, outputSize);
 }
 
 }
@@ -0,0 +1,252 @@
+#ifndef UWAVE_SERVER_PRIVATE_DECODED_PACKET_CACHE_HPP
+#define UWAVE_SERVER_PRIVATE_DECODED_PACKET_CACHE_HPP
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "uWaveServer/packet.hpp"
+namespace
+{
+/// @brief A byte-bounded LRU cache of decoded packets keyed by (stream
+///        identifier, packet start time).  Besides the packets the cache
+///        tracks, per stream, a covered time interval in which every row
+///        in the database is known to be cached.  A query then only needs
+///        to fetch the parts of its window that fall outside of that
+///        interval, which for a dashboard re-requesting the latest minutes
+///        is just the leading edge.
+/// @note Times are microseconds since the epoch.  A window [t0, t1)
+///       contains the packets whose end time exceeds t0 and whose start
+///       time is less than t1, as in the SQL.
+/// @note Rows that arrive after their window was covered, e.g., a spool
+///       replayed after a database outage, are invisible until the
+///       coverage expires so callers should bound its age.
+class DecodedPacketCache
+{
+public:
+    /// @brief The result of a lookup.
+    struct Lookup
+    {
+        /// Copies of the cached packets in the covered part of the window.
+        std::vector<UWaveServer::Packet> packets;
+        /// The windows that must be fetched from the database.
+        std::vector<std::pair<int64_t, int64_t>> missing;
+        /// The covered interval once the missing windows are inserted.
+        std::pair<int64_t, int64_t> coverage{0, 0};
+        /// The settled time at which the coverage was last verified.
+        int64_t coverageTime{0};
+        /// Detects evictions between the lookup and the insert.
+        uint64_t generation{0};
+    };
+    /// @param[in] maximumBytes  The cache's memory budget.
+    explicit DecodedPacketCache(const int64_t maximumBytes) :
+        mMaximumBytes(std::max<int64_t> (0, maximumBytes))
+    {
+    }
+    /// @param[in] settledTime  Rows may still be arriving after this time so
+    ///                         the coverage will not extend past it.
+    /// @param[in] maximumCoverageAge  Coverage verified longer than this
+    ///                                before the settled time is discarded
+    ///                                so late rows are eventually seen.
+    [[nodiscard]] Lookup lookup(const int streamIdentifier,
+                                const int64_t t0,
+                                const int64_t t1,
+                                const int64_t settledTime,
+                                const int64_t maximumCoverageAge
+                                    = std::numeric_limits<int64_t>::max())
+    {
+        Lookup result;
+        std::scoped_lock lock(mMutex);
+        auto &stream = mStreams[streamIdentifier];
+        if (stream.hasCoverage() &&
+            settledTime - stream.coverageTime > maximumCoverageAge)
+        {
+            stream.coverageStart = 0;
+            stream.coverageEnd = 0;
+            stream.generation = stream.generation + 1;
+        }
+        result.generation = stream.generation;
+        auto coverageEnd = std::min(t1, settledTime);
+        if (stream.hasCoverage() &&
+            t0 <= stream.coverageEnd && t1 >= stream.coverageStart)
+        {
+            if (t0 < stream.coverageStart)
+            {
+                result.missing.push_back(std::pair {t0, stream.coverageStart});
+            }
+            if (t1 > stream.coverageEnd)
+            {
+                result.missing.push_back(std::pair {stream.coverageEnd, t1});
+            }
+            result.coverage
+                = std::pair {std::min(t0, stream.coverageStart),
+                             std::max(stream.coverageEnd, coverageEnd)};
+            // The cached part was not re-verified
+            result.coverageTime = stream.coverageTime;
+            // Packets can start before t0 and still overlap the window
+            auto first = stream.rows.lower_bound(t0 - stream.maximumDuration);
+            for (auto it = first;
+                 it != stream.rows.end() && it->first < t1;
+                 ++it)
+            {
+                auto &entry = *it->second;
+                if (entry.endTime <= t0){continue;}
+                result.packets.push_back(entry.packet);
+                mEntries.splice(mEntries.begin(), mEntries, it->second);
+                mHits = mHits + 1;
+            }
+        }
+        else
+        {
+            result.missing.push_back(std::pair {t0, t1});
+            result.coverage = std::pair {t0, coverageEnd};
+            result.coverageTime = settledTime;
+        }
+        return result;
+    }
+    /// @brief Inserts the packets fetched for the lookup's missing windows
+    ///        and, if nothing was evicted in the meantime, extends the
+    ///        stream's coverage.
+    void insert(const int streamIdentifier,
+                const std::vector<UWaveServer::Packet> &packets,
+                const Lookup &lookup)
+    {
+        std::scoped_lock lock(mMutex);
+        // Extend the coverage first so that evicting the packets being
+        // inserted correctly shrinks it.  No one sees the intermediate state.
+        {
+        auto &stream = mStreams[streamIdentifier];
+        if (stream.generation == lookup.generation &&
+            lookup.coverage.first < lookup.coverage.second)
+        {
+            stream.coverageStart = lookup.coverage.first;
+            stream.coverageEnd = lookup.coverage.second;
+            stream.coverageTime = lookup.coverageTime;
+        }
+        }
+        for (const auto &packet : packets)
+        {
+            auto &stream = mStreams[streamIdentifier];
+            auto bytes = toBytes(packet);
+            if (bytes > mMaximumBytes)
+            {
+                // This packet would be a hole in the coverage
+                stream.coverageStart = 0;
+                stream.coverageEnd = 0;
+                stream.generation = stream.generation + 1;
+                continue;
+            }
+            auto startTime = packet.getStartTime().count();
+            if (stream.rows.contains(startTime)){continue;}
+            auto endTime = packet.getEndTime().count();
+            mEntries.push_front(Entry {packet,
+                                       streamIdentifier,
+                                       startTime,
+                                       endTime,
+                                       bytes});
+            stream.rows.insert(std::pair {startTime, mEntries.begin()});
+            stream.maximumDuration
+                = std::max(stream.maximumDuration, endTime - startTime);
+            mBytes = mBytes + bytes;
+            mMisses = mMisses + 1;
+            evict();
+        }
+    }
+    /// @result The bytes held by the cache.
+    [[nodiscard]] int64_t size() const noexcept
+    {
+        std::scoped_lock lock(mMutex);
+        return mBytes;
+    }
+    /// @result The number of packets served from the cache.
+    [[nodiscard]] int64_t hits() const noexcept
+    {
+        std::scoped_lock lock(mMutex);
+        return mHits;
+    }
+    /// @result The number of packets fetched and inserted into the cache.
+    [[nodiscard]] int64_t misses() const noexcept
+    {
+        std::scoped_lock lock(mMutex);
+        return mMisses;
+    }
+private:
+    struct Entry
+    {
+        UWaveServer::Packet packet;
+        int streamIdentifier{-1};
+        int64_t startTime{0};
+        int64_t endTime{0};
+        int64_t bytes{0};
+    };
+    struct Stream
+    {
+        [[nodiscard]] bool hasCoverage() const noexcept
+        {
+            return coverageStart < coverageEnd;
+        }
+        std::map<int64_t, std::list<Entry>::iterator> rows;
+        int64_t coverageStart{0};
+        int64_t coverageEnd{0};
+        int64_t coverageTime{0};
+        int64_t maximumDuration{0};
+        uint64_t generation{0};
+    };
+    // The packet's samples plus a rough allowance for the packet, list
+    // node, and map node.
+    [[nodiscard]] static int64_t toBytes(const UWaveServer::Packet &packet)
+    {
+        constexpr int64_t overhead{384};
+        return overhead
+             + packet.visitData([](const auto samples)
+                                {
+                                    return static_cast<int64_t>
+                                           (samples.size_bytes());
+                                });
+    }
+    // Drops least recently used packets until we are within budget.  The
+    // caller must hold the mutex.
+    void evict()
+    {
+        while (mBytes > mMaximumBytes && !mEntries.empty())
+        {
+            auto &entry = mEntries.back();
+            auto streamIndex = mStreams.find(entry.streamIdentifier);
+            if (streamIndex != mStreams.end())
+            {
+                auto &stream = streamIndex->second;
+                // Losing the earliest packet only shrinks the coverage.
+                // Losing any other leaves a hole.
+                if (!stream.rows.empty() &&
+                    stream.rows.begin()->first == entry.startTime)
+                {
+                    stream.coverageStart
+                        = std::max(stream.coverageStart, entry.endTime);
+                }
+                else
+                {
+                    stream.coverageStart = 0;
+                    stream.coverageEnd = 0;
+                }
+                // The stream itself is kept so its generation keeps counting
+                stream.generation = stream.generation + 1;
+                stream.rows.erase(entry.startTime);
+            }
+            mBytes = mBytes - entry.bytes;
+            mEntries.pop_back();
+        }
+    }
+    mutable std::mutex mMutex;
+    std::list<Entry> mEntries; // Most recently used first
+    std::unordered_map<int, Stream> mStreams;
+    int64_t mMaximumBytes{0};
+    int64_t mBytes{0};
+    int64_t mHits{0};
+    int64_t mMisses{0};
+};
+}
+#endif
@@ -0,0 +1,235 @@
+#ifndef UWAVE_SERVER_PRIVATE_INTEGER_CODEC_HPP
+#define UWAVE_SERVER_PRIVATE_INTEGER_CODEC_HPP
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+namespace
+{
+/// @brief The codec identifiers stored in the data tables' codec column.
+///        Rows written before the column existed default to Default.
+enum class Codec : int16_t
+{
+    Default = 0,     /*!< The data are raw or zlib compressed as indicated
+                          by the compressed column. */
+    DeltaBitPack = 1 /*!< Integer data are first differenced, zigzag
+                          encoded, and bit-packed. */
+};
+
+/// Samples are bit-packed in blocks of this many first differences.  Each
+/// block has its own bit width so a burst of large amplitudes only costs
+/// us locally.
+constexpr size_t DELTA_BIT_PACK_BLOCK_SIZE{128};
+
+/// Little-endian, LSB-first bit writer.
+class BitWriter
+{
+public:
+    explicit BitWriter(std::string *output) :
+        mOutput(output)
+    {
+    }
+    void put(uint64_t value, int nBits)
+    {
+        while (nBits > 0)
+        {
+            auto chunk = std::min(nBits, 32);
+            auto mask = (uint64_t {1} << chunk) - 1;
+            mAccumulator = mAccumulator | ((value & mask) << mBitCount);
+            mBitCount = mBitCount + chunk;
+            value = value >> chunk;
+            nBits = nBits - chunk;
+            while (mBitCount >= 8)
+            {
+                mOutput->push_back(static_cast<char> (mAccumulator & 0xFF));
+                mAccumulator = mAccumulator >> 8;
+                mBitCount = mBitCount - 8;
+            }
+        }
+    }
+    /// Pads the last partial byte with zeros.
+    void flush()
+    {
+        if (mBitCount > 0)
+        {
+            mOutput->push_back(static_cast<char> (mAccumulator & 0xFF));
+        }
+        mAccumulator = 0;
+        mBitCount = 0;
+    }
+private:
+    std::string *mOutput{nullptr};
+    uint64_t mAccumulator{0};
+    int mBitCount{0};
+};
+
+/// Little-endian, LSB-first bit reader.
+class BitReader
+{
+public:
+    BitReader(const unsigned char *data, const size_t size) :
+        mData(data),
+        mSize(size)
+    {
+    }
+    [[nodiscard]] uint64_t get(int nBits)
+    {
+        uint64_t value{0};
+        int shift{0};
+        while (nBits > 0)
+        {
+            auto chunk = std::min(nBits, 32);
+            while (mBitCount < chunk)
+            {
+                if (mPosition >= mSize)
+                {
+                    throw std::runtime_error("Bit-packed data is truncated");
+                }
+                mAccumulator = mAccumulator
+                             | (static_cast<uint64_t> (mData[mPosition])
+                                << mBitCount);
+                mPosition = mPosition + 1;
+                mBitCount = mBitCount + 8;
+            }
+            auto mask = (uint64_t {1} << chunk) - 1;
+            value = value | ((mAccumulator & mask) << shift);
+            mAccumulator = mAccumulator >> chunk;
+            mBitCount = mBitCount - chunk;
+            shift = shift + chunk;
+            nBits = nBits - chunk;
+        }
+        return value;
+    }
+    [[nodiscard]] uint8_t getByte()
+    {
+        return static_cast<uint8_t> (get(8));
+    }
+    /// Discards the remaining bits in the current byte.
+    void align() noexcept
+    {
+        mAccumulator = 0;
+        mBitCount = 0;
+    }
+private:
+    const unsigned char *mData{nullptr};
+    size_t mSize{0};
+    size_t mPosition{0};
+    uint64_t mAccumulator{0};
+    int mBitCount{0};
+};
+
+/// @brief Encodes integer samples with the DeltaBitPack codec.  The layout
+///        is the first sample as a little-endian integer followed by, for
+///        each block of up to 128 first differences, the block's bit width
+///        (1 byte) then the zigzag encoded differences packed LSB-first
+///        and padded to a byte boundary.  Differences are computed with
+///        wraparound so any input round-trips.
+template<typename T>
+[[nodiscard]] std::string encodeDeltaBitPack(const size_t n, const T *data)
+{
+    static_assert(std::is_same<T, int32_t>::value ||
+                  std::is_same<T, int64_t>::value,
+                  "Only 32 and 64 bit integers are supported");
+    using U = std::make_unsigned_t<T>;
+    constexpr int nBitsInT{8*sizeof(T)};
+    std::string result;
+    if (n == 0){return result;}
+    if (data == nullptr){throw std::invalid_argument("Data is null");}
+    // Typically seismic data will need 1-2 bytes per difference
+    result.reserve(sizeof(T) + (n/DELTA_BIT_PACK_BLOCK_SIZE + 1)
+                 + 2*n);
+    BitWriter writer(&result);
+    writer.put(static_cast<U> (data[0]), nBitsInT);
+    std::array<U, DELTA_BIT_PACK_BLOCK_SIZE> zigzag;
+    for (size_t i0 = 1; i0 < n; i0 = i0 + DELTA_BIT_PACK_BLOCK_SIZE)
+    {
+        auto nBlock = std::min(DELTA_BIT_PACK_BLOCK_SIZE, n - i0);
+        // Difference and zigzag encode.  This loop has no dependencies so
+        // the compiler can vectorize it.
+        U orBits{0};
+        for (size_t j = 0; j < nBlock; ++j)
+        {
+            auto difference = static_cast<T> (static_cast<U> (data[i0 + j])
+                                            - static_cast<U> (data[i0 + j - 1]));
+            zigzag[j] = (static_cast<U> (difference) << 1)
+                      ^ static_cast<U> (difference >> (nBitsInT - 1));
+            orBits = orBits | zigzag[j];
+        }
+        auto nBits = nBitsInT - std::countl_zero(orBits);
+        writer.put(static_cast<uint64_t> (nBits), 8);
+        for (size_t j = 0; j < nBlock; ++j)
+        {
+            writer.put(static_cast<uint64_t> (zigzag[j]), nBits);
+        }
+        writer.flush();
+    }
+    writer.flush();
+    return result;
+}
+
+/// @brief Decodes nSamples samples encoded with encodeDeltaBitPack directly
+///        into output.
+/// @throws std::runtime_error if the data are truncated or malformed.
+template<typename T>
+void decodeDeltaBitPack(const size_t nSamples,
+                        const unsigned char *data,
+                        const size_t dataSize,
+                        T *output)
+{
+    static_assert(std::is_same<T, int32_t>::value ||
+                  std::is_same<T, int64_t>::value,
+                  "Only 32 and 64 bit integers are supported");
+    using U = std::make_unsigned_t<T>;
+    constexpr int nBitsInT{8*sizeof(T)};
+    if (nSamples == 0){return;}
+    BitReader reader(data, dataSize);
+    U previous = static_cast<U> (reader.get(nBitsInT));
+    output[0] = static_cast<T> (previous);
+    std::array<U, DELTA_BIT_PACK_BLOCK_SIZE> zigzag;
+    for (size_t i0 = 1; i0 < nSamples; i0 = i0 + DELTA_BIT_PACK_BLOCK_SIZE)
+    {
+        auto nBlock = std::min(DELTA_BIT_PACK_BLOCK_SIZE, nSamples - i0);
+        reader.align();
+        auto nBits = static_cast<int> (reader.getByte());
+        if (nBits > nBitsInT)
+        {
+            throw std::runtime_error("Invalid bit width in packed data");
+        }
+        for (size_t j = 0; j < nBlock; ++j)
+        {
+            zigzag[j] = static_cast<U> (reader.get(nBits));
+        }
+        // Undo the zigzag then integrate
+        for (size_t j = 0; j < nBlock; ++j)
+        {
+            auto difference = (zigzag[j] >> 1)
+                            ^ (U {0} - (zigzag[j] & U {1}));
+            previous = previous + difference;
+            output[i0 + j] = static_cast<T> (previous);
+        }
+    }
+}
+
+/// @brief Decodes nSamples samples encoded with encodeDeltaBitPack.
+template<typename T>
+[[nodiscard]] std::vector<T>
+    decodeDeltaBitPack(const int nSamples,
+                       const std::basic_string<std::byte> &data)
+{
+    std::vector<T> result(std::max(0, nSamples));
+    ::decodeDeltaBitPack<T> (result.size(),
+                             reinterpret_cast<const unsigned char *>
+                             (data.data()),
+                             data.size(),
+                             result.data());
+    return result;
+}
+
+}
+#endif
@@ -0,0 +1,398 @@
+#ifndef UWAVE_SERVER_PRIVATE_LOCK_FREE_BOUNDED_QUEUE_HPP
+#define UWAVE_SERVER_PRIVATE_LOCK_FREE_BOUNDED_QUEUE_HPP
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+namespace
+{
+/// @brief This is a bounded multi-producer/multi-consumer ring buffer
+///        based on Dmitry Vyukov's bounded MPMC queue.  Pushing and popping
+///        are lock-free.  Like the ThreadSafeBoundedQueue, when the queue is
+///        full the oldest element is dropped to make room for the newest.
+///        Threads that wait on an empty queue sleep on a futex and are only
+///        woken when a producer adds data (or the wait times out) so idle
+///        consumers neither spin nor poll.  Producers only make a system
+///        call when a consumer has gone to sleep since the last wake up.
+/// @note setCapacity() must be called before the queue is shared between
+///       threads.
+template<typename T>
+class LockFreeBoundedQueue
+{
+public:
+    /// @brief Pass this as the wait time to wait without a deadline.
+    static constexpr std::chrono::milliseconds NO_DEADLINE
+    {
+        std::chrono::milliseconds::max()
+    };
+    /// @name Constructors
+    /// @{
+
+    /// @brief Constructor.
+    LockFreeBoundedQueue() = default;
+    /// @brief Constructor with a given size.
+    explicit LockFreeBoundedQueue(const int capacity)
+    {
+        setCapacity(capacity);
+    }
+    /// @}
+
+    /// @brief Sets the capacity.  This is not thread-safe and will clear the
+    ///        queue.
+    void setCapacity(const int capacity)
+    {
+        if (capacity < 1)
+        {
+            throw std::invalid_argument("Bounded queue capacity must be positive");
+        }
+        auto buffer = std::make_unique<Cell[]> (capacity);
+        for (int i = 0; i < capacity; ++i)
+        {
+            buffer[i].sequence.store(static_cast<uint64_t> (i),
+                                     std::memory_order_relaxed);
+        }
+        mBuffer = std::move(buffer);
+        mCapacity = static_cast<uint64_t> (capacity);
+        mEnqueuePosition.store(0, std::memory_order_relaxed);
+        mDequeuePosition.store(0, std::memory_order_relaxed);
+        mDropped.store(0, std::memory_order_relaxed);
+    }
+    /// @brief Adds a value to the back of the bounded queue.
+    /// @param[in] value  The value to add to the bounded queue.
+    void push(const T &value)
+    {
+        T copy{value};
+        push(std::move(copy));
+    }
+    /// @brief Adds a value to the back of the bounded queue.  If the queue is
+    ///        full then the oldest element is dropped.
+    /// @param[in,out] value  The value to add to the bounded queue.
+    ///                       On exit, value's behavior is undefined.
+    void push(T &&value)
+    {
+        while (!tryEnqueue(value))
+        {
+            // Full - pop the first (oldest) element and try again
+            dropOldest();
+        }
+        notify();
+    }
+    /// @brief Adds values to the back of the bounded queue.  Waiting
+    ///        consumers are signaled once after all values are added.
+    /// @param[in,out] values  The values to add to the bounded queue.
+    ///                        On exit, values will be empty.
+    void push(std::vector<T> &&values)
+    {
+        if (values.empty()){return;}
+        for (auto &value : values)
+        {
+            while (!tryEnqueue(value))
+            {
+                dropOldest();
+            }
+        }
+        values.clear();
+        notify();
+    }
+    /// @brief Waits for and removes the value at the front of the queue.
+    /// @param[out] value  The value at the front of the queue.
+    void wait_and_pop(T *value)
+    {
+        while (!tryDequeue(value))
+        {
+            // Announce we are going to sleep then check one last time
+            mConsumerSleeping.store(true, std::memory_order_seq_cst);
+            auto epoch = mEpoch.load(std::memory_order_seq_cst);
+            if (tryDequeue(value)){break;}
+            futexWait(epoch, nullptr);
+        }
+    }
+    /// @brief Waits for and removes the value at the front of the queue.
+    /// @param[out] value    The value from the front of the queue.
+    /// @param[in] waitFor   The maximum time to wait.  NO_DEADLINE waits
+    ///                      until a value arrives or the queue is closed.
+    /// @result True indicates that the value was set whereas false indicates
+    ///         the wait timed out.
+    /// @note Being woken by notifyAll() or close() (e.g., at shutdown) or
+    ///       losing the race for a new value to another consumer will return
+    ///       false before the time out has elapsed.
+    [[nodiscard]]
+    bool wait_until_and_pop(T *value,
+                            const std::chrono::milliseconds &waitFor
+                               = static_cast<std::chrono::milliseconds> (10))
+    {
+        if (tryDequeue(value)){return true;}
+        if (waitFor.count() <= 0){return false;}
+        // Announce we are going to sleep then check one last time
+        mConsumerSleeping.store(true, std::memory_order_seq_cst);
+        auto epoch = mEpoch.load(std::memory_order_seq_cst);
+        if (tryDequeue(value)){return true;}
+        sleep(epoch, waitFor);
+        return tryDequeue(value);
+    }
+    /// @brief Waits for at least one value then removes up to maximumValues
+    ///        values from the front of the queue.
+    /// @param[out] values         The values are appended to this container.
+    /// @param[in] maximumValues   The maximum number of values to remove.
+    /// @param[in] waitFor         The maximum time to wait for the first
+    ///                            value.  NO_DEADLINE waits until a value
+    ///                            arrives or the queue is closed.
+    /// @result The number of values appended to values.
+    [[nodiscard]]
+    size_t wait_until_and_pop_n(std::vector<T> *values,
+                                const size_t maximumValues,
+                                const std::chrono::milliseconds &waitFor
+                                   = static_cast<std::chrono::milliseconds> (10))
+    {
+        if (maximumValues == 0){return 0;}
+        auto nPopped = try_pop_n(values, maximumValues);
+        if (nPopped > 0 || waitFor.count() <= 0){return nPopped;}
+        // Announce we are going to sleep then check one last time
+        mConsumerSleeping.store(true, std::memory_order_seq_cst);
+        auto epoch = mEpoch.load(std::memory_order_seq_cst);
+        nPopped = try_pop_n(values, maximumValues);
+        if (nPopped > 0){return nPopped;}
+        sleep(epoch, waitFor);
+        return try_pop_n(values, maximumValues);
+    }
+    /// @brief Removes the front of the bounded queue.  This returns nothing.
+    void pop()
+    {
+        static_cast<void> (tryDequeue([](T &&){}));
+    }
+    /// @brief Attempts to remove the value at the front of the bounded queue.
+    /// @param[out] value  The value at the front of the queue.
+    /// @retval True indicates that the queue was not empty and value
+    ///         corresponds to the value that was at the front of the queue.
+    /// @retval False indicates that the queue was empty.
+    [[nodiscard]] bool try_pop(T *value)
+    {
+        return tryDequeue(value);
+    }
+    /// @brief Attempts to remove up to maximumValues values from the front of
+    ///        the bounded queue without waiting.
+    /// @param[out] values         The values are appended to this container.
+    /// @param[in] maximumValues   The maximum number of values to remove.
+    /// @result The number of values appended to values.
+    [[nodiscard]] size_t try_pop_n(std::vector<T> *values,
+                                   const size_t maximumValues)
+    {
+        size_t nPopped{0};
+        while (nPopped < maximumValues &&
+               tryDequeue([values](T &&value)
+                          {
+                              values->push_back(std::move(value));
+                          }))
+        {
+            nPopped = nPopped + 1;
+        }
+        return nPopped;
+    }
+    /// @brief Wakes all waiting consumers.
+    void notifyAll()
+    {
+        mConsumerSleeping.store(false, std::memory_order_seq_cst);
+        mEpoch.fetch_add(1, std::memory_order_seq_cst);
+        futexWake();
+    }
+    /// @brief Wakes all waiting consumers and keeps subsequent waits from
+    ///        sleeping.  Values may still be pushed and popped.  This is
+    ///        for shutdown since, unlike notifyAll(), a consumer about to
+    ///        wait cannot miss it.
+    void close()
+    {
+        mClosed.store(true, std::memory_order_seq_cst);
+        notifyAll();
+    }
+    /// @result True indicates the queue was closed.
+    [[nodiscard]] bool closed() const noexcept
+    {
+        return mClosed.load(std::memory_order_acquire);
+    }
+    /// @result True indicates that the bounded queue is empty.
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+    /// @result The approximate number of elements in the bounded queue.
+    [[nodiscard]] size_t size() const noexcept
+    {
+        auto dequeuePosition = mDequeuePosition.load(std::memory_order_acquire);
+        auto enqueuePosition = mEnqueuePosition.load(std::memory_order_acquire);
+        if (enqueuePosition <= dequeuePosition){return 0;}
+        auto result = enqueuePosition - dequeuePosition;
+        return static_cast<size_t> (std::min(result, mCapacity));
+    }
+    /// @result The maximum number of elements in the bounded queue.
+    [[nodiscard]] size_t capacity() const noexcept
+    {
+        return static_cast<size_t> (mCapacity);
+    }
+    /// @result The number of elements dropped because the queue was full.
+    [[nodiscard]] uint64_t dropped() const noexcept
+    {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+    /// @brief Destructor.
+    ~LockFreeBoundedQueue() = default;
+
+    LockFreeBoundedQueue(const LockFreeBoundedQueue &) = delete;
+    LockFreeBoundedQueue& operator=(const LockFreeBoundedQueue &) = delete;
+private:
+    // Slot in the ring.  The sequence number tells producers and consumers
+    // whose turn it is to use the slot.
+    struct alignas(64) Cell
+    {
+        std::atomic<uint64_t> sequence{0};
+        T data;
+    };
+    [[nodiscard]] bool tryEnqueue(T &value)
+    {
+        if (mCapacity == 0)
+        {
+            throw std::runtime_error("Bounded queue capacity not set");
+        }
+        auto position = mEnqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto &cell = mBuffer[position%mCapacity];
+            auto sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<int64_t> (sequence)
+                            - static_cast<int64_t> (position);
+            if (difference == 0)
+            {
+                if (mEnqueuePosition.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.data = std::move(value);
+                    cell.sequence.store(position + 1,
+                                        std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false; // Full
+            }
+            else
+            {
+                position = mEnqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    [[nodiscard]] bool tryDequeue(T *value)
+    {
+        return tryDequeue([value](T &&front)
+                          {
+                              *value = std::move(front);
+                          });
+    }
+    // Hands the front value to consume so callers that do not already have
+    // a T need not construct one before knowing the queue is not empty.
+    template<typename F>
+    [[nodiscard]] bool tryDequeue(F &&consume)
+    {
+        if (mCapacity == 0){return false;}
+        auto position = mDequeuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto &cell = mBuffer[position%mCapacity];
+            auto sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<int64_t> (sequence)
+                            - static_cast<int64_t> (position + 1);
+            if (difference == 0)
+            {
+                if (mDequeuePosition.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed))
+                {
+                    // Release the slot before consume() can throw
+                    T front{std::move(cell.data)};
+                    cell.sequence.store(position + mCapacity,
+                                        std::memory_order_release);
+                    consume(std::move(front));
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false; // Empty
+            }
+            else
+            {
+                position = mDequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    void dropOldest()
+    {
+        if (tryDequeue([](T &&){}))
+        {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void notify()
+    {
+        // Pairs with the store to mConsumerSleeping in the waiting consumer
+        // so either the consumer sees the new value or we see the consumer.
+        // Only the first producer to see a sleeping consumer pays for the
+        // system call.  Since the flag is shared every sleeper is woken.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mConsumerSleeping.load(std::memory_order_relaxed) &&
+            mConsumerSleeping.exchange(false, std::memory_order_seq_cst))
+        {
+            mEpoch.fetch_add(1, std::memory_order_seq_cst);
+            futexWake();
+        }
+    }
+    // Sleeps until the epoch changes from the given value, the queue is
+    // closed, or the wait expires.
+    void sleep(const uint32_t epoch, const std::chrono::milliseconds &waitFor)
+    {
+        // Closing bumps the epoch after setting the flag so checking it
+        // after reading the epoch can't miss the wake up
+        if (mClosed.load(std::memory_order_seq_cst)){return;}
+        if (waitFor == NO_DEADLINE)
+        {
+            futexWait(epoch, nullptr);
+            return;
+        }
+        auto waitForNanoSeconds
+            = std::chrono::duration_cast<std::chrono::nanoseconds>
+              (waitFor).count();
+        struct timespec timeOut;
+        timeOut.tv_sec = static_cast<time_t> (waitForNanoSeconds/1000000000);
+        timeOut.tv_nsec = static_cast<long> (waitForNanoSeconds%1000000000);
+        futexWait(epoch, &timeOut);
+    }
+    void futexWake()
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *> (&mEpoch),
+                FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+    // Sleeps until the epoch changes from the given value, we are woken,
+    // or the relative time out expires.
+    void futexWait(const uint32_t epoch, const struct timespec *timeOut)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *> (&mEpoch),
+                FUTEX_WAIT_PRIVATE, epoch, timeOut, nullptr, 0);
+    }
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+    std::unique_ptr<Cell[]> mBuffer{nullptr};
+    uint64_t mCapacity{0};
+    alignas(64) std::atomic<uint64_t> mEnqueuePosition{0};
+    alignas(64) std::atomic<uint64_t> mDequeuePosition{0};
+    alignas(64) std::atomic<bool> mConsumerSleeping{false};
+    std::atomic<uint32_t> mEpoch{0};
+    std::atomic<uint64_t> mDropped{0};
+    std::atomic<bool> mClosed{false};
+};
+}
+#endif
@@ -0,0 +1,214 @@
+#ifndef UWAVE_SERVER_PRIVATE_OBJECT_POOL_HPP
+#define UWAVE_SERVER_PRIVATE_OBJECT_POOL_HPP
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+namespace
+{
+/// @brief A thread-safe free list of heap allocated objects.  Released
+///        objects keep whatever memory they own, e.g., a vector's capacity,
+///        which is the point of recycling them.
+///
+///        Each thread caches a few objects so that most acquisitions and
+///        releases do not lock.  Objects are typically acquired on one
+///        thread (e.g., acquisition) and released on another (e.g., a
+///        database writer) so a thread whose cache fills spills half of it
+///        to a shared list and a thread whose cache empties refills half of
+///        it from the shared list.  The shared list is capped by the memory
+///        its objects retain rather than by their number.
+/// @note The caller is responsible for resetting an object's state before
+///       releasing it.
+/// @note The pool must outlive the threads that use it and there should be
+///       one pool per type since the per-thread caches are per type.
+template<typename T>
+class ObjectPool
+{
+public:
+    /// @brief Computes the memory retained by an object, e.g., sizeof(T)
+    ///        plus the capacity of its buffers.
+    using RetainedBytesFunction = size_t (*)(const T &);
+    /// @brief Constructor.
+    /// @param[in] maximumRetainedBytes  The most memory the shared list
+    ///                                  retains.  Objects spilled to a full
+    ///                                  shared list are deleted.
+    /// @param[in] retainedBytes         Computes the memory an object
+    ///                                  retains.
+    ObjectPool(const size_t maximumRetainedBytes,
+               RetainedBytesFunction retainedBytes) :
+        mRetainedBytesFunction(retainedBytes),
+        mMaximumRetainedBytes(maximumRetainedBytes)
+    {
+    }
+    /// @result A recycled object or, if there are none, a new one.
+    [[nodiscard]] std::unique_ptr<T> acquire()
+    {
+        auto cache = getLocalCache();
+        if (cache != nullptr)
+        {
+            if (cache->size == 0){refill(cache);}
+            if (cache->size > 0)
+            {
+                cache->size = cache->size - 1;
+                std::unique_ptr<T> object{cache->objects[cache->size].object};
+                mHits.fetch_add(1, std::memory_order_relaxed);
+                return object;
+            }
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lockGuard(mMutex);
+            if (!mObjects.empty())
+            {
+                std::unique_ptr<T> object{mObjects.back().object};
+                mRetainedBytes = mRetainedBytes - mObjects.back().bytes;
+                mObjects.pop_back();
+                mHits.fetch_add(1, std::memory_order_relaxed);
+                return object;
+            }
+        }
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        return std::make_unique<T> ();
+    }
+    /// @brief Returns the object to the pool.
+    void release(std::unique_ptr<T> &&object) noexcept
+    {
+        if (object == nullptr){return;}
+        Entry entry{nullptr, mRetainedBytesFunction(*object)};
+        auto cache = getLocalCache();
+        if (cache != nullptr)
+        {
+            if (cache->size == LOCAL_CAPACITY){spill(cache, LOCAL_CAPACITY/2);}
+            entry.object = object.release();
+            cache->objects[cache->size] = entry;
+            cache->size = cache->size + 1;
+            return;
+        }
+        {
+        std::lock_guard<std::mutex> lockGuard(mMutex);
+        if (mRetainedBytes + entry.bytes <= mMaximumRetainedBytes)
+        {
+            try
+            {
+                entry.object = object.get();
+                mObjects.push_back(entry);
+                mRetainedBytes = mRetainedBytes + entry.bytes;
+                static_cast<void> (object.release());
+                return;
+            }
+            catch (...)
+            {
+            }
+        }
+        }
+        object.reset(); // Shared list is full
+    }
+    /// @result The number of acquisitions served by a recycled object.
+    [[nodiscard]] int64_t getHits() const noexcept
+    {
+        return mHits.load(std::memory_order_relaxed);
+    }
+    /// @result The number of acquisitions that required an allocation.
+    [[nodiscard]] int64_t getMisses() const noexcept
+    {
+        return mMisses.load(std::memory_order_relaxed);
+    }
+    /// @result The number of objects waiting in the shared list.
+    [[nodiscard]] int64_t size() const noexcept
+    {
+        std::lock_guard<std::mutex> lockGuard(mMutex);
+        return static_cast<int64_t> (mObjects.size());
+    }
+    /// @result The memory retained by the objects in the shared list.
+    [[nodiscard]] size_t getRetainedBytes() const noexcept
+    {
+        std::lock_guard<std::mutex> lockGuard(mMutex);
+        return mRetainedBytes;
+    }
+    /// @brief Destructor.
+    ~ObjectPool()
+    {
+        for (auto &entry : mObjects){delete entry.object;}
+    }
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool& operator=(const ObjectPool &) = delete;
+private:
+    /// The most objects a thread caches.
+    static constexpr size_t LOCAL_CAPACITY{32};
+    struct Entry
+    {
+        T *object{nullptr};
+        size_t bytes{0};
+    };
+    struct LocalCache
+    {
+        /// Gives the cached objects back to the pool when the thread exits.
+        ~LocalCache()
+        {
+            if (owner != nullptr){owner->spill(this, size);}
+        }
+        std::array<Entry, LOCAL_CAPACITY> objects;
+        size_t size{0};
+        ObjectPool *owner{nullptr};
+    };
+    /// @result This thread's cache or nullptr if it belongs to another pool.
+    [[nodiscard]] LocalCache *getLocalCache() noexcept
+    {
+        thread_local LocalCache cache;
+        if (cache.owner == nullptr){cache.owner = this;}
+        return cache.owner == this ? &cache : nullptr;
+    }
+    /// Moves the cache's newest objects to the shared list.
+    void spill(LocalCache *cache, const size_t nObjects) noexcept
+    {
+        std::array<T *, LOCAL_CAPACITY> overflow;
+        size_t nOverflow{0};
+        {
+        std::lock_guard<std::mutex> lockGuard(mMutex);
+        for (size_t i = 0; i < nObjects; ++i)
+        {
+            cache->size = cache->size - 1;
+            const auto &entry = cache->objects[cache->size];
+            if (mRetainedBytes + entry.bytes <= mMaximumRetainedBytes)
+            {
+                try
+                {
+                    mObjects.push_back(entry);
+                    mRetainedBytes = mRetainedBytes + entry.bytes;
+                    continue;
+                }
+                catch (...)
+                {
+                }
+            }
+            overflow[nOverflow] = entry.object;
+            nOverflow = nOverflow + 1;
+        }
+        }
+        // Delete outside of the lock
+        for (size_t i = 0; i < nOverflow; ++i){delete overflow[i];}
+    }
+    /// Moves up to half a cache's worth of objects from the shared list.
+    void refill(LocalCache *cache)
+    {
+        std::lock_guard<std::mutex> lockGuard(mMutex);
+        while (!mObjects.empty() && cache->size < LOCAL_CAPACITY/2)
+        {
+            cache->objects[cache->size] = mObjects.back();
+            cache->size = cache->size + 1;
+            mRetainedBytes = mRetainedBytes - mObjects.back().bytes;
+            mObjects.pop_back();
+        }
+    }
+    mutable std::mutex mMutex;
+    std::vector<Entry> mObjects;
+    std::atomic<int64_t> mHits{0};
+    std::atomic<int64_t> mMisses{0};
+    RetainedBytesFunction mRetainedBytesFunction{nullptr};
+    size_t mRetainedBytes{0};
+    size_t mMaximumRetainedBytes{0};
+};
+}
+#endif
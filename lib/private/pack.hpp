@@ -3,55 +3,46 @@
 #include <bit>
 #include <string>
 #include <cstddef>
+#include <cstring>
 #include <algorithm>
+#include <stdexcept>
+#include <vector>
 #ifndef NDEBUG
 #include <cassert>
 #endif
 #include "private/compression.hpp"
+#include "private/byteSwap.hpp"
 namespace
 {
 
+/// @brief Packs the n samples into output which must hold n*sizeof(T)
+///        bytes.  When the byte order is native this is a memcpy, otherwise
+///        each sample's bytes are reversed with a vectorized kernel.
 template<typename T>
-std::string pack(const size_t n, const T *data, const bool swapBytes)
+void pack(const size_t n, const T *data, const bool swapBytes, char *output)
 {
-    std::string result;
-    constexpr auto dataTypeSize{sizeof(T)};
-    if (std::is_same<T, char>::value)
-    {
-        result.resize(n);
-        std::copy(data, data + n, result.data());
-        return result;
-    }
-    if (n == 0){return result;}
+    if (n == 0){return;}
 #ifndef NDEBUG
     assert(data != nullptr);
+    assert(output != nullptr);
 #endif
-    // Pack it up
-    result.resize(dataTypeSize*n);
-    union CharacterValueUnion
-    {
-        unsigned char cArray[dataTypeSize];
-        T value;
-    };
-    CharacterValueUnion cvUnion;
-    if (!swapBytes)
+    if (!swapBytes || sizeof(T) == 1)
     {
-        for (int i = 0; i < static_cast<int> (n); ++i)
-        {
-            cvUnion.value = data[i]; 
-            std::copy(cvUnion.cArray, cvUnion.cArray + dataTypeSize,
-                      result.data() + dataTypeSize*i);
-        }
+        std::memcpy(output, data, n*sizeof(T));
     }
     else
     {
-        for (int i = 0; i < static_cast<int> (n); ++i)
-        {
-            cvUnion.value = data[i];     
-            std::reverse_copy(cvUnion.cArray, cvUnion.cArray + dataTypeSize,
-                              result.data() + dataTypeSize*i);
-        }
+        ::reverseBytes<sizeof(T)> (data, n, output);
     }
+}
+
+template<typename T>
+std::string pack(const size_t n, const T *data, const bool swapBytes)
+{
+    std::string result;
+    if (n == 0){return result;}
+    result.resize(sizeof(T)*n);
+    ::pack<T> (n, data, swapBytes, result.data());
     return result;
 }
 
@@ -71,89 +62,93 @@ std::string packAndCompress(const size_t n,
     {
         result = ::pack<T> (n, data, swapBytes);
     }
+    else if (!swapBytes || sizeof(T) == 1)
+    {
+        // The samples are already in the desired byte order so compress
+        // straight from them
+        ::compressBytes(data, n*sizeof(T), compressionLevel, &result);
+    }
     else
     {
         auto workSpace = ::pack<T> (n, data, swapBytes);
-        result = ::compressString(workSpace, compressionLevel);
+        ::compressBytes(workSpace.data(), workSpace.size(),
+                        compressionLevel, &result);
     }
     return result;
 }
 
+/// @brief Unpacks the nSamples samples in dataPtr into output which must
+///        hold nSamples samples.
+/// @throws std::invalid_argument if dataPtrSize is not nSamples*sizeof(T).
 template<typename T>
-std::vector<T> unpack(const int nSamples,
-                      const unsigned char *dataPtr,
-                      const size_t dataPtrSize,
-                      const bool swapBytes)
+void unpack(const int nSamples,
+            const unsigned char *dataPtr,
+            const size_t dataPtrSize,
+            const bool swapBytes,
+            T *output)
 {
-    std::vector<T> result;
-    constexpr auto dataTypeSize{sizeof(T)};
-    result.resize(nSamples);
-    if (std::is_same<T, char>::value)
+    if (nSamples <= 0){return;}
+    auto nBytes = static_cast<size_t> (nSamples)*sizeof(T);
+    if (dataPtrSize != nBytes)
     {
-        std::copy(dataPtr, dataPtr + nSamples, result.data());
-        return result;
+        throw std::invalid_argument("Expecting " + std::to_string(nBytes)
+                                  + " bytes but have "
+                                  + std::to_string(dataPtrSize));
     }
-    if (nSamples == 0){return result;}
-#ifndef NDEBUG
-    assert(dataPtrSize == dataTypeSize*nSamples);
-#endif
-    // Unpack it
-    union CharacterValueUnion
+    if (!swapBytes || sizeof(T) == 1)
     {
-        unsigned char cArray[dataTypeSize];
-        T value;
-    };
-    CharacterValueUnion cvUnion;
-    if (!swapBytes)
-    {
-        for (int i = 0; i < nSamples; ++i)
-        {
-            auto i0 = dataTypeSize*i;
-            auto i1 = i0 + dataTypeSize;
-            std::copy(dataPtr + i0, dataPtr + i1, cvUnion.cArray);
-            result[i] = cvUnion.value;
-        }
+        std::memcpy(output, dataPtr, nBytes);
     }
     else
     {
-        for (int i = 0; i < nSamples; ++i)
-        {
-            auto i0 = dataTypeSize*i;
-            auto i1 = i0 + dataTypeSize;
-            std::reverse_copy(dataPtr + i0, dataPtr + i1, cvUnion.cArray);
-            result[i] = cvUnion.value;
-        }
+        ::reverseBytes<sizeof(T)> (dataPtr, nSamples, output);
     }
-    return result; 
 }
 
+/// @brief Decompresses, if necessary, and unpacks the nSamples samples
+///        directly into output which must hold nSamples samples.
 template<typename T>
-std::vector<T> decompressAndUnpack(const int nSamples,
-                                   std::basic_string<std::byte> &data,
-                                   const bool packedAsLittleEndian,
-                                   const bool amLittleEndian,
-                                   const bool isCompressed)
+void decompressAndUnpack(const int nSamples,
+                         const std::basic_string<std::byte> &data,
+                         const bool packedAsLittleEndian,
+                         const bool amLittleEndian,
+                         const bool isCompressed,
+                         T *output)
 {
+    if (nSamples <= 0){return;}
     bool swapBytes
         = (packedAsLittleEndian == amLittleEndian) ? false : true;
     if (isCompressed)
     {
-        auto decompressedData = ::decompressByteString(data);
-        auto dataPtr 
-            = reinterpret_cast<const unsigned char *> (decompressedData.data());
-        return ::unpack<T> (nSamples,
-                            dataPtr,
-                            decompressedData.size(),
-                            swapBytes);
-
+        // We know the size so inflate straight into the output
+        ::decompressBytes(data.data(), data.size(),
+                          output, nSamples*sizeof(T));
+        if (swapBytes && sizeof(T) > 1)
+        {
+            ::reverseBytes<sizeof(T)> (output, nSamples, output);
+        }
     }
     else
     {
         auto dataPtr = reinterpret_cast<const unsigned char *> (data.data());
-        return ::unpack<T> (nSamples, dataPtr, data.size(), swapBytes);
+        ::unpack<T> (nSamples, dataPtr, data.size(), swapBytes, output);
     }
 }
 
+template<typename T>
+std::vector<T> decompressAndUnpack(const int nSamples,
+                                   const std::basic_string<std::byte> &data,
+                                   const bool packedAsLittleEndian,
+                                   const bool amLittleEndian,
+                                   const bool isCompressed)
+{
+    std::vector<T> result(std::max(0, nSamples));
+    ::decompressAndUnpack<T> (nSamples, data,
+                              packedAsLittleEndian, amLittleEndian,
+                              isCompressed, result.data());
+    return result;
+}
+
 
 /*
 /// @brief Performs a byte swap on a value.
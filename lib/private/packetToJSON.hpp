@@ -1,5 +1,6 @@
 #ifndef PACKET_TO_JSON_HPP
 #define PACKET_TO_JSON_HPP
+#include <type_traits>
 #include <vector>
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
@@ -17,58 +18,36 @@ nlohmann::json toJSON(const UWaveServer::Packet &packet)
     result["locationCode"] = packet.getLocationCode();
     result["samplingRate"] = packet.getSamplingRate();
     result["startTimeMuSeconds"] = packet.getStartTime().count();
-    auto nSamples = packet.size(); 
-    
-    if (!packet.empty())
+    if (!packet.empty() &&
+        packet.getDataType() != UWaveServer::Packet::DataType::Text)
     {
-        auto nSamples = packet.size();
-        auto dataType = packet.getDataType();
-        if (dataType == UWaveServer::Packet::DataType::Integer32)
+        packet.visitData([&result](const auto samples)
         {
-            auto dataPtr = reinterpret_cast<const int *> (packet.data());
-            std::vector<int> data(dataPtr, dataPtr + nSamples);
-            result["dataType"] = "integer32";
-            result["data"] = std::move(data); 
-        } 
-        else if (dataType == UWaveServer::Packet::DataType::Integer64)
-        {
-            auto dataPtr = reinterpret_cast<const int64_t *> (packet.data());
-            std::vector<int64_t> data(dataPtr, dataPtr + nSamples);
-            result["dataType"] = "integer64";
-            result["data"] = std::move(data); 
-        }
-        else if (dataType == UWaveServer::Packet::DataType::Double)
-        {
-            auto dataPtr = reinterpret_cast<const double *> (packet.data());
-            std::vector<double> data(dataPtr, dataPtr + nSamples);
-            result["dataType"] = "float64";
-            result["data"] = std::move(data); 
-        }
-        else if (dataType == UWaveServer::Packet::DataType::Float)
-        {
-            auto dataPtr = reinterpret_cast<const float *> (packet.data());
-            std::vector<float> data(dataPtr, dataPtr + nSamples);
-            result["dataType"] = "float32";
-            result["data"] = std::move(data); 
-        }
-#ifndef NDEBUG
-        else
-        {
-            assert(false);
-        }
-#else
-        else
-        {
-            result["dataType"] = nullptr;
-            result["data"] = nullptr;
-        }
-#endif
+            using T = typename decltype(samples)::value_type;
+            if constexpr (std::is_same_v<T, int>)
+            {
+                result["dataType"] = "integer32";
+            }
+            else if constexpr (std::is_same_v<T, int64_t>)
+            {
+                result["dataType"] = "integer64";
+            }
+            else if constexpr (std::is_same_v<T, double>)
+            {
+                result["dataType"] = "float64";
+            }
+            else if constexpr (std::is_same_v<T, float>)
+            {
+                result["dataType"] = "float32";
+            }
+            result["data"]
+                = nlohmann::json::array_t(samples.begin(), samples.end());
+        });
     }
     else
     {
         result["dataType"] = nullptr;
         result["data"] = nullptr;
-
     } 
     return result;
 }
@@ -0,0 +1,105 @@
+#ifndef UWAVE_SERVER_PRIVATE_PREPARED_STATEMENT_CACHE_HPP
+#define UWAVE_SERVER_PRIVATE_PREPARED_STATEMENT_CACHE_HPP
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <pqxx/pqxx>
+namespace
+{
+/// @brief Caches the names of statements prepared on a single connection.
+///        Our SQL depends on the data table so there is one entry per
+///        (statement kind, table name).  On a miss the SQL is prepared on
+///        the connection and on a hit the server-side plan is reused.
+///        Prepared statements do not survive a reconnect so the owner
+///        must call clear() whenever a new connection is established.
+/// @note This is not thread safe; callers should hold the same mutex that
+///       guards the connection.  The hit and miss counts may be read from
+///       any thread.
+class PreparedStatementCache
+{
+public:
+    /// @brief The statement kinds.
+    enum class Kind
+    {
+        Insert,          /*!< Insert a packet into a data table. */
+        InsertWithCodec, /*!< Insert a packet and its codec into a data
+                              table. */
+        Query,           /*!< Query a stream's packets from a data table. */
+        QueryWithoutCodec, /*!< Query a stream's packets from a data table
+                                that predates the codec column. */
+        QueryAllChannels, /*!< Query many streams' packets from a data
+                               table. */
+        QueryAllChannelsWithoutCodec /*!< Query many streams' packets from a
+                                          data table that predates the codec
+                                          column. */
+    };
+    /// @result The name of the prepared statement for the given kind and
+    ///         table.  If it does not exist then the SQL is created with
+    ///         createSQL(tableName) and prepared on the connection.
+    template<typename F>
+    [[nodiscard]]
+    std::string get(pqxx::connection &connection,
+                    const Kind kind,
+                    const std::string &tableName,
+                    F &&createSQL)
+    {
+        return get(kind, tableName, std::forward<F> (createSQL),
+                   [&connection](const std::string &name,
+                                 const std::string &sql)
+                   {
+                       connection.prepare(name, sql);
+                   });
+    }
+    /// @result The name of the prepared statement for the given kind and
+    ///         table.  If it does not exist then the SQL is created with
+    ///         createSQL(tableName) and prepared with prepare(name, sql).
+    ///         This is for connections that are not managed by pqxx.
+    template<typename F, typename P>
+    [[nodiscard]]
+    std::string get(const Kind kind,
+                    const std::string &tableName,
+                    F &&createSQL,
+                    P &&prepare)
+    {
+        auto key = std::pair {kind, tableName};
+        auto index = mStatements.find(key);
+        if (index != mStatements.end())
+        {
+            mHits.fetch_add(1, std::memory_order_relaxed);
+            return index->second;
+        }
+        auto name = "uws_statement_" + std::to_string(mStatements.size());
+        prepare(name, createSQL(tableName)); // Throws
+        mStatements.insert(std::pair {std::move(key), name});
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        return name;
+    }
+    /// @brief Forgets all statements.  Call this after (re)connecting.
+    void clear() noexcept
+    {
+        mStatements.clear();
+    }
+    /// @result The number of prepared statements.
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return mStatements.size();
+    }
+    /// @result The number of times a statement was found in the cache.
+    [[nodiscard]] int64_t hits() const noexcept
+    {
+        return mHits.load(std::memory_order_relaxed);
+    }
+    /// @result The number of times a statement had to be prepared.
+    [[nodiscard]] int64_t misses() const noexcept
+    {
+        return mMisses.load(std::memory_order_relaxed);
+    }
+private:
+    std::map<std::pair<Kind, std::string>, std::string> mStatements;
+    std::atomic<int64_t> mHits{0};
+    std::atomic<int64_t> mMisses{0};
+};
+}
+#endif
@@ -0,0 +1,114 @@
+#ifndef UWAVE_SERVER_PRIVATE_SINGLE_FLIGHT_HPP
+#define UWAVE_SERVER_PRIVATE_SINGLE_FLIGHT_HPP
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+namespace
+{
+/// @brief Coalesces concurrent calls for the same key.  The first caller
+///        computes the value while callers arriving before it finishes
+///        wait and share the result, e.g., when dozens of clients request
+///        the same window right after an event.
+/// @note Nothing is cached - once the computation finishes the next call
+///       for the key computes a fresh value.
+template<typename Key, typename Value>
+class SingleFlight
+{
+public:
+    /// @param[in] key       Identifies the computation.
+    /// @param[in] function  Computes the value.  This is only invoked if no
+    ///                      call for the key is in flight.
+    /// @result The value computed by this or a concurrent caller.
+    /// @throws Whatever the function threw.  Callers waiting on the
+    ///         computation receive the same exception.
+    template<typename F>
+    [[nodiscard]] std::shared_ptr<const Value> run(const Key &key,
+                                                   F &&function)
+    {
+        std::shared_ptr<Call> call;
+        bool isLeader{false};
+        {
+        std::scoped_lock lock(mMutex);
+        auto index = mCalls.find(key);
+        if (index != mCalls.end())
+        {
+            call = index->second;
+        }
+        else
+        {
+            call = std::make_shared<Call> ();
+            call->result = call->promise.get_future().share();
+            mCalls.insert(std::pair {key, call});
+            isLeader = true;
+        }
+        }
+        if (!isLeader)
+        {
+            mCoalesced.fetch_add(1, std::memory_order_relaxed);
+            return call->result.get();
+        }
+        try
+        {
+            // Not const so the last owner may move it - see take()
+            std::shared_ptr<const Value> value
+                = std::make_shared<Value> (function());
+            finish(key);
+            call->promise.set_value(std::move(value));
+        }
+        catch (...)
+        {
+            finish(key);
+            call->promise.set_exception(std::current_exception());
+        }
+        return call->result.get();
+    }
+    /// @brief Releases a caller's reference to a result.
+    /// @result The value.  The last caller holding the result moves it out
+    ///         while the others copy it.
+    [[nodiscard]] static Value take(std::shared_ptr<const Value> &&value)
+    {
+        if (value.use_count() == 1)
+        {
+            // The value was created non-const in run() and no one else can
+            // reach it
+            auto owned = std::const_pointer_cast<Value> (std::move(value));
+            return std::move(*owned);
+        }
+        Value copy{*value};
+        value.reset();
+        return copy;
+    }
+    /// @result The number of calls that shared another caller's result.
+    [[nodiscard]] int64_t getCoalesced() const noexcept
+    {
+        return mCoalesced.load(std::memory_order_relaxed);
+    }
+    /// @result The number of computations in flight.
+    [[nodiscard]] int size() const noexcept
+    {
+        std::scoped_lock lock(mMutex);
+        return static_cast<int> (mCalls.size());
+    }
+private:
+    struct Call
+    {
+        std::promise<std::shared_ptr<const Value>> promise;
+        std::shared_future<std::shared_ptr<const Value>> result;
+    };
+    // Later callers start a new computation
+    void finish(const Key &key)
+    {
+        std::scoped_lock lock(mMutex);
+        mCalls.erase(key);
+    }
+    mutable std::mutex mMutex;
+    std::map<Key, std::shared_ptr<Call>> mCalls;
+    std::atomic<int64_t> mCoalesced{0};
+};
+}
+#endif
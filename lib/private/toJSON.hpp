@@ -4,6 +4,8 @@
 #include <cmath>
 #include <chrono>
 #include <set>
+#include <span>
+#include <type_traits>
 #include <crow/json.h>
 #include <spdlog/spdlog.h>
 #include "uWaveServer/packet.hpp"
@@ -11,45 +13,48 @@
 namespace
 {
 
+/// Converts the samples to a JSON list without an intermediate copy.
+template<typename T>
+[[nodiscard]] crow::json::wvalue::list toCrowList(const std::span<const T> samples)
+{
+    crow::json::wvalue::list result;
+    result.reserve(samples.size());
+    for (const auto &sample : samples){result.emplace_back(sample);}
+    return result;
+}
+
 crow::json::wvalue packetToCrowJSON(const UWaveServer::Packet &packet)
 {
     crow::json::wvalue result;
     result["samplingRate"] = packet.getSamplingRate();
     result["startTimeMuSec"] = packet.getStartTime().count();
-    auto dataType = packet.getDataType(); 
     if (!packet.empty())
     {
-        if (dataType == UWaveServer::Packet::DataType::Integer32)
-        {
-            result["dataType"] = "int32_t";
-            result["samples"] = packet.getData<int> (); 
-        }
-        else if (dataType == UWaveServer::Packet::DataType::Integer64)
-        {
-            result["dataType"] = "int64_t";
-            result["samples"] = packet.getData<int64_t> (); 
-        }
-        else if (dataType == UWaveServer::Packet::DataType::Double)
-        {
-            result["dataType"] = "double";
-            result["samples"] = packet.getData<double> (); 
-        }
-        else if (dataType == UWaveServer::Packet::DataType::Float)
-        {
-            result["dataType"] = "float";
-            result["samples"] = packet.getData<float> (); 
-        }
-        else if (dataType == UWaveServer::Packet::DataType::Text)
-        {
-            result["dataType"] = "text";
-            result["samples"] = packet.getData<char> (); 
-        }
-        else
+        packet.visitData([&result](const auto samples)
         {
-            spdlog::warn("Undefined data type");
-            result["dataType"] = nullptr;
-            result["samples"] = nullptr;
-        }
+            using T = typename decltype(samples)::value_type;
+            if constexpr (std::is_same_v<T, int>)
+            {
+                result["dataType"] = "int32_t";
+            }
+            else if constexpr (std::is_same_v<T, int64_t>)
+            {
+                result["dataType"] = "int64_t";
+            }
+            else if constexpr (std::is_same_v<T, double>)
+            {
+                result["dataType"] = "double";
+            }
+            else if constexpr (std::is_same_v<T, float>)
+            {
+                result["dataType"] = "float";
+            }
+            else
+            {
+                result["dataType"] = "text";
+            }
+            result["samples"] = ::toCrowList(samples);
+        });
     }
     return result;    
 }
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <type_traits>
 #include <libmseed.h>
 #include <spdlog/spdlog.h>
 #ifndef NDEBUG
@@ -66,6 +67,131 @@ int getMiniSEEDEncoding(const int encoding, const bool canDoSTEIM2)
     throw std::runtime_error("Unhandled encoding " + std::to_string(encoding));
 } 
 
+/// Adds the packet to the trace list.  The int64_t packets are converted
+/// to doubles in i64Data.  This is safe since the trace list copies the
+/// samples.
+/// @result False indicates the packet was skipped.
+bool addToTraceList(const UWaveServer::Packet &packet,
+                    const bool canDoSTEIM2,
+                    MS3Record *msRecord,
+                    MS3TraceList *msTraceList,
+                    std::vector<double> *i64Data,
+                    spdlog::logger *logger)
+{
+    if (packet.empty() ||
+        !packet.hasNetwork() ||
+        !packet.hasStation() ||
+        !packet.hasChannel())
+    {
+        if (logger)
+        {
+            SPDLOG_LOGGER_WARN(logger, "Empty packet");
+        }
+        return false;
+    }
+    if (msRecord == nullptr)
+    {
+        if (logger)
+        {
+            SPDLOG_LOGGER_WARN(logger, "MiniSEED record pointer is null");
+        }
+        return false;
+    }
+    // Pack the sid
+    auto network = packet.getNetwork();
+    auto station = packet.getStation();
+    auto channel = packet.getChannel();
+    std::string locationCode;
+    if (packet.hasLocationCode())
+    {
+        locationCode = packet.getLocationCode();
+    }
+    auto sidLength
+        = ms_nslc2sid(msRecord->sid, LM_SIDLEN, 0,
+                      const_cast<char *> (network.c_str()),
+                      const_cast<char *>(station.c_str()),
+                      const_cast<char *>(locationCode.c_str()),
+                      const_cast<char *>(channel.c_str()));
+    if (sidLength < 1)
+    {
+        if (logger)
+        {
+            SPDLOG_LOGGER_ERROR(logger, "Failed to pack SID");
+        }
+        return false;
+    }
+    msRecord->datasamples = nullptr;
+    // Pack the data
+    msRecord->pubversion = 1;
+    // Microseconds to nanoseconds
+    msRecord->starttime
+        = static_cast<int64_t> (packet.getStartTime().count()*1000);
+    //char timestr[30];
+    //ms_nstime2timestr(msRecord->starttime, timestr, ISOMONTHDAY, NANO_MICRO_NONE);
+    //std::cout << msRecord->starttime << " " << timestr << std::endl;
+    msRecord->samprate = packet.getSamplingRate();
+    msRecord->numsamples = packet.size();
+    // libmseed reads the packet's samples in place
+    packet.visitData([&](const auto samples)
+    {
+        using T = typename decltype(samples)::value_type;
+        auto dataPtr = const_cast<T *> (samples.data());
+        if constexpr (std::is_same_v<T, int>)
+        {
+            msRecord->encoding = DE_INT32;
+            if (canDoSTEIM2){msRecord->encoding = DE_STEIM2;}
+            msRecord->sampletype = 'i';
+            msRecord->datasamples = dataPtr;
+        }
+        else if constexpr (std::is_same_v<T, float>)
+        {
+            msRecord->encoding = DE_FLOAT32;
+            msRecord->sampletype = 'f';
+            msRecord->datasamples = dataPtr;
+        }
+        else if constexpr (std::is_same_v<T, double>)
+        {
+            msRecord->encoding = DE_FLOAT64;
+            msRecord->sampletype = 'd';
+            msRecord->datasamples = dataPtr;
+        }
+        else if constexpr (std::is_same_v<T, int64_t>)
+        {
+            // Pack an int64_t into a double
+            i64Data->assign(samples.begin(), samples.end());
+            msRecord->encoding = DE_FLOAT64;
+            msRecord->sampletype = 'd';
+            msRecord->datasamples = i64Data->data();
+        }
+        else
+        {
+            throw std::runtime_error("Unhandled data type");
+        }
+    });
+    msRecord->samplecnt = msRecord->numsamples;
+    // Add the record to the trace list
+    constexpr uint32_t unusedFlags{0};
+    auto msTraceSegment
+        = mstl3_addmsr_recordptr(msTraceList,
+                                 msRecord, 
+                                 nullptr,
+                                 0, // split version
+                                 1, // auto heal
+                                 unusedFlags, // flags 
+                                 nullptr); // NULL is default tolerance
+    msRecord->datasamples = nullptr;
+    if (msTraceSegment == nullptr)
+    {
+        if (logger)
+        {
+            SPDLOG_LOGGER_WARN(logger,
+                               "Failed to add miniSEED record to trace list");
+        }
+        return false;
+    }
+    return true;
+}
+
 [[nodiscard]]
 std::string toMiniSEED(const std::vector<UWaveServer::Packet> &packets,
                        const int maxRecordLength = 512, //-1 results in default which is 4096
@@ -99,135 +225,25 @@ std::string toMiniSEED(const std::vector<UWaveServer::Packet> &packets,
     }
     // Package things up 
     MS3TraceList *msTraceList{nullptr};
-    MS3Tolerance *msTolerance{nullptr};
-    MS3TraceSeg *msTraceSegment{nullptr};
     MS3Record *msRecord{nullptr};
     msRecord = msr3_init(msRecord);
     msTraceList = mstl3_init(msTraceList); 
+    // Reused by the int64_t packets which are packed as doubles
+    std::vector<double> i64Data;
     int64_t expectedNumberOfSamplesToPack{0};
     int64_t packedSamplesCount{0};
     if (msTraceList == nullptr)
     {
         throw std::runtime_error("Failed to initialize mseed trace list");
     }
+    if (msRecord){msRecord->reclen = maxRecordLength;}
     for (const auto &packet : packets)
     { 
-        if (!packet.empty() &&
-            packet.hasNetwork() &&
-            packet.hasStation() &&
-            packet.hasChannel())
-        {
-            if (msRecord)
-            {
-                // Pack the sid
-                auto network = packet.getNetwork();
-                auto station = packet.getStation();
-                auto channel = packet.getChannel();
-                std::string locationCode;
-                if (packet.hasLocationCode())
-                {
-                    locationCode = packet.getLocationCode();
-                }
-                auto sidLength
-                    = ms_nslc2sid(msRecord->sid, LM_SIDLEN, 0,
-                                  const_cast<char *> (network.c_str()),
-                                  const_cast<char *>(station.c_str()),
-                                  const_cast<char *>(locationCode.c_str()),
-                                  const_cast<char *>(channel.c_str()));
-                if (sidLength < 1)
-                {
-                    if (logger)
-                    {
-                        SPDLOG_LOGGER_ERROR(logger, "Failed to pack SID");
-                    }
-                    continue;
-                }
-                msRecord->datasamples = nullptr;
-                // Pack the data
-                std::vector<double> i64Data;
-                msRecord->reclen = maxRecordLength;
-                msRecord->pubversion = 1;
-                // Microseconds to nanoseconds
-                msRecord->starttime
-                    = static_cast<int64_t> (packet.getStartTime().count()*1000);
-                //char timestr[30];
-                //ms_nstime2timestr(msRecord->starttime, timestr, ISOMONTHDAY, NANO_MICRO_NONE);
-                //std::cout << msRecord->starttime << " " << timestr << std::endl;
-                msRecord->samprate = packet.getSamplingRate();
-                msRecord->numsamples = packet.size();
-                auto encodingInteger = ::encodingInteger(packet.getDataType());
-                if (encodingInteger == INT_ENCODING)
-                {
-                    msRecord->encoding = DE_INT32;
-                    if (canDoSTEIM2){msRecord->encoding = DE_STEIM2;}
-                    msRecord->sampletype = 'i';
-                    msRecord->datasamples = const_cast<void *> (packet.data());
-                }
-                else if (encodingInteger == FLOAT_ENCODING)
-                {
-                    msRecord->encoding = DE_FLOAT32;
-                    msRecord->sampletype = 'f';
-                    msRecord->datasamples = const_cast<void *> (packet.data());
-                }
-                else if (encodingInteger == DOUBLE_ENCODING)
-                {
-                    msRecord->encoding = DE_FLOAT64;
-                    msRecord->sampletype = 'd';
-                    msRecord->datasamples = const_cast<void *> (packet.data());
-                }
-                else if (encodingInteger == INT64_ENCODING)
-                {
-                    i64Data.resize(packet.size());
-                    auto dataPtr = static_cast<const int64_t *> (packet.data());
-                    // Pack an int64_t into a double
-                    std::copy(dataPtr, dataPtr + packet.size(), i64Data.data());
-                    msRecord->datasamples = i64Data.data(); 
-                }
-                else
-                {
-                    throw std::runtime_error("Unhandled data type");
-                } 
-                msRecord->samplecnt = msRecord->numsamples;
-                expectedNumberOfSamplesToPack
-                    = expectedNumberOfSamplesToPack + msRecord->numsamples;
-                // Add the record to the trace list
-                constexpr uint32_t unusedFlags{0};
-                msTraceSegment = mstl3_addmsr_recordptr(msTraceList,
-                                                        msRecord, 
-                                                        nullptr,
-                                                        0, // split version
-                                                        1, // auto heal
-                                                        unusedFlags, // flags 
-                                                        msTolerance); // NULL is default tolerance
-                if (msTraceSegment == nullptr)
-                {
-                    if (logger)
-                    {
-                        SPDLOG_LOGGER_WARN(logger,
-                                           "Failed to add miniSEED record to trace list");
-                    }
-                    msRecord->datasamples = nullptr;
-                    //msr3_free(&msRecord);
-                    continue;
-                }
-                
-                msRecord->datasamples = nullptr;
-                //msr3_free(&msRecord);
-            }
-            else
-            {
-                if (logger)
-                {
-                    SPDLOG_LOGGER_WARN(logger, "MiniSEED record pointer is null");
-                }
-            }
-        }
-        else
+        if (::addToTraceList(packet, canDoSTEIM2,
+                             msRecord, msTraceList, &i64Data, logger))
         {
-            if (logger)
-            {
-                SPDLOG_LOGGER_WARN(logger, "Empty packet");
-            }
+            expectedNumberOfSamplesToPack
+                = expectedNumberOfSamplesToPack + packet.size();
         }
     }
     // Write the data to a string buffer
@@ -287,6 +303,142 @@ std::string toMiniSEED(const std::vector<UWaveServer::Packet> &packets,
     return outputBuffer; 
 }
 
+/// @brief Packs packets into miniSEED records as they arrive, e.g., from
+///        ReadOnlyClient::streamQuery.  Until flush() only complete records
+///        are packed and the packed samples are dropped from the trace
+///        list, so the memory held is the partially filled records rather
+///        than the entire request.
+/// @note Unlike toMiniSEED the encoding cannot be chosen by looking at all
+///       the packets first.  Instead, the encoding follows the packets' data
+///       type and the pending data is flushed whenever it changes.
+class MiniSEEDStreamEncoder
+{
+public:
+    /// @param[in,out] outputBuffer  The records are appended to this buffer.
+    MiniSEEDStreamEncoder(std::string *outputBuffer,
+                          const int maxRecordLength = 512,
+                          const bool useMiniSEED3 = true,
+                          spdlog::logger *logger = nullptr) :
+        mOutputBuffer(outputBuffer),
+        mLogger(logger),
+        mMaxRecordLength(maxRecordLength),
+        mUseMiniSEED3(useMiniSEED3)
+    {
+        if (mOutputBuffer == nullptr)
+        {
+            throw std::invalid_argument("Output buffer is null");
+        }
+        mRecord = msr3_init(mRecord);
+        mTraceList = mstl3_init(mTraceList);
+        if (mRecord == nullptr || mTraceList == nullptr)
+        {
+            if (mRecord){msr3_free(&mRecord);}
+            if (mTraceList){mstl3_free(&mTraceList, 1);}
+            throw std::runtime_error("Failed to initialize mseed trace list");
+        }
+        mRecord->reclen = mMaxRecordLength;
+    }
+    /// @brief Adds the packet and packs any records that are now complete.
+    void add(const UWaveServer::Packet &packet)
+    {
+        if (packet.empty()){return;}
+        auto encodingInteger = ::encodingInteger(packet.getDataType());
+        if (encodingInteger != mEncodingInteger)
+        {
+            // A trace segment cannot mix sample types so start over
+            if (mEncodingInteger >= 0)
+            {
+                flush();
+                mstl3_free(&mTraceList, 1);
+                mTraceList = mstl3_init(mTraceList);
+                if (mTraceList == nullptr)
+                {
+                    throw std::runtime_error(
+                        "Failed to initialize mseed trace list");
+                }
+            }
+            mEncodingInteger = encodingInteger;
+        }
+        constexpr bool canDoSTEIM2{true};
+        if (::addToTraceList(packet, canDoSTEIM2,
+                             mRecord, mTraceList, &mI64Data, mLogger))
+        {
+            mSamplesAdded = mSamplesAdded + packet.size();
+            pack(false);
+        }
+    }
+    /// @brief Packs the remaining samples, including partial records.
+    void flush()
+    {
+        if (mEncodingInteger >= 0){pack(true);}
+    }
+    /// @result The number of records packed.
+    [[nodiscard]] int64_t getNumberOfRecords() const noexcept
+    {
+        return mRecordsPacked;
+    }
+    /// @result The number of samples packed.
+    [[nodiscard]] int64_t getNumberOfSamples() const noexcept
+    {
+        return mSamplesPacked;
+    }
+    ~MiniSEEDStreamEncoder()
+    {
+        if (mRecord){msr3_free(&mRecord);}
+        if (mTraceList){mstl3_free(&mTraceList, 1);}
+    }
+    MiniSEEDStreamEncoder(const MiniSEEDStreamEncoder &) = delete;
+    MiniSEEDStreamEncoder& operator=(const MiniSEEDStreamEncoder &) = delete;
+private:
+    void pack(const bool flushData)
+    {
+        uint32_t flags{0};
+        if (flushData){flags |= MSF_FLUSHDATA;}
+        if (!mUseMiniSEED3){flags |= MSF_PACKVER2;}
+        constexpr bool canDoSTEIM2{true};
+        auto mseedEncoding
+            = ::getMiniSEEDEncoding(mEncodingInteger, canDoSTEIM2);
+        char *extraHeaders{nullptr};
+        constexpr int8_t verbose{0};
+        int64_t packedSamplesCount{0};
+        auto nRecordsPacked = mstl3_pack(mTraceList,
+                                         &msRecordHandler,
+                                         mOutputBuffer,
+                                         mMaxRecordLength,
+                                         mseedEncoding,
+                                         &packedSamplesCount,
+                                         flags,
+                                         verbose,
+                                         extraHeaders);
+        if (nRecordsPacked < 0)
+        {
+            throw std::runtime_error("Failed to pack miniSEED records");
+        }
+        mRecordsPacked = mRecordsPacked + nRecordsPacked;
+        mSamplesPacked = mSamplesPacked + packedSamplesCount;
+        if (flushData && mSamplesPacked != mSamplesAdded && mLogger)
+        {
+            SPDLOG_LOGGER_WARN(mLogger,
+                               "Only packed {} of {} samples into {} records",
+                               mSamplesPacked,
+                               mSamplesAdded,
+                               mRecordsPacked);
+        }
+    }
+    std::string *mOutputBuffer{nullptr};
+    spdlog::logger *mLogger{nullptr};
+    MS3Record *mRecord{nullptr};
+    MS3TraceList *mTraceList{nullptr};
+    // Reused by the int64_t packets which are packed as doubles
+    std::vector<double> mI64Data;
+    int64_t mRecordsPacked{0};
+    int64_t mSamplesPacked{0};
+    int64_t mSamplesAdded{0};
+    int mMaxRecordLength{512};
+    int mEncodingInteger{-1};
+    bool mUseMiniSEED3{true};
+};
+
 
 }
 #endif
@@ -1,8 +1,12 @@
 #ifndef PRIVATE_TO_NAME_HPP
 #define PRIVATE_TO_NAME_HPP
+#include <array>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include "uWaveServer/packet.hpp"
+#include "uWaveServer/packetHeader.hpp"
+#include "uWaveServer/streamRegistry.hpp"
 namespace
 {
 
@@ -33,6 +37,12 @@ namespace
 
 [[nodiscard]] std::string toName(const UWaveServer::Packet &packet)
 {
+    // Once the stream is interned its name is already built
+    if (packet.hasStreamHandle())
+    {
+        return UWaveServer::StreamRegistry::getInstance().getName(
+                   packet.getStreamHandle());
+    }
     auto network = packet.getNetwork();
     auto station = packet.getStation(); 
     auto channel = packet.getChannel();
@@ -54,5 +64,31 @@ namespace
     return name;
     */
 }
+
+/// Splits NETWORK.STATION.CHANNEL[.LOCATION] into the header's codes.
+[[maybe_unused]]
+void fromName(const std::string_view name, UWaveServer::PacketHeader *header)
+{
+    std::array<std::string_view, 4> codes;
+    size_t nCodes{0};
+    size_t start{0};
+    while (nCodes < codes.size())
+    {
+        auto dot = name.find('.', start);
+        codes[nCodes] = name.substr(start, dot - start);
+        nCodes = nCodes + 1;
+        if (dot == std::string_view::npos){break;}
+        start = dot + 1;
+    }
+    if (nCodes < 3)
+    {
+        throw std::invalid_argument("Malformed stream name "
+                                  + std::string {name});
+    }
+    header->network = codes[0];
+    header->station = codes[1];
+    header->channel = codes[2];
+    header->locationCode = nCodes == 4 ? codes[3] : std::string_view {};
+}
 }
 #endif
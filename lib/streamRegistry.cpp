@@ -0,0 +1,143 @@
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "uWaveServer/streamRegistry.hpp"
+#include "uWaveServer/packet.hpp"
+
+using namespace UWaveServer;
+
+namespace
+{
+/// Writes NETWORK.STATION.CHANNEL[.LOCATION] into name.  This is the same
+/// convention as ::toName.
+void toName(const std::string_view network,
+            const std::string_view station,
+            const std::string_view channel,
+            const std::string_view locationCode,
+            std::string *name)
+{
+    name->clear();
+    name->append(network);
+    name->push_back('.');
+    name->append(station);
+    name->push_back('.');
+    name->append(channel);
+    if (!locationCode.empty())
+    {
+        name->push_back('.');
+        name->append(locationCode);
+    }
+}
+}
+
+class StreamRegistry::StreamRegistryImpl
+{
+public:
+    [[nodiscard]] uint32_t intern(const std::string_view network,
+                                  const std::string_view station,
+                                  const std::string_view channel,
+                                  const std::string_view locationCode)
+    {
+        if (network.empty()){throw std::invalid_argument("Network is empty");}
+        if (station.empty()){throw std::invalid_argument("Station is empty");}
+        if (channel.empty()){throw std::invalid_argument("Channel is empty");}
+        // Reuse the key's buffer so a hit doesn't allocate
+        thread_local std::string name;
+        ::toName(network, station, channel, locationCode, &name);
+        // Streams are nearly always already registered
+        {
+        std::shared_lock lock(mMutex);
+        auto index = mHandles.find(std::string_view {name});
+        if (index != mHandles.end()){return index->second;}
+        }
+        std::unique_lock lock(mMutex);
+        // Someone may have beaten me to it
+        auto index = mHandles.find(std::string_view {name});
+        if (index != mHandles.end()){return index->second;}
+        if (mNames.size() >= std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("Stream handles exhausted");
+        }
+        auto handle = static_cast<uint32_t> (mNames.size());
+        // A deque never moves its elements so the map can view them
+        mNames.push_back(name);
+        mHandles.insert(std::pair {std::string_view {mNames.back()}, handle});
+        return handle;
+    }
+    [[nodiscard]] const std::string &getName(const uint32_t handle) const
+    {
+        std::shared_lock lock(mMutex);
+        if (handle >= mNames.size())
+        {
+            throw std::out_of_range("Stream handle "
+                                  + std::to_string(handle)
+                                  + " was never assigned");
+        }
+        return mNames[handle];
+    }
+    [[nodiscard]] uint32_t size() const noexcept
+    {
+        std::shared_lock lock(mMutex);
+        return static_cast<uint32_t> (mNames.size());
+    }
+    mutable std::shared_mutex mMutex;
+    std::deque<std::string> mNames;
+    std::unordered_map<std::string_view, uint32_t> mHandles;
+};
+
+/// Constructor
+StreamRegistry::StreamRegistry() :
+    pImpl(std::make_unique<StreamRegistryImpl> ())
+{
+}
+
+/// Destructor
+StreamRegistry::~StreamRegistry() = default;
+
+/// Singleton
+StreamRegistry &StreamRegistry::getInstance()
+{
+    static StreamRegistry registry;
+    return registry;
+}
+
+/// Intern
+uint32_t StreamRegistry::intern(const std::string_view network,
+                                const std::string_view station,
+                                const std::string_view channel,
+                                const std::string_view locationCode)
+{
+    return pImpl->intern(network, station, channel, locationCode);
+}
+
+uint32_t StreamRegistry::intern(const Packet &packet)
+{
+    if (packet.hasLocationCode())
+    {
+        return pImpl->intern(packet.getNetworkReference(),
+                             packet.getStationReference(),
+                             packet.getChannelReference(),
+                             packet.getLocationCodeReference());
+    }
+    return pImpl->intern(packet.getNetworkReference(),
+                         packet.getStationReference(),
+                         packet.getChannelReference(),
+                         std::string_view {});
+}
+
+/// Name
+const std::string &StreamRegistry::getName(const uint32_t handle) const
+{
+    return pImpl->getName(handle);
+}
+
+/// Size
+uint32_t StreamRegistry::size() const noexcept
+{
+    return pImpl->size();
+}
@@ -1,10 +1,14 @@
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <array>
 #include <chrono>
-#include <map>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #ifndef NDEBUG
 #include <cassert>
 #endif
@@ -15,6 +19,9 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include "uWaveServer/testDuplicatePacket.hpp"
 #include "uWaveServer/packet.hpp"
+#include "uWaveServer/packetHeader.hpp"
+#include "uWaveServer/streamRegistry.hpp"
+#include "private/toName.hpp"
 
 using namespace UWaveServer;
 
@@ -24,53 +31,28 @@ namespace
 static_assert(std::is_same<boost::hash2::xxhash_64::result_type, uint64_t>::value,
               "xxhash64 result is not uint64_t");
 
+/// Hashes the samples' bytes.  On a little-endian machine this matches the
+/// hash that may be supplied upstream - see Packet::setDataHash.
 template<typename T>
 uint64_t toHash(const T *data, const int nSamples)
 {
      boost::hash2::xxhash_64 hashFunction;
-     boost::hash2::hash_append_range(hashFunction, {},
-                                     data + 0, data + nSamples);
+     if (data != nullptr)
+     {
+         hashFunction.update(data, static_cast<size_t> (nSamples)*sizeof(T));
+     }
      return hashFunction.result();
 }
 
-uint64_t toHash(const Packet &packet, const int nSamples)
+uint64_t toHash(const Packet &packet)
 {
     constexpr uint64_t zero{0};
-    if (nSamples == 0){return zero;}
-    auto dataType = packet.getDataType();
-    if (dataType == Packet::DataType::Integer32)
-    {
-        auto dPtr = reinterpret_cast<const int32_t *> (packet.data());
-        return ::toHash(dPtr, nSamples);
-    }
-    else if (dataType == Packet::DataType::Float)
-    {
-        auto dPtr = reinterpret_cast<const float *> (packet.data());
-        return ::toHash(dPtr, nSamples);
-    }
-    else if (dataType == Packet::DataType::Double)
-    {
-        auto dPtr = reinterpret_cast<const double *> (packet.data());
-        return ::toHash(dPtr, nSamples);
-    }
-    else if (dataType == Packet::DataType::Integer64)
-    {
-        auto dPtr = reinterpret_cast<const int64_t *> (packet.data());
-        return ::toHash(dPtr, nSamples);
-    }
-    else if (dataType == Packet::DataType::Text)
-    {
-        auto dPtr = reinterpret_cast<const char *> (packet.data());
-        return ::toHash(dPtr, nSamples);
-    }
-    else if (dataType == Packet::DataType::Unknown)
-    {
-        return zero;
-    }
-    else
-    {
-        throw std::runtime_error("Unhandled data type");
-    } 
+    if (packet.empty()){return zero;}
+    return packet.visitData([](const auto samples)
+                            {
+                                return ::toHash(samples.data(),
+                                                static_cast<int> (samples.size()));
+                            });
 }
 
 struct DataPacketHeader
@@ -79,23 +61,10 @@ public:
     DataPacketHeader() = default;
     explicit DataPacketHeader(const UWaveServer::Packet &packet)
     {
-        auto network = packet.getNetwork();
-        auto station = packet.getStation(); 
-        auto channel = packet.getChannel();
-        std::string locationCode;
-        try
-        {
-            locationCode = packet.getLocationCode();
-        }
-        catch (...)
-        {
-        }
-        // Trace name
-        name = network + "."  + station + "." + channel;
-        if (!locationCode.empty())
-        {
-            name = name + "." + locationCode;
-        }
+        // Stream
+        stream = packet.hasStreamHandle() ?
+                 packet.getStreamHandle() :
+                 StreamRegistry::getInstance().intern(packet); // Throws
         // Start and end time
         startTime = packet.getStartTime();
         endTime = packet.getEndTime(); // Throws
@@ -108,15 +77,84 @@ public:
         {
             throw std::invalid_argument("No samples in packet");
         }
-        try
+        // Most packets are not duplicates so the samples are only hashed
+        // if this is compared to a retained packet.  Use the upstream hash
+        // when we have one.
+        dataHash = packet.getDataHash();
+        this->packet = &packet;
+    } 
+    /// @result The hash of the samples.  This is computed on first use
+    ///         and can only be computed while the packet is in scope.
+    [[nodiscard]] std::optional<uint64_t> getDataHash() const
+    {
+        if (!dataHash && packet != nullptr)
         {
-            dataHash = ::toHash(packet, nSamples);
+            try
+            {
+                dataHash = ::toHash(*packet);
+            }
+            catch (const std::exception &e)
+            {
+                dataHash = 0;
+            }
         }
-        catch (const std::exception &e)
+        return dataHash;
+    }
+    /// @result False indicates the samples are known to differ.  If one of
+    ///         the hashes cannot be obtained then the samples are assumed
+    ///         to be the same.  Retained headers drop their packet on
+    ///         insertion without hashing it so, in practice, samples can
+    ///         only be compared to a retained packet that carried an
+    ///         upstream hash.
+    [[nodiscard]] bool mayHaveSameData(const ::DataPacketHeader &rhs) const
+    {
+        if (!dataHash && !rhs.dataHash)
         {
-            dataHash = 0;
-        } 
-    } 
+            // Hashing one side is pointless if the other can't be
+            if (packet == nullptr || rhs.packet == nullptr){return true;}
+        }
+        auto lhsHash = getDataHash();
+        if (!lhsHash){return true;}
+        auto rhsHash = rhs.getDataHash();
+        if (!rhsHash){return true;}
+        return *lhsHash == *rhsHash;
+    }
+    /// Seeds the header from a packet that was processed earlier.  Its
+    /// samples are not known so it has no hash.
+    explicit DataPacketHeader(const UWaveServer::PacketHeader &header)
+    {
+        stream = StreamRegistry::getInstance().intern(header.network,
+                                                      header.station,
+                                                      header.channel,
+                                                      header.locationCode);
+        startTime = header.startTime;
+        endTime = header.endTime;
+        if (endTime < startTime)
+        {
+            throw std::invalid_argument("End time is before start time");
+        }
+        if (header.samplingRate <= 0)
+        {
+            throw std::invalid_argument("Sampling rate must be positive");
+        }
+        samplingRate = static_cast<int> (std::round(header.samplingRate));
+        nSamples = header.numberOfSamples;
+        if (nSamples <= 0)
+        {
+            throw std::invalid_argument("No samples in packet");
+        }
+    }
+    /// @result The header without its samples, e.g., for a snapshot.
+    [[nodiscard]] UWaveServer::PacketHeader toPacketHeader() const
+    {
+        UWaveServer::PacketHeader header;
+        ::fromName(StreamRegistry::getInstance().getName(stream), &header);
+        header.startTime = startTime;
+        header.endTime = endTime;
+        header.samplingRate = samplingRate;
+        header.numberOfSamples = nSamples;
+        return header;
+    }
     bool operator<(const ::DataPacketHeader &rhs) const
     {
         return startTime < rhs.startTime;
@@ -127,44 +165,60 @@ public:
     }
     bool operator==(const ::DataPacketHeader &rhs) const
     {
-        if (rhs.name != name){return false;}
+        if (rhs.stream != stream){return false;}
         if (rhs.samplingRate - samplingRate != 0)
         {
             throw std::runtime_error("Inconsistent sampling rates for: "
-                                   + name);
+                                   + getName());
             //return false;
         }
         if (rhs.nSamples != nSamples){return false;}
-        if (rhs.dataHash != dataHash)
-        {
-            return false;
-        }
+        // Check the times before doing anything expensive with the samples
         auto dStartTime = std::abs(rhs.startTime.count() - startTime.count());
+        bool sameStartTime{false};
         if (samplingRate < 105)
         {
-            return (dStartTime < std::chrono::microseconds {15000}.count());
+            sameStartTime
+                = (dStartTime < std::chrono::microseconds {15000}.count());
         }
         else if (samplingRate < 255)
         {
-            return (dStartTime < std::chrono::microseconds {4500}.count());
+            sameStartTime
+                = (dStartTime < std::chrono::microseconds {4500}.count());
         }
         else if (samplingRate < 505)
         {
-            return (dStartTime < std::chrono::microseconds {2500}.count());
+            sameStartTime
+                = (dStartTime < std::chrono::microseconds {2500}.count());
         }
         else if (samplingRate < 1005)
         {
-            return (dStartTime < std::chrono::microseconds {1500}.count());
+            sameStartTime
+                = (dStartTime < std::chrono::microseconds {1500}.count());
+        }
+        else
+        {
+            throw std::runtime_error(
+                "Could not classify sampling rate: "
+              + std::to_string(samplingRate) + " for " + getName());
         }
-        throw std::runtime_error(
-            "Could not classify sampling rate: " + std::to_string(samplingRate)
-          + " for " + name);
-        //return false;
+        if (!sameStartTime){return false;}
+        return mayHaveSameData(rhs);
     } 
-    std::string name; // Packet name NETWORK.STATION.CHANNEL.LOCATION
+    /// The packet's name NETWORK.STATION.CHANNEL.LOCATION
+    [[nodiscard]] const std::string &getName() const
+    {
+        return StreamRegistry::getInstance().getName(stream);
+    }
+    uint32_t stream{0}; // Handle of the stream in the stream registry
     std::chrono::microseconds startTime{0}; // UTC time of first sample
     std::chrono::microseconds endTime{0}; // UTC time of last sample
-    uint64_t dataHash{0};
+    // The packet this was made from.  This is only valid during allow()
+    // and is cleared when the header is retained.
+    const UWaveServer::Packet *packet{nullptr};
+    // Upstream or computed on demand.  Retained headers only have the
+    // upstream hash.
+    mutable std::optional<uint64_t> dataHash;
     // Typically `observed' sampling rates wobble around a nominal sampling rate
     int samplingRate{100};
     int nSamples{0}; // Number of samples in packet
@@ -181,11 +235,157 @@ public:
     return std::max(1000, static_cast<int> (memory.count()/duration)) + 1;
 }
 
+/// Start times are hashed into buckets this wide.  This is at least the
+/// largest start time tolerance in DataPacketHeader::operator== so a
+/// duplicate is always in the same or an adjacent bucket.
+constexpr std::chrono::microseconds START_TIME_BUCKET_WIDTH{15000};
+
+[[nodiscard]] int64_t toBucket(const std::chrono::microseconds &time)
+{
+    constexpr auto width = START_TIME_BUCKET_WIDTH.count();
+    auto t = time.count();
+    return t >= 0 ? t/width : -((-t + width - 1)/width);
+}
+
+/// @brief The recent packet headers of a stream.  The headers are kept
+///        sorted on start time and, since overlapping packets are rejected,
+///        the intervals are disjoint so their end times are sorted as well.
+///        Exact duplicates are found through a hash of the start time
+///        buckets and overlaps with binary searches.
+class StreamHistory
+{
+public:
+    using Iterator
+        = boost::circular_buffer<::DataPacketHeader>::const_iterator;
+    /// A stream's history is created on its first packet.
+    [[nodiscard]] bool isInitialized() const noexcept
+    {
+        return mHeaders.capacity() > 0;
+    }
+    void initialize(const int capacity)
+    {
+        mHeaders.set_capacity(std::max(1, capacity));
+        mIndex.clear();
+        mIndex.reserve(mHeaders.capacity());
+    }
+    [[nodiscard]] bool full() const noexcept
+    {
+        return mHeaders.full();
+    }
+    [[nodiscard]] Iterator begin() const noexcept
+    {
+        return mHeaders.begin();
+    }
+    [[nodiscard]] Iterator end() const noexcept
+    {
+        return mHeaders.end();
+    }
+    [[nodiscard]] const ::DataPacketHeader &front() const
+    {
+        return mHeaders.front();
+    }
+    [[nodiscard]] const ::DataPacketHeader &back() const
+    {
+        return mHeaders.back();
+    }
+    /// @result True indicates this header matches a retained header.
+    [[nodiscard]] bool containsDuplicate(const ::DataPacketHeader &header) const
+    {
+        auto bucket = ::toBucket(header.startTime);
+        for (auto b = bucket - 1; b <= bucket + 1; ++b)
+        {
+            auto [first, last] = mIndex.equal_range(b);
+            for (auto it = first; it != last; ++it)
+            {
+                if (it->second == header){return true;}
+            }
+        }
+        return false;
+    }
+    /// @result The retained headers whose intervals overlap the header's.
+    [[nodiscard]] std::pair<Iterator, Iterator>
+        getOverlapping(const ::DataPacketHeader &header) const
+    {
+        auto first
+            = std::lower_bound(mHeaders.begin(), mHeaders.end(),
+                               header.startTime,
+                               [](const ::DataPacketHeader &lhs,
+                                  const std::chrono::microseconds &time)
+                               {
+                                   return lhs.endTime < time;
+                               });
+        auto last
+            = std::upper_bound(first, mHeaders.end(),
+                               header.endTime,
+                               [](const std::chrono::microseconds &time,
+                                  const ::DataPacketHeader &rhs)
+                               {
+                                   return time < rhs.startTime;
+                               });
+        return std::pair {first, last};
+    }
+    /// @brief Inserts the header in start time order.  If the history is
+    ///        full then the oldest header is evicted.
+    void insert(const ::DataPacketHeader &headerIn)
+    {
+        // The packet won't outlive this call
+        auto header = headerIn;
+        header.packet = nullptr;
+        if (mHeaders.full())
+        {
+            unindex(mHeaders.front());
+            mHeaders.pop_front();
+        }
+        // Typically new stuff shows up so this is usually the end
+        if (mHeaders.empty() || header.startTime > mHeaders.back().startTime)
+        {
+            mHeaders.push_back(header);
+        }
+        else
+        {
+            auto position = std::upper_bound(mHeaders.begin(), mHeaders.end(),
+                                             header);
+            mHeaders.insert(position, header);
+        }
+        mIndex.insert(std::pair {::toBucket(header.startTime), header});
+#ifndef NDEBUG
+        assert(std::is_sorted(mHeaders.begin(), mHeaders.end()));
+        assert(mIndex.size() == mHeaders.size());
+#endif
+    }
+private:
+    void unindex(const ::DataPacketHeader &header)
+    {
+        auto [first, last] = mIndex.equal_range(::toBucket(header.startTime));
+        for (auto it = first; it != last; ++it)
+        {
+            if (it->second.startTime == header.startTime &&
+                it->second.endTime == header.endTime &&
+                it->second.nSamples == header.nSamples)
+            {
+                mIndex.erase(it);
+                return;
+            }
+        }
+    }
+    boost::circular_buffer<::DataPacketHeader> mHeaders;
+    std::unordered_multimap<int64_t, ::DataPacketHeader> mIndex;
+};
+
 }
 
 class TestDuplicatePacket::TestDuplicatePacketImpl
 {
 public:
+    /// Streams are assigned to stripes by their handle.  Each stripe has its
+    /// own lock so threads checking different streams rarely contend.
+    static constexpr size_t N_STRIPES{32};
+    struct Stripe
+    {
+        std::mutex mMutex;
+        // Indexed by stream handle/N_STRIPES
+        std::vector<::StreamHistory> mStreams;
+    };
     TestDuplicatePacketImpl() :
         mLogger(spdlog::stdout_color_mt("duplicate-packet-tester-console"))
     {
@@ -219,9 +419,10 @@ public:
             if (!mDuplicateChannels.empty())
             {
                 std::string message{"Duplicate packets detected for:"};
-                for (const auto &channel : mDuplicateChannels)
+                for (const auto &stream : mDuplicateChannels)
                 {
-                    message = message + " " + channel;
+                    message = message + " "
+                            + StreamRegistry::getInstance().getName(stream);
                 }
                 SPDLOG_LOGGER_INFO(mLogger, "{}", message);
                 mDuplicateChannels.clear();
@@ -230,9 +431,10 @@ public:
             if (!mBadTimingChannels.empty())
             {
                 std::string message{"Bad timing detected for:"};
-                for (const auto &channel : mBadTimingChannels)
+                for (const auto &stream : mBadTimingChannels)
                 {
-                    message = message + " " + channel;
+                    message = message + " "
+                            + StreamRegistry::getInstance().getName(stream);
                 }
                 SPDLOG_LOGGER_INFO(mLogger, "{}", message);
                 mBadTimingChannels.clear();
@@ -241,15 +443,37 @@ public:
         }
         }
     }
+    [[nodiscard]] std::vector<UWaveServer::PacketHeader> getPacketHeaders() const
+    {
+        std::vector<UWaveServer::PacketHeader> headers;
+        for (auto &stripe : mStripes)
+        {
+            std::lock_guard<std::mutex> stripeLockGuard(stripe.mMutex);
+            for (const auto &history : stripe.mStreams)
+            {
+                for (const auto &header : history)
+                {
+                    headers.push_back(header.toPacketHeader());
+                }
+            }
+        }
+        return headers;
+    }
     [[nodiscard]] bool allow(const ::DataPacketHeader &header) const
     {
 #ifndef NDEBUG
-        assert(!header.name.empty());
         assert(header.nSamples > 0);
 #endif
+        auto &stripe = mStripes[header.stream%N_STRIPES];
+        std::lock_guard<std::mutex> stripeLockGuard(stripe.mMutex);
         // Does this channel exist?
-        auto circularBufferIndex = mCircularBuffers.find(header.name);
-        if (circularBufferIndex == mCircularBuffers.end())
+        auto iStream = header.stream/N_STRIPES;
+        if (iStream >= stripe.mStreams.size())
+        {
+            stripe.mStreams.resize(iStream + 1);
+        }
+        auto &history = stripe.mStreams[iStream];
+        if (!history.isInitialized())
         {
             int capacity = mCircularBufferSize;
             if (mEstimateCapacity)
@@ -260,74 +484,47 @@ public:
             }
             SPDLOG_LOGGER_INFO(mLogger,
                  "Creating new circular buffer for {} with capacity {}",
-                 header.name, capacity);
-            boost::circular_buffer<::DataPacketHeader>
-                newCircularBuffer(capacity);
-            newCircularBuffer.push_back(header);
-            mCircularBuffers.insert(std::pair{header.name,
-                                              std::move(newCircularBuffer)});
+                 header.getName(), capacity);
+            history.initialize(capacity);
+            history.insert(header);
             // Can't be a a duplicate because its the first one
             return true;
         }
-        // Now we should definitely be able to find the appropriate circular
-        // buffer for this stream 
-        circularBufferIndex = mCircularBuffers.find(header.name);
-        if (circularBufferIndex == mCircularBuffers.end())
-        {
-            SPDLOG_LOGGER_ERROR(
-                mLogger,
-                "Algorithm error - circular buffer doesn't exist for {}",
-                header.name);
-            return false;
-        }
         // See if this header exists (exactly)
-        auto headerIndex
-            = std::find(circularBufferIndex->second.begin(),
-                        circularBufferIndex->second.end(),
-                        header);
-        // Matched it
-        if (headerIndex != circularBufferIndex->second.end())
+        if (history.containsDuplicate(header))
         {
             if (mLogBadData)
             {
                 SPDLOG_LOGGER_DEBUG(mLogger, "Detected duplicate for {}",
-                                    header.name);
+                                    header.getName());
                 {
                 std::lock_guard<std::mutex> lockGuard(mMutex);
-                if (!mDuplicateChannels.contains(header.name))
+                if (!mDuplicateChannels.contains(header.stream))
                 {
-                    mDuplicateChannels.insert(header.name);
+                    mDuplicateChannels.insert(header.stream);
                 }
                 }
             }
             return false;
         }
         // Insert it (typically new stuff shows up)
-        if (header.startTime > circularBufferIndex->second.back().endTime)
+        if (header.startTime > history.back().endTime)
         {
             SPDLOG_LOGGER_DEBUG(mLogger,
                                 "Inserting {} at end of circular buffer",
-                                header.name);
-            circularBufferIndex->second.push_back(header);
+                                header.getName());
+            history.insert(header);
             return true;
         }
         // If it is is really old and there's space then push to front
-        if (header.endTime < circularBufferIndex->second.front().startTime)
+        if (header.endTime < history.front().startTime)
         {
-            if (!circularBufferIndex->second.full())
+            if (!history.full())
             {
                 SPDLOG_LOGGER_DEBUG(mLogger,
                              "Inserting {} at front of circular buffer",
-                             header.name);
-                circularBufferIndex->second.push_front(header);
-#ifndef NDEBUG
-                assert(std::is_sorted(circularBufferIndex->second.begin(),
-                                      circularBufferIndex->second.end(),
-                       [](const ::DataPacketHeader &lhs, const ::DataPacketHeader &rhs)
-                       {
-                          return lhs.startTime < rhs.startTime;
-                       }));
-#endif
+                             header.getName());
+                history.insert(header);
             }
             // Note, if the buffer is full then this packet is expired in the
             // eyes of the circular buffer.  For that, we let the database 
@@ -335,64 +532,61 @@ public:
             return true;
         }
         // The packet is old.  We have to check for a GPS slip.
-        for (const auto &streamHeader : circularBufferIndex->second)
+        auto [first, last] = history.getOverlapping(header);
+        for (auto it = first; it != last; ++it)
         {
-            // Looks like a timing slip to me
-            if ((header.startTime >= streamHeader.startTime &&
-                 header.startTime <= streamHeader.endTime) ||
-                (header.endTime >= streamHeader.startTime &&
-                 header.endTime <= streamHeader.endTime))
+            const auto &streamHeader = *it;
+            // This is a really exotic failure . This is like a bit flip
+            // in transit or something.  The retained samples are only
+            // known through an upstream hash.
+            if (streamHeader.dataHash &&
+                header.startTime == streamHeader.startTime &&
+                header.endTime == streamHeader.endTime &&
+                header.nSamples == streamHeader.nSamples &&
+                header.samplingRate == streamHeader.samplingRate &&
+                !header.mayHaveSameData(streamHeader))
             {
-                // This is a really exotic failure . This is like a bit flip
-                // in transit or something.
-                if (header.startTime == streamHeader.startTime &&
-                    header.endTime == streamHeader.endTime &&
-                    header.nSamples == streamHeader.nSamples &&
-                    header.samplingRate == streamHeader.samplingRate &&
-                    header.dataHash != streamHeader.dataHash)
+                SPDLOG_LOGGER_WARN(mLogger,
+                                   "Data perturbation detected for {}",
+                                   header.getName());
+                return false;
+            }
+        }
+        // Looks like a timing slip to me
+        if (first != last)
+        {
+            if (mLogBadData)
+            {
+                SPDLOG_LOGGER_DEBUG(mLogger,
+                                    "Detected possible timing slip for {}",
+                                    header.getName());
                 {
-                    SPDLOG_LOGGER_WARN(mLogger,
-                                       "Data perturbation detected for {}",
-                                       header.name);
-                    return false;
-                }
-                //std::cout << std::setprecision(16) << header.name << " " << streamHeader.name << " | " << header.startTime.count()*1.e-6 << " " << streamHeader.startTime.count()*1.e-6 << " | " 
-                //<< header.endTime.count()*1.e-6 << " " << streamHeader.endTime.count()*1.e-6 << std::endl;
-                if (mLogBadData)
+                std::lock_guard<std::mutex> lockGuard(mMutex);
+                if (!mBadTimingChannels.contains(header.stream))
                 {
-                    SPDLOG_LOGGER_DEBUG(mLogger,
-                                        "Detected possible timing slip for {}",
-                                        header.name);
-                    {
-                    std::lock_guard<std::mutex> lockGuard(mMutex);
-                    if (!mBadTimingChannels.contains(header.name))
-                    {
-                        mBadTimingChannels.insert(header.name);
-                    }
-                    }
+                    mBadTimingChannels.insert(header.stream);
+                }
                 }
-                return false;
             }
+            return false;
         }
         // This appears to be a valid (out-of-order) back-fill
         SPDLOG_LOGGER_DEBUG(mLogger,
-                            "Inserting {} in circular buffer then sorting",
-                            header.name);
-        circularBufferIndex->second.push_back(header);
-        std::sort(circularBufferIndex->second.begin(),
-                  circularBufferIndex->second.end(),
-                  [](const ::DataPacketHeader &lhs, const ::DataPacketHeader &rhs)
-                  {
-                      return lhs.startTime < rhs.startTime;
-                  });
+                            "Inserting {} in circular buffer",
+                            header.getName());
+        history.insert(header);
         return true;
     }
     TestDuplicatePacketImpl& operator=(const TestDuplicatePacketImpl &impl)
     {
         if (&impl == this){return *this;}
+        for (size_t i = 0; i < N_STRIPES; ++i)
         {
-        std::lock_guard<std::mutex> lockGuard(impl.mMutex);
-        mCircularBuffers = impl.mCircularBuffers;
+            std::scoped_lock lock(mStripes[i].mMutex, impl.mStripes[i].mMutex);
+            mStripes[i].mStreams = impl.mStripes[i].mStreams;
+        }
+        {
+        std::scoped_lock lock(mMutex, impl.mMutex);
         mDuplicateChannels = impl.mDuplicateChannels;
         mBadTimingChannels = impl.mBadTimingChannels;
         mLastLogTime = impl.mLastLogTime; 
@@ -408,10 +602,9 @@ public:
 //private:
     std::shared_ptr<spdlog::logger> mLogger{nullptr};
     mutable std::mutex mMutex;
-    mutable std::map<std::string, boost::circular_buffer<::DataPacketHeader>>
-        mCircularBuffers;
-    mutable std::set<std::string> mDuplicateChannels;
-    mutable std::set<std::string> mBadTimingChannels;
+    mutable std::array<Stripe, N_STRIPES> mStripes;
+    mutable std::set<uint32_t> mDuplicateChannels;
+    mutable std::set<uint32_t> mBadTimingChannels;
     std::chrono::seconds mLogBadDataInterval{std::chrono::minutes {15}};
     std::chrono::seconds mLastLogTime{0};
     std::chrono::seconds mCircularBufferDuration{300};
@@ -504,6 +697,20 @@ void TestDuplicatePacket::clear() noexcept
 /// Destructor
 TestDuplicatePacket::~TestDuplicatePacket() = default;
 
+/// Seed with a previously processed packet
+void TestDuplicatePacket::seed(const PacketHeader &packetHeader)
+{
+    ::DataPacketHeader header{packetHeader}; // Throws
+    // A conflict just means the earlier packet is already retained
+    [[maybe_unused]] auto allow = pImpl->allow(header);
+}
+
+/// Retained headers
+std::vector<PacketHeader> TestDuplicatePacket::getPacketHeaders() const
+{
+    return pImpl->getPacketHeaders();
+}
+
 /// Allow this packet?
 bool TestDuplicatePacket::allow(const UWaveServer::Packet &packet) const
 {
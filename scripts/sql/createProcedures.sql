@@ -127,6 +127,7 @@ BEGIN
         number_of_samples INT NOT NULL CHECK(number_of_samples >= 0),
         little_endian BOOLEAN NOT NULL,
         compressed BOOLEAN NOT NULL,
+        codec SMALLINT NOT NULL DEFAULT 0 CHECK(codec IN (0, 1)),
         data_type CHARACTER (1) NOT NULL CHECK(data_type IN (''i'', ''f'', ''d'', ''l'', ''t'')),
         data BYTEA NOT NULL,
         PRIMARY KEY (stream_identifier, start_time),
@@ -302,3 +303,24 @@ BEGIN
      l_compression_interval_mus);
 END
 $func$;
+
+
+--- The codec column was added after the data tables were first deployed.
+--- 0 indicates the data are raw or zlib compressed as given by the compressed
+--- column and 1 indicates integer data that were first differenced, zigzag
+--- encoded, and bit-packed.  This adds the column to existing data tables.
+--- Existing rows take the default so they are read as before.
+--- e.g., CALL update_data_tables_add_codec();
+CREATE OR REPLACE PROCEDURE update_data_tables_add_codec()
+  LANGUAGE plpgsql AS
+$func$
+DECLARE
+  l_data_table_name TEXT;
+BEGIN
+  FOR l_data_table_name IN SELECT DISTINCT data_table_name FROM streams
+  LOOP
+    EXECUTE 'ALTER TABLE ' || l_data_table_name ||
+            ' ADD COLUMN IF NOT EXISTS codec SMALLINT NOT NULL DEFAULT 0 CHECK(codec IN (0, 1))';
+  END LOOP;
+END
+$func$;
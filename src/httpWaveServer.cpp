@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cmath>
 #include <limits>
 #include <iomanip>
 #include <string>
@@ -21,6 +22,7 @@
 #include "uWaveServer/packet.hpp"
 #include "lib/private/toMiniSEED.hpp"
 #include "lib/private/toJSON.hpp"
+#include "lib/private/singleFlight.hpp"
 //#include "getEnvironmentVariable.hpp"
 //#include "metricsExporter.hpp"
 //#include "serverMetrics.hpp"
@@ -43,6 +45,12 @@ opentelemetry::nostd::shared_ptr<opentelemetry::metrics::ObservableInstrument>
     clientErrorResponseCounter;
 opentelemetry::nostd::unique_ptr<opentelemetry::metrics::Histogram<double>>
     writeHistogram{nullptr};
+opentelemetry::nostd::shared_ptr<opentelemetry::metrics::ObservableInstrument>
+    connectionWaitTimeCounter;
+opentelemetry::nostd::shared_ptr<opentelemetry::metrics::ObservableInstrument>
+    connectionCheckoutCounter;
+opentelemetry::nostd::shared_ptr<opentelemetry::metrics::ObservableInstrument>
+    connectionCheckoutTimeOutCounter;
 
 
 struct ProgramOptions
@@ -77,10 +85,20 @@ struct ProgramOptions
         UWaveServer::getIntegerEnvironmentVariable("UWAVE_SERVER_DATABASE_PORT", 5432)
     };
     std::set<std::string> databaseSchemas;
+    // Time a query will wait for a free database connection
+    std::chrono::milliseconds databaseCheckoutTimeOut{10000};
+    // Bytes of decoded packets each database client caches (0 disables)
+    int64_t databasePacketCacheSize{0};
+    // Longer miniSEED queries stream from the database and skip the cache
+    double databasePacketCacheMaximumWindow{3600};
+    // Cached windows are re-fetched after this so late rows are seen
+    std::chrono::seconds databasePacketCacheCoverageLifetime{600};
 
     int verbosity{3};
     uint16_t crowPort{8000}; 
     uint16_t nThreads{2}; // Min is 2 for crow
+    // Each worker thread gets its own database connection
+    uint16_t databaseConnectionPoolSize{nThreads};
     bool exportLogs{false};
     bool exportMetrics{false};
     bool exportHTTPMetrics{true};
@@ -111,6 +129,110 @@ std::string getOriginalKey(
     return std::string {""};
 }
 
+using ReadOnlyClients
+    = std::vector<std::unique_ptr<UWaveServer::Database::ReadOnlyClient>>;
+
+/// The encoded response to a stream query.
+struct StreamQueryResult
+{
+    std::string body;
+    int64_t nPackets{0};
+};
+
+/// Observes the cumulative time in seconds that queries waited for a
+/// database connection.  The state is the ReadOnlyClients.
+void observeDatabaseConnectionWaitTime(
+    opentelemetry::metrics::ObserverResult observerResult,
+    void *state)
+{
+    if (state == nullptr){return;}
+    if (opentelemetry::nostd::holds_alternative
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+                opentelemetry::metrics::ObserverResultT<double>
+            >
+        > (observerResult))
+    {
+        auto observer = opentelemetry::nostd::get
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+               opentelemetry::metrics::ObserverResultT<double>
+            >
+        > (observerResult);
+        const auto clients = static_cast<const ReadOnlyClients *> (state);
+        std::chrono::microseconds waitTime{0};
+        for (const auto &client : *clients)
+        {
+            waitTime = waitTime + client->getConnectionWaitTime();
+        }
+        observer->Observe(waitTime.count()*1.e-6);
+    }
+}
+
+/// Observes the number of database connection checkouts.
+void observeDatabaseConnectionCheckouts(
+    opentelemetry::metrics::ObserverResult observerResult,
+    void *state)
+{
+    if (state == nullptr){return;}
+    if (opentelemetry::nostd::holds_alternative
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+                opentelemetry::metrics::ObserverResultT<int64_t>
+            >
+        > (observerResult))
+    {
+        auto observer = opentelemetry::nostd::get
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+               opentelemetry::metrics::ObserverResultT<int64_t>
+            >
+        > (observerResult);
+        const auto clients = static_cast<const ReadOnlyClients *> (state);
+        int64_t checkouts{0};
+        for (const auto &client : *clients)
+        {
+            checkouts = checkouts + client->getConnectionCheckouts();
+        }
+        observer->Observe(checkouts);
+    }
+}
+
+/// Observes the number of queries that gave up waiting for a connection.
+void observeDatabaseConnectionCheckoutTimeOuts(
+    opentelemetry::metrics::ObserverResult observerResult,
+    void *state)
+{
+    if (state == nullptr){return;}
+    if (opentelemetry::nostd::holds_alternative
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+                opentelemetry::metrics::ObserverResultT<int64_t>
+            >
+        > (observerResult))
+    {
+        auto observer = opentelemetry::nostd::get
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+               opentelemetry::metrics::ObserverResultT<int64_t>
+            >
+        > (observerResult);
+        const auto clients = static_cast<const ReadOnlyClients *> (state);
+        int64_t timeOuts{0};
+        for (const auto &client : *clients)
+        {
+            timeOuts = timeOuts + client->getConnectionCheckoutTimeOuts();
+        }
+        observer->Observe(timeOuts);
+    }
+}
+
 }
 
 /// Converts YYYY-MM-DDTHH:MM:SS or YYYY-MM-DDTHH:MM:SS.XXXXXX
@@ -427,7 +549,7 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    std::vector<std::unique_ptr<UWaveServer::Database::ReadOnlyClient>> clients;
+    ::ReadOnlyClients clients;
     try
     {
         if (programOptions.databaseSchemas.empty())
@@ -436,7 +558,13 @@ int main(int argc, char *argv[])
                                "Initializing database client");
             auto client
                 = std::make_unique<UWaveServer::Database::ReadOnlyClient>
-                  (databaseCredentials, customLogger.logger);
+                  (databaseCredentials,
+                   programOptions.databaseConnectionPoolSize,
+                   programOptions.databaseCheckoutTimeOut,
+                   customLogger.logger);
+            client->setPacketCacheSize(programOptions.databasePacketCacheSize);
+            client->setPacketCacheCoverageLifetime(
+                programOptions.databasePacketCacheCoverageLifetime);
             clients.push_back(std::move(client));
         }
         else
@@ -449,7 +577,14 @@ int main(int argc, char *argv[])
                 databaseCredentials.setSchema(schema);
                 auto client
                     = std::make_unique<UWaveServer::Database::ReadOnlyClient>
-                      (databaseCredentials, customLogger.logger);
+                      (databaseCredentials,
+                       programOptions.databaseConnectionPoolSize,
+                       programOptions.databaseCheckoutTimeOut,
+                       customLogger.logger);
+                client->setPacketCacheSize(
+                    programOptions.databasePacketCacheSize);
+                client->setPacketCacheCoverageLifetime(
+                    programOptions.databasePacketCacheCoverageLifetime);
                 clients.push_back(std::move(client));
             }
         }
@@ -465,6 +600,35 @@ int main(int argc, char *argv[])
     assert(!clients.empty());
 #endif
 
+    // Database connection pool metrics
+    if (programOptions.exportMetrics)
+    {
+        auto provider = opentelemetry::metrics::Provider::GetMeterProvider();
+        auto meter = provider->GetMeter(programOptions.applicationName,
+                                        "1.2.0");
+        connectionWaitTimeCounter
+            = meter->CreateDoubleObservableCounter(
+                 "seismic_data.waveform_storage.database.connection_wait_time",
+                 "Cumulative time queries waited for a database connection.",
+                 "s");
+        connectionWaitTimeCounter->AddCallback(
+            ::observeDatabaseConnectionWaitTime, &clients);
+        connectionCheckoutCounter
+            = meter->CreateInt64ObservableCounter(
+                 "seismic_data.waveform_storage.database.connection_checkouts",
+                 "Number of times a query checked out a database connection.",
+                 "{checkouts}");
+        connectionCheckoutCounter->AddCallback(
+            ::observeDatabaseConnectionCheckouts, &clients);
+        connectionCheckoutTimeOutCounter
+            = meter->CreateInt64ObservableCounter(
+                 "seismic_data.waveform_storage.database.connection_checkout_time_outs",
+                 "Number of queries that timed out waiting for a database connection.",
+                 "{checkouts}");
+        connectionCheckoutTimeOutCounter->AddCallback(
+            ::observeDatabaseConnectionCheckoutTimeOuts, &clients);
+    }
+
     crow::logger::setHandler(&customLogger);
     crow::SimpleApp app;
 
@@ -479,6 +643,10 @@ int main(int argc, char *argv[])
         return response;//crow::response(200);
     });
 
+    // Coalesces the identical stream queries that arrive in bursts, e.g.,
+    // right after an event
+    ::SingleFlight<std::string, ::StreamQueryResult> streamQueries;
+
     // Unpack something like:
     // host/stream-query?network=UU&station=BGU&channel=HHZ&location=01&starttime=1235&endtime=678910&nodata=404
     CROW_ROUTE(app, "/stream-query")
@@ -744,37 +912,85 @@ int main(int argc, char *argv[])
             // TODO histogram metrics
             SPDLOG_LOGGER_DEBUG(customLogger.logger, "Unpacking data");
             auto queryStartTime = std::chrono::high_resolution_clock::now();
-            std::vector<UWaveServer::Packet> packets;
-            // Two-pass loop - first check our caches
-            for (int strategy = 0; strategy < 2; ++strategy)
+            // Identical concurrent requests share one query and encoding
+            auto key = network + "." + station + "." + channel + "."
+                     + locationCode + "."
+                     + std::to_string(std::llround(startTime*1.e6)) + "."
+                     + std::to_string(std::llround(endTime*1.e6)) + "."
+                     + (format == "json" ? "json" :
+                        (wantMiniSEED3 ? "mseed3" : "mseed2"));
+            auto sharedResult = streamQueries.run(key, [&]()
             {
-                for (const auto &client : clients)
+                ::StreamQueryResult result;
+                // Two-pass loop - first check our caches then the databases
+                UWaveServer::Database::ReadOnlyClient *client{nullptr};
+                for (int strategy = 0; strategy < 2; ++strategy)
                 {
-                    if (strategy == 0)
+                    const bool checkCacheOnly{strategy == 0};
+                    for (const auto &candidate : clients)
                     {
-                        constexpr bool checkCacheOnly{true};
-                        if (client->contains(network, station,
-                                             channel, locationCode,
-                                             checkCacheOnly))
-                        {
-                            packets
-                                = client->query(network, station,
+                        if (candidate->contains(network, station,
                                                 channel, locationCode,
-                                                startTime, endTime);
+                                                checkCacheOnly))
+                        {
+                            client = candidate.get();
+                            break;
                         }
                     }
-                    else
+                    if (client != nullptr){break;}
+                }
+                if (client == nullptr){return result;}
+                if (format == "json")
+                {
+                    auto packets = client->query(network, station,
+                                                 channel, locationCode,
+                                                 startTime, endTime);
+                    result.nPackets = static_cast<int64_t> (packets.size());
+                    if (!packets.empty())
                     {
-                        // This will actually search the sensors table and
-                        // potentially add the sensor to the cache
-                        packets
-                            = client->query(network, station,
-                                            channel, locationCode,
-                                            startTime, endTime);
+                        result.body = ::packetsToCrowJSON(packets).dump();
                     }
+                    return result;
                 }
-                if (!packets.empty()){break;}
-            }
+                // Decoded packets are encoded as they arrive so the whole
+                // query result is never held
+                {
+                constexpr int recordLength{512};
+                ::MiniSEEDStreamEncoder encoder{&result.body,
+                                                recordLength,
+                                                wantMiniSEED3,
+                                                customLogger.logger.get()};
+                // Short windows, e.g., dashboards, go through the
+                // packet cache while long windows stream
+                if (programOptions.databasePacketCacheSize > 0 &&
+                    endTime - startTime <=
+                    programOptions.databasePacketCacheMaximumWindow)
+                {
+                    auto packets = client->query(network, station,
+                                                 channel, locationCode,
+                                                 startTime, endTime);
+                    for (const auto &packet : packets)
+                    {
+                        encoder.add(packet);
+                    }
+                    result.nPackets = static_cast<int64_t> (packets.size());
+                }
+                else
+                {
+                    result.nPackets
+                        = client->streamQuery(
+                             network, station,
+                             channel, locationCode,
+                             startTime, endTime,
+                             [&encoder](UWaveServer::Packet &&packet)
+                             {
+                                 encoder.add(packet);
+                             });
+                }
+                encoder.flush();
+                }
+                return result;
+            });
             auto queryEndTime = std::chrono::high_resolution_clock::now();
             double queryDuration
                 = std::chrono::duration_cast<std::chrono::microseconds>
@@ -782,7 +998,7 @@ int main(int argc, char *argv[])
             SPDLOG_LOGGER_INFO(customLogger.logger,
                                "Query duration and unpack {} (s)",
                                queryDuration);
-            if (packets.empty())
+            if (sharedResult->nPackets == 0)
             {
                 // I did my job right
                 //mObservableSuccessResponses.add_or_assign("stream-query", 1);
@@ -800,26 +1016,25 @@ int main(int argc, char *argv[])
                 //mObservableSuccessResponses.add_or_assign("stream-query", 1);
                 //auto &metrics = UWaveServer::Metrics::MetricsSingleton::getInstance();
                 metrics.incrementSuccessResponseCounter();
-                auto payload = ::packetsToCrowJSON(packets);
                 crow::response response;
                 response.set_header("Content-Type", "application/json");
                 response.code = 200;
-                response.body = payload.dump();
+                // The last request sharing the result moves the payload
+                response.body
+                    = streamQueries.take(std::move(sharedResult)).body;
                 return response;
             }
             else
             {
-                constexpr int recordLength{512};
                 //mObservableSuccessResponses.add_or_assign("stream-query", 1);
-                auto payload
-                    = ::toMiniSEED(packets, recordLength, wantMiniSEED3,
-                                   customLogger.logger.get());
                 //auto &metrics = UWaveServer::Metrics::MetricsSingleton::getInstance();
                 metrics.incrementSuccessResponseCounter();
                 crow::response response;
                 response.set_header("Content-Type", "application/octet-stream");
                 response.code = 200;
-                response.body = std::move(payload);
+                // The last request sharing the result moves the payload
+                response.body
+                    = streamQueries.take(std::move(sharedResult)).body;
                 return response;
             }
             //std::cout << "hey packets; " << packets.size() << std::endl;
@@ -1139,6 +1354,12 @@ ProgramOptions parseIniFile(const std::filesystem::path &iniFile)
     }
     options.crowPort
         = propertyTree.get<uint16_t> ("Crow.port", options.crowPort);
+    options.nThreads
+        = propertyTree.get<uint16_t> ("Crow.threads", options.nThreads);
+    if (options.nThreads < 2)
+    {
+        throw std::invalid_argument("Crow.threads must be at least 2");
+    }
 
     // Database
     options.databaseUser
@@ -1171,6 +1392,49 @@ ProgramOptions parseIniFile(const std::filesystem::path &iniFile)
     }
     options.databasePort
         = propertyTree.get<uint16_t> ("Database.port", options.databasePort);
+    options.databaseConnectionPoolSize
+        = propertyTree.get<uint16_t> ("Database.connectionPoolSize",
+                                      options.nThreads);
+    if (options.databaseConnectionPoolSize < 1)
+    {
+        throw std::invalid_argument(
+            "Database.connectionPoolSize must be positive");
+    }
+    options.databaseCheckoutTimeOut
+        = std::chrono::milliseconds
+          {propertyTree.get<int64_t> ("Database.connectionCheckoutTimeOut",
+                                      options.databaseCheckoutTimeOut.count())};
+    if (options.databaseCheckoutTimeOut.count() < 0)
+    {
+        throw std::invalid_argument(
+            "Database.connectionCheckoutTimeOut must be non-negative");
+    }
+    options.databasePacketCacheSize
+        = propertyTree.get<int64_t> ("Database.packetCacheSize",
+                                     options.databasePacketCacheSize);
+    if (options.databasePacketCacheSize < 0)
+    {
+        throw std::invalid_argument(
+            "Database.packetCacheSize must be non-negative");
+    }
+    options.databasePacketCacheMaximumWindow
+        = propertyTree.get<double> ("Database.packetCacheMaximumWindow",
+                                    options.databasePacketCacheMaximumWindow);
+    if (options.databasePacketCacheMaximumWindow <= 0)
+    {
+        throw std::invalid_argument(
+            "Database.packetCacheMaximumWindow must be positive");
+    }
+    options.databasePacketCacheCoverageLifetime
+        = std::chrono::seconds
+          {propertyTree.get<int64_t>
+              ("Database.packetCacheCoverageLifetime",
+               options.databasePacketCacheCoverageLifetime.count())};
+    if (options.databasePacketCacheCoverageLifetime.count() <= 0)
+    {
+        throw std::invalid_argument(
+            "Database.packetCacheCoverageLifetime must be positive");
+    }
     for (int i = 1; i < std::numeric_limits<int16_t>::max(); ++i)
     {
         auto keyName = "Database.schema_" + std::to_string(i);
@@ -1,8 +1,13 @@
 #include <iostream>
 #include <string>
 #include <thread>
+#include <algorithm>
 #include <atomic>
+#include <charconv>
 #include <csignal>
+#include <map>
+#include <mutex>
+#include <set>
 #include <boost/program_options.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
@@ -13,8 +18,11 @@
 #include <opentelemetry/metrics/meter_provider.h>
 #include <opentelemetry/metrics/provider.h>
 #include "uWaveServer/packet.hpp"
+#include "uWaveServer/packetHeader.hpp"
 #include "uWaveServer/packetSanitizer.hpp"
 #include "uWaveServer/packetSanitizerOptions.hpp"
+#include "uWaveServer/packetSpool.hpp"
+#include "uWaveServer/streamRegistry.hpp"
 #include "uWaveServer/testDuplicatePacket.hpp"
 #include "uWaveServer/testFuturePacket.hpp"
 #include "uWaveServer/testExpiredPacket.hpp"
@@ -27,7 +35,8 @@
 #include "uWaveServer/database/writeClient.hpp"
 #include "uWaveServer/database/credentials.hpp"
 #include "uWaveServer/database/exception.hpp"
-#include "private/threadSafeBoundedQueue.hpp"
+#include "private/lockFreeBoundedQueue.hpp"
+#include "private/toName.hpp"
 //#include "getEnvironmentVariable.hpp"
 //#include "writerMetrics.hpp"
 
@@ -53,21 +62,78 @@ opentelemetry::nostd::shared_ptr<opentelemetry::metrics::ObservableInstrument>
     totalPacketsWrittenCounter;
 opentelemetry::nostd::shared_ptr<opentelemetry::metrics::ObservableInstrument>
     totalPacketsRejectedCounter;
+opentelemetry::nostd::shared_ptr<opentelemetry::metrics::ObservableInstrument>
+    totalBatchFlushesCounter;
 opentelemetry::nostd::unique_ptr<opentelemetry::metrics::Histogram<double>>
     databaseWritePerformanceHistogram{nullptr};
+opentelemetry::nostd::unique_ptr<opentelemetry::metrics::Histogram<double>>
+    databaseWriteBatchSizeHistogram{nullptr};
 
 }
 
-std::string toName(const UWaveServer::Packet &packet)
+/// Estimates the memory required to hold the packet's samples.
+[[nodiscard]] int64_t estimateSizeInBytes(const UWaveServer::Packet &packet)
 {
-    auto name = packet.getNetwork() + "." 
-              + packet.getStation() + "." 
-              + packet.getChannel();
-    if (!packet.getLocationCode().empty())
+    auto nSamples = static_cast<int64_t> (packet.size());
+    auto dataType = packet.getDataType();
+    if (dataType == UWaveServer::Packet::DataType::Integer32)
+    {
+        return nSamples*static_cast<int64_t> (sizeof(int));
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Integer64)
+    {
+        return nSamples*static_cast<int64_t> (sizeof(int64_t));
+    }
+    else if (dataType == UWaveServer::Packet::DataType::Double)
     {
-        name = name + "." + packet.getLocationCode();
+        return nSamples*static_cast<int64_t> (sizeof(double));
     }
-    return name;
+    else if (dataType == UWaveServer::Packet::DataType::Float)
+    {
+        return nSamples*static_cast<int64_t> (sizeof(float));
+    }
+    return nSamples*static_cast<int64_t> (sizeof(char));
+}
+
+/// Combines the hash of the value with the seed.
+[[nodiscard]] size_t hashCombine(const size_t seed, const std::string_view value)
+{
+    std::hash<std::string_view> hasher;
+    return seed ^ (hasher(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+/// Maps the packet's stream to a shard.  All packets from a stream map to
+/// the same shard.
+[[nodiscard]] size_t toShard(const UWaveServer::Packet &packet,
+                             const size_t nShards)
+{
+    if (nShards <= 1){return 0;}
+    // Handles are dense so this also spreads the streams evenly
+    if (packet.hasStreamHandle())
+    {
+        return static_cast<size_t> (packet.getStreamHandle())%nShards;
+    }
+    size_t seed{0};
+    seed = ::hashCombine(seed, packet.getNetworkReference());
+    seed = ::hashCombine(seed, packet.getStationReference());
+    seed = ::hashCombine(seed, packet.getChannelReference());
+    if (packet.hasLocationCode())
+    {
+        seed = ::hashCombine(seed, packet.getLocationCodeReference());
+    }
+    return seed%nShards;
+}
+
+/// Maps the packet's network and station to a shard.  Since a station's
+/// channels share a data table this keeps a table on one shard.
+[[nodiscard]] size_t toStationShard(const UWaveServer::Packet &packet,
+                                    const size_t nShards)
+{
+    if (nShards <= 1){return 0;}
+    size_t seed{0};
+    seed = ::hashCombine(seed, packet.getNetworkReference());
+    seed = ::hashCombine(seed, packet.getStationReference());
+    return seed%nShards;
 }
 
 /*
@@ -104,26 +170,59 @@ public:
     {
         nDatabaseWriterThreads = options.nDatabaseWriterThreads;
         // Reserve size the queues
-        mShallowPacketSanitizerQueue.setCapacity(options.mQueueCapacity);
         //mDeepPacketSanitizerQueue.setCapacity(options.mQueueCapacity);
-        mWritePacketToDatabaseQueue.setCapacity(options.mQueueCapacity);
+        // When writers are stream-affine each writer gets its own queue
+        // and a station's packets always go to the same writer (and hence
+        // database connection).  Otherwise, all writers share one queue.
+        mStreamAffineWriters = options.streamAffineDatabaseWriters
+                            && options.nDatabaseWriterThreads > 1;
+        const int nWriteQueues
+            = mStreamAffineWriters ? options.nDatabaseWriterThreads : 1;
+        const int writeQueueCapacity
+            = std::max(1, (options.mQueueCapacity + nWriteQueues - 1)
+                          /nWriteQueues);
+        for (int iQueue = 0; iQueue < nWriteQueues; ++iQueue)
+        {
+            auto queue
+                = std::make_unique<::LockFreeBoundedQueue<UWaveServer::Packet>>
+                  (writeQueueCapacity);
+            mWritePacketToDatabaseQueues.push_back(std::move(queue));
+        }
 
-        // Testers
+        // Each sanitizer shard owns its streams' queue and testers so the
+        // shards share nothing.  The ingest queue capacity is split
+        // between the shards.
+        const int nSanitizerThreads = std::max(1, options.nSanitizerThreads);
+        const int shardQueueCapacity
+            = std::max(1, (options.mQueueCapacity + nSanitizerThreads - 1)
+                          /nSanitizerThreads);
         constexpr std::chrono::microseconds maxFutureTime{0};
+        constexpr std::chrono::microseconds maxExpiredTime{std::chrono::days {60}};
         constexpr std::chrono::seconds logBadDataInterval{std::chrono::minutes {30}};
-        mTestFuturePacket = std::make_unique<UWaveServer::TestFuturePacket> (maxFutureTime,  logBadDataInterval, mLogger);
-        constexpr std::chrono::microseconds maxExpiredTime{std::chrono::days {180}};
-        mTestExpiredPacket = std::make_unique<UWaveServer::TestExpiredPacket> (maxExpiredTime, logBadDataInterval, mLogger);
-        mTestShallowDuplicatePacket = std::make_unique<UWaveServer::TestDuplicatePacket> (
-            15, // Last 15 packets (good for multiple telemetry routes)
-            std::chrono::seconds {-1},
-            mLogger
-        );
-        mTestDeepDuplicatePacket = std::make_unique<UWaveServer::TestDuplicatePacket> (
-            std::chrono::seconds {120},
-            logBadDataInterval,
-            mLogger
-        );
+        constexpr std::chrono::seconds logFutureAndExpiredInterval{std::chrono::hours {1}};
+        for (int iShard = 0; iShard < nSanitizerThreads; ++iShard)
+        {
+            auto shard = std::make_unique<SanitizerShard> ();
+            shard->queue.setCapacity(shardQueueCapacity);
+            shard->acknowledgements.setCapacity(shardQueueCapacity);
+            shard->testFuturePacket
+                = std::make_unique<UWaveServer::TestFuturePacket> (
+                     maxFutureTime, logFutureAndExpiredInterval, mLogger);
+            shard->testExpiredPacket
+                = std::make_unique<UWaveServer::TestExpiredPacket> (
+                     maxExpiredTime, logFutureAndExpiredInterval, mLogger);
+            shard->testShallowDuplicatePacket
+                = std::make_unique<UWaveServer::TestDuplicatePacket> (
+                    15, // Last 15 packets (good for multiple telemetry routes)
+                    std::chrono::seconds {-1},
+                    mLogger);
+            shard->testDeepDuplicatePacket
+                = std::make_unique<UWaveServer::TestDuplicatePacket> (
+                    std::chrono::seconds {120},
+                    logBadDataInterval,
+                    mLogger);
+            mSanitizerShards.push_back(std::move(shard));
+        }
 
         // Create the database connection
         SPDLOG_LOGGER_DEBUG(mLogger,
@@ -149,8 +248,15 @@ public:
             auto databaseClient 
                 = std::make_unique<UWaveServer::Database::WriteClient>
                   (databaseCredentials, mLogger);
+            if (options.writeDeltaBitPackIntegers)
+            {
+                databaseClient->setIntegerCodec(
+                    UWaveServer::Database::WriteClient::IntegerCodec::
+                    DeltaBitPack);
+            }
             mDatabaseClients.push_back(std::move(databaseClient)); 
         }
+        if (!restoreSanitizerSnapshot()){warmStartSanitizers();}
 
         // Create data clients
         if (!options.seedLinkOptions.empty())
@@ -215,48 +321,340 @@ public:
                 UMetrics::observeNumberOfPacketsWritten,
                 nullptr);
 
+            // Batch flushes by reason
+            totalBatchFlushesCounter
+                = meter->CreateInt64ObservableCounter(
+                    "seismic_data.waveform_storage.client.batches.flushed",
+                    "Number of packet batches flushed to the database.",
+                    "{batches}");
+            totalBatchFlushesCounter->AddCallback(
+                UMetrics::observeNumberOfBatchFlushes,
+                nullptr);
+
             auto histogramMeter
                 = provider->GetMeter("database_write_duration", "1.2.0");
             databaseWritePerformanceHistogram
                 = histogramMeter->CreateDoubleHistogram(
                   "seismic_data.waveform_storage.database.write.duration",
-                  "Time required to write packet to the database",
+                  "Time required to write a batch of packets to the database",
                   "{s}");
 
+            auto batchSizeHistogramMeter
+                = provider->GetMeter("database_write_batch_size", "1.2.0");
+            databaseWriteBatchSizeHistogram
+                = batchSizeHistogramMeter->CreateDoubleHistogram(
+                  "seismic_data.waveform_storage.database.write.batch_size",
+                  "Number of packets written to the database in a batch",
+                  "{packets}");
+
         }
 
         mInitialized = true;
     }
+    /// Seeds each shard's duplicate testers with the headers of its streams.
+    /// @result The number of headers that were seeded.
+    int seedSanitizers(const std::vector<UWaveServer::PacketHeader> &headers)
+    {
+        if (mSanitizerShards.empty()){return 0;}
+        int nSeeded{0};
+        for (const auto &header : headers)
+        {
+            try
+            {
+                auto handle
+                    = UWaveServer::StreamRegistry::getInstance().intern(
+                         header.network, header.station,
+                         header.channel, header.locationCode);
+                auto &shard
+                    = *mSanitizerShards.at(handle%mSanitizerShards.size());
+                shard.testShallowDuplicatePacket->seed(header);
+                shard.testDeepDuplicatePacket->seed(header);
+                nSeeded = nSeeded + 1;
+            }
+            catch (const std::exception &e)
+            {
+                SPDLOG_LOGGER_DEBUG(mLogger, "Could not seed header because {}",
+                                    std::string {e.what()});
+            }
+        }
+        return nSeeded;
+    }
+    /// Restores the duplicate testers from the snapshot file.
+    /// @result True indicates the testers were restored.
+    bool restoreSanitizerSnapshot()
+    {
+        const auto &snapshotFile = mProgramOptions.snapshotFile;
+        if (snapshotFile.empty() || !std::filesystem::exists(snapshotFile))
+        {
+            return false;
+        }
+        std::vector<UWaveServer::PacketHeader> headers;
+        try
+        {
+            headers = UWaveServer::readPacketHeaderSnapshot(snapshotFile);
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_LOGGER_WARN(mLogger,
+                               "Could not read snapshot {} because {}",
+                               snapshotFile.string(), std::string {e.what()});
+            return false;
+        }
+        auto nSeeded = seedSanitizers(headers);
+        SPDLOG_LOGGER_INFO(mLogger,
+                           "Restored sanitizers with {} packet headers from {}",
+                           nSeeded, snapshotFile.string());
+        return nSeeded > 0;
+    }
+    /// Identifies a packet by its stream handle and start time.
+    using InFlightKey = std::pair<uint32_t, int64_t>;
+    /// A packet a shard passed that the writers have yet to finish with.
+    struct InFlightPacket
+    {
+        int64_t startTime{0};
+        int64_t generation{0}; // The snapshot generation when marked
+    };
+    struct SanitizerShard;
+    /// @result The key under which the packet is tracked while in flight.
+    [[nodiscard]] static InFlightKey
+        toInFlightKey(const UWaveServer::Packet &packet)
+    {
+        return std::pair {packet.getStreamHandle(),
+                          static_cast<int64_t> (packet.getStartTime().count())};
+    }
+    /// Forgets one in-flight packet.  This must be called while holding
+    /// the shard's in-flight mutex.
+    static void removeInFlight(SanitizerShard &shard, const InFlightKey &key)
+    {
+        if (key.first >= shard.inFlight.size()){return;}
+        auto &packets = shard.inFlight[key.first];
+        for (auto &packet : packets)
+        {
+            if (packet.startTime == key.second)
+            {
+                packet = packets.back();
+                packets.pop_back();
+                return;
+            }
+        }
+    }
+    /// Applies the writers' acknowledgements.  This must be called while
+    /// holding the shard's in-flight mutex.
+    static void applyAcknowledgements(SanitizerShard &shard)
+    {
+        if (shard.acknowledgements.empty()){return;}
+        std::vector<std::vector<InFlightKey>> acknowledgements;
+        static_cast<void> (shard.acknowledgements.try_pop_n(
+            &acknowledgements, shard.acknowledgements.capacity()));
+        for (const auto &keys : acknowledgements)
+        {
+            for (const auto &key : keys){removeInFlight(shard, key);}
+        }
+    }
+    /// Notes that the packet is on its way to the writers.  This must
+    /// happen before the duplicate testers record it.  Only the shard's
+    /// thread and the snapshot take the shard's mutex.
+    void markInFlight(SanitizerShard &shard,
+                      const UWaveServer::Packet &packet) const
+    {
+        if (mProgramOptions.snapshotFile.empty()){return;}
+        auto key = toInFlightKey(packet);
+        std::scoped_lock lock(shard.inFlightMutex);
+        applyAcknowledgements(shard);
+        if (key.first >= shard.inFlight.size())
+        {
+            shard.inFlight.resize(key.first + 1);
+        }
+        shard.inFlight[key.first].push_back(
+            InFlightPacket {key.second, shard.snapshotGeneration});
+    }
+    /// Notes that a packet the shard marked will not go to the writers.
+    void unmarkInFlight(SanitizerShard &shard,
+                        const UWaveServer::Packet &packet) const
+    {
+        if (mProgramOptions.snapshotFile.empty()){return;}
+        std::scoped_lock lock(shard.inFlightMutex);
+        removeInFlight(shard, toInFlightKey(packet));
+    }
+    /// Hands the writers' acknowledgements to the shards that marked the
+    /// packets, i.e., the packets were written, spooled, or given up on.
+    /// On exit, keysByShard will hold empty vectors.
+    void acknowledgeInFlight(std::vector<std::vector<InFlightKey>> &keysByShard)
+    {
+        for (size_t iShard = 0; iShard < keysByShard.size(); ++iShard)
+        {
+            if (keysByShard[iShard].empty()){continue;}
+            mSanitizerShards[iShard]->acknowledgements.push(
+                std::move(keysByShard[iShard]));
+            keysByShard[iShard].clear();
+        }
+    }
+    /// Writes the deep duplicate testers' state to the snapshot file.  The
+    /// shallow testers are restored from the same headers.  Packets the
+    /// writers have yet to finish with are left out.  Otherwise, were we to
+    /// crash, the feeds' replay of those packets would be rejected as
+    /// duplicates even though they never made it to the database.
+    void writeSanitizerSnapshot()
+    {
+        if (mProgramOptions.snapshotFile.empty()){return;}
+        try
+        {
+            auto &registry = UWaveServer::StreamRegistry::getInstance();
+            std::vector<UWaveServer::PacketHeader> headers;
+            for (const auto &shard : mSanitizerShards)
+            {
+                // The shard marks a packet before its testers record it so,
+                // holding the lock, every recorded packet that is still in
+                // flight is marked
+                std::scoped_lock lock(shard->inFlightMutex);
+                applyAcknowledgements(*shard);
+                auto shardHeaders
+                    = shard->testDeepDuplicatePacket->getPacketHeaders();
+                std::set<InFlightKey> snapshotKeys;
+                std::erase_if(shardHeaders,
+                    [&](const UWaveServer::PacketHeader &header)
+                    {
+                        auto key = std::pair {
+                            registry.intern(header.network,
+                                            header.station,
+                                            header.channel,
+                                            header.locationCode),
+                            static_cast<int64_t> (header.startTime.count())};
+                        snapshotKeys.insert(key);
+                        if (key.first >= shard->inFlight.size()){return false;}
+                        const auto &packets = shard->inFlight[key.first];
+                        return std::any_of(packets.begin(), packets.end(),
+                                           [&](const InFlightPacket &packet)
+                                           {
+                                               return packet.startTime
+                                                   == key.second;
+                                           });
+                    });
+                // Packets dropped on the way to the writers are never
+                // acknowledged.  Once such a packet has outlived a snapshot
+                // and is no longer held by a tester it can be forgotten.
+                for (uint32_t handle = 0;
+                     handle < shard->inFlight.size();
+                     ++handle)
+                {
+                    std::erase_if(shard->inFlight[handle],
+                        [&](const InFlightPacket &packet)
+                        {
+                            return packet.generation
+                                 < shard->snapshotGeneration
+                                && !snapshotKeys.contains(
+                                       std::pair {handle, packet.startTime});
+                        });
+                }
+                shard->snapshotGeneration = shard->snapshotGeneration + 1;
+                headers.insert(headers.end(),
+                               std::make_move_iterator(shardHeaders.begin()),
+                               std::make_move_iterator(shardHeaders.end()));
+            }
+            UWaveServer::writePacketHeaderSnapshot(headers,
+                                                   mProgramOptions.snapshotFile);
+            SPDLOG_LOGGER_DEBUG(mLogger,
+                                "Wrote {} packet headers to snapshot {}",
+                                headers.size(),
+                                mProgramOptions.snapshotFile.string());
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_LOGGER_WARN(mLogger,
+                               "Could not write snapshot because {}",
+                               std::string {e.what()});
+        }
+    }
+    /// Seeds the duplicate testers with the packets most recently written
+    /// to the database.  Otherwise, the data replayed by the feeds after a
+    /// restart would go all the way to the database only to be dropped.
+    void warmStartSanitizers()
+    {
+        if (mProgramOptions.warmStartDuration.count() <= 0){return;}
+        if (mDatabaseClients.empty()){return;}
+        auto now = std::chrono::duration_cast<std::chrono::microseconds>
+                   (std::chrono::system_clock::now().time_since_epoch());
+        auto startTime
+            = now
+            - std::chrono::duration_cast<std::chrono::microseconds>
+              (mProgramOptions.warmStartDuration);
+        std::vector<UWaveServer::PacketHeader> headers;
+        try
+        {
+            headers = mDatabaseClients.front()->queryPacketHeaders(startTime);
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_LOGGER_WARN(mLogger,
+                               "Could not warm start sanitizers because {}",
+                               std::string {e.what()});
+            return;
+        }
+        auto nSeeded = seedSanitizers(headers);
+        SPDLOG_LOGGER_INFO(mLogger,
+                           "Seeded sanitizers with {} packet headers from the last {} s",
+                           nSeeded, mProgramOptions.warmStartDuration.count());
+    }
+    // Adds a batch of packets obtained by the acquisition.  Each shard's
+    // packets are pushed onto its queue at once so its worker is woken
+    // once per batch rather than once per packet.
     void addPacketsFromAcquisition(std::vector<UWaveServer::Packet> &&packetsIn)
     {
+        if (packetsIn.size() == 1)
+        {
+            addPacketFromAcquisition(std::move(packetsIn[0]));
+            return;
+        }
+        // Acquisition clients call this from their own threads.  The
+        // bulk push leaves the batches empty but keeps their capacity.
+        thread_local std::vector<std::vector<UWaveServer::Packet>> batches;
+        batches.resize(mSanitizerShards.size());
         for (auto &packet : packetsIn)
         {
-            addPacketFromAcquisition(std::move(packet));
-        } 
+            if (!isValidAcquiredPacket(packet)){continue;}
+            // This is where packets enter the pipeline so this is where
+            // the stream is interned.  Later stages use the handle.
+            packet.assignStreamHandle();
+            auto iShard = ::toShard(packet, mSanitizerShards.size());
+            batches[iShard].push_back(std::move(packet));
+        }
+        for (size_t iShard = 0; iShard < batches.size(); ++iShard)
+        {
+            if (batches[iShard].empty()){continue;}
+            mSanitizerShards[iShard]->queue.push(std::move(batches[iShard]));
+        }
     }
     // Adds a packet obtained by the acquisition
     void addPacketFromAcquisition(UWaveServer::Packet &&packet)
+    {
+        if (!isValidAcquiredPacket(packet)){return;}
+        //mObservableReceivedPacketsCounter.fetch_add(
+        //    1, std::memory_order_relaxed);
+        addPacketToSanitizer(std::move(packet));
+    }
+    // Checks the packet obtained by the acquisition can be archived
+    [[nodiscard]] bool isValidAcquiredPacket(const UWaveServer::Packet &packet) const
     {
         if (!packet.hasNetwork())
         {
             SPDLOG_LOGGER_WARN(mLogger, "Network not set on packet - skipping");
-            return;
+            return false;
         }
         if (!packet.hasStation())
         {
             SPDLOG_LOGGER_WARN(mLogger, "Station not set on packet - skipping");
-            return;
+            return false;
         }
         if (!packet.hasChannel())
         {
             SPDLOG_LOGGER_WARN(mLogger, "Channel not set on packet - skipping");
-            return;
+            return false;
         }
         if (!packet.hasLocationCode())
         {
             SPDLOG_LOGGER_WARN(mLogger,
                                "Location code not set on packet - skipping");
-            return;
+            return false;
         }
         if (!packet.hasSamplingRate())
         {
@@ -264,48 +662,68 @@ public:
             SPDLOG_LOGGER_WARN(mLogger,
                              "Sampling rate not set on {}'s packet - skipping",
                              name);
-            return;
+            return false;
         }
         if (packet.empty())
         {
             auto name = ::toName(packet);
             SPDLOG_LOGGER_WARN(mLogger, "No data on {}'s packet - skipping",
                                name);
-            return;
+            return false;
         }
-        //mObservableReceivedPacketsCounter.fetch_add(
-        //    1, std::memory_order_relaxed);
-        mShallowPacketSanitizerQueue.push(std::move(packet));
+        return true;
+    }
+    /// Sends the packet to the database writer queue.
+    void addPacketToWriter(UWaveServer::Packet &&packet)
+    {
+        auto iQueue = ::toStationShard(packet,
+                                       mWritePacketToDatabaseQueues.size());
+        mWritePacketToDatabaseQueues[iQueue]->push(std::move(packet));
+    }
+    /// Sends the packet to the sanitizer shard that owns its stream.
+    void addPacketToSanitizer(UWaveServer::Packet &&packet)
+    {
+        // This is where packets enter the pipeline so this is where the
+        // stream is interned.  Later stages use the handle.
+        packet.assignStreamHandle();
+        auto iShard = ::toShard(packet, mSanitizerShards.size());
+        mSanitizerShards[iShard]->queue.push(std::move(packet));
     }
     // Data acquisitions likely will have similar latencies.  So the first
     // thing to do is just check if we're seeing the latest near real-time
-    // packet.
-    void shallowDeduplicator()
+    // packet.  Each shard sees every packet for its streams so per-stream
+    // ordering is preserved.
+    void shallowDeduplicator(const int iShard)
     {
+        auto &shard = *mSanitizerShards.at(iShard);
 #ifndef NDEBUG
-        assert(mTestFuturePacket != nullptr);
-        assert(mTestExpiredPacket != nullptr);
+        assert(shard.testFuturePacket != nullptr);
+        assert(shard.testExpiredPacket != nullptr);
 #endif
-        SPDLOG_LOGGER_INFO(mLogger, "Thread entering shallow packet sanitizer");
+        SPDLOG_LOGGER_INFO(mLogger,
+                           "Thread entering shallow packet sanitizer {}",
+                           iShard);
         auto &metrics
             = UWaveServer::Metrics::MetricsSingleton::getInstance();
-        const std::chrono::milliseconds mTimeOut{10};
         while (keepRunning())
         {
             UWaveServer::Packet packet;
+            // Sleep until there's a packet or stop() closes the queue
             auto gotPacket 
-                = mShallowPacketSanitizerQueue.wait_until_and_pop(
-                     &packet, mTimeOut);
+                = shard.queue.wait_until_and_pop(
+                     &packet, ::LockFreeBoundedQueue<UWaveServer::Packet>::
+                              NO_DEADLINE);
             if (gotPacket)
             {
                 metrics.incrementReceivedPacketsCounter();
+                markInFlight(shard, packet);
                 bool allow{true};
                 // Handle future data
                 try
                 {
                     if (allow)
                     {
-                        allow = mTestFuturePacket->allow(packet);
+                        allow = shard.testFuturePacket->allow(packet);
                         if (!allow)
                         {
                             metrics.incrementRejectedPacketsCounter(UWaveServer::Metrics::MetricsSingleton::Reason::Future);
@@ -326,7 +744,7 @@ public:
                 {
                     if (allow)
                     {
-                        allow = mTestExpiredPacket->allow(packet);
+                        allow = shard.testExpiredPacket->allow(packet);
                         if (!allow)
                         {
                             metrics.incrementRejectedPacketsCounter(UWaveServer::Metrics::MetricsSingleton::Reason::Expired);
@@ -348,9 +766,9 @@ public:
                     if (allow &&
                         static_cast<int> (mDataAcquisitionClients.size()) > 1)
                     {
-                        if (mTestShallowDuplicatePacket)
+                        if (shard.testShallowDuplicatePacket)
                         {
-                            allow = mTestShallowDuplicatePacket->allow(packet);
+                            allow = shard.testShallowDuplicatePacket->allow(packet);
                         }
                         if (!allow)
                         {
@@ -361,9 +779,9 @@ public:
                     }
                     if (allow)
                     {
-                        if (mTestDeepDuplicatePacket)
+                        if (shard.testDeepDuplicatePacket)
                         {
-                            allow = mTestDeepDuplicatePacket->allow(packet);
+                            allow = shard.testDeepDuplicatePacket->allow(packet);
                         }
                         if (!allow)
                         {
@@ -382,11 +800,17 @@ public:
                 }
                 if (allow)
                 {
-                    mWritePacketToDatabaseQueue.push(std::move(packet));
+                    addPacketToWriter(std::move(packet));
+                }
+                else
+                {
+                    unmarkInFlight(shard, packet);
                 }
             }
         }
-        SPDLOG_LOGGER_INFO(mLogger, "Thread leaving shallow packet sanitizer");
+        SPDLOG_LOGGER_INFO(mLogger,
+                           "Thread leaving shallow packet sanitizer {}",
+                           iShard);
     }
 /*
     /// Next, we perform a deeper deduplication process.  This helps to
@@ -408,8 +832,61 @@ public:
         SPDLOG_LOGGER_DEBUG(mLogger, "Thread leaving deep deduplicator");
     }
 */
+    /// @result The spools in the spool directory that no writer owns, e.g.,
+    ///         because fewer writer threads are running than before.  These
+    ///         are divided among the writers by index.
+    [[nodiscard]] std::vector<std::unique_ptr<UWaveServer::PacketSpool>>
+        openOrphanedSpools(const int iThread) const
+    {
+        std::vector<std::unique_ptr<UWaveServer::PacketSpool>> spools;
+        const auto &spoolDirectory = mProgramOptions.spoolDirectory;
+        std::error_code error;
+        if (!std::filesystem::is_directory(spoolDirectory, error))
+        {
+            return spools;
+        }
+        constexpr std::string_view prefix{"writer-"};
+        for (const auto &entry :
+             std::filesystem::directory_iterator(spoolDirectory, error))
+        {
+            if (!entry.is_directory(error)){continue;}
+            const auto name = entry.path().filename().string();
+            if (!name.starts_with(prefix)){continue;}
+            int index{-1};
+            const auto *first = name.data() + prefix.size();
+            const auto *last = name.data() + name.size();
+            auto [end, errorCode] = std::from_chars(first, last, index);
+            if (errorCode != std::errc {} || end != last){continue;}
+            if (index < nDatabaseWriterThreads ||
+                index%nDatabaseWriterThreads != iThread)
+            {
+                continue;
+            }
+            try
+            {
+                auto spool = std::make_unique<UWaveServer::PacketSpool>
+                             (entry.path(),
+                              mProgramOptions.spoolSegmentSize,
+                              mProgramOptions.spoolMaximumSize,
+                              mLogger);
+                SPDLOG_LOGGER_INFO(mLogger,
+                    "Writer {} will replay {} packets from orphaned spool {}",
+                    iThread, spool->size(), entry.path().string());
+                spools.push_back(std::move(spool));
+            }
+            catch (const std::exception &e)
+            {
+                SPDLOG_LOGGER_WARN(mLogger, "Could not open spool {} because {}",
+                                   entry.path().string(),
+                                   std::string {e.what()});
+            }
+        }
+        return spools;
+    }
     /// Finally, we write this to the database.  This is where the real compute
-    /// work happens (on postgres's end).
+    /// work happens (on postgres's end).  Packets are accumulated into a
+    /// batch which is flushed when it is large enough or has waited long
+    /// enough.
     void writePacketToDatabase(int iThread)
     {
         SPDLOG_LOGGER_INFO(mLogger, "Thread {} entering database writer",
@@ -422,18 +899,6 @@ public:
             databaseKey = databaseKey + "." + mProgramOptions.databaseSchema;
         }
 
-        // Testers
-        mTestFuturePacket
-            = std::make_unique<UWaveServer::TestFuturePacket> (
-                std::chrono::microseconds {0},
-                std::chrono::hours {1},
-                mLogger);
-        mTestExpiredPacket
-            = std::make_unique<UWaveServer::TestExpiredPacket> (
-                std::chrono::days {60},
-                std::chrono::hours {1},
-                mLogger);
-
         //mObservablePacketsWritten.add_or_assign(databaseKey, 0);
         //mObservablePacketsNotWritten.add_or_assign(databaseKey, 0);
         auto &metrics
@@ -447,91 +912,579 @@ public:
         auto lastLogTime
             = std::chrono::duration_cast<std::chrono::seconds> (nowMuSeconds);
 
-        const std::chrono::milliseconds mTimeOut{10};
+        // Batching policy
+        using FlushReason = UWaveServer::Metrics::MetricsSingleton::FlushReason;
+        const auto maximumBatchPackets
+            = std::max(1, mProgramOptions.writeBatchMaximumPackets);
+        const auto maximumBatchBytes = mProgramOptions.writeBatchMaximumBytes;
+        const auto maximumBatchDelay = mProgramOptions.writeBatchMaximumDelay;
+        const auto maximumInFlightInserts
+            = mProgramOptions.writeMaximumInFlightInserts;
+        std::vector<UWaveServer::Packet> batch;
+        batch.reserve(maximumBatchPackets);
+        auto &writeQueue
+            = *mWritePacketToDatabaseQueues.at(mStreamAffineWriters ?
+                                               iThread : 0);
+        int64_t batchBytes{0};
+        auto batchStartTime = std::chrono::steady_clock::now();
+
 //int printEvery{0};
         int consecutiveFailureCounter{0};
         int nRowsWritten{0};
         double averageTime{0};
         double cumulativeTime{0};
-        while (keepRunning())
+        auto &databaseClient = *mDatabaseClients.at(iThread);
+        // Writes the packets and returns the number that failed.  If the
+        // connection can't be reestablished then the packets are left as-is.
+        auto writePackets = [&](std::vector<UWaveServer::Packet> &packets)
         {
-            UWaveServer::Packet packet;
-            auto gotPacket 
-                = mWritePacketToDatabaseQueue.wait_until_and_pop(
-                     &packet, mTimeOut);
-            if (gotPacket)
+            int64_t nFailed{0};
+            if (maximumInFlightInserts > 0)
+            {
+                auto failed
+                    = databaseClient.writePipelined(packets,
+                                                    maximumInFlightInserts);
+                nFailed = std::count(failed.begin(), failed.end(), true);
+            }
+            else if (packets.size() == 1)
+            {
+                databaseClient.write(packets.front());
+            }
+            else
+            {
+                nFailed = databaseClient.write(std::move(packets));
+            }
+            return nFailed;
+        };
+        // Writes the packets one at a time so a packet that spoiled a batch
+        // only fails itself.  The result is the number that failed.  If
+        // rejected is set then the failed packets are moved there.  Should
+        // the connection be lost then the packets that were attempted are
+        // tallied and removed before rethrowing.
+        auto writeIndividually = [&](std::vector<UWaveServer::Packet> &packets,
+                                     std::vector<UWaveServer::Packet> *rejected)
+        {
+            int64_t nFailed{0};
+            for (size_t i = 0; i < packets.size(); ++i)
             {
                 try
                 {
-                    auto t1 = std::chrono::high_resolution_clock::now(); 
-                    mDatabaseClients.at(iThread)->write(packet);
-                    consecutiveFailureCounter = 0;
-                    auto t2 = std::chrono::high_resolution_clock::now();
-                    double duration
-                        = std::chrono::duration_cast<std::chrono::microseconds>
-                          (t2 - t1).count()*1.e-6;
-                    //mObservablePacketsWritten.add_or_assign(databaseKey, 1);
-                    metrics.incrementWrittenPacketsCounter();
-                    if (databaseWritePerformanceHistogram)
+                    databaseClient.write(packets[i]);
+                }
+                catch (const std::exception &e)
+                {
+                    if (!databaseClient.isConnected())
+                    {
+                        const auto nAttempted = static_cast<int64_t> (i);
+                        metrics.incrementWrittenPacketsCounter(nAttempted
+                                                             - nFailed);
+                        if (nFailed > 0)
+                        {
+                            metrics.incrementNotWrittenPacketsCounter(nFailed);
+                        }
+                        packets.erase(packets.begin(), packets.begin() + i);
+                        throw;
+                    }
+                    SPDLOG_LOGGER_WARN(mLogger,
+                                       "Failed to add {} to database because {}",
+                                       ::toName(packets[i]),
+                                       std::string {e.what()});
+                    nFailed = nFailed + 1;
+                    if (rejected){rejected->push_back(std::move(packets[i]));}
+                }
+            }
+            const auto nPackets = static_cast<int64_t> (packets.size());
+            metrics.incrementWrittenPacketsCounter(nPackets - nFailed);
+            if (nFailed > 0)
+            {
+                metrics.incrementNotWrittenPacketsCounter(nFailed);
+            }
+            packets.clear();
+            return nFailed;
+        };
+
+        // While the database is unavailable packets go to the spool (if
+        // there is one) and are replayed at a limited rate once it returns
+        std::unique_ptr<UWaveServer::PacketSpool> spool{nullptr};
+        // Spools left behind by writers that no longer exist are replayed
+        // first then removed
+        std::vector<std::unique_ptr<UWaveServer::PacketSpool>> orphanedSpools;
+        // Replayed packets the database rejects one at a time are set aside
+        // here for an operator rather than retried forever
+        std::unique_ptr<UWaveServer::PacketSpool> quarantine{nullptr};
+        if (!mProgramOptions.spoolDirectory.empty())
+        {
+            spool = std::make_unique<UWaveServer::PacketSpool>
+                    (mProgramOptions.spoolDirectory
+                       /("writer-" + std::to_string(iThread)),
+                     mProgramOptions.spoolSegmentSize,
+                     mProgramOptions.spoolMaximumSize,
+                     mLogger);
+            orphanedSpools = openOrphanedSpools(iThread);
+        }
+        auto quarantinePackets = [&](std::vector<UWaveServer::Packet> &packets)
+        {
+            if (packets.empty()){return;}
+            try
+            {
+                if (!quarantine)
+                {
+                    quarantine = std::make_unique<UWaveServer::PacketSpool>
+                        (mProgramOptions.spoolDirectory
+                           /("quarantine-" + std::to_string(iThread)),
+                         mProgramOptions.spoolSegmentSize,
+                         mProgramOptions.spoolMaximumSize,
+                         mLogger);
+                }
+                int nQuarantined{0};
+                for (const auto &packet : packets)
+                {
+                    if (quarantine->push(packet))
                     {
-                        databaseWritePerformanceHistogram->Record(duration,
-                                                                  histogramKey,
-                                                                  otelContext);
+                        nQuarantined = nQuarantined + 1;
                     }
-                    averageTime = averageTime + duration;
-                    cumulativeTime = cumulativeTime + duration;
-                    nRowsWritten = nRowsWritten + 1; //packet.size();
-                    //printEvery = printEvery + 1;
- 
-                    nowMuSeconds
-                       = std::chrono::time_point_cast<std::chrono::microseconds>
-                         (t2).time_since_epoch();
-                    auto nowSeconds
-                        = std::chrono::duration_cast<std::chrono::seconds>
-                          (nowMuSeconds);
-
-                    //if (printEvery > 1000)
-                    if (nowSeconds >= lastLogTime
-                                    + mLogWritePerformanceInterval)
+                }
+                quarantine->flush();
+                SPDLOG_LOGGER_WARN(mLogger,
+                                   "Quarantined {} of {} rejected packets in {}",
+                                   nQuarantined, packets.size(),
+                                   quarantine->getDirectory().string());
+            }
+            catch (const std::exception &e)
+            {
+                SPDLOG_LOGGER_WARN(mLogger,
+                                   "Could not quarantine {} packets because {}",
+                                   packets.size(), std::string {e.what()});
+            }
+            packets.clear();
+        };
+        const auto spoolRetryInterval = mProgramOptions.spoolRetryInterval;
+        const auto replayRate = mProgramOptions.spoolReplayPacketsPerSecond;
+        bool databaseUnavailable{false};
+        auto lastConnectionAttempt = std::chrono::steady_clock::now();
+        auto lastReplayTime = lastConnectionAttempt;
+        double replayCredits{0};
+        auto enterOutage = [&](const std::string &reason)
+        {
+            if (!databaseUnavailable)
+            {
+                SPDLOG_LOGGER_ERROR(mLogger,
+                   "Database unavailable on thread {} because {}.  Spooling packets to {}",
+                   std::to_string(iThread), reason,
+                   spool->getDirectory().string());
+            }
+            databaseUnavailable = true;
+            lastConnectionAttempt = std::chrono::steady_clock::now();
+        };
+        auto spoolPackets = [&](std::vector<UWaveServer::Packet> &packets)
+        {
+            int64_t nLost{0};
+            for (const auto &packet : packets)
+            {
+                try
+                {
+                    if (packet.empty() || !spool->push(packet))
                     {
-                        SPDLOG_LOGGER_INFO(mLogger,
-                                          "{} packets written on thread {}.  Average packet write time took {} seconds.  ({} rows/second)",
-                                          nRowsWritten, 
-                                          std::to_string(iThread),
-                                          static_cast<double> (averageTime/nRowsWritten),
-                                          static_cast<int> (std::round(nRowsWritten/cumulativeTime)));
-                        //printEvery = 0;
-                        averageTime = 0;
-                        nRowsWritten = 0;
-                        cumulativeTime = 0;
-                        lastLogTime = nowSeconds;
+                        nLost = nLost + 1;
                     }
                 }
-                catch (const UWaveServer::Database::ReconnectError &e)
+                catch (const std::exception &e)
                 {
-                    SPDLOG_LOGGER_CRITICAL(mLogger,
-                        "Reconnect error detected: {}",
-                        std::string {e.what()});
-                    throw std::runtime_error("Database connectivity is in question");
+                    SPDLOG_LOGGER_WARN(mLogger, "Failed to spool {} because {}",
+                                       ::toName(packet),
+                                       std::string {e.what()});
+                    nLost = nLost + 1;
+                }
+            }
+            if (nLost > 0)
+            {
+                SPDLOG_LOGGER_WARN(mLogger,
+                                   "Spool full; {} packets lost on thread {}",
+                                   nLost, std::to_string(iThread));
+                metrics.incrementNotWrittenPacketsCounter(nLost);
+            }
+            packets.clear();
+        };
+        // When serviceSpool() next has work to do
+        auto nextSpoolServiceTime = [&]()
+        {
+            if (databaseUnavailable)
+            {
+                return lastConnectionAttempt
+                     + std::chrono::duration_cast
+                       <std::chrono::steady_clock::duration>
+                       (spoolRetryInterval);
+            }
+            if (spool->empty() && orphanedSpools.empty())
+            {
+                return std::chrono::steady_clock::time_point::max();
+            }
+            // When the token bucket will have a packet's worth of credit
+            std::chrono::duration<double> wait
+            {
+                std::max(0.0, 1 - replayCredits)/replayRate
+            };
+            return lastReplayTime
+                 + std::chrono::duration_cast
+                   <std::chrono::steady_clock::duration> (wait);
+        };
+        auto serviceSpool = [&]()
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (databaseUnavailable)
+            {
+                if (now - lastConnectionAttempt < spoolRetryInterval){return;}
+                lastConnectionAttempt = now;
+                try
+                {
+                    databaseClient.connect();
                 }
                 catch (const std::exception &e)
                 {
-                    SPDLOG_LOGGER_WARN(mLogger,
-                                   "Failed to add packet to database because {}",
-                                   std::string {e.what()});
-                    //mObservablePacketsNotWritten.add_or_assign(databaseKey, 1);
-                    metrics.incrementNotWrittenPacketsCounter();
-                    consecutiveFailureCounter = consecutiveFailureCounter + 1;
-                    if (consecutiveFailureCounter == 100)
+                    SPDLOG_LOGGER_DEBUG(mLogger,
+                                        "Database still unavailable: {}",
+                                        std::string {e.what()});
+                    return;
+                }
+                if (!databaseClient.isConnected()){return;}
+                SPDLOG_LOGGER_INFO(mLogger,
+                   "Database available again; replaying {} spooled packets on thread {}",
+                   spool->size(), std::to_string(iThread));
+                databaseUnavailable = false;
+                replayCredits = 0;
+                lastReplayTime = now;
+            }
+            while (!orphanedSpools.empty() && orphanedSpools.front()->empty())
+            {
+                auto directory = orphanedSpools.front()->getDirectory();
+                orphanedSpools.erase(orphanedSpools.begin());
+                std::error_code error;
+                std::filesystem::remove_all(directory, error);
+                SPDLOG_LOGGER_INFO(mLogger, "Finished replaying spool {}",
+                                   directory.string());
+            }
+            auto &replaySpool
+                = orphanedSpools.empty() ? *spool : *orphanedSpools.front();
+            if (replaySpool.empty())
+            {
+                replayCredits = 0;
+                lastReplayTime = now;
+                return;
+            }
+            // Token bucket with at most a second's worth of credit
+            replayCredits
+                = std::min(replayRate,
+                           replayCredits
+                         + replayRate*std::chrono::duration<double>
+                                      (now - lastReplayTime).count());
+            lastReplayTime = now;
+            auto nReplay = std::min(static_cast<int> (replayCredits),
+                                    maximumBatchPackets);
+            if (nReplay < 1){return;}
+            auto packets = replaySpool.peek(nReplay);
+            const auto nPackets = static_cast<int64_t> (packets.size());
+            try
+            {
+                auto nFailed = writePackets(packets);
+                metrics.incrementWrittenPacketsCounter(nPackets - nFailed);
+                if (nFailed > 0)
+                {
+                    metrics.incrementNotWrittenPacketsCounter(nFailed);
+                }
+            }
+            catch (const UWaveServer::Database::ReconnectError &e)
+            {
+                enterOutage(e.what());
+                return;
+            }
+            catch (const std::exception &e)
+            {
+                if (!databaseClient.isConnected())
+                {
+                    enterOutage(e.what());
+                    return;
+                }
+                // Don't let bad packets wedge the replay.  Only the packets
+                // the database rejects on their own are set aside.
+                SPDLOG_LOGGER_WARN(mLogger,
+                    "Failed to replay {} packets because {}.  Replaying them individually.",
+                    nPackets, std::string {e.what()});
+                const auto nDropped
+                    = nPackets - static_cast<int64_t> (packets.size());
+                if (nDropped > 0)
+                {
+                    metrics.incrementNotWrittenPacketsCounter(nDropped);
+                }
+                std::vector<UWaveServer::Packet> rejected;
+                try
+                {
+                    writeIndividually(packets, &rejected);
+                }
+                catch (const std::exception &individualError)
+                {
+                    // The packets that were attempted are done with
+                    quarantinePackets(rejected);
+                    replaySpool.consume(
+                        static_cast<int> (nPackets
+                                        - static_cast<int64_t> (packets.size())));
+                    enterOutage(individualError.what());
+                    return;
+                }
+                quarantinePackets(rejected);
+            }
+            replaySpool.consume(static_cast<int> (nPackets));
+            replayCredits = replayCredits - static_cast<double> (nPackets);
+        };
+
+        auto flushBatch = [&](const FlushReason reason)
+        {
+            if (batch.empty()){return;}
+            const auto batchSize = static_cast<int64_t> (batch.size());
+            if (spool && databaseUnavailable)
+            {
+                spoolPackets(batch);
+                batchBytes = 0;
+                return;
+            }
+            metrics.incrementBatchFlushCounter(reason);
+            if (databaseWriteBatchSizeHistogram)
+            {
+                databaseWriteBatchSizeHistogram->Record(
+                    static_cast<double> (batchSize),
+                    histogramKey,
+                    otelContext);
+            }
+            try
+            {
+                auto t1 = std::chrono::high_resolution_clock::now(); 
+                auto nFailed = writePackets(batch);
+                batch.clear();
+                batchBytes = 0;
+                consecutiveFailureCounter = 0;
+                auto t2 = std::chrono::high_resolution_clock::now();
+                double duration
+                    = std::chrono::duration_cast<std::chrono::microseconds>
+                      (t2 - t1).count()*1.e-6;
+                //mObservablePacketsWritten.add_or_assign(databaseKey, 1);
+                metrics.incrementWrittenPacketsCounter(batchSize - nFailed);
+                if (nFailed > 0)
+                {
+                    metrics.incrementNotWrittenPacketsCounter(nFailed);
+                }
+                if (databaseWritePerformanceHistogram)
+                {
+                    databaseWritePerformanceHistogram->Record(duration,
+                                                              histogramKey,
+                                                              otelContext);
+                }
+                averageTime = averageTime + duration;
+                cumulativeTime = cumulativeTime + duration;
+                nRowsWritten = nRowsWritten + static_cast<int> (batchSize);
+                //printEvery = printEvery + 1;
+ 
+                nowMuSeconds
+                   = std::chrono::time_point_cast<std::chrono::microseconds>
+                     (t2).time_since_epoch();
+                auto nowSeconds
+                    = std::chrono::duration_cast<std::chrono::seconds>
+                      (nowMuSeconds);
+
+                //if (printEvery > 1000)
+                if (nowSeconds >= lastLogTime
+                                + mLogWritePerformanceInterval)
+                {
+                    SPDLOG_LOGGER_INFO(mLogger,
+                                      "{} packets written on thread {}.  Average packet write time took {} seconds.  ({} rows/second)",
+                                      nRowsWritten, 
+                                      std::to_string(iThread),
+                                      static_cast<double> (cumulativeTime/nRowsWritten),
+                                      static_cast<int> (std::round(nRowsWritten/cumulativeTime)));
+                    //printEvery = 0;
+                    averageTime = 0;
+                    nRowsWritten = 0;
+                    cumulativeTime = 0;
+                    lastLogTime = nowSeconds;
+                }
+            }
+            catch (const UWaveServer::Database::ReconnectError &e)
+            {
+                if (spool)
+                {
+                    enterOutage(e.what());
+                    spoolPackets(batch);
+                    batchBytes = 0;
+                    return;
+                }
+                SPDLOG_LOGGER_CRITICAL(mLogger,
+                    "Reconnect error detected: {}",
+                    std::string {e.what()});
+                throw std::runtime_error("Database connectivity is in question");
+            }
+            catch (const std::exception &e)
+            {
+                // Lost the connection mid-write.  Whatever remains in the
+                // batch can still be spooled.
+                if (spool && !databaseClient.isConnected())
+                {
+                    enterOutage(e.what());
+                    spoolPackets(batch);
+                    batchBytes = 0;
+                    return;
+                }
+                SPDLOG_LOGGER_WARN(mLogger,
+                    "Failed to add {} packets to database because {}.  Writing them individually.",
+                    batchSize,
+                    std::string {e.what()});
+                // The batch write removes the packets it will never write
+                const auto nDropped
+                    = batchSize - static_cast<int64_t> (batch.size());
+                if (nDropped > 0)
+                {
+                    metrics.incrementNotWrittenPacketsCounter(nDropped);
+                }
+                bool allFailed{false};
+                try
+                {
+                    auto nFailed = writeIndividually(batch, nullptr);
+                    allFailed = (nDropped + nFailed == batchSize);
+                }
+                catch (const std::exception &individualError)
+                {
+                    if (spool && !databaseClient.isConnected())
                     {
-                        SPDLOG_LOGGER_CRITICAL(mLogger,
-                           "Too many consecutive db write failures");
-                        throw std::runtime_error(
-                           "Too many consecutive failures writing packets");
+                        enterOutage(individualError.what());
+                        spoolPackets(batch);
+                        batchBytes = 0;
+                        return;
                     }
+                    //mObservablePacketsNotWritten.add_or_assign(databaseKey, 1);
+                    metrics.incrementNotWrittenPacketsCounter(
+                        static_cast<int64_t> (batch.size()));
+                    allFailed = true;
+                }
+                batch.clear();
+                batchBytes = 0;
+                if (!allFailed)
+                {
+                    consecutiveFailureCounter = 0;
+                    return;
+                }
+                consecutiveFailureCounter = consecutiveFailureCounter + 1;
+                if (consecutiveFailureCounter == 100)
+                {
+                    SPDLOG_LOGGER_CRITICAL(mLogger,
+                       "Too many consecutive db write failures");
+                    throw std::runtime_error(
+                       "Too many consecutive failures writing packets");
+                }
+            }
+        };
+        // Once a batch is flushed - whether it was written, spooled, or
+        // given up on - its packets may go in the sanitizer snapshot
+        std::vector<std::vector<InFlightKey>>
+            inFlightKeys(mSanitizerShards.size());
+        auto flush = [&](const FlushReason reason)
+        {
+            if (batch.empty()){return;}
+            if (!mProgramOptions.snapshotFile.empty())
+            {
+                for (const auto &packet : batch)
+                {
+                    inFlightKeys[::toShard(packet, inFlightKeys.size())]
+                        .push_back(toInFlightKey(packet));
+                }
+            }
+            flushBatch(reason);
+            acknowledgeInFlight(inFlightKeys);
+        };
+        while (keepRunning())
+        {
+            // Only wake up on our own when a partial batch is due to be
+            // flushed or the spool is due to be serviced.  Otherwise, sleep
+            // until there's a packet or stop() closes the queue.
+            auto deadline = std::chrono::steady_clock::time_point::max();
+            if (!batch.empty())
+            {
+                deadline = batchStartTime
+                         + std::chrono::duration_cast
+                           <std::chrono::steady_clock::duration>
+                           (maximumBatchDelay);
+            }
+            if (spool){deadline = std::min(deadline, nextSpoolServiceTime());}
+            auto timeOut
+                = ::LockFreeBoundedQueue<UWaveServer::Packet>::NO_DEADLINE;
+            if (deadline != std::chrono::steady_clock::time_point::max())
+            {
+                timeOut = std::max(std::chrono::milliseconds {0},
+                                   std::chrono::ceil<std::chrono::milliseconds>
+                                   (deadline
+                                  - std::chrono::steady_clock::now()));
+            }
+            // Drain as much as the batch can hold in one go
+            const auto nPreviousPackets = batch.size();
+            auto nPopped
+                = writeQueue.wait_until_and_pop_n(
+                     &batch,
+                     static_cast<size_t> (maximumBatchPackets)
+                   - nPreviousPackets,
+                     timeOut);
+            if (nPopped > 0)
+            {
+                if (nPreviousPackets == 0)
+                {
+                    batchStartTime = std::chrono::steady_clock::now();
+                }
+                for (auto i = nPreviousPackets; i < batch.size(); ++i)
+                {
+                    batchBytes = batchBytes + ::estimateSizeInBytes(batch[i]);
                 }
             }
+            if (spool){serviceSpool();}
+            if (batch.empty()){continue;}
+            if (static_cast<int> (batch.size()) >= maximumBatchPackets)
+            {
+                flush(FlushReason::PacketCount);
+            }
+            else if (batchBytes >= maximumBatchBytes)
+            {
+                flush(FlushReason::ByteCount);
+            }
+            else if (std::chrono::steady_clock::now() - batchStartTime >=
+                     maximumBatchDelay)
+            {
+                flush(FlushReason::MaximumDelay);
+            }
+        }
+        // Don't leave anything behind.  Packets dropped here would only be
+        // recovered if the feeds were to resend them.
+        flush(FlushReason::Shutdown);
+        while (batch.empty())
+        {
+            auto nPopped
+                = writeQueue.wait_until_and_pop_n(
+                     &batch,
+                     static_cast<size_t> (maximumBatchPackets),
+                     std::chrono::milliseconds {0});
+            if (nPopped == 0){break;}
+            flush(FlushReason::Shutdown);
         }
+        if (spool)
+        {
+            spool->flush();
+            if (!spool->empty())
+            {
+                SPDLOG_LOGGER_WARN(mLogger,
+                    "{} packets remain in {} and will be replayed on restart",
+                    spool->size(), spool->getDirectory().string());
+            }
+        }
+        SPDLOG_LOGGER_INFO(mLogger,
+                   "Thread {} prepared statement cache had {} hits and {} misses",
+                   std::to_string(iThread),
+                   mDatabaseClients.at(iThread)->getPreparedStatementCacheHits(),
+                   mDatabaseClients.at(iThread)->getPreparedStatementCacheMisses());
+        SPDLOG_LOGGER_INFO(mLogger, "Thread {} leaving database writer",
+                           std::to_string(iThread));
     }
 
     void addPacketsCallback(std::vector<UWaveServer::Packet> &&packets)
@@ -570,7 +1523,7 @@ public:
             // Add packet to shallow deduplicator
             try
             {
-                mShallowPacketSanitizerQueue.push(std::move(packet));
+                addPacketToSanitizer(std::move(packet));
             }
             catch (const std::exception &e)
             {
@@ -609,6 +1562,7 @@ public:
     {
         SPDLOG_LOGGER_DEBUG(mLogger, "Main thread entering waiting loop");
         catchSignals();
+        auto lastSnapshotTime = std::chrono::steady_clock::now();
         {
             while (!mStopRequested)
             {
@@ -628,6 +1582,12 @@ public:
                     break;
                 }
                 printSummary();
+                auto now = std::chrono::steady_clock::now();
+                if (now >= lastSnapshotTime + mProgramOptions.snapshotInterval)
+                {
+                    writeSanitizerSnapshot();
+                    lastSnapshotTime = now;
+                }
                 std::unique_lock<std::mutex> lock(mStopMutex);
                 constexpr std::chrono::milliseconds pause{100};
                 mStopCondition.wait_for(lock, pause,
@@ -642,6 +1602,8 @@ public:
             SPDLOG_LOGGER_DEBUG(mLogger,
                                 "Stop request received.  Terminating...");
             stop();
+            // The sanitizers are idle now so this is their final state
+            writeSanitizerSnapshot();
             std::this_thread::sleep_for(std::chrono::milliseconds {15});
         }
     }
@@ -672,8 +1634,13 @@ public:
             mDataAcquisitionFutures.push_back(
                 dataAcquisitionClient->start());
         }
-        mShallowPacketSanitizerThread
-            = std::thread(&::Process::shallowDeduplicator, this);
+        for (int iShard = 0;
+             iShard < static_cast<int> (mSanitizerShards.size());
+             ++iShard)
+        {
+            mSanitizerShards[iShard]->thread
+                = std::thread(&::Process::shallowDeduplicator, this, iShard);
+        }
         //mDeepPacketSanitizerThread
         //    = std::thread(&::Process::deepDeduplicator, this);
         mDatabaseWriterThreads.clear();
@@ -688,6 +1655,9 @@ public:
     void stop()
     {
         setRunning(false);
+        // The consumers sleep without a deadline so they must be released
+        for (auto &shard : mSanitizerShards){shard->queue.close();}
+        for (auto &queue : mWritePacketToDatabaseQueues){queue->close();}
         for (auto &dataAcquisitionClient : mDataAcquisitionClients)
         {
             dataAcquisitionClient->stop();
@@ -698,9 +1668,9 @@ public:
         }
         mDataAcquisitionFutures.clear();
 
-        if (mShallowPacketSanitizerThread.joinable())
+        for (auto &shard : mSanitizerShards)
         {
-            mShallowPacketSanitizerThread.join();
+            if (shard->thread.joinable()){shard->thread.join();}
         }
         //if (mDeepPacketSanitizerThread.joinable())
         //{
@@ -721,17 +1691,23 @@ public:
     /// @brief Starts the processes
     void emptyQueues()
     {   
-        while (!mShallowPacketSanitizerQueue.empty())
+        for (auto &shard : mSanitizerShards)
         {
-            mShallowPacketSanitizerQueue.pop();
+            while (!shard->queue.empty())
+            {
+                shard->queue.pop();
+            }
         }
         //while (!mDeepPacketSanitizerQueue.empty())
         //{   
         //    mDeepPacketSanitizerQueue.pop();
         //}   
-        while (!mWritePacketToDatabaseQueue.empty())
+        for (auto &queue : mWritePacketToDatabaseQueues)
         {
-            mWritePacketToDatabaseQueue.pop();
+            while (!queue->empty())
+            {
+                queue->pop();
+            }
         }
     }
     /// @brief Checks the futures
@@ -760,9 +1736,28 @@ public:
         }
         return isOkay;
     }
-    ::ThreadSafeBoundedQueue<UWaveServer::Packet> mShallowPacketSanitizerQueue;
+    /// A sanitizer worker.  Streams are assigned to shards by ::toShard.
+    struct SanitizerShard
+    {
+        ::LockFreeBoundedQueue<UWaveServer::Packet> queue;
+        // The packets in flight indexed by stream handle.  These are left
+        // out of the snapshot.  Only the shard's thread and the snapshot
+        // take the mutex.
+        std::vector<std::vector<InFlightPacket>> inFlight;
+        // Writers acknowledge batches of packets here
+        ::LockFreeBoundedQueue<std::vector<InFlightKey>> acknowledgements;
+        int64_t snapshotGeneration{0};
+        std::mutex inFlightMutex;
+        std::unique_ptr<UWaveServer::TestDuplicatePacket> testShallowDuplicatePacket{nullptr};
+        std::unique_ptr<UWaveServer::TestDuplicatePacket> testDeepDuplicatePacket{nullptr};
+        std::unique_ptr<UWaveServer::TestFuturePacket> testFuturePacket{nullptr};
+        std::unique_ptr<UWaveServer::TestExpiredPacket> testExpiredPacket{nullptr};
+        std::thread thread;
+    };
+    std::vector<std::unique_ptr<SanitizerShard>> mSanitizerShards;
     //::ThreadSafeBoundedQueue<UWaveServer::Packet> mDeepPacketSanitizerQueue;
-    ::ThreadSafeBoundedQueue<UWaveServer::Packet> mWritePacketToDatabaseQueue;
+    std::vector<std::unique_ptr<::LockFreeBoundedQueue<UWaveServer::Packet>>>
+        mWritePacketToDatabaseQueues;
     std::vector<std::unique_ptr<UWaveServer::Database::WriteClient>>
         mDatabaseClients;
     std::vector<std::unique_ptr<UWaveServer::DataClient::IDataClient>>
@@ -781,10 +1776,6 @@ public:
         std::chrono::seconds {120},
         std::chrono::seconds {std::chrono::minutes {15}}};
     */
-    std::unique_ptr<UWaveServer::TestDuplicatePacket> mTestShallowDuplicatePacket{nullptr};
-    std::unique_ptr<UWaveServer::TestDuplicatePacket> mTestDeepDuplicatePacket{nullptr};
-    std::unique_ptr<UWaveServer::TestFuturePacket> mTestFuturePacket{nullptr};
-    std::unique_ptr<UWaveServer::TestExpiredPacket> mTestExpiredPacket{nullptr};
 /*
     UWaveServer::TestFuturePacket mTestFuturePacket{
         std::chrono::microseconds {0},
@@ -802,12 +1793,12 @@ public:
     std::vector<std::future<void>> mDataAcquisitionFutures;
     std::vector<std::thread> mDatabaseWriterThreads;
     //std::vector<std::pair<int, double>> mWriterThroughPut;
-    std::thread mShallowPacketSanitizerThread;
     std::chrono::seconds mLogWritePerformanceInterval{3600};
     std::chrono::seconds mMaximumLatency{-1};
     std::atomic<bool> mRunning{true};
     bool mStopRequested{false};
     int nDatabaseWriterThreads{4};
+    bool mStreamAffineWriters{false};
     bool mInitialized{false};
 };
 
@@ -1108,6 +2099,20 @@ UWaveServer::ProgramOptions parseIniFile(const std::string &iniFile)
             "Number of database threads must be between 1 and 2048");
     }
 
+    options.streamAffineDatabaseWriters
+       = propertyTree.get<bool> ("General.streamAffineDatabaseWriters",
+                                 options.streamAffineDatabaseWriters);
+
+    options.nSanitizerThreads
+       = propertyTree.get<int> ("General.nSanitizerThreads",
+                                options.nSanitizerThreads);
+    if (options.nSanitizerThreads < 1 ||
+        options.nSanitizerThreads > 256)
+    {
+        throw std::invalid_argument(
+            "Number of sanitizer threads must be between 1 and 256");
+    }
+
     /*
     // Prometheus
     uint16_t prometheusPort
@@ -1281,6 +2286,117 @@ UWaveServer::ProgramOptions parseIniFile(const std::string &iniFile)
     options.databaseSchema
         = propertyTree.get<std::string> ("Database.schema", "");
 
+    // Write batching
+    options.writeBatchMaximumPackets
+        = propertyTree.get<int> ("DatabaseWriter.maximumBatchPackets",
+                                 options.writeBatchMaximumPackets);
+    if (options.writeBatchMaximumPackets < 1)
+    {
+        throw std::invalid_argument(
+            "DatabaseWriter.maximumBatchPackets must be positive");
+    }
+    options.writeBatchMaximumBytes
+        = propertyTree.get<int64_t> ("DatabaseWriter.maximumBatchBytes",
+                                     options.writeBatchMaximumBytes);
+    if (options.writeBatchMaximumBytes < 1)
+    {
+        throw std::invalid_argument(
+            "DatabaseWriter.maximumBatchBytes must be positive");
+    }
+    auto maximumBatchDelay
+        = propertyTree.get<int64_t>
+          ("DatabaseWriter.maximumBatchDelayInMilliSeconds",
+           options.writeBatchMaximumDelay.count());
+    if (maximumBatchDelay < 0)
+    {
+        throw std::invalid_argument(
+       "DatabaseWriter.maximumBatchDelayInMilliSeconds cannot be negative");
+    }
+    options.writeBatchMaximumDelay
+        = std::chrono::milliseconds {maximumBatchDelay};
+    options.writeMaximumInFlightInserts
+        = propertyTree.get<int> ("DatabaseWriter.maximumInFlightInserts",
+                                 options.writeMaximumInFlightInserts);
+    if (options.writeMaximumInFlightInserts < 0)
+    {
+        throw std::invalid_argument(
+            "DatabaseWriter.maximumInFlightInserts cannot be negative");
+    }
+    auto integerCodec
+        = propertyTree.get<std::string> ("DatabaseWriter.integerCodec",
+                                         "zlib");
+    std::transform(integerCodec.begin(), integerCodec.end(),
+                   integerCodec.begin(), ::tolower);
+    if (integerCodec == "deltabitpack")
+    {
+        options.writeDeltaBitPackIntegers = true;
+    }
+    else if (integerCodec != "zlib")
+    {
+        throw std::invalid_argument(
+            "DatabaseWriter.integerCodec must be zlib or deltaBitPack");
+    }
+
+    // Spooling during database outages
+    options.spoolDirectory
+        = propertyTree.get<std::string> ("DatabaseWriter.spoolDirectory",
+                                         options.spoolDirectory.string());
+    options.spoolSegmentSize
+        = propertyTree.get<int64_t>
+          ("DatabaseWriter.spoolSegmentSizeInMegaBytes",
+           options.spoolSegmentSize/(1024*1024))*1024*1024;
+    options.spoolMaximumSize
+        = propertyTree.get<int64_t>
+          ("DatabaseWriter.spoolMaximumSizeInMegaBytes",
+           options.spoolMaximumSize/(1024*1024))*1024*1024;
+    if (options.spoolSegmentSize <= 0 ||
+        options.spoolMaximumSize < options.spoolSegmentSize)
+    {
+        throw std::invalid_argument(
+  "DatabaseWriter.spoolMaximumSizeInMegaBytes must be at least DatabaseWriter.spoolSegmentSizeInMegaBytes which must be positive");
+    }
+    options.spoolReplayPacketsPerSecond
+        = propertyTree.get<double>
+          ("DatabaseWriter.spoolReplayPacketsPerSecond",
+           options.spoolReplayPacketsPerSecond);
+    if (options.spoolReplayPacketsPerSecond < 1)
+    {
+        throw std::invalid_argument(
+            "DatabaseWriter.spoolReplayPacketsPerSecond must be at least 1");
+    }
+    auto spoolRetryInterval
+        = propertyTree.get<int> ("DatabaseWriter.spoolRetryIntervalInSeconds",
+                                 options.spoolRetryInterval.count());
+    if (spoolRetryInterval < 1)
+    {
+        throw std::invalid_argument(
+            "DatabaseWriter.spoolRetryIntervalInSeconds must be positive");
+    }
+    options.spoolRetryInterval = std::chrono::seconds {spoolRetryInterval};
+
+    auto warmStartDuration
+        = propertyTree.get<int> ("PacketSanitizer.warmStartDurationInSeconds",
+                                 options.warmStartDuration.count());
+    if (warmStartDuration < 0)
+    {
+        throw std::invalid_argument(
+            "PacketSanitizer.warmStartDurationInSeconds cannot be negative");
+    }
+    options.warmStartDuration = std::chrono::seconds {warmStartDuration};
+
+    options.snapshotFile
+        = propertyTree.get<std::string> ("PacketSanitizer.snapshotFile",
+                                         options.snapshotFile.string());
+    auto snapshotInterval
+        = propertyTree.get<int> ("PacketSanitizer.snapshotIntervalInSeconds",
+                                 options.snapshotInterval.count());
+    if (snapshotInterval <= 0)
+    {
+        throw std::invalid_argument(
+            "PacketSanitizer.snapshotIntervalInSeconds must be positive");
+    }
+    options.snapshotInterval = std::chrono::seconds {snapshotInterval};
+
     UWaveServer::PacketSanitizerOptions packetSanitizerOptions; 
     // Realistically, anything older than 2 -4 weeks isn't making it back
     // from the field.  2 months is pretty generous so we let the database
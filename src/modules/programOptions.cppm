@@ -1,5 +1,6 @@
 module;
 
+#include <filesystem>
 #include <boost/program_options.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
@@ -29,6 +30,33 @@ struct ProgramOptions
     OTelGRPCMetricsOptions otelGRPCMetricsOptions;
     OTelGRPCLogOptions otelGRPCLogOptions;
     std::chrono::seconds printSummaryInterval{std::chrono::minutes {15}};
+    // Writer threads flush a batch when any of these are reached.  Keep the
+    // delay small so the data remains near real-time.
+    std::chrono::milliseconds writeBatchMaximumDelay{50};
+    int64_t writeBatchMaximumBytes{4*1024*1024};
+    int writeBatchMaximumPackets{256};
+    // When positive, batches are written as pipelined INSERTs instead of
+    // with COPY.  At most this many INSERTs await the server's reply.
+    int writeMaximumInFlightInserts{0};
+    // Store integer samples with the delta bit-pack codec rather than zlib.
+    // The data tables must have a codec column.
+    bool writeDeltaBitPackIntegers{false};
+    // When set, writers spool packets here while the database is down and
+    // replay them at a limited rate once it returns
+    std::filesystem::path spoolDirectory;
+    int64_t spoolSegmentSize{64*1024*1024};
+    int64_t spoolMaximumSize{4LL*1024*1024*1024};
+    double spoolReplayPacketsPerSecond{500};
+    std::chrono::seconds spoolRetryInterval{5};
+    // On startup the duplicate testers are seeded with the headers of the
+    // packets written in this trailing window so replayed data is rejected
+    // before it reaches the database.  Zero disables this.
+    std::chrono::seconds warmStartDuration{120};
+    // When set, the duplicate testers' state is written here periodically
+    // and on shutdown then restored on startup.  This is cheaper than the
+    // database warm start which is only used when there is no snapshot.
+    std::filesystem::path snapshotFile;
+    std::chrono::seconds snapshotInterval{60};
     //std::string prometheusURL{"localhost:9020"};
     std::string databaseUser{getEnvironmentVariable("UWAVE_SERVER_DATABASE_READ_WRITE_USER")};
     std::string databasePassword{getEnvironmentVariable("UWAVE_SERVER_DATABASE_READ_WRITE_PASSWORD")};
@@ -38,7 +66,10 @@ struct ProgramOptions
     int databasePort{getIntegerEnvironmentVariable("UWAVE_SERVER_DATABASE_PORT", 5432)};
     int mQueueCapacity{8092}; // Want this big enough but not too big
     int nDatabaseWriterThreads{1};
+    int nSanitizerThreads{1};
     int verbosity{3};
+    // Route each network.station to a fixed database writer thread
+    bool streamAffineDatabaseWriters{false};
     bool exportLogs{false};
     bool exportMetrics{false};
     bool exportHTTPLogs{true};
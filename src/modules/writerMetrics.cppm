@@ -70,6 +70,50 @@ void createDatabaseWriterHistogram(
                              std::move(histogramView));
 }
 
+void createDatabaseWriterBatchSizeHistogram(
+    opentelemetry::sdk::metrics::MeterProvider *metricsProvider)
+{
+    // Histogram config
+    auto histogramInstrumentSelector
+        = opentelemetry::sdk::metrics::InstrumentSelectorFactory::Create(
+             opentelemetry::sdk::metrics::InstrumentType::kHistogram,
+             "database_write_batch_size_histogram",
+             "{packets}");
+    auto histogramMeterSelector
+        = opentelemetry::sdk::metrics::MeterSelectorFactory::Create(
+             "database_write_batch_size",
+             "https://opentelemetry.io/schemas/1.2.0",
+             "1.2.0");
+    auto histogramAggregationConfig
+        = std::make_shared
+          <
+             opentelemetry::sdk::metrics::HistogramAggregationConfig
+          > ();
+    histogramAggregationConfig->boundaries_
+        = std::vector<double> {0,
+                               1,
+                               2,
+                               4,
+                               8,
+                               16,
+                               32,
+                               64,
+                               128,
+                               256,
+                               512,
+                               1024,
+                               4096};
+    auto histogramView
+        = opentelemetry::sdk::metrics::ViewFactory::Create(
+             "database_write_batch_size",
+              "Number of packets written to the database in a batch.",
+              opentelemetry::sdk::metrics::AggregationType::kHistogram,
+              histogramAggregationConfig);
+    metricsProvider->AddView(std::move(histogramInstrumentSelector),
+                             std::move(histogramMeterSelector),
+                             std::move(histogramView));
+}
+
 }
 
 namespace UWaveServer::Metrics
@@ -115,6 +159,7 @@ void initialize(
 
     // Histogram config
     createDatabaseWriterHistogram(metricsProvider.get());
+    createDatabaseWriterBatchSizeHistogram(metricsProvider.get());
     /*
     auto histogramInstrumentSelector
         = otel::sdk::metrics::InstrumentSelectorFactory::Create(
@@ -196,6 +241,7 @@ void initialize(
 
     // Histogram config
     createDatabaseWriterHistogram(metricsProvider.get());
+    createDatabaseWriterBatchSizeHistogram(metricsProvider.get());
 
     std::shared_ptr<otel::metrics::MeterProvider>
         provider(std::move(metricsProvider));
@@ -224,6 +270,13 @@ public:
         Expired,
         Future
     };
+    enum class FlushReason
+    {
+        PacketCount,
+        ByteCount,
+        MaximumDelay,
+        Shutdown
+    };
     static MetricsSingleton &getInstance()
     {   
         std::mutex mutex;
@@ -239,21 +292,57 @@ public:
     {   
         return mReceivedPacketsCounter.load();
     }   
-    void incrementWrittenPacketsCounter() noexcept
+    void incrementWrittenPacketsCounter(const int64_t nPackets = 1) noexcept
     {
-        mWrittenPacketsCounter.fetch_add(1, std::memory_order_relaxed);
+        mWrittenPacketsCounter.fetch_add(nPackets, std::memory_order_relaxed);
     }
     [[nodiscard]] int64_t getWrittenPacketsCount() const noexcept
     {   
         return mWrittenPacketsCounter.load();
     }   
-    void incrementNotWrittenPacketsCounter() noexcept
+    void incrementNotWrittenPacketsCounter(const int64_t nPackets = 1) noexcept
     {
-        mWrittenPacketsCounter.fetch_add(1, std::memory_order_relaxed);
+        mNotWrittenPacketsCounter.fetch_add(nPackets,
+                                            std::memory_order_relaxed);
     }
     [[nodiscard]] int64_t getNotWrittenPacketsCount() const noexcept
     {
-        return mWrittenPacketsCounter.load();
+        return mNotWrittenPacketsCounter.load();
+    }
+    void incrementBatchFlushCounter(const FlushReason reason) noexcept
+    {
+        if (reason == FlushReason::PacketCount)
+        {
+            mPacketCountFlushCounter.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (reason == FlushReason::ByteCount)
+        {
+            mByteCountFlushCounter.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (reason == FlushReason::MaximumDelay)
+        {
+            mMaximumDelayFlushCounter.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (reason == FlushReason::Shutdown)
+        {
+            mShutdownFlushCounter.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    [[nodiscard]] int64_t getBatchFlushCount(const FlushReason reason) const noexcept
+    {
+        if (reason == FlushReason::PacketCount)
+        {
+            return mPacketCountFlushCounter.load();
+        }
+        else if (reason == FlushReason::ByteCount)
+        {
+            return mByteCountFlushCounter.load();
+        }
+        else if (reason == FlushReason::MaximumDelay)
+        {
+            return mMaximumDelayFlushCounter.load();
+        }
+        return mShutdownFlushCounter.load();
     }
     void incrementRejectedPacketsCounter(const Reason reason) noexcept
     {   
@@ -281,6 +370,10 @@ public:
         mFuturePacketsCounter.store(0);
         mExpiredPacketsCounter.store(0);
         mDuplicatePacketsCounter.store(0);
+        mPacketCountFlushCounter.store(0);
+        mByteCountFlushCounter.store(0);
+        mMaximumDelayFlushCounter.store(0);
+        mShutdownFlushCounter.store(0);
     }   
 private:
     MetricsSingleton() = default;
@@ -292,6 +385,10 @@ private:
     std::atomic<int64_t> mFuturePacketsCounter{0};
     std::atomic<int64_t> mExpiredPacketsCounter{0};
     std::atomic<int64_t> mDuplicatePacketsCounter{0};
+    std::atomic<int64_t> mPacketCountFlushCounter{0};
+    std::atomic<int64_t> mByteCountFlushCounter{0};
+    std::atomic<int64_t> mMaximumDelayFlushCounter{0};
+    std::atomic<int64_t> mShutdownFlushCounter{0};
 };
 
 export void initializeMetricsSingleton()
@@ -395,5 +492,47 @@ export void observeNumberOfPacketsNotWritten(
     }   
 }
 
+export void observeNumberOfBatchFlushes(
+    opentelemetry::metrics::ObserverResult observerResult,
+    void *)
+{
+    if (opentelemetry::nostd::holds_alternative
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+                opentelemetry::metrics::ObserverResultT<int64_t>
+            >
+        > (observerResult))
+    {
+        auto observer = opentelemetry::nostd::get
+        <
+            opentelemetry::nostd::shared_ptr
+            <
+               opentelemetry::metrics::ObserverResultT<int64_t>
+            >
+        > (observerResult);
+        try
+        {
+            using FlushReason = MetricsSingleton::FlushReason;
+            auto &instance = MetricsSingleton::getInstance();
+            observer->Observe(
+                instance.getBatchFlushCount(FlushReason::PacketCount),
+                {{"reason", "packet_count"}});
+            observer->Observe(
+                instance.getBatchFlushCount(FlushReason::ByteCount),
+                {{"reason", "byte_count"}});
+            observer->Observe(
+                instance.getBatchFlushCount(FlushReason::MaximumDelay),
+                {{"reason", "maximum_delay"}});
+            observer->Observe(
+                instance.getBatchFlushCount(FlushReason::Shutdown),
+                {{"reason", "shutdown"}});
+        }
+        catch (const std::exception &e) 
+        {
+
+        }
+    }
+}
 
 }
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include "private/lockFreeBoundedQueue.hpp"
+#include "private/threadSafeBoundedQueue.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+namespace
+{
+
+/// Pushes nValuesPerProducer values from each producer and drains them
+/// with the consumers.  The result is the sum of all popped values.
+template<typename Queue>
+int64_t runContention(Queue &queue,
+                      const int nProducers,
+                      const int nConsumers,
+                      const int nValuesPerProducer)
+{
+    std::atomic<int64_t> sum{0};
+    std::atomic<int> nProducersDone{0};
+    std::vector<std::thread> threads;
+    for (int iProducer = 0; iProducer < nProducers; ++iProducer)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int i = 0; i < nValuesPerProducer; ++i)
+            {
+                queue.push(static_cast<int64_t> (i));
+            }
+            nProducersDone.fetch_add(1);
+        });
+    }
+    for (int iConsumer = 0; iConsumer < nConsumers; ++iConsumer)
+    {
+        threads.emplace_back([&]()
+        {
+            int64_t localSum{0};
+            while (true)
+            {
+                int64_t value{0};
+                if (queue.wait_until_and_pop(&value,
+                                             std::chrono::milliseconds {1}))
+                {
+                    localSum = localSum + value;
+                }
+                else if (nProducersDone.load() == nProducers &&
+                         queue.empty())
+                {
+                    break;
+                }
+            }
+            sum.fetch_add(localSum);
+        });
+    }
+    for (auto &thread : threads){thread.join();}
+    return sum.load();
+}
+
+}
+
+TEST_CASE("uWaveServer::LockFreeBoundedQueue", "[basic]")
+{
+    ::LockFreeBoundedQueue<int> queue;
+    REQUIRE_THROWS(queue.setCapacity(0));
+    queue.setCapacity(5);
+    REQUIRE(queue.capacity() == 5);
+    REQUIRE(queue.empty());
+    int value{-1};
+    REQUIRE(!queue.try_pop(&value));
+    REQUIRE(!queue.wait_until_and_pop(&value, std::chrono::milliseconds {1}));
+    for (int i = 0; i < 5; ++i){queue.push(i);}
+    REQUIRE(queue.size() == 5);
+    REQUIRE(queue.try_pop(&value));
+    REQUIRE(value == 0);
+    REQUIRE(queue.wait_until_and_pop(&value));
+    REQUIRE(value == 1);
+    REQUIRE(queue.size() == 3);
+
+    SECTION("drop oldest")
+    {
+        for (int i = 5; i < 10; ++i){queue.push(i);}
+        REQUIRE(queue.size() == 5);
+        REQUIRE(queue.dropped() == 3);
+        std::vector<int> values;
+        REQUIRE(queue.try_pop_n(&values, 100) == 5);
+        REQUIRE(values == std::vector<int> {5, 6, 7, 8, 9});
+        REQUIRE(queue.empty());
+    }
+
+    SECTION("bulk")
+    {
+        std::vector<int> values{10, 11};
+        queue.push(std::move(values));
+        REQUIRE(values.empty());
+        std::vector<int> popped;
+        REQUIRE(queue.try_pop_n(&popped, 2) == 2);
+        REQUIRE(popped == std::vector<int> {2, 3});
+        REQUIRE(queue.wait_until_and_pop_n(&popped, 10) == 3);
+        REQUIRE(popped == std::vector<int> {2, 3, 4, 10, 11});
+    }
+
+    SECTION("close")
+    {
+        std::vector<int> values;
+        REQUIRE(queue.try_pop_n(&values, 100) == 3);
+        // A consumer blocked without a deadline is released by close()
+        std::atomic<bool> released{false};
+        std::thread consumer([&]()
+        {
+            int front{-1};
+            auto gotValue
+                = queue.wait_until_and_pop(&front,
+                    ::LockFreeBoundedQueue<int>::NO_DEADLINE);
+            released = !gotValue;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds {20});
+        REQUIRE(!released.load());
+        queue.close();
+        consumer.join();
+        REQUIRE(released.load());
+        REQUIRE(queue.closed());
+        // Later waits don't sleep but values still flow
+        REQUIRE(!queue.wait_until_and_pop(&value,
+                    ::LockFreeBoundedQueue<int>::NO_DEADLINE));
+        queue.push(12);
+        REQUIRE(queue.wait_until_and_pop(&value,
+                    ::LockFreeBoundedQueue<int>::NO_DEADLINE));
+        REQUIRE(value == 12);
+    }
+}
+
+TEST_CASE("uWaveServer::LockFreeBoundedQueue", "[threads]")
+{
+    constexpr int nProducers{4};
+    constexpr int nConsumers{4};
+    constexpr int nValuesPerProducer{20000};
+    // Big enough nothing is dropped so we can check the sum
+    ::LockFreeBoundedQueue<int64_t> queue(nProducers*nValuesPerProducer);
+    auto sum = ::runContention(queue, nProducers, nConsumers,
+                               nValuesPerProducer);
+    int64_t reference = nProducers*(static_cast<int64_t> (nValuesPerProducer)
+                                  *(nValuesPerProducer - 1)/2);
+    REQUIRE(sum == reference);
+    REQUIRE(queue.dropped() == 0);
+}
+
+TEST_CASE("uWaveServer::LockFreeBoundedQueue", "[!benchmark]")
+{
+    constexpr int nProducers{4};
+    constexpr int nConsumers{4};
+    constexpr int nValuesPerProducer{20000};
+    constexpr int capacity{8092};
+    BENCHMARK("ThreadSafeBoundedQueue 4 producers/4 consumers")
+    {
+        ::ThreadSafeBoundedQueue<int64_t> queue(capacity);
+        return ::runContention(queue, nProducers, nConsumers,
+                               nValuesPerProducer);
+    };
+    BENCHMARK("LockFreeBoundedQueue 4 producers/4 consumers")
+    {
+        ::LockFreeBoundedQueue<int64_t> queue(capacity);
+        return ::runContention(queue, nProducers, nConsumers,
+                               nValuesPerProducer);
+    };
+}
@@ -20,6 +20,8 @@ TEST_CASE("UWaveServer::DataClient", "[grpcOptions]")
         REQUIRE(options.getServerCertificate() == std::nullopt);
         REQUIRE(options.getClientCertificate() == std::nullopt);
         REQUIRE(options.getClientKey() == std::nullopt);
+        REQUIRE(options.getMaximumBatchSize() == 64);
+        REQUIRE(options.getBatchFlushInterval() == std::chrono::milliseconds {10});
     }
 
     SECTION("Options")
@@ -30,6 +32,8 @@ TEST_CASE("UWaveServer::DataClient", "[grpcOptions]")
         std::string clientCertificate{"some-other-hash"};
         std::string clientKey{"some-private-hash"};
         uint16_t port{12345};
+        int batchSize{128};
+        std::chrono::milliseconds batchFlushInterval{25};
         UWaveServer::DataClient::GRPCOptions options;
 
         options.setHost(host);
@@ -38,6 +42,10 @@ TEST_CASE("UWaveServer::DataClient", "[grpcOptions]")
         options.setAccessToken(token);
         options.setClientCertificate(clientCertificate);
         options.setClientKey(clientKey);
+        options.setMaximumBatchSize(batchSize);
+        options.setBatchFlushInterval(batchFlushInterval);
+        REQUIRE_THROWS(options.setMaximumBatchSize(0));
+        REQUIRE_THROWS(options.setBatchFlushInterval(std::chrono::milliseconds {0}));
 
         REQUIRE(options.getHost() == host);
         REQUIRE(options.getPort() == port);
@@ -45,5 +53,7 @@ TEST_CASE("UWaveServer::DataClient", "[grpcOptions]")
         REQUIRE(*options.getAccessToken() == token);
         REQUIRE(*options.getClientCertificate() == clientCertificate);
         REQUIRE(*options.getClientKey() == clientKey);
+        REQUIRE(options.getMaximumBatchSize() == batchSize);
+        REQUIRE(options.getBatchFlushInterval() == batchFlushInterval);
     }
 }
@@ -5,7 +5,13 @@
 #include <string>
 #include <vector>
 #include <random>
+#include <numbers>
+#include <numeric>
+#include <type_traits>
+#include <algorithm>
 #include "private/pack.hpp"
+#include "private/integerCodec.hpp"
+#include "private/byteSwap.hpp"
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
@@ -293,6 +299,277 @@ TEST_CASE("uWaveServer::pack::compressed", "[double]")
 }
 
 
+namespace
+{
+// A noisy, band-limited signal like what comes off a broadband channel
+template<typename T>
+std::vector<T> createWaveform(const int nSamples)
+{
+    std::mt19937 generator(26342);
+    std::uniform_int_distribution<int> noiseDistribution{-20, 20};
+    std::vector<T> data(nSamples);
+    for (int i = 0; i < nSamples; ++i)
+    {
+        data[i] = static_cast<T> (5000*std::sin(2*std::numbers::pi*i/400.)
+                                + 800*std::sin(2*std::numbers::pi*i/37.)
+                                + noiseDistribution(generator));
+    }
+    return data;
+}
+
+template<typename T>
+std::vector<T> decodeDeltaBitPack(const int nSamples, const std::string &data)
+{
+    std::basic_string<std::byte> byteStringData(data.size(), std::byte {0});
+    std::copy(data.begin(), data.end(),
+              reinterpret_cast<char *> (byteStringData.data()));
+    return ::decodeDeltaBitPack<T> (nSamples, byteStringData);
+}
+}
+
+TEST_CASE("uWaveServer::pack::deltaBitPack", "[int]")
+{
+    int iMin{std::numeric_limits<int>::lowest()};
+    int iMax{std::numeric_limits<int>::max()};
+    SECTION("extremes")
+    {
+        std::vector<int> data{305419896, iMin, -10, -5, 0, 5, 10, iMax,
+                              iMin, iMax, iMax, 0};
+        auto nSamples = static_cast<int> (data.size());
+        auto encoded = ::encodeDeltaBitPack<int> (data.size(), data.data());
+        REQUIRE(::decodeDeltaBitPack<int> (nSamples, encoded) == data);
+    }
+    SECTION("waveform")
+    {
+        // Not a multiple of the block size
+        auto data = ::createWaveform<int> (4000 + 17);
+        auto nSamples = static_cast<int> (data.size());
+        auto encoded = ::encodeDeltaBitPack<int> (data.size(), data.data());
+        REQUIRE(::decodeDeltaBitPack<int> (nSamples, encoded) == data);
+        auto deflated = ::packAndCompress(data, Z_BEST_COMPRESSION, false);
+        auto unpackedSize = static_cast<double> (data.size()*sizeof(int));
+        std::cout << "int delta bit-packed is "
+                  << 100*encoded.size()/unpackedSize
+                  << " pct of original size; deflated is "
+                  << 100*deflated.size()/unpackedSize << " pct" << std::endl;
+        REQUIRE(encoded.size() <= deflated.size());
+    }
+    SECTION("constant")
+    {
+        std::vector<int> data(300, 42);
+        auto encoded = ::encodeDeltaBitPack<int> (data.size(), data.data());
+        // First sample then a zero width for each block
+        REQUIRE(encoded.size() == sizeof(int) + 3);
+        REQUIRE(::decodeDeltaBitPack<int> (300, encoded) == data);
+    }
+    SECTION("edge cases")
+    {
+        std::vector<int> one{iMin};
+        auto encoded = ::encodeDeltaBitPack<int> (one.size(), one.data());
+        REQUIRE(::decodeDeltaBitPack<int> (1, encoded) == one);
+        REQUIRE(::encodeDeltaBitPack<int> (0, one.data()).empty());
+        REQUIRE(::decodeDeltaBitPack<int> (0, std::string {}).empty());
+        auto data = ::createWaveform<int> (500);
+        encoded = ::encodeDeltaBitPack<int> (data.size(), data.data());
+        encoded.pop_back();
+        REQUIRE_THROWS(::decodeDeltaBitPack<int> (500, encoded));
+    }
+}
+
+TEST_CASE("uWaveServer::pack::deltaBitPack", "[int64_t]")
+{
+    int64_t iMin{std::numeric_limits<int64_t>::lowest()};
+    int64_t iMax{std::numeric_limits<int64_t>::max()};
+    SECTION("extremes")
+    {
+        std::vector<int64_t> data{305419896, iMin, -10, -5, 0, 5, 10, iMax,
+                                  iMin, iMax, iMax, 0};
+        auto nSamples = static_cast<int> (data.size());
+        auto encoded
+            = ::encodeDeltaBitPack<int64_t> (data.size(), data.data());
+        REQUIRE(::decodeDeltaBitPack<int64_t> (nSamples, encoded) == data);
+    }
+    SECTION("waveform")
+    {
+        auto data = ::createWaveform<int64_t> (4000 + 17);
+        auto nSamples = static_cast<int> (data.size());
+        auto encoded
+            = ::encodeDeltaBitPack<int64_t> (data.size(), data.data());
+        REQUIRE(::decodeDeltaBitPack<int64_t> (nSamples, encoded) == data);
+        auto deflated = ::packAndCompress(data, Z_BEST_COMPRESSION, false);
+        auto unpackedSize = static_cast<double> (data.size()*sizeof(int64_t));
+        std::cout << "int64_t delta bit-packed is "
+                  << 100*encoded.size()/unpackedSize
+                  << " pct of original size; deflated is "
+                  << 100*deflated.size()/unpackedSize << " pct" << std::endl;
+        REQUIRE(encoded.size() <= deflated.size());
+    }
+}
+
+TEST_CASE("uWaveServer::pack::deltaBitPack", "[!benchmark]")
+{
+    auto data = ::createWaveform<int> (4000);
+    auto nSamples = static_cast<int> (data.size());
+    auto encoded = ::encodeDeltaBitPack<int> (data.size(), data.data());
+    auto deflated = ::packAndCompress(data, Z_BEST_COMPRESSION, false);
+    BENCHMARK("encode delta bit-pack")
+    {
+        return ::encodeDeltaBitPack<int> (data.size(), data.data());
+    };
+    BENCHMARK("encode zlib")
+    {
+        return ::packAndCompress(data, Z_BEST_COMPRESSION, false);
+    };
+    BENCHMARK("decode delta bit-pack")
+    {
+        return ::decodeDeltaBitPack<int> (nSamples, encoded);
+    };
+    BENCHMARK("decode zlib")
+    {
+        return ::decompressAndUnpack<int> (nSamples, deflated,
+                                           true, true, true);
+    };
+}
+
+
+TEST_CASE("uWaveServer::pack::byteSwap", "[kernels]")
+{
+    // Odd sizes exercise the scalar tails
+    std::mt19937 generator(26342);
+    std::uniform_int_distribution<int> byteDistribution{0, 255};
+    std::vector<unsigned char> input(8*1031 + 3);
+    for (auto &byte : input)
+    {
+        byte = static_cast<unsigned char> (byteDistribution(generator));
+    }
+    auto check = [&](auto kernel, const auto elementSize)
+    {
+        constexpr size_t N = decltype(elementSize)::value;
+        for (size_t n : {0, 1, 3, 7, 8, 15, 16, 17, 33, 1031})
+        {
+            std::vector<unsigned char> reference(n*N);
+            std::vector<unsigned char> result(n*N);
+            for (size_t i = 0; i < n; ++i)
+            {
+                std::reverse_copy(input.data() + i*N,
+                                  input.data() + (i + 1)*N,
+                                  reference.data() + i*N);
+            }
+            kernel(input.data(), n, result.data());
+            REQUIRE(result == reference);
+            // In place
+            std::copy(input.data(), input.data() + n*N, result.data());
+            kernel(result.data(), n, result.data());
+            REQUIRE(result == reference);
+        }
+    };
+    using Two = std::integral_constant<size_t, 2>;
+    using Four = std::integral_constant<size_t, 4>;
+    using Eight = std::integral_constant<size_t, 8>;
+    check(::reverseBytesScalar<2>, Two {});
+    check(::reverseBytesScalar<4>, Four {});
+    check(::reverseBytesScalar<8>, Eight {});
+    check([](const void *in, size_t n, void *out){::reverseBytes<2> (in, n, out);}, Two {});
+    check([](const void *in, size_t n, void *out){::reverseBytes<4> (in, n, out);}, Four {});
+    check([](const void *in, size_t n, void *out){::reverseBytes<8> (in, n, out);}, Eight {});
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        check(::reverseBytesSSSE3<2>, Two {});
+        check(::reverseBytesSSSE3<4>, Four {});
+        check(::reverseBytesSSSE3<8>, Eight {});
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        check(::reverseBytesAVX2<2>, Two {});
+        check(::reverseBytesAVX2<4>, Four {});
+        check(::reverseBytesAVX2<8>, Eight {});
+    }
+#endif
+}
+
+TEST_CASE("uWaveServer::pack::swapped", "[int]")
+{
+    bool amLittleEndian{std::endian::native == std::endian::little ? true : false};
+    int iMin{std::numeric_limits<int>::lowest()};
+    int iMax{std::numeric_limits<int>::max()};
+    std::vector<int> data{305419896, iMin, -10, -5, 0, 5, 10, iMax};
+    auto nSamples = static_cast<int> (data.size());
+    constexpr bool swapBytes{true};
+    auto packedData = ::packAndCompress(data, Z_NO_COMPRESSION, swapBytes);
+    REQUIRE(static_cast<unsigned char> (packedData[0]) == 0x12);
+    REQUIRE(static_cast<unsigned char> (packedData[3]) == 0x78);
+    auto unpackedData = ::decompressAndUnpack<int> (nSamples,
+                                                    packedData,
+                                                    !amLittleEndian,
+                                                    amLittleEndian,
+                                                    false);
+    REQUIRE(unpackedData == data);
+    // Into a caller's buffer
+    std::vector<int> buffer(nSamples + 1, 0);
+    ::unpack<int> (nSamples,
+                   reinterpret_cast<const unsigned char *> (packedData.data()),
+                   packedData.size(), swapBytes, buffer.data());
+    REQUIRE(std::equal(data.begin(), data.end(), buffer.begin()));
+    REQUIRE(buffer.back() == 0);
+    REQUIRE_THROWS(::unpack<int> (nSamples + 1,
+                   reinterpret_cast<const unsigned char *> (packedData.data()),
+                   packedData.size(), swapBytes, buffer.data()));
+    packedData = ::packAndCompress(data, Z_BEST_COMPRESSION, swapBytes);
+    unpackedData = ::decompressAndUnpack<int> (nSamples,
+                                               packedData,
+                                               !amLittleEndian,
+                                               amLittleEndian,
+                                               true);
+    REQUIRE(unpackedData == data);
+}
+
+TEST_CASE("uWaveServer::pack::throughput", "[!benchmark]")
+{
+    constexpr int nSamples{100000};
+    std::vector<int> data(nSamples);
+    std::iota(data.begin(), data.end(), -nSamples/2);
+    std::vector<double> doubleData(data.begin(), data.end());
+    auto packedData = ::pack<int> (data.size(), data.data(), false);
+    auto swappedData = ::pack<int> (data.size(), data.data(), true);
+    std::vector<int> buffer(nSamples);
+    auto packedPtr = reinterpret_cast<const unsigned char *> (packedData.data());
+    auto swappedPtr = reinterpret_cast<const unsigned char *> (swappedData.data());
+    std::cout << "Byte swap kernel: "
+              << static_cast<int> (::getByteSwapKernel()) << std::endl;
+    BENCHMARK("pack int native")
+    {
+        return ::pack<int> (data.size(), data.data(), false);
+    };
+    BENCHMARK("pack int swapped")
+    {
+        return ::pack<int> (data.size(), data.data(), true);
+    };
+    BENCHMARK("pack double swapped")
+    {
+        return ::pack<double> (doubleData.size(), doubleData.data(), true);
+    };
+    BENCHMARK("unpack int native into buffer")
+    {
+        ::unpack<int> (nSamples, packedPtr, packedData.size(), false,
+                       buffer.data());
+        return buffer.front();
+    };
+    BENCHMARK("unpack int swapped into buffer")
+    {
+        ::unpack<int> (nSamples, swappedPtr, swappedData.size(), true,
+                       buffer.data());
+        return buffer.front();
+    };
+    BENCHMARK("unpack int swapped scalar")
+    {
+        ::reverseBytesScalar<4> (swappedPtr, nSamples,
+                    reinterpret_cast<unsigned char *> (buffer.data()));
+        return buffer.front();
+    };
+}
+
+
 /*
 TEST_CASE("uWaveServer::pack::hex", "[int]")
 {
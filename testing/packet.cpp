@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <numeric>
@@ -6,13 +7,17 @@
 #include <vector>
 #include <string>
 #include <bit>
+#include <thread>
+#include <type_traits>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <google/protobuf/util/time_util.h>
 #include "uWaveServer/packet.hpp"
+#include "uWaveServer/streamRegistry.hpp"
 #include "uDataPacketServiceAPI/v1/packet.pb.h"
+#include "private/decodedPacketCache.hpp"
 #include "private/toMiniSEED.hpp"
 #include "private/toJSON.hpp"
 #include "unpackMiniSEED3.hpp"
@@ -79,6 +84,25 @@ TEST_CASE("uWaveServer::Packet", "[class]")
     REQUIRE(packet.getLocationCode() == locationCode);
     REQUIRE(packet.getSamplingRate() == Catch::Approx(samplingRate));
 
+    SECTION("codes")
+    {
+        REQUIRE(packet.getNetworkReference() == network);
+        REQUIRE(packet.getStationReference() == station);
+        REQUIRE(packet.getChannelReference() == channel);
+        REQUIRE(packet.getLocationCodeReference() == locationCode);
+        // Longest codes permitted by the FDSN source identifiers
+        REQUIRE_NOTHROW(packet.setNetwork("ABCDEFGH"));
+        REQUIRE_NOTHROW(packet.setStation("ABCDEFGH"));
+        REQUIRE_NOTHROW(packet.setLocationCode("ABCDEFGH"));
+        REQUIRE(packet.getNetwork() == "ABCDEFGH");
+        REQUIRE_THROWS(packet.setNetwork("ABCDEFGHI"));
+        REQUIRE_THROWS(packet.setStation("ABCDEFGHI"));
+        REQUIRE_THROWS(packet.setChannel("ABCDEFGHIJKLMNOPQ"));
+        REQUIRE_THROWS(packet.setLocationCode("ABCDEFGHI"));
+        // A failed set leaves the prior code
+        REQUIRE(packet.getNetwork() == "ABCDEFGH");
+        REQUIRE(packet.getChannel() == channel);
+    }
     SECTION("int")
     {
         std::vector<int> data{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
@@ -92,6 +116,12 @@ TEST_CASE("uWaveServer::Packet", "[class]")
         {
             REQUIRE(data.at(i) == dPtr[i]);
         }
+        REQUIRE_FALSE(packet.getDataHash());
+        packet.setDataHash(1234);
+        REQUIRE(*packet.getDataHash() == 1234);
+        // New data invalidates the hash
+        packet.setData(data);
+        REQUIRE_FALSE(packet.getDataHash());
     }
 
     SECTION("int64_t")
@@ -139,6 +169,61 @@ TEST_CASE("uWaveServer::Packet", "[class]")
         }
     }   
 
+    SECTION("views")
+    {
+        std::vector<int64_t> data{1, 2, 3, 4, 5};
+        packet.setData(data);
+        auto view = packet.getDataView<int64_t> ();
+        REQUIRE(view.size() == data.size());
+        REQUIRE(view.data() == packet.data());
+        REQUIRE(std::equal(view.begin(), view.end(), data.begin()));
+        REQUIRE_THROWS(packet.getDataView<int> ());
+        auto sum = packet.visitData([](const auto samples)
+                   {
+                       double result{0};
+                       for (const auto &sample : samples){result = result + sample;}
+                       return result;
+                   });
+        REQUIRE(sum == Catch::Approx(15));
+        auto isInteger64 = packet.visitData([](const auto samples)
+                           {
+                               using T = typename decltype(samples)::value_type;
+                               return std::is_same_v<T, int64_t>;
+                           });
+        REQUIRE(isInteger64);
+
+        std::vector<char> text{'a', 'b', 'c'};
+        packet.setData(text);
+        REQUIRE(packet.data() != nullptr);
+        auto textView = packet.getDataView<char> ();
+        REQUIRE(std::string(textView.begin(), textView.end()) == "abc");
+
+        UWaveServer::Packet emptyPacket;
+        REQUIRE(emptyPacket.getDataView<double> ().empty());
+        REQUIRE_THROWS(emptyPacket.visitData([](const auto samples)
+                                             {
+                                                 return samples.size();
+                                             }));
+    }
+
+    SECTION("resize data")
+    {
+        std::vector<double> data{1, 2, 3, 4, 5};
+        packet.setData(data);
+        packet.setDataHash(42);
+        auto samples = packet.resizeData<float> (3);
+        REQUIRE(samples.size() == 3);
+        REQUIRE(samples.data() == packet.data());
+        REQUIRE(packet.getDataType() == UWaveServer::Packet::DataType::Float);
+        REQUIRE(packet.size() == 3);
+        REQUIRE(!packet.getDataHash());
+        REQUIRE(packet.getEndTime().count() == 101000000 + 20000);
+        std::vector<float> reference{7, 8, 9};
+        std::copy(reference.begin(), reference.end(), samples.begin());
+        REQUIRE(packet.getData<float> () == reference);
+        REQUIRE_THROWS(packet.resizeData<int> (0));
+    }
+
     SECTION("trim ends")
     {
         int nSamples{100};
@@ -217,6 +302,166 @@ TEST_CASE("uWaveServer::Packet", "[class]")
         {
             CHECK(dataBack.at(i) == data.at(nInStart - 1 + i));
         }
+
+        // Other data types are trimmed the same way
+        std::vector<char> text(nSamples);
+        std::transform(data.begin(), data.end(), text.begin(),
+                       [](const int i){return static_cast<char> ('a' + i%26);});
+        packet.setStartTime(t1);
+        packet.setData(text);
+        packet.trim(t1Inside, t2Inside);
+        REQUIRE(packet.getStartTime() == t1Inside);
+        REQUIRE(packet.size() == nNewSamples);
+        auto textBack = packet.getDataView<char> ();
+        REQUIRE(std::equal(textBack.begin(), textBack.end(),
+                           text.begin() + (nInStart - 1)));
+    }
+}
+
+TEST_CASE("uWaveServer::Packet", "[pool]")
+{
+    std::vector<int> data(400, 1);
+    auto statistics = UWaveServer::Packet::getPoolStatistics();
+    {
+        UWaveServer::Packet packet;
+        packet.setNetwork("UU");
+        packet.setStation("VRUT");
+        packet.setChannel("HHZ");
+        packet.setLocationCode("01");
+        packet.setSamplingRate(100);
+        packet.setStartTime(101.0);
+        packet.setData(data);
+        packet.setDataHash(1234);
+        REQUIRE(packet.assignStreamHandle() ==
+                UWaveServer::StreamRegistry::getInstance().intern(packet));
+    }
+    // The next packet recycles the last one's storage but not its state
+    UWaveServer::Packet packet;
+    auto newStatistics = UWaveServer::Packet::getPoolStatistics();
+    CHECK(newStatistics.hits > statistics.hits);
+    REQUIRE_FALSE(packet.hasNetwork());
+    REQUIRE_FALSE(packet.hasStation());
+    REQUIRE_FALSE(packet.hasChannel());
+    REQUIRE_FALSE(packet.hasLocationCode());
+    REQUIRE_FALSE(packet.hasSamplingRate());
+    REQUIRE_FALSE(packet.hasStreamHandle());
+    REQUIRE_FALSE(packet.getDataHash());
+    REQUIRE(packet.empty());
+    REQUIRE(packet.size() == 0);
+    REQUIRE(packet.getStartTime().count() == 0);
+    REQUIRE(packet.getDataType() == UWaveServer::Packet::DataType::Unknown);
+
+    SECTION("copy into existing storage")
+    {
+        std::vector<double> doubleData{1, 2, 3};
+        UWaveServer::Packet source;
+        source.setNetwork("UU");
+        source.setStation("CTU");
+        source.setChannel("HHN");
+        source.setSamplingRate(40);
+        source.setData(doubleData);
+        packet.setData(data);
+        packet = source;
+        REQUIRE(packet.getStation() == "CTU");
+        REQUIRE_FALSE(packet.hasLocationCode());
+        REQUIRE(packet.getDataType() == UWaveServer::Packet::DataType::Double);
+        REQUIRE(packet.getData<double> () == doubleData);
+        packet.clear();
+        REQUIRE(packet.empty());
+        REQUIRE_FALSE(packet.hasNetwork());
+    }
+
+    SECTION("released on another thread")
+    {
+        // A writer destroying the packets acquisition made feeds them back
+        constexpr int nPackets{100};
+        std::vector<UWaveServer::Packet> packets(nPackets);
+        for (auto &p : packets){p.setData(data);}
+        std::thread writer([&packets]()
+                           {
+                               packets.clear();
+                           });
+        writer.join();
+        auto beforeStatistics = UWaveServer::Packet::getPoolStatistics();
+        std::vector<UWaveServer::Packet> recycled(nPackets);
+        auto afterStatistics = UWaveServer::Packet::getPoolStatistics();
+        CHECK(afterStatistics.hits - beforeStatistics.hits == nPackets);
+        CHECK(afterStatistics.misses == beforeStatistics.misses);
+    }
+}
+
+TEST_CASE("uWaveServer::StreamRegistry", "[class]")
+{
+    auto &registry = UWaveServer::StreamRegistry::getInstance();
+    auto hhz = registry.intern("UU", "REGT", "HHZ", "01");
+    auto hhn = registry.intern("UU", "REGT", "HHN", "01");
+    auto enz = registry.intern("UU", "REGT", "ENZ", "");
+    REQUIRE(hhz != hhn);
+    REQUIRE(hhz != enz);
+    REQUIRE(registry.intern("UU", "REGT", "HHZ", "01") == hhz);
+    REQUIRE(registry.getName(hhz) == "UU.REGT.HHZ.01");
+    REQUIRE(registry.getName(enz) == "UU.REGT.ENZ");
+    REQUIRE(registry.size() > std::max({hhz, hhn, enz}));
+    REQUIRE_THROWS(registry.getName(registry.size()));
+    REQUIRE_THROWS(registry.intern("", "REGT", "HHZ", "01"));
+
+    SECTION("packet")
+    {
+        UWaveServer::Packet packet;
+        packet.setNetwork("UU");
+        packet.setStation("REGT");
+        packet.setChannel("HHZ");
+        packet.setLocationCode("01");
+        REQUIRE_FALSE(packet.hasStreamHandle());
+        REQUIRE_THROWS(packet.getStreamHandle());
+        // Reading the handle does not register the stream
+        UWaveServer::Packet unseen;
+        unseen.setNetwork("UU");
+        unseen.setStation("NOREG");
+        unseen.setChannel("HHZ");
+        auto nStreams = registry.size();
+        REQUIRE_THROWS(unseen.getStreamHandle());
+        REQUIRE(registry.size() == nStreams);
+        REQUIRE(packet.assignStreamHandle() == hhz);
+        REQUIRE(packet.hasStreamHandle());
+        auto copy = packet;
+        REQUIRE(copy.hasStreamHandle());
+        REQUIRE(copy.getStreamHandle() == hhz);
+        // Changing the stream discards the handle
+        packet.setChannel("HHN");
+        REQUIRE_FALSE(packet.hasStreamHandle());
+        REQUIRE_THROWS(packet.getStreamHandle());
+        REQUIRE(packet.assignStreamHandle() == hhn);
+    }
+
+    SECTION("concurrent")
+    {
+        constexpr int nThreads{4};
+        constexpr int nStations{200};
+        std::vector<std::vector<uint32_t>> handles(nThreads);
+        std::vector<std::thread> threads;
+        for (int iThread = 0; iThread < nThreads; ++iThread)
+        {
+            threads.push_back(std::thread([&handles, &registry, iThread]()
+            {
+                for (int i = 0; i < nStations; ++i)
+                {
+                    handles[iThread].push_back(
+                        registry.intern("CC", "S" + std::to_string(i),
+                                        "HHZ", "00"));
+                }
+            }));
+        }
+        for (auto &thread : threads){thread.join();}
+        for (int iThread = 1; iThread < nThreads; ++iThread)
+        {
+            REQUIRE(handles[iThread] == handles[0]);
+        }
+        for (int i = 0; i < nStations; ++i)
+        {
+            REQUIRE(registry.getName(handles[0][i])
+                 == "CC.S" + std::to_string(i) + ".HHZ.00");
+        }
     }
 }
 
@@ -256,7 +501,12 @@ TEST_CASE("UWaveServer::Packet", "[gRPC]")
         auto packedData = ::pack(data.data(), nSamples, swapBytes); 
         *packet.mutable_data() = packedData;
         packet.set_data_type(UDataPacketServiceAPI::V1::DATA_TYPE_INTEGER_32);
+        packet.set_data_hash(1234);
         auto result = UWaveServer::fromGRPC(packet);
+        if (std::endian::native == std::endian::little)
+        {
+            REQUIRE(*result.getDataHash() == 1234);
+        }
 
         REQUIRE(result.getNetwork() == network);
         REQUIRE(result.getStation() == station);
@@ -360,6 +610,116 @@ TEST_CASE("UWaveServer::Packet", "[gRPC]")
     }   
 }
 
+TEST_CASE("UWaveServer::DecodedPacketCache", "[class]")
+{
+    // Ten 1 s packets at 100 Hz starting at t = 1000 s
+    constexpr int streamIdentifier{3};
+    constexpr int64_t second{1000000};
+    constexpr int64_t t0{1000*second};
+    std::vector<UWaveServer::Packet> packets;
+    for (int i = 0; i < 10; ++i)
+    {
+        UWaveServer::Packet packet;
+        packet.setNetwork("UU");
+        packet.setStation("CTU");
+        packet.setChannel("HHZ");
+        packet.setSamplingRate(100);
+        packet.setStartTime(std::chrono::microseconds {t0 + i*second});
+        packet.setData(std::vector<int> (100, i));
+        packets.push_back(std::move(packet));
+    }
+    const int64_t settledTime{t0 + 100*second};
+    ::DecodedPacketCache cache{1024*1024};
+
+    // Nothing is cached so the whole window is fetched
+    auto lookup = cache.lookup(streamIdentifier,
+                               t0, t0 + 5*second, settledTime);
+    REQUIRE(lookup.packets.empty());
+    REQUIRE(lookup.missing.size() == 1);
+    REQUIRE(lookup.missing[0].first == t0);
+    REQUIRE(lookup.missing[0].second == t0 + 5*second);
+    cache.insert(streamIdentifier,
+                 std::vector<UWaveServer::Packet> (packets.begin(),
+                                                   packets.begin() + 5),
+                 lookup);
+    REQUIRE(cache.size() > 5*400);
+
+    // A window inside the coverage is served from the cache
+    lookup = cache.lookup(streamIdentifier,
+                          t0 + second + second/2, t0 + 3*second,
+                          settledTime);
+    REQUIRE(lookup.missing.empty());
+    REQUIRE(lookup.packets.size() == 2);
+    REQUIRE(lookup.packets[0].getStartTime().count() == t0 + second);
+    REQUIRE(lookup.packets[0].getData<int> () == packets[1].getData<int> ());
+    // Another stream is unaffected
+    REQUIRE(cache.lookup(streamIdentifier + 1,
+                         t0, t0 + second, settledTime).packets.empty());
+
+    // Only the leading edge is fetched
+    lookup = cache.lookup(streamIdentifier,
+                          t0 + 2*second, t0 + 8*second, settledTime);
+    REQUIRE(lookup.missing.size() == 1);
+    REQUIRE(lookup.missing[0].first == t0 + 5*second);
+    REQUIRE(lookup.missing[0].second == t0 + 8*second);
+    REQUIRE(lookup.packets.size() == 3);
+    cache.insert(streamIdentifier,
+                 std::vector<UWaveServer::Packet> (packets.begin() + 5,
+                                                   packets.begin() + 8),
+                 lookup);
+    lookup = cache.lookup(streamIdentifier,
+                          t0, t0 + 8*second, settledTime);
+    REQUIRE(lookup.missing.empty());
+    REQUIRE(lookup.packets.size() == 8);
+
+    // Old coverage expires so late rows are eventually fetched
+    lookup = cache.lookup(streamIdentifier,
+                          t0, t0 + 8*second, settledTime + 11*second,
+                          10*second);
+    REQUIRE(lookup.packets.empty());
+    REQUIRE(lookup.missing.size() == 1);
+    REQUIRE(lookup.missing[0].first == t0);
+    REQUIRE(lookup.missing[0].second == t0 + 8*second);
+    cache.insert(streamIdentifier,
+                 std::vector<UWaveServer::Packet> (packets.begin(),
+                                                   packets.begin() + 8),
+                 lookup);
+    lookup = cache.lookup(streamIdentifier,
+                          t0, t0 + 8*second, settledTime + 11*second,
+                          10*second);
+    REQUIRE(lookup.missing.empty());
+    REQUIRE(lookup.packets.size() == 8);
+
+    // Unsettled data is never covered
+    lookup = cache.lookup(streamIdentifier,
+                          t0, t0 + 10*second, t0 + 9*second);
+    cache.insert(streamIdentifier,
+                 std::vector<UWaveServer::Packet> (packets.begin() + 8,
+                                                   packets.end()),
+                 lookup);
+    lookup = cache.lookup(streamIdentifier,
+                          t0, t0 + 10*second, t0 + 9*second);
+    REQUIRE(lookup.missing.size() == 1);
+    REQUIRE(lookup.missing[0].first == t0 + 9*second);
+    REQUIRE(lookup.missing[0].second == t0 + 10*second);
+
+    // Evicting the oldest packets shrinks the coverage
+    ::DecodedPacketCache smallCache{3*(400 + 384)};
+    lookup = smallCache.lookup(streamIdentifier,
+                               t0, t0 + 5*second, settledTime);
+    smallCache.insert(streamIdentifier,
+                      std::vector<UWaveServer::Packet> (packets.begin(),
+                                                        packets.begin() + 5),
+                      lookup);
+    REQUIRE(smallCache.size() <= 3*(400 + 384));
+    lookup = smallCache.lookup(streamIdentifier,
+                               t0, t0 + 5*second, settledTime);
+    REQUIRE(lookup.missing.size() == 1);
+    REQUIRE(lookup.missing[0].first == t0);
+    REQUIRE(lookup.packets.size() == 3);
+    REQUIRE(lookup.packets[0].getStartTime().count() == t0 + 2*second);
+}
+
 TEST_CASE("UWaveServer::Packet", "[miniSEED]")
 {
     const std::string network{"UU"};
@@ -441,6 +801,39 @@ TEST_CASE("UWaveServer::Packet", "[miniSEED]")
             }
         }
     }
+    SECTION("stream")
+    {
+        for (auto useMiniSEED3 : std::vector<bool> {true, false})
+        {
+            std::string result;
+            ::MiniSEEDStreamEncoder encoder{&result, 512, useMiniSEED3};
+            for (const auto &packet : packets)
+            {
+                encoder.add(packet);
+                // Only whole records are written before the flush
+                REQUIRE(static_cast<int64_t> (result.size()) ==
+                        512*encoder.getNumberOfRecords());
+            }
+            encoder.flush();
+            REQUIRE(encoder.getNumberOfRecords() > 0);
+            REQUIRE(encoder.getNumberOfSamples() ==
+                    static_cast<int64_t> (allDataReference.size()));
+            auto returnedPackets = ::unpackMiniSEED(result);
+            REQUIRE(returnedPackets.at(0).getStartTime() ==
+                    packets.at(0).getStartTime());
+            REQUIRE(returnedPackets.back().getEndTime() ==
+                    packets.back().getEndTime());
+            std::vector<int> allDataBack;
+            for (const auto &rp : returnedPackets)
+            {
+                auto packetDataBack = rp.getData<int> ();
+                allDataBack.insert(allDataBack.end(),
+                                   packetDataBack.begin(),
+                                   packetDataBack.end());
+            }
+            REQUIRE(allDataBack == allDataReference);
+        }
+    }
 }
 
 TEST_CASE("UWaveServer::Packet", "[json]")
@@ -0,0 +1,114 @@
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+#include "uWaveServer/packet.hpp"
+#include "uWaveServer/packetSpool.hpp"
+
+namespace
+{
+
+UWaveServer::Packet makePacket(const int i)
+{
+    UWaveServer::Packet packet;
+    packet.setNetwork("UU");
+    packet.setStation("ST" + std::to_string(i%3));
+    packet.setChannel("HHZ");
+    if (i%2 == 1){packet.setLocationCode("01");}
+    packet.setSamplingRate(100);
+    packet.setStartTime(std::chrono::microseconds {i*1000000LL});
+    std::vector<int> data(100 + i, i);
+    packet.setData(data);
+    return packet;
+}
+
+// Concurrent test runs must not share a spool
+std::filesystem::path makeDirectory()
+{
+    auto pattern
+        = (std::filesystem::temp_directory_path()
+          /"uwsPacketSpoolTest.XXXXXX").string();
+    if (::mkdtemp(pattern.data()) == nullptr)
+    {
+        throw std::runtime_error("Could not create temporary directory");
+    }
+    return std::filesystem::path {pattern};
+}
+
+}
+
+TEST_CASE("uWaveServer::PacketSpool", "[basic]")
+{
+    constexpr int64_t segmentSize{4096};
+    constexpr int64_t maximumSize{8*segmentSize};
+    auto directory = ::makeDirectory();
+    REQUIRE_THROWS(UWaveServer::PacketSpool(directory, 8, maximumSize));
+    REQUIRE_THROWS(UWaveServer::PacketSpool(directory, segmentSize, 1));
+    int nPushed{0};
+    {
+    UWaveServer::PacketSpool spool(directory, segmentSize, maximumSize);
+    REQUIRE(spool.empty());
+    // Fill it up
+    while (spool.push(::makePacket(nPushed))){nPushed = nPushed + 1;}
+    REQUIRE(nPushed > 8);
+    REQUIRE(spool.size() == nPushed);
+    REQUIRE(spool.getSizeInBytes() <= maximumSize);
+    auto packets = spool.peek(5);
+    REQUIRE(packets.size() == 5);
+    for (int i = 0; i < 5; ++i)
+    {
+        auto reference = ::makePacket(i);
+        REQUIRE(packets[i].getNetwork() == reference.getNetwork());
+        REQUIRE(packets[i].getStation() == reference.getStation());
+        REQUIRE(packets[i].getChannel() == reference.getChannel());
+        REQUIRE(packets[i].hasLocationCode() == reference.hasLocationCode());
+        REQUIRE(packets[i].getStartTime() == reference.getStartTime());
+        REQUIRE(packets[i].getSamplingRate() ==
+                reference.getSamplingRate());
+        REQUIRE(packets[i].getData<int> () == reference.getData<int> ());
+    }
+    // Peeking doesn't consume
+    REQUIRE(spool.size() == nPushed);
+    spool.consume(20);
+    REQUIRE(spool.size() == nPushed - 20);
+    REQUIRE(spool.getSizeInBytes() < maximumSize);
+    }
+
+    SECTION("recover")
+    {
+        UWaveServer::PacketSpool spool(directory, segmentSize, maximumSize);
+        REQUIRE(spool.size() == nPushed - 20);
+        auto packets = spool.peek(1);
+        REQUIRE(packets.at(0).getStartTime() ==
+                ::makePacket(20).getStartTime());
+        while (!spool.empty())
+        {
+            auto nPackets = static_cast<int> (spool.peek(7).size());
+            spool.consume(nPackets);
+        }
+        REQUIRE(spool.getSizeInBytes() == 0);
+    }
+
+    SECTION("torn record")
+    {
+        // Corrupt the first record of every segment.  Since nothing after
+        // a bad record is trusted the spool should come back empty.
+        for (const auto &entry : std::filesystem::directory_iterator(directory))
+        {
+            std::fstream file(entry.path(),
+                              std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(48);
+            file.put('x');
+        }
+        UWaveServer::PacketSpool spool(directory, segmentSize, maximumSize);
+        REQUIRE(spool.empty());
+        REQUIRE(spool.push(::makePacket(0)));
+        REQUIRE(spool.size() == 1);
+    }
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,68 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "private/singleFlight.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("uWaveServer::SingleFlight", "[basic]")
+{
+    ::SingleFlight<std::string, std::string> singleFlight;
+    auto result = singleFlight.run("a", []() {return std::string {"x"};});
+    REQUIRE(*result == "x");
+    // A shared result is copied and the last holder moves it
+    auto other = result;
+    REQUIRE(decltype(singleFlight)::take(std::move(other)) == "x");
+    REQUIRE(*result == "x");
+    REQUIRE(decltype(singleFlight)::take(std::move(result)) == "x");
+    REQUIRE(result == nullptr);
+    REQUIRE(singleFlight.size() == 0);
+    REQUIRE(singleFlight.getCoalesced() == 0);
+    // Nothing is cached
+    result = singleFlight.run("a", []() {return std::string {"y"};});
+    REQUIRE(*result == "y");
+    REQUIRE_THROWS(singleFlight.run("b", []() -> std::string
+                                    {
+                                        throw std::runtime_error("failed");
+                                    }));
+    REQUIRE(singleFlight.size() == 0);
+}
+
+TEST_CASE("uWaveServer::SingleFlight", "[threads]")
+{
+    ::SingleFlight<std::string, std::string> singleFlight;
+    constexpr int nThreads{8};
+    std::atomic<int> nComputations{0};
+    std::atomic<int> nStarted{0};
+    std::vector<std::shared_ptr<const std::string>> results(nThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            nStarted.fetch_add(1);
+            results[i] = singleFlight.run("UU.CTU.HHZ.01", [&]()
+            {
+                nComputations.fetch_add(1);
+                // Hold the flight open until everyone has arrived
+                while (nStarted.load() < nThreads)
+                {
+                    std::this_thread::yield();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds {50});
+                return std::string {"payload"};
+            });
+        });
+    }
+    for (auto &thread : threads){thread.join();}
+    REQUIRE(nComputations.load() + singleFlight.getCoalesced() == nThreads);
+    REQUIRE(nComputations.load() < nThreads);
+    for (const auto &result : results)
+    {
+        REQUIRE(result != nullptr);
+        REQUIRE(*result == "payload");
+    }
+    REQUIRE(singleFlight.size() == 0);
+}